@@ -0,0 +1,246 @@
+// Compares MemoryCache with malloc on the allocation patterns of the
+// buffers. Build it with optimizations, e.g. -O2. The jemalloc column is
+// filled when libjemalloc.so.2, or the library named by CNETPP_JEMALLOC,
+// can be loaded, and shows "-" otherwise.
+#include <cnetpp/base/memory_cache.h>
+
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct Malloc {
+  static void* Allocate(uint32_t n) {
+    return ::malloc(n);
+  }
+  static void Deallocate(void* ptr) {
+    ::free(ptr);
+  }
+};
+
+// the non-standard entry points of jemalloc, which don't clash with malloc
+struct Jemalloc {
+  static void* (*mallocx)(size_t, int);
+  static void (*dallocx)(void*, int);
+
+  static bool Load() {
+    const char* path = ::getenv("CNETPP_JEMALLOC");
+    void* library = ::dlopen(path != nullptr ? path : "libjemalloc.so.2",
+                             RTLD_NOW | RTLD_LOCAL);
+    if (library == nullptr) {
+      return false;
+    }
+    mallocx = reinterpret_cast<void* (*)(size_t, int)>(
+        ::dlsym(library, "mallocx"));
+    dallocx = reinterpret_cast<void (*)(void*, int)>(
+        ::dlsym(library, "dallocx"));
+    return mallocx != nullptr && dallocx != nullptr;
+  }
+
+  static void* Allocate(uint32_t n) {
+    return mallocx(n, 0);
+  }
+  static void Deallocate(void* ptr) {
+    dallocx(ptr, 0);
+  }
+};
+
+void* (*Jemalloc::mallocx)(size_t, int) = nullptr;
+void (*Jemalloc::dallocx)(void*, int) = nullptr;
+
+bool has_jemalloc = false;
+
+struct Cache {
+  static void* Allocate(uint32_t n) {
+    return cnetpp::base::MemoryCache::Instance()->Allocate(n);
+  }
+  static void Deallocate(void* ptr) {
+    cnetpp::base::MemoryCache::Instance()->Deallocate(ptr);
+  }
+};
+
+// 'count' sizes between 'min' and 'max', spread evenly over the powers of
+// two in between, as small responses are far more common than large ones
+std::vector<uint32_t> MakeSizes(uint32_t min, uint32_t max, size_t count) {
+  std::vector<uint32_t> sizes;
+  uint64_t seed = 88172645463325252ull;
+  for (size_t i = 0; i < count; ++i) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    uint32_t n = min << (seed % 64 % (__builtin_ctz(max / min) + 1));
+    n += static_cast<uint32_t>((seed >> 8) % n);
+    sizes.push_back(n < max ? n : max);
+  }
+  return sizes;
+}
+
+// Keeps 'live' blocks allocated, each round freeing one of them and
+// allocating the next size in place of it. Returns nanoseconds per pair.
+template <typename Allocator>
+double Run(const std::vector<uint32_t>& sizes, size_t live, size_t rounds) {
+  std::vector<void*> blocks(live, nullptr);
+  for (size_t i = 0; i < live; ++i) {
+    blocks[i] = Allocator::Allocate(sizes[i % sizes.size()]);
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < rounds; ++i) {
+    size_t slot = (i * 7919) % live;
+    Allocator::Deallocate(blocks[slot]);
+    auto block = Allocator::Allocate(sizes[i % sizes.size()]);
+    static_cast<char*>(block)[0] = 1;
+    blocks[slot] = block;
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  for (auto block : blocks) {
+    Allocator::Deallocate(block);
+  }
+  return std::chrono::duration<double, std::nano>(elapsed).count() / rounds;
+}
+
+// One thread allocates batches of 'size' bytes which another one frees,
+// as the send buffers built by the application threads and freed by the
+// pollers. Returns nanoseconds per pair.
+template <typename Allocator>
+double RunCrossThread(uint32_t size, size_t rounds) {
+  const size_t kBatch = 64;
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<std::vector<void*>> queue;
+  std::thread consumer([&] () {
+    for (size_t i = 0; i < rounds; ++i) {
+      std::unique_lock<std::mutex> guard(mutex);
+      cond.wait(guard, [&queue] () { return !queue.empty(); });
+      auto blocks = std::move(queue.front());
+      queue.pop_front();
+      guard.unlock();
+      for (auto block : blocks) {
+        Allocator::Deallocate(block);
+      }
+    }
+  });
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < rounds; ++i) {
+    std::vector<void*> blocks;
+    blocks.reserve(kBatch);
+    for (size_t j = 0; j < kBatch; ++j) {
+      auto block = Allocator::Allocate(size);
+      static_cast<char*>(block)[0] = 1;
+      blocks.push_back(block);
+    }
+    std::lock_guard<std::mutex> guard(mutex);
+    queue.push_back(std::move(blocks));
+    cond.notify_one();
+  }
+  consumer.join();
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() /
+      (rounds * kBatch);
+}
+
+// Fills a 'size' bytes buffer, then reads it at random places, as a large
+// RingBuffer of a bulk transfer. Returns milliseconds for each of the two.
+std::pair<double, double> RunBulk(uint32_t size, size_t reads) {
+  auto cache = cnetpp::base::MemoryCache::Instance();
+  auto start = std::chrono::steady_clock::now();
+  auto buffer = static_cast<char*>(cache->Allocate(size));
+  ::memset(buffer, 1, size);
+  auto filled = std::chrono::steady_clock::now();
+  uint64_t seed = 88172645463325252ull;
+  uint64_t sum = 0;
+  for (size_t i = 0; i < reads; ++i) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    sum += buffer[seed % size];
+  }
+  auto read = std::chrono::steady_clock::now();
+  cache->Deallocate(buffer);
+  if (sum != reads) {
+    ::abort();
+  }
+  return std::make_pair(
+      std::chrono::duration<double, std::milli>(filled - start).count(),
+      std::chrono::duration<double, std::milli>(read - filled).count());
+}
+
+void Print(const std::string& name, double malloc_ns, double jemalloc_ns,
+           double cache_ns) {
+  char jemalloc[16] = "-";
+  if (has_jemalloc) {
+    ::snprintf(jemalloc, sizeof(jemalloc), "%.1f", jemalloc_ns);
+  }
+  ::printf("%-28s %10.1f %10s %10.1f\n", name.c_str(), malloc_ns, jemalloc,
+           cache_ns);
+}
+
+void Report(const std::string& name, const std::vector<uint32_t>& sizes,
+            size_t live) {
+  const size_t kRounds = 2000000;
+  // warm them up first
+  Run<Malloc>(sizes, live, kRounds / 10);
+  Run<Cache>(sizes, live, kRounds / 10);
+  double malloc_ns = Run<Malloc>(sizes, live, kRounds);
+  double jemalloc_ns = 0;
+  if (has_jemalloc) {
+    Run<Jemalloc>(sizes, live, kRounds / 10);
+    jemalloc_ns = Run<Jemalloc>(sizes, live, kRounds);
+  }
+  double cache_ns = Run<Cache>(sizes, live, kRounds);
+  Print(name, malloc_ns, jemalloc_ns, cache_ns);
+}
+
+}  // namespace
+
+int main() {
+  has_jemalloc = Jemalloc::Load();
+  ::printf("%-28s %10s %10s %10s  (ns per allocate and free)\n",
+           "workload", "malloc", "jemalloc", "cache");
+  Report("2048 bytes", std::vector<uint32_t>(1, 2048), 64);
+  Report("16B-4KB, 64 live", MakeSizes(16, 4096, 4096), 64);
+  Report("16B-4KB, 4096 live", MakeSizes(16, 4096, 4096), 4096);
+  Report("4KB-64KB, 64 live", MakeSizes(4096, 65536, 4096), 64);
+  Report("64KB-1MB, 16 live", MakeSizes(65536, 1 << 20, 4096), 16);
+
+  auto usage = cnetpp::base::MemoryCache::Instance()->SmallMemoryUsage();
+  double malloc_ns = RunCrossThread<Malloc>(2048, 20000);
+  double jemalloc_ns =
+      has_jemalloc ? RunCrossThread<Jemalloc>(2048, 20000) : 0;
+  double cache_ns = RunCrossThread<Cache>(2048, 20000);
+  Print("2048 bytes, cross thread", malloc_ns, jemalloc_ns, cache_ns);
+  ::printf("spans taken by the cache: %lu bytes\n",
+           static_cast<unsigned long>(
+               cnetpp::base::MemoryCache::Instance()->SmallMemoryUsage() -
+               usage));
+
+  ::printf("\n%-28s %10s %10s  (ms to fill and to read 64m at random)\n",
+           "256m buffer", "fill", "read");
+  for (bool huge_pages : { false, true }) {
+    cnetpp::base::MemoryCache::Instance()->huge_pages(huge_pages);
+    auto result = RunBulk(256u << 20, 64u << 20);
+    ::printf("%-28s %10.1f %10.1f\n",
+             huge_pages ? "huge pages" : "malloc", result.first,
+             result.second);
+  }
+  for (auto& node :
+       cnetpp::base::MemoryCache::Instance()->GetHugePageStats()) {
+    ::printf("node %u: %lu bytes in explicit huge pages, %lu in transparent "
+             "ones\n", std::get<0>(node),
+             static_cast<unsigned long>(std::get<1>(node)),
+             static_cast<unsigned long>(std::get<2>(node)));
+  }
+  return 0;
+}
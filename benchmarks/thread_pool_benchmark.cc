@@ -0,0 +1,289 @@
+// Compares ThreadPool with a pool of one queue under one lock, as the
+// ThreadPool was before the workers got deques of their own. Build it with
+// optimizations, e.g. -O2, and run it with the numbers of threads to try:
+//   ./cnetpp_thread_pool_benchmark 4 16 32
+#include <cnetpp/concurrency/thread_pool.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// The ThreadPool as it was: every worker waits on the same condition
+// variable for the same queue
+class LockedPool {
+ public:
+  explicit LockedPool(size_t num_threads)
+      : queue_(cnetpp::concurrency::CreateDefaultQueue()) {
+    for (size_t i = 0; i < num_threads; ++i) {
+      threads_.emplace_back([this] () { DoTask(); });
+    }
+  }
+
+  ~LockedPool() {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      stopping_ = true;
+      queue_cv_.notify_all();
+    }
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  bool AddTask(const std::function<bool()>& closure) {
+    auto task = std::static_pointer_cast<cnetpp::concurrency::Task>(
+        std::make_shared<ClosureTask>(closure));
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (stopping_) {
+      return false;
+    }
+    queue_->Push(std::move(task));
+    queue_cv_.notify_one();
+    return true;
+  }
+
+ private:
+  class ClosureTask final : public cnetpp::concurrency::Task {
+   public:
+    explicit ClosureTask(std::function<bool()> closure)
+        : closure_(std::move(closure)) {
+    }
+
+    bool operator()(void* arg = nullptr) override {
+      (void) arg;
+      return closure_();
+    }
+
+   private:
+    std::function<bool()> closure_;
+  };
+
+  std::mutex mutex_;
+  std::condition_variable queue_cv_;
+  std::shared_ptr<cnetpp::concurrency::QueueBase> queue_;
+  std::atomic<size_t> num_running_tasks_ { 0 };
+  bool stopping_ { false };
+  std::vector<std::thread> threads_;
+
+  void DoTask() {
+    while (true) {
+      std::shared_ptr<cnetpp::concurrency::Task> task;
+      {
+        std::unique_lock<std::mutex> guard(mutex_);
+        queue_cv_.wait(guard, [this] () {
+          return stopping_ || !queue_->Empty();
+        });
+        task = queue_->TryPop();
+        if (!task) {
+          return;
+        }
+        num_running_tasks_++;
+      }
+      (*task)();
+      num_running_tasks_--;
+    }
+  }
+};
+
+class StealingPool {
+ public:
+  explicit StealingPool(size_t num_threads) : pool_("bench") {
+    pool_.set_num_threads(num_threads);
+    pool_.Start();
+  }
+
+  ~StealingPool() {
+    pool_.Stop(true);
+  }
+
+  template <typename F>
+  bool AddTask(F&& closure) {
+    return pool_.AddTask(std::forward<F>(closure));
+  }
+
+  template <typename Range>
+  size_t AddTasks(Range&& tasks) {
+    return pool_.AddTasks(std::forward<Range>(tasks));
+  }
+
+ private:
+  cnetpp::concurrency::ThreadPool pool_;
+};
+
+void WaitFor(const std::atomic<size_t>& done, size_t count) {
+  while (done.load(std::memory_order_acquire) < count) {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+}
+
+struct Result {
+  double tasks_per_second;
+  // from the submission to the start of the task
+  double p50_us;
+  double p99_us;
+};
+
+// 'producers' threads out of the pool add 'count' tasks doing nothing
+template <typename Pool>
+Result FireAndForget(size_t num_threads, size_t producers, size_t count) {
+  const size_t kSampleEvery = 64;
+  std::vector<double> latencies(count / kSampleEvery + producers, 0);
+  std::atomic<size_t> done { 0 };
+  std::atomic<size_t> sampled { 0 };
+  Pool pool(num_threads);
+  auto start = Clock::now();
+  std::vector<std::thread> threads;
+  for (size_t p = 0; p < producers; ++p) {
+    threads.emplace_back([&, p] () {
+      for (size_t i = p; i < count; i += producers) {
+        if (i % kSampleEvery != 0) {
+          pool.AddTask([&done] () -> bool {
+            done.fetch_add(1, std::memory_order_release);
+            return true;
+          });
+          continue;
+        }
+        auto submitted = Clock::now();
+        pool.AddTask([&, submitted] () -> bool {
+          auto latency = Clock::now() - submitted;
+          latencies[sampled.fetch_add(1)] =
+              std::chrono::duration<double, std::micro>(latency).count();
+          done.fetch_add(1, std::memory_order_release);
+          return true;
+        });
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  WaitFor(done, count);
+  auto elapsed = Clock::now() - start;
+  latencies.resize(sampled.load());
+  std::sort(latencies.begin(), latencies.end());
+  Result result;
+  result.tasks_per_second =
+      count / std::chrono::duration<double>(elapsed).count();
+  result.p50_us = latencies[latencies.size() / 2];
+  result.p99_us = latencies[latencies.size() * 99 / 100];
+  return result;
+}
+
+// each task adds two subtasks until 'depth' is 0, from the worker it runs in
+template <typename Pool>
+void Spawn(Pool* pool, int depth, std::atomic<size_t>* done) {
+  if (depth > 0) {
+    for (int i = 0; i < 2; ++i) {
+      pool->AddTask([pool, depth, done] () -> bool {
+        Spawn(pool, depth - 1, done);
+        return true;
+      });
+    }
+  }
+  done->fetch_add(1, std::memory_order_release);
+}
+
+template <typename Pool>
+double ForkJoin(size_t num_threads, int depth) {
+  size_t count = (size_t(1) << (depth + 1)) - 1;
+  std::atomic<size_t> done { 0 };
+  Pool pool(num_threads);
+  auto start = Clock::now();
+  pool.AddTask([&pool, depth, &done] () -> bool {
+    Spawn(&pool, depth, &done);
+    return true;
+  });
+  WaitFor(done, count);
+  auto elapsed = Clock::now() - start;
+  return count / std::chrono::duration<double>(elapsed).count();
+}
+
+// a thread out of the pool adds 'count' tasks doing nothing by batches of
+// 'batch', with AddTasks() or one by one
+double FanOut(size_t num_threads, size_t count, size_t batch, bool batched) {
+  std::atomic<size_t> done { 0 };
+  StealingPool pool(num_threads);
+  std::vector<cnetpp::concurrency::TaskFunction> tasks;
+  tasks.reserve(batch);
+  auto start = Clock::now();
+  for (size_t i = 0; i < count; i += batch) {
+    for (size_t j = 0; j < batch; ++j) {
+      auto task = [&done] () -> bool {
+        done.fetch_add(1, std::memory_order_release);
+        return true;
+      };
+      if (batched) {
+        tasks.emplace_back(task);
+      } else {
+        pool.AddTask(task);
+      }
+    }
+    if (batched) {
+      pool.AddTasks(tasks);
+      tasks.clear();
+    }
+  }
+  WaitFor(done, count);
+  auto elapsed = Clock::now() - start;
+  return count / std::chrono::duration<double>(elapsed).count();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::vector<size_t> thread_counts;
+  for (int i = 1; i < argc; ++i) {
+    thread_counts.push_back(::atoi(argv[i]));
+  }
+  if (thread_counts.empty()) {
+    thread_counts = { 4, std::max(4u, std::thread::hardware_concurrency()) };
+  }
+  const size_t kCount = 1000000;
+  const size_t kProducers = 4;
+  const int kDepth = 19;
+  const size_t kBatch = 32;
+
+  ::printf("%-10s %-8s %14s %10s %10s\n",
+           "threads", "pool", "tasks/s", "p50 us", "p99 us");
+  for (auto n : thread_counts) {
+    auto locked = FireAndForget<LockedPool>(n, kProducers, kCount);
+    auto stealing = FireAndForget<StealingPool>(n, kProducers, kCount);
+    ::printf("%-10lu %-8s %14.0f %10.1f %10.1f  fire and forget\n",
+             static_cast<unsigned long>(n), "locked",
+             locked.tasks_per_second, locked.p50_us, locked.p99_us);
+    ::printf("%-10lu %-8s %14.0f %10.1f %10.1f  fire and forget\n",
+             static_cast<unsigned long>(n), "stealing",
+             stealing.tasks_per_second, stealing.p50_us, stealing.p99_us);
+    ::printf("%-10lu %-8s %14.0f %10s %10s  fork join\n",
+             static_cast<unsigned long>(n), "locked",
+             ForkJoin<LockedPool>(n, kDepth), "-", "-");
+    ::printf("%-10lu %-8s %14.0f %10s %10s  fork join\n",
+             static_cast<unsigned long>(n), "stealing",
+             ForkJoin<StealingPool>(n, kDepth), "-", "-");
+    ::printf("%-10lu %-8s %14.0f %10s %10s  fan out x%lu, one by one\n",
+             static_cast<unsigned long>(n), "stealing",
+             FanOut(n, kCount, kBatch, false), "-", "-",
+             static_cast<unsigned long>(kBatch));
+    ::printf("%-10lu %-8s %14.0f %10s %10s  fan out x%lu, AddTasks\n",
+             static_cast<unsigned long>(n), "stealing",
+             FanOut(n, kCount, kBatch, true), "-", "-",
+             static_cast<unsigned long>(kBatch));
+  }
+  return 0;
+}
@@ -38,7 +38,7 @@ int main(int argc, const char **argv) {
           tc->remote_end_point().ToStringWithoutPort());
     }
     http_request->SetHttpHeader("User-Agent", "cnetpp/1.0");
-    return c->SendPacket(http_request->ToString());
+    return c->SendPacket(http_request);
   };
 
   http_options.set_connected_callback([&send_func] (HttpConnectionPtr c) -> bool {
@@ -39,9 +39,7 @@ class HttpServerHandler final {
         static_cast<cnetpp::http::HttpResponse::StatusCode>(200));
     http_response->SetHttpHeader("Content-Length", "10");
     http_response->set_http_body("1234567890");
-    std::string str_response;
-    http_response->ToString(&str_response);
-    c->SendPacket(str_response);
+    c->SendPacket(http_response);
     //c->MarkAsClosed(false);
     return true;
   }
@@ -87,6 +85,8 @@ int main() {
         std::shared_ptr<cnetpp::http::HttpConnection> c) -> bool {
       return http_handler.OnSent(success, c);
   });
+  options.set_add_date_header(true);
+  options.AddDefaultHeader("Server", "cnetpp/1.0");
 
   cnetpp::http::HttpServer http_server;
   if (!http_server.Launch(listen_end_point, options)) {
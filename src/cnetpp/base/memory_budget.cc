@@ -0,0 +1,98 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include <cnetpp/base/memory_budget.h>
+
+#include <utility>
+
+namespace cnetpp {
+namespace base {
+
+MemoryBudget::MemoryBudget(int64_t limit,
+                           std::shared_ptr<MemoryBudget> parent)
+    : parent_(std::move(parent)), limit_(limit) {
+}
+
+const std::shared_ptr<MemoryBudget>& MemoryBudget::Process() {
+  // never destroyed, the connections may outlive the static objects
+  static auto process = new std::shared_ptr<MemoryBudget>(
+      std::make_shared<MemoryBudget>());
+  return *process;
+}
+
+bool MemoryBudget::TryCharge(int64_t n) {
+  for (auto budget = this; budget; budget = budget->parent_.get()) {
+    int64_t limit = budget->limit();
+    int64_t usage = budget->usage_.fetch_add(n, std::memory_order_relaxed) + n;
+    if (limit > 0 && n > 0 && usage > limit) {
+      // roll back this one and the children already charged
+      budget->usage_.fetch_sub(n, std::memory_order_relaxed);
+      budget->rejected_.fetch_add(1, std::memory_order_relaxed);
+      for (auto charged = this; charged != budget;
+           charged = charged->parent_.get()) {
+        charged->usage_.fetch_sub(n, std::memory_order_relaxed);
+      }
+      return false;
+    }
+    budget->UpdatePeak(usage);
+  }
+  return true;
+}
+
+void MemoryBudget::Charge(int64_t n) {
+  for (auto budget = this; budget; budget = budget->parent_.get()) {
+    budget->UpdatePeak(
+        budget->usage_.fetch_add(n, std::memory_order_relaxed) + n);
+  }
+}
+
+void MemoryBudget::Release(int64_t n) {
+  for (auto budget = this; budget; budget = budget->parent_.get()) {
+    budget->usage_.fetch_sub(n, std::memory_order_relaxed);
+  }
+}
+
+bool MemoryBudget::Exhausted() const {
+  for (auto budget = this; budget; budget = budget->parent_.get()) {
+    int64_t limit = budget->limit();
+    if (limit > 0 && budget->usage() >= limit) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void MemoryBudget::UpdatePeak(int64_t usage) {
+  int64_t peak = peak_.load(std::memory_order_relaxed);
+  while (usage > peak &&
+         !peak_.compare_exchange_weak(peak, usage,
+                                      std::memory_order_relaxed)) {
+  }
+}
+
+}  // namespace base
+}  // namespace cnetpp
+
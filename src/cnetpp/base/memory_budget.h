@@ -0,0 +1,98 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef CNETPP_BASE_MEMORY_BUDGET_H_
+#define CNETPP_BASE_MEMORY_BUDGET_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+namespace cnetpp {
+namespace base {
+
+// The memory a part of the process may use, e.g. the buffers of a
+// connection. Each budget is charged along with its parents up to the one of
+// the whole process, so a limit at any level holds for all the parts below
+// it. It is thread safe.
+class MemoryBudget final {
+ public:
+  // 'limit' in bytes, 0 means no limit
+  explicit MemoryBudget(int64_t limit = 0,
+                        std::shared_ptr<MemoryBudget> parent = nullptr);
+
+  // The budget of the whole process, the root of all the others
+  static const std::shared_ptr<MemoryBudget>& Process();
+
+  const std::shared_ptr<MemoryBudget>& parent() const {
+    return parent_;
+  }
+
+  int64_t limit() const {
+    return limit_.load(std::memory_order_relaxed);
+  }
+  void set_limit(int64_t limit) {
+    limit_.store(limit, std::memory_order_relaxed);
+  }
+
+  // The bytes charged now and at most so far
+  int64_t usage() const {
+    return usage_.load(std::memory_order_relaxed);
+  }
+  int64_t peak() const {
+    return peak_.load(std::memory_order_relaxed);
+  }
+  // How many charges were refused because of this budget
+  uint64_t rejected() const {
+    return rejected_.load(std::memory_order_relaxed);
+  }
+
+  // Charge 'n' bytes to this budget and its parents, or nothing if it would
+  // take one of them over its limit.
+  bool TryCharge(int64_t n);
+  // Charge 'n' bytes even over the limits, for the memory already in use
+  void Charge(int64_t n);
+  void Release(int64_t n);
+
+  // Whether this budget or one of its parents is at its limit
+  bool Exhausted() const;
+
+ private:
+  std::shared_ptr<MemoryBudget> parent_;
+  std::atomic<int64_t> limit_;
+  std::atomic<int64_t> usage_ { 0 };
+  std::atomic<int64_t> peak_ { 0 };
+  std::atomic<uint64_t> rejected_ { 0 };
+
+  void UpdatePeak(int64_t usage);
+};
+
+}  // namespace base
+}  // namespace cnetpp
+
+#endif  // CNETPP_BASE_MEMORY_BUDGET_H_
+
@@ -27,10 +27,17 @@
 #include <cnetpp/concurrency/this_thread.h>
 #include <cnetpp/base/memory_cache.h>
 
+#include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <assert.h>
 
+#include <algorithm>
+#include <chrono>
+#include <map>
+
 #define CNETPP_PTHREAD_CALL(result) do { \
   if ((result) != 0) abort(); \
 } while(0)
@@ -40,25 +47,287 @@ namespace base {
 
 struct MemoryAddress {
   uint32_t              length_;
+  // 0 for the blocks from malloc, the index of the small class plus one for
+  // the blocks carved from spans, or kMappedBlock with the kind of the pages
+  // and the NUMA node for the blocks mapped in huge pages mode
+  uint32_t              origin_;
   struct MemoryAddress* next_;
   char                  data_[];
 };
 
 struct MemoryClass {
   uint32_t        length_;
+  // the fewest blocks on the list since the last scavenge, these have not
+  // been used for a whole interval
+  uint32_t        low_water_;
   uint64_t        size_;
   MemoryAddress*  addrs_;
 };
 
+namespace {
+
+// The small blocks are carved from spans of 2m, which are kept for the life
+// of the process and go round between the threads through the transfer
+// caches.
+constexpr size_t kSpanSize = 2 * 1024 * 1024;
+constexpr uint32_t kMaxSmallSize = 64 * 1024;
+// 16 to 128 bytes by 16, then 8 classes between two powers of two, so that
+// no more than 12.5% of a block is wasted
+constexpr int kSmallClasses = 80;
+// the blocks move to and from the transfer caches in batches of about 64k,
+// and of 2 to 32 blocks
+constexpr uint32_t kBatchSize = 64 * 1024;
+constexpr uint32_t kMaxBatchLength = 32;
+constexpr int kTransferShards = 8;
+// how many allocations and deallocations a thread makes between two looks
+// at the clock for a due scavenge
+constexpr uint32_t kScavengeCheckEvents = 256;
+
+constexpr uint32_t kMappedBlock = 1u << 31;
+constexpr uint32_t kHugeTlbBlock = 1u << 30;
+constexpr uint32_t kNumaNodeMask = 0xffff;
+
+bool IsSmall(const MemoryAddress* address) {
+  return address->origin_ != 0 && (address->origin_ & kMappedBlock) == 0;
+}
+
+int GetSmallClassIndex(uint32_t n) {
+  assert(n <= kMaxSmallSize);
+  if (n <= 128) {
+    return n == 0 ? 0 : (n - 1) / 16;
+  }
+  int power = 31 - __builtin_clz(n - 1);  // 2^power < n <= 2^(power+1)
+  int shift = power - 3;  // the classes are 2^shift bytes apart
+  return 8 + (power - 7) * 8 +
+         ((n - (1u << power) + (1u << shift) - 1) >> shift) - 1;
+}
+
+uint32_t GetSmallClassSize(int index) {
+  if (index < 8) {
+    return (index + 1) * 16;
+  }
+  int power = 7 + (index - 8) / 8;
+  return (1u << power) + ((index - 8) % 8 + 1) * (1u << (power - 3));
+}
+
+uint32_t GetBatchLength(int index) {
+  return std::max<uint32_t>(
+      2, std::min(kMaxBatchLength, kBatchSize / GetSmallClassSize(index)));
+}
+
+struct TransferBatch {
+  MemoryAddress* addrs_;
+  uint32_t       length_;
+};
+
+// A shard of the transfer cache of a small class. Each thread gives its
+// batches to one of the shards, and takes from the others only when that
+// one is empty, so that the threads seldom wait for each other.
+struct TransferShard {
+  std::mutex                 mtx_;
+  std::vector<TransferBatch> batches_;
+};
+
+struct TransferCache {
+  TransferShard shards_[kTransferShards];
+};
+
+struct SpanPool {
+  std::mutex mtx_;
+  // the unused tails of the spans of the exited threads
+  std::vector<std::pair<char*, char*>> tails_;
+  std::atomic<uint64_t> usage_ { 0 };
+};
+
+// never destroyed, the blocks may be freed by the destructors of other
+// static objects
+TransferCache* TransferCaches() {
+  static auto caches = new TransferCache[kSmallClasses];
+  return caches;
+}
+
+SpanPool* Spans() {
+  static auto spans = new SpanPool;
+  return spans;
+}
+
+int NextTransferShard() {
+  static std::atomic<uint32_t> next { 0 };
+  return next.fetch_add(1, std::memory_order_relaxed) % kTransferShards;
+}
+
+// The large blocks of the huge pages mode are mapped one by one, in explicit
+// huge pages when the system has some reserved, or else in a region advised
+// for transparent huge pages. The data is aligned to the huge pages and
+// spans whole ones, the header of the block sits at the end of a normal page
+// mapped right before it, so that a block of 2m takes a single huge page.
+size_t ReadPageSize(const char* path, const char* format, size_t unit) {
+  size_t result = 2 * 1024 * 1024;
+  FILE* file = fopen(path, "r");
+  if (file != nullptr) {
+    char line[256];
+    unsigned long size = 0;
+    while (fgets(line, sizeof(line), file) != nullptr) {
+      if (sscanf(line, format, &size) == 1 && size > 0) {
+        result = size * unit;
+        break;
+      }
+    }
+    fclose(file);
+  }
+  return result;
+}
+
+// the size of the explicit huge pages
+size_t GetHugePageSize() {
+  static size_t size =
+      ReadPageSize("/proc/meminfo", "Hugepagesize: %lu kB", 1024);
+  return size;
+}
+
+// the size of the transparent huge pages
+size_t GetTransparentHugePageSize() {
+  static size_t size = ReadPageSize(
+      "/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "%lu", 1);
+  return size;
+}
+
+// Whether a block of 'n' bytes may take explicit huge pages. A block smaller
+// than one of them, such as 4m with pages of 1g, takes transparent ones.
+bool UsesHugeTlb(uint32_t n) {
+  return GetHugePageSize() <= GetTransparentHugePageSize() ||
+      n >= GetHugePageSize();
+}
+
+size_t GetMappingPage(uint32_t n) {
+  return UsesHugeTlb(n) ? GetHugePageSize() : GetTransparentHugePageSize();
+}
+
+size_t GetMappingLength(uint32_t n) {
+  size_t page = GetMappingPage(n);
+  return (n + page - 1) / page * page;
+}
+
+uint32_t GetNumaNode() {
+  unsigned node = 0;
+#ifdef SYS_getcpu
+  unsigned cpu = 0;
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+    return 0;
+  }
+#endif
+  return node & kNumaNodeMask;
+}
+
+// the bytes mapped in explicit and in transparent huge pages, by NUMA node
+struct HugePageUsage {
+  std::mutex mtx_;
+  std::map<uint32_t, std::pair<uint64_t, uint64_t>> nodes_;
+
+  void Add(uint32_t origin, int64_t length) {
+    std::lock_guard<std::mutex> guard(mtx_);
+    auto& usage = nodes_[origin & kNumaNodeMask];
+    if (origin & kHugeTlbBlock) {
+      usage.first += length;
+    } else {
+      usage.second += length;
+    }
+  }
+};
+
+HugePageUsage* HugePages() {
+  static auto usage = new HugePageUsage;
+  return usage;
+}
+
+MemoryAddress* MapMemory(uint32_t n) {
+  uint32_t origin = kMappedBlock | GetNumaNode();
+  size_t page = GetMappingPage(n);
+  size_t length = GetMappingLength(n);
+  size_t header_page = sysconf(_SC_PAGESIZE);
+
+  // reserve a huge page more, then keep the aligned data and the normal
+  // page before it
+  void* memory = mmap(nullptr, length + page, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (memory == MAP_FAILED) {
+    return nullptr;
+  }
+  auto begin = reinterpret_cast<uintptr_t>(memory);
+  auto end = begin + length + page;
+  auto data = (begin + header_page + page - 1) / page * page;
+  if (data - header_page > begin) {
+    munmap(memory, data - header_page - begin);
+  }
+  if (data + length < end) {
+    munmap(reinterpret_cast<void*>(data + length), end - data - length);
+  }
+  mprotect(reinterpret_cast<void*>(data - header_page), header_page,
+           PROT_READ | PROT_WRITE);
+
+  memory = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (UsesHugeTlb(n)) {
+    memory = mmap(reinterpret_cast<void*>(data), length,
+                  PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB,
+                  -1, 0);
+  }
+#endif
+  if (memory != MAP_FAILED) {
+    origin |= kHugeTlbBlock;
+  } else {
+    memory = mmap(reinterpret_cast<void*>(data), length,
+                  PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    if (memory == MAP_FAILED) {
+      munmap(reinterpret_cast<void*>(data - header_page),
+             header_page + length);
+      return nullptr;
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(memory, length, MADV_HUGEPAGE);
+#endif
+  }
+  HugePages()->Add(origin, length);
+  auto address = reinterpret_cast<MemoryAddress*>(
+      data - sizeof(MemoryAddress));
+  address->length_ = n;
+  address->origin_ = origin;
+  address->next_   = nullptr;
+  return address;
+}
+
+void FreeMemory(MemoryAddress* address) {
+  if ((address->origin_ & kMappedBlock) == 0) {
+    free(address);
+    return;
+  }
+  size_t length = GetMappingLength(address->length_);
+  size_t header_page = sysconf(_SC_PAGESIZE);
+  HugePages()->Add(address->origin_, -static_cast<int64_t>(length));
+  munmap(address->data_ - header_page, header_page + length);
+}
+
+}  // namespace
+
 class MemoryCacheTLS {
  public:
   using Stats = std::vector<std::tuple<uint32_t, uint32_t, uint64_t>>;
 
-  MemoryCacheTLS() : prev_(nullptr), next_(nullptr) {
+  MemoryCacheTLS()
+      : prev_(nullptr),
+        next_(nullptr),
+        span_begin_(nullptr),
+        span_end_(nullptr),
+        small_size_(0),
+        events_(0),
+        last_scavenge_(std::chrono::steady_clock::now()) {
+    memset(mem_small_, 0, sizeof(MemoryClass) * kSmallClasses);
     memset(mem_low_, 0, sizeof(MemoryClass) * LOW_CLASS);
     memset(mem_high_, 0, sizeof(MemoryClass) * HIGH_CLASS);
-    memset(&mem_normal_, 0, sizeof(MemoryClass));
     tid_ = cnetpp::concurrency::ThisThread::GetId();
+    shard_ = NextTransferShard();
   }
   ~MemoryCacheTLS();
 
@@ -66,12 +335,18 @@ class MemoryCacheTLS {
   void* Recycle(void* ptr, uint32_t* len);
   void Deallocate(void* ptr);
 
+  void Scavenge();
+  int ScavengeIfDue();
+
  private:
-  // 4k 8k 16k 32k 64k 128k 256k 512k
+  // whether no block is cached
+  bool Empty() const;
+
+  // 128k 256k 512k
   int GetLowMemoryIndex(uint32_t n) const {
-    assert(n >= 4096 && n < 1024 * 1024);
+    assert(n > kMaxSmallSize && n < 1024 * 1024);
     int x = 0;
-    n = n / 4096;
+    n = n / (128 * 1024);
     while (n) {
       n = n >> 1;
       x = x + 1;
@@ -85,20 +360,53 @@ class MemoryCacheTLS {
     return n / (1024 * 1024) - 1;
   }
 
+  // the blocks of a small class a thread keeps, no more than a span of them
+  uint32_t MaxCacheSmall(int index) const {
+    return std::min<uint32_t>(MemoryCache::Instance()->max_cache_normal(),
+                              kSpanSize / GetSmallClassSize(index));
+  }
+
+  void* AllocateSmall(uint32_t n);
+  void DeallocateSmall(MemoryAddress* address);
+  MemoryAddress* CarveSmall(int index);
+  // carves what is left of the current span into blocks of the largest
+  // classes fitting in it, onto the free lists
+  void CarveTail();
+  // takes a batch of a small class from the transfer cache
+  void FetchSmall(int index);
+  // gives the blocks over 'keep' of a small class to the transfer cache
+  void ReleaseSmall(int index, uint32_t keep);
+  // frees the blocks over 'keep' of a class of large blocks
+  void ReleaseLarge(MemoryClass* memory_class, uint32_t keep);
+
+  void CountEvent() {
+    if (++events_ % kScavengeCheckEvents == 0) {
+      ScavengeIfDue();
+    }
+  }
+
   void* NewMemory(uint32_t n);
   void* TryRecycle(MemoryClass* memory_class, MemoryAddress* address, uint32_t* len);
   MemoryCacheTLS::Stats GetStats() const;
 
   friend class MemoryCache;
-  constexpr static int LOW_CLASS  = 8;
+  constexpr static int LOW_CLASS  = 3;
   constexpr static int HIGH_CLASS = 16;
   constexpr static int MEMORY_ADDRESS_NORMAL = 2048;
 
   MemoryCacheTLS* prev_;
   MemoryCacheTLS* next_;
+  MemoryClass     mem_small_[kSmallClasses];
   MemoryClass     mem_low_[LOW_CLASS];
   MemoryClass     mem_high_[HIGH_CLASS];
-  MemoryClass     mem_normal_;
+  // the part of the current span not carved yet
+  char*           span_begin_;
+  char*           span_end_;
+  // the bytes on all the small lists
+  uint64_t        small_size_;
+  uint32_t        events_;
+  int             shard_;
+  std::chrono::steady_clock::time_point last_scavenge_;
   pid_t           tid_;
 };
 
@@ -107,105 +415,323 @@ constexpr int MemoryCacheTLS::HIGH_CLASS;
 constexpr int MemoryCacheTLS::MEMORY_ADDRESS_NORMAL;
 
 MemoryCacheTLS::~MemoryCacheTLS() {
-  {
-    while (mem_normal_.addrs_ != nullptr) {
-      MemoryAddress* ma  = mem_normal_.addrs_;
-      mem_normal_.addrs_ = ma->next_;
-      free(ma);
-    }
+  for (int i = 0; i < kSmallClasses; i++) {
+    ReleaseSmall(i, 0);
+  }
+  if (span_begin_ != span_end_) {
+    auto spans = Spans();
+    std::lock_guard<std::mutex> guard(spans->mtx_);
+    spans->tails_.emplace_back(span_begin_, span_end_);
   }
 
   for (int i = 0; i < LOW_CLASS; i++) {
-    auto& clazz = mem_low_[i];
-    while (clazz.addrs_ != nullptr) {
-      MemoryAddress* ma = clazz.addrs_;
-      clazz.addrs_      = ma->next_;
-      free(ma);
-    }
+    ReleaseLarge(&mem_low_[i], 0);
   }
-
   for (int i = 0; i < HIGH_CLASS; i++) {
-    auto& clazz = mem_high_[i];
-    while (clazz.addrs_ != nullptr) {
-      MemoryAddress* ma = clazz.addrs_;
-      clazz.addrs_      = ma->next_;
-      free(ma);
-    }
+    ReleaseLarge(&mem_high_[i], 0);
   }
 }
 
 void* MemoryCacheTLS::NewMemory(uint32_t n) {
-  if (n == MEMORY_ADDRESS_NORMAL && mem_normal_.addrs_ != nullptr) {
-    MemoryAddress* ma = mem_normal_.addrs_;
-    mem_normal_.addrs_    = mem_normal_.addrs_->next_;
-    mem_normal_.length_  -= 1;
-    mem_normal_.size_    -= MEMORY_ADDRESS_NORMAL;
-    return ma->data_;
+  if (n >= 1024 * 1024 && MemoryCache::Instance()->huge_pages()) {
+    auto address = MapMemory(n);
+    if (address != nullptr) {
+      return address->data_;
+    }
   }
-
   auto ptr =
     reinterpret_cast<MemoryAddress*>(malloc(sizeof(MemoryAddress) + n));
   ptr->length_ = n;
+  ptr->origin_ = 0;
   ptr->next_   = nullptr;
   return ptr->data_;
 }
 
-void* MemoryCacheTLS::Allocate(uint32_t n) {
-  if (n >= 4096 && n < 1024 * 1024) {
-    auto& memory_class  = mem_low_[GetLowMemoryIndex(n)];
-    MemoryAddress** ptr = &memory_class.addrs_;
-    while (*ptr != nullptr) {
-      MemoryAddress* addr = *ptr;
-      if (addr->length_ >= n) {
-        *ptr = addr->next_;
-        memory_class.length_ -= 1;
-        memory_class.size_   -= addr->length_;
-        return addr->data_;
+MemoryAddress* MemoryCacheTLS::CarveSmall(int index) {
+  size_t block_size = sizeof(MemoryAddress) + GetSmallClassSize(index);
+  if (static_cast<size_t>(span_end_ - span_begin_) < block_size) {
+    CarveTail();
+    char* span = nullptr;
+    auto spans = Spans();
+    {
+      std::lock_guard<std::mutex> guard(spans->mtx_);
+      auto& tails = spans->tails_;
+      for (auto itr = tails.begin(); itr != tails.end(); ++itr) {
+        if (static_cast<size_t>(itr->second - itr->first) >= block_size) {
+          span_begin_ = itr->first;
+          span_end_   = itr->second;
+          tails.erase(itr);
+          span = span_begin_;
+          break;
+        }
+      }
+    }
+    if (span == nullptr) {
+      void* memory = nullptr;
+      if (posix_memalign(&memory, kSpanSize, kSpanSize) != 0) {
+        return nullptr;
       }
-      ptr = &addr->next_;
+      spans->usage_.fetch_add(kSpanSize, std::memory_order_relaxed);
+      span_begin_ = static_cast<char*>(memory);
+      span_end_   = span_begin_ + kSpanSize;
+    }
+  }
+  auto address = reinterpret_cast<MemoryAddress*>(span_begin_);
+  span_begin_ += block_size;
+  address->origin_ = index + 1;
+  address->next_   = nullptr;
+  return address;
+}
+
+void MemoryCacheTLS::CarveTail() {
+  while (static_cast<size_t>(span_end_ - span_begin_) >=
+         sizeof(MemoryAddress) + GetSmallClassSize(0)) {
+    uint32_t n = std::min<size_t>(span_end_ - span_begin_ -
+                                      sizeof(MemoryAddress),
+                                  kMaxSmallSize);
+    int index = GetSmallClassIndex(n);
+    if (GetSmallClassSize(index) > n) {
+      index--;
+    }
+    auto address = reinterpret_cast<MemoryAddress*>(span_begin_);
+    span_begin_ += sizeof(MemoryAddress) + GetSmallClassSize(index);
+    address->length_ = GetSmallClassSize(index);
+    address->origin_ = index + 1;
+    auto& memory_class = mem_small_[index];
+    address->next_ = memory_class.addrs_;
+    memory_class.addrs_   = address;
+    memory_class.length_ += 1;
+    memory_class.size_   += GetSmallClassSize(index);
+    small_size_          += GetSmallClassSize(index);
+  }
+}
+
+void MemoryCacheTLS::FetchSmall(int index) {
+  auto& cache = TransferCaches()[index];
+  TransferBatch batch { nullptr, 0 };
+  for (int i = 0; i < kTransferShards && batch.addrs_ == nullptr; i++) {
+    auto& shard = cache.shards_[(shard_ + i) % kTransferShards];
+    std::lock_guard<std::mutex> guard(shard.mtx_);
+    if (!shard.batches_.empty()) {
+      batch = shard.batches_.back();
+      shard.batches_.pop_back();
+    }
+  }
+  if (batch.addrs_ == nullptr) {
+    return;
+  }
+
+  auto& memory_class = mem_small_[index];
+  MemoryAddress* last = batch.addrs_;
+  while (last->next_ != nullptr) {
+    last = last->next_;
+  }
+  last->next_ = memory_class.addrs_;
+  memory_class.addrs_   = batch.addrs_;
+  memory_class.length_ += batch.length_;
+  uint64_t size = static_cast<uint64_t>(batch.length_) *
+      GetSmallClassSize(index);
+  memory_class.size_ += size;
+  small_size_ += size;
+}
+
+void MemoryCacheTLS::ReleaseSmall(int index, uint32_t keep) {
+  auto& memory_class = mem_small_[index];
+  if (memory_class.length_ <= keep) {
+    return;
+  }
+  uint32_t count = memory_class.length_ - keep;
+  uint32_t batch_length = GetBatchLength(index);
+  std::vector<TransferBatch> batches;
+  batches.reserve((count + batch_length - 1) / batch_length);
+  for (uint32_t released = 0; released < count; ) {
+    TransferBatch batch { memory_class.addrs_, 0 };
+    MemoryAddress* last = nullptr;
+    while (batch.length_ < batch_length && released < count) {
+      last = memory_class.addrs_;
+      memory_class.addrs_ = last->next_;
+      batch.length_++;
+      released++;
     }
-  } else if (n >= 1024 * 1024) {
+    last->next_ = nullptr;
+    batches.push_back(batch);
+  }
+  uint64_t size = static_cast<uint64_t>(count) * GetSmallClassSize(index);
+  memory_class.length_ = keep;
+  memory_class.size_  -= size;
+  memory_class.low_water_ = std::min(memory_class.low_water_, keep);
+  small_size_ -= size;
+
+  auto& shard = TransferCaches()[index].shards_[shard_];
+  std::lock_guard<std::mutex> guard(shard.mtx_);
+  shard.batches_.insert(shard.batches_.end(), batches.begin(), batches.end());
+}
+
+void MemoryCacheTLS::ReleaseLarge(MemoryClass* memory_class, uint32_t keep) {
+  while (memory_class->length_ > keep) {
+    auto addr = memory_class->addrs_;
+    memory_class->addrs_ = memory_class->addrs_->next_;
+    memory_class->length_ -= 1;
+    memory_class->size_   -= addr->length_;
+    FreeMemory(addr);
+  }
+  memory_class->low_water_ = std::min(memory_class->low_water_, keep);
+}
+
+void* MemoryCacheTLS::AllocateSmall(uint32_t n) {
+  int index = GetSmallClassIndex(n);
+  auto& memory_class = mem_small_[index];
+  if (memory_class.addrs_ == nullptr) {
+    FetchSmall(index);
+  }
+
+  MemoryAddress* address = memory_class.addrs_;
+  if (address != nullptr) {
+    memory_class.addrs_   = address->next_;
+    memory_class.length_ -= 1;
+    memory_class.size_   -= GetSmallClassSize(index);
+    small_size_          -= GetSmallClassSize(index);
+    if (memory_class.length_ < memory_class.low_water_) {
+      memory_class.low_water_ = memory_class.length_;
+    }
+  } else {
+    address = CarveSmall(index);
+    if (address == nullptr) {
+      return nullptr;
+    }
+  }
+  address->length_ = n;
+  CountEvent();
+  return address->data_;
+}
+
+void MemoryCacheTLS::DeallocateSmall(MemoryAddress* address) {
+  assert(IsSmall(address));
+  int index = address->origin_ - 1;
+  auto& memory_class = mem_small_[index];
+  address->next_ = memory_class.addrs_;
+  memory_class.addrs_   = address;
+  memory_class.length_ += 1;
+  memory_class.size_   += GetSmallClassSize(index);
+  small_size_          += GetSmallClassSize(index);
+  if (memory_class.size_ > kSpanSize ||
+      memory_class.length_ > MemoryCache::Instance()->max_cache_normal()) {
+    ReleaseSmall(index, MaxCacheSmall(index) / 2);
+  }
+  if (small_size_ > MemoryCache::Instance()->max_cache_thread()) {
+    // over the high watermark, give back the idle blocks first and then
+    // half of each class
+    Scavenge();
+    for (int i = 0; i < kSmallClasses &&
+         small_size_ > MemoryCache::Instance()->max_cache_thread() / 2; i++) {
+      ReleaseSmall(i, mem_small_[i].length_ / 2);
+    }
+  }
+  CountEvent();
+}
+
+void MemoryCacheTLS::Scavenge() {
+  for (int i = 0; i < kSmallClasses; i++) {
+    auto& memory_class = mem_small_[i];
+    ReleaseSmall(i, memory_class.length_ - memory_class.low_water_);
+    memory_class.low_water_ = memory_class.length_;
+  }
+  for (int i = 0; i < LOW_CLASS + HIGH_CLASS; i++) {
+    auto memory_class = i < LOW_CLASS ? &mem_low_[i]
+                                      : &mem_high_[i - LOW_CLASS];
+    ReleaseLarge(memory_class,
+                 memory_class->length_ - memory_class->low_water_);
+    memory_class->low_water_ = memory_class->length_;
+  }
+  last_scavenge_ = std::chrono::steady_clock::now();
+}
+
+bool MemoryCacheTLS::Empty() const {
+  if (small_size_ != 0) {
+    return false;
+  }
+  for (int i = 0; i < LOW_CLASS; i++) {
+    if (mem_low_[i].length_ != 0) {
+      return false;
+    }
+  }
+  for (int i = 0; i < HIGH_CLASS; i++) {
+    if (mem_high_[i].length_ != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int MemoryCacheTLS::ScavengeIfDue() {
+  if (Empty()) {
+    return -1;
+  }
+  auto interval =
+      std::chrono::milliseconds(MemoryCache::Instance()->scavenge_interval());
+  auto left = last_scavenge_ + interval - std::chrono::steady_clock::now();
+  if (left <= std::chrono::steady_clock::duration::zero()) {
+    Scavenge();
+    return Empty() ? -1 : static_cast<int>(interval.count());
+  }
+  // round up, or the poller would wake up a bit early and spin
+  return static_cast<int>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(left).count() + 1);
+}
+
+void* MemoryCacheTLS::Allocate(uint32_t n) {
+  if (n <= kMaxSmallSize) {
+    return AllocateSmall(n);
+  }
+
+  MemoryClass* memory_class = nullptr;
+  MemoryAddress* addr = nullptr;
+  if (n < 1024 * 1024) {
+    // a power of two, so that any block of the class fits
+    n = 1u << (32 - __builtin_clz(n - 1));
+  }
+  if (n < 1024 * 1024) {
+    memory_class = &mem_low_[GetLowMemoryIndex(n)];
+    addr = memory_class->addrs_;
+    if (addr != nullptr) {
+      memory_class->addrs_ = addr->next_;
+    }
+  } else {
     int index = HIGH_CLASS - 1;
     if (n < 16 * 1024 * 1024) {
       index = GetHighMemoryIndex(n);
     }
-    auto& memory_class = mem_high_[index];
-    MemoryAddress** ptr = &memory_class.addrs_;
+    memory_class = &mem_high_[index];
+    MemoryAddress** ptr = &memory_class->addrs_;
     while (*ptr != nullptr) {
-      MemoryAddress* addr = *ptr;
-      if (addr->length_ >= n) {
+      if ((*ptr)->length_ >= n) {
+        addr = *ptr;
         *ptr = addr->next_;
-        memory_class.length_ -= 1;
-        memory_class.size_   -= addr->length_;
-        return addr->data_;
+        break;
       }
-      ptr = &addr->next_;
+      ptr = &(*ptr)->next_;
     }
   }
 
-  return NewMemory(n);
+  if (addr == nullptr) {
+    return NewMemory(n);
+  }
+  memory_class->length_ -= 1;
+  memory_class->size_   -= addr->length_;
+  if (memory_class->length_ < memory_class->low_water_) {
+    memory_class->low_water_ = memory_class->length_;
+  }
+  return addr->data_;
 }
 
 void MemoryCacheTLS::Deallocate(void* ptr) {
   if (ptr == nullptr) return;
   auto addr =
     reinterpret_cast<MemoryAddress*>((char *)ptr - sizeof(MemoryAddress));
-  if (addr->length_ == MEMORY_ADDRESS_NORMAL
-      && mem_normal_.length_ < MemoryCache::Instance()->max_cache_normal()) {
-    addr->next_    = mem_normal_.addrs_;
-    mem_normal_.addrs_ = addr;
-    mem_normal_.length_ += 1;
-    mem_normal_.size_   += MEMORY_ADDRESS_NORMAL;
+  if (IsSmall(addr)) {
+    DeallocateSmall(addr);
   } else {
-    free(addr);
-  }
-
-  while (mem_normal_.length_ > MemoryCache::Instance()->max_cache_normal()) {
-    MemoryAddress* ma = mem_normal_.addrs_;
-    mem_normal_.addrs_    = mem_normal_.addrs_->next_;
-    mem_normal_.length_  -= 1;
-    mem_normal_.size_    -= MEMORY_ADDRESS_NORMAL;
-    free(ma);
+    FreeMemory(addr);
   }
 }
 
@@ -223,16 +749,10 @@ void* MemoryCacheTLS::TryRecycle(MemoryClass* memory_class,
   memory_class->length_ += 1;
   memory_class->size_   += address->length_;
 
-  while (memory_class->length_ > MemoryCache::Instance()->max_cache_large()) {
-    auto addr = memory_class->addrs_;
-    memory_class->addrs_ = memory_class->addrs_->next_;
-    memory_class->length_ -= 1;
-    memory_class->size_   -= addr->length_;
-    free(addr);
-  }
+  ReleaseLarge(memory_class, MemoryCache::Instance()->max_cache_large());
 
   *len = MEMORY_ADDRESS_NORMAL;
-  return NewMemory(MEMORY_ADDRESS_NORMAL);
+  return AllocateSmall(MEMORY_ADDRESS_NORMAL);
 }
 
 void* MemoryCacheTLS::Recycle(void* ptr, uint32_t* len) {
@@ -243,6 +763,12 @@ void* MemoryCacheTLS::Recycle(void* ptr, uint32_t* len) {
     return ptr;
   }
 
+  if (IsSmall(address)) {
+    DeallocateSmall(address);
+    *len = MEMORY_ADDRESS_NORMAL;
+    return AllocateSmall(MEMORY_ADDRESS_NORMAL);
+  }
+
   MemoryClass* memory_class;
   if (address->length_ < 1024 * 1024) {
     memory_class  = &mem_low_[GetLowMemoryIndex(address->length_)];
@@ -257,15 +783,18 @@ void* MemoryCacheTLS::Recycle(void* ptr, uint32_t* len) {
 }
 
 MemoryCacheTLS::Stats MemoryCacheTLS::GetStats() const {
-  MemoryCacheTLS::Stats stats(LOW_CLASS + HIGH_CLASS + 1);
-  stats[0] = std::make_tuple(MEMORY_ADDRESS_NORMAL,
-        mem_normal_.length_, mem_normal_.size_);
+  MemoryCacheTLS::Stats stats(kSmallClasses + LOW_CLASS + HIGH_CLASS);
+  for (int i = 0; i < kSmallClasses; i++) {
+    stats[i] = std::make_tuple(GetSmallClassSize(i),
+          mem_small_[i].length_, mem_small_[i].size_);
+  }
   for (int i = 0; i < LOW_CLASS; i++) {
-    stats[i + 1] = std::make_tuple(4096 * (1 << i),
+    stats[i + kSmallClasses] = std::make_tuple(128 * 1024 * (1 << i),
           mem_low_[i].length_, mem_low_[i].size_);
   }
   for (int i = 0; i < HIGH_CLASS; i++) {
-    stats[i + 1 + LOW_CLASS] = std::make_tuple((i + 1) * 1024 * 1024,
+    stats[i + kSmallClasses + LOW_CLASS] =
+        std::make_tuple((i + 1) * 1024 * 1024,
           mem_high_[i].length_, mem_high_[i].size_);
   }
   return stats;
@@ -273,6 +802,9 @@ MemoryCacheTLS::Stats MemoryCacheTLS::GetStats() const {
 
 uint32_t MemoryCache::max_cache_normal_ = 1024;
 uint32_t MemoryCache::max_cache_large_  = 8;
+uint64_t MemoryCache::max_cache_thread_ = 4 * 1024 * 1024;
+uint32_t MemoryCache::scavenge_interval_ = 1000;
+bool     MemoryCache::huge_pages_ = false;
 pthread_key_t            MemoryCache::tls_key_;
 MemoryCacheHead          MemoryCache::h_;
 __thread MemoryCacheTLS* MemoryCache::pool_ = nullptr;
@@ -304,6 +836,30 @@ void* MemoryCache::Recycle(void* ptr, uint32_t* len) {
   return ptr != nullptr ? pool_->Recycle(ptr, len) : ptr;
 }
 
+void MemoryCache::Scavenge() {
+  EnsureHasMemoryCacheTLS();
+  pool_->Scavenge();
+}
+
+int MemoryCache::ScavengeIfDue() {
+  EnsureHasMemoryCacheTLS();
+  return pool_->ScavengeIfDue();
+}
+
+MemoryCache::HugePageStats MemoryCache::GetHugePageStats() const {
+  MemoryCache::HugePageStats stats;
+  auto usage = HugePages();
+  std::lock_guard<std::mutex> guard(usage->mtx_);
+  for (auto& node : usage->nodes_) {
+    stats.emplace_back(node.first, node.second.first, node.second.second);
+  }
+  return stats;
+}
+
+uint64_t MemoryCache::SmallMemoryUsage() const {
+  return Spans()->usage_.load(std::memory_order_relaxed);
+}
+
 void MemoryCache::PrepareCleanupTLSAtThreadExit() {
   if (pthread_getspecific(tls_key_) == nullptr) {
     void* flag = (void *)(uintptr_t)0x1;
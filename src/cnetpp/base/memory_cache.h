@@ -32,6 +32,7 @@
 #include <condition_variable>
 #include <atomic>
 #include <deque>
+#include <tuple>
 #include <vector>
 #include <pthread.h>
 
@@ -50,6 +51,9 @@ class MemoryCache {
  public:
   using Stats =
     std::deque<std::vector<std::tuple<uint32_t, uint32_t, uint64_t>>>;
+  // the NUMA node, the bytes in explicit huge pages and the bytes advised
+  // for transparent huge pages
+  using HugePageStats = std::vector<std::tuple<uint32_t, uint64_t, uint64_t>>;
 
   static MemoryCache* Instance();
 
@@ -59,6 +63,10 @@ class MemoryCache {
   void Deallocate(void* ptr);
   void* Recycle(void* ptr, uint32_t* len);
 
+  // The blocks of up to 64k are taken from size classes carved out of 2m
+  // spans. Each thread keeps at most 'n' free blocks of each of the classes,
+  // and no more than 2m of them, and gives the rest in batches to a transfer
+  // cache the other threads take from.
   void max_cache_normal(uint32_t n) {
     max_cache_normal_ = n;
   }
@@ -73,6 +81,48 @@ class MemoryCache {
     return max_cache_large_;
   }
 
+  // The most bytes of small blocks a thread keeps, 4m by default. Beyond it
+  // the thread gives its idle blocks, and then half of the others, to the
+  // transfer caches.
+  void max_cache_thread(uint64_t n) {
+    max_cache_thread_ = n;
+  }
+  uint64_t max_cache_thread() const {
+    return max_cache_thread_;
+  }
+
+  // Every 'ms' milliseconds, 1000 by default, a thread gives away the blocks
+  // it cached but didn't use since the last time.
+  void scavenge_interval(uint32_t ms) {
+    scavenge_interval_ = ms;
+  }
+  uint32_t scavenge_interval() const {
+    return scavenge_interval_;
+  }
+
+  // Gives away the idle blocks of the calling thread now.
+  void Scavenge();
+  // Scavenges the calling thread if it is due. Returns the milliseconds until
+  // the next scavenge, or -1 if the thread caches nothing. A thread which
+  // may stay blocked for long, such as an event poller, wakes up by then.
+  int ScavengeIfDue();
+
+  // Whether the blocks of 1m and more are mapped in huge pages instead of
+  // taken from malloc, false by default. Explicit huge pages are used when
+  // the system has some reserved and the block fills at least one, or else
+  // transparent ones. A block of a whole number of huge pages maps no more.
+  void huge_pages(bool enabled) {
+    huge_pages_ = enabled;
+  }
+  bool huge_pages() const {
+    return huge_pages_;
+  }
+  // The memory mapped in huge pages mode, by NUMA node.
+  MemoryCache::HugePageStats GetHugePageStats() const;
+
+  // The memory taken from the system for the small blocks.
+  uint64_t SmallMemoryUsage() const;
+
   void EnsureHasMemoryCacheTLS();
   MemoryCache::Stats GetStats() const;
 
@@ -86,6 +136,9 @@ class MemoryCache {
 
   static uint32_t  max_cache_normal_;
   static uint32_t  max_cache_large_;
+  static uint64_t  max_cache_thread_;
+  static uint32_t  scavenge_interval_;
+  static bool      huge_pages_;
   static pthread_key_t            tls_key_;
   static MemoryCacheHead          h_;
   static __thread MemoryCacheTLS* pool_;
@@ -0,0 +1,49 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include <cnetpp/base/pool_allocator.h>
+
+namespace cnetpp {
+namespace base {
+
+std::atomic<uint64_t> BlockPoolCounters::allocated_ { 0 };
+std::atomic<uint64_t> BlockPoolCounters::reused_ { 0 };
+std::atomic<uint64_t> BlockPoolCounters::freed_ { 0 };
+std::atomic<int64_t> BlockPoolCounters::cached_ { 0 };
+std::atomic<size_t> BlockPoolCounters::max_cached_blocks_ { 1024 };
+
+PoolAllocatorStats BlockPoolCounters::GetStats() {
+  PoolAllocatorStats stats;
+  stats.allocated = allocated_.load(std::memory_order_relaxed);
+  stats.reused = reused_.load(std::memory_order_relaxed);
+  stats.freed = freed_.load(std::memory_order_relaxed);
+  stats.cached = cached_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+}  // namespace base
+}  // namespace cnetpp
+
@@ -0,0 +1,208 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef CNETPP_BASE_POOL_ALLOCATOR_H_
+#define CNETPP_BASE_POOL_ALLOCATOR_H_
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <new>
+#include <utility>
+
+namespace cnetpp {
+namespace base {
+
+struct PoolAllocatorStats {
+  // the blocks got from operator new
+  uint64_t allocated { 0 };
+  // the blocks taken from a free list instead
+  uint64_t reused { 0 };
+  // the blocks given back to operator delete
+  uint64_t freed { 0 };
+  // the blocks on the free lists now
+  int64_t cached { 0 };
+};
+
+// The counters and the limits shared by all the block pools.
+class BlockPoolCounters final {
+ public:
+  static PoolAllocatorStats GetStats();
+
+  // The maximum number of blocks of one size each thread keeps, 1024 by
+  // default. The blocks freed over it go back to operator delete.
+  static void set_max_cached_blocks(size_t n) {
+    max_cached_blocks_.store(n, std::memory_order_relaxed);
+  }
+  static size_t max_cached_blocks() {
+    return max_cached_blocks_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  template <size_t kSize>
+  friend class BlockPool;
+
+  static std::atomic<uint64_t> allocated_;
+  static std::atomic<uint64_t> reused_;
+  static std::atomic<uint64_t> freed_;
+  static std::atomic<int64_t> cached_;
+  static std::atomic<size_t> max_cached_blocks_;
+};
+
+// Free lists of the blocks of 'kSize' bytes, one per thread, so that
+// allocating and freeing take no lock. The connections are created and
+// destroyed in the event poller threads, so each poller ends up with its
+// own pool. A block freed in another thread than the one which allocated it
+// joins the free list of the freeing thread.
+template <size_t kSize>
+class BlockPool final {
+ public:
+  static void* Allocate() {
+    auto block = head_;
+    if (block) {
+      head_ = block->next;
+      count_--;
+      BlockPoolCounters::reused_.fetch_add(1, std::memory_order_relaxed);
+      BlockPoolCounters::cached_.fetch_sub(1, std::memory_order_relaxed);
+      return block;
+    }
+    BlockPoolCounters::allocated_.fetch_add(1, std::memory_order_relaxed);
+    return ::operator new(kBlockSize);
+  }
+
+  static void Deallocate(void* ptr) {
+    assert(ptr);
+    // touching the cleaner registers it to run at the thread exit
+    if (!cleaner_.exited && count_ < BlockPoolCounters::max_cached_blocks()) {
+      auto block = static_cast<Block*>(ptr);
+      block->next = head_;
+      head_ = block;
+      count_++;
+      BlockPoolCounters::cached_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    BlockPoolCounters::freed_.fetch_add(1, std::memory_order_relaxed);
+    ::operator delete(ptr);
+  }
+
+ private:
+  struct Block {
+    Block* next;
+  };
+  static const size_t kBlockSize =
+      kSize < sizeof(Block) ? sizeof(Block) : kSize;
+
+  // Frees the blocks of the thread when it exits. The list itself is kept
+  // in trivial thread locals, which stay usable after the cleaner has run.
+  struct Cleaner {
+    bool exited { false };
+    ~Cleaner() {
+      exited = true;
+      while (head_) {
+        auto block = head_;
+        head_ = block->next;
+        BlockPoolCounters::cached_.fetch_sub(1, std::memory_order_relaxed);
+        BlockPoolCounters::freed_.fetch_add(1, std::memory_order_relaxed);
+        ::operator delete(block);
+      }
+      count_ = 0;
+    }
+  };
+
+  static thread_local Block* head_;
+  static thread_local size_t count_;
+  static thread_local Cleaner cleaner_;
+};
+
+template <size_t kSize>
+thread_local typename BlockPool<kSize>::Block* BlockPool<kSize>::head_ =
+    nullptr;
+template <size_t kSize>
+thread_local size_t BlockPool<kSize>::count_ = 0;
+template <size_t kSize>
+thread_local typename BlockPool<kSize>::Cleaner BlockPool<kSize>::cleaner_;
+
+// An allocator taking single objects from a BlockPool, for the objects
+// created and destroyed at a high rate such as the connections:
+//   auto c = std::allocate_shared<T>(base::PoolAllocator<T>(), args...);
+// std::allocate_shared() rebinds it to the type holding both the object and
+// its reference counts, so that both come from one pooled block. A class
+// with a private constructor can befriend PoolAllocator<T>.
+template <typename T>
+class PoolAllocator {
+ public:
+  using value_type = T;
+
+  PoolAllocator() = default;
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U>&) {
+  }
+
+  T* allocate(size_t n) {
+    static_assert(alignof(T) <= alignof(max_align_t),
+                  "over-aligned types aren't supported");
+    if (n != 1) {
+      return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+    return static_cast<T*>(BlockPool<sizeof(T)>::Allocate());
+  }
+
+  void deallocate(T* ptr, size_t n) {
+    if (n != 1) {
+      ::operator delete(ptr);
+      return;
+    }
+    BlockPool<sizeof(T)>::Deallocate(ptr);
+  }
+
+  template <typename U, typename... Args>
+  void construct(U* ptr, Args&&... args) {
+    ::new (static_cast<void*>(ptr)) U(std::forward<Args>(args)...);
+  }
+
+  template <typename U>
+  void destroy(U* ptr) {
+    ptr->~U();
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) {
+  return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) {
+  return false;
+}
+
+}  // namespace base
+}  // namespace cnetpp
+
+#endif  // CNETPP_BASE_POOL_ALLOCATOR_H_
+
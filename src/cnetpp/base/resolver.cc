@@ -0,0 +1,754 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include <cnetpp/base/resolver.h>
+#include <cnetpp/base/log.h>
+#include <cnetpp/base/socket.h>
+#include <cnetpp/base/string_utils.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <future>
+#include <sstream>
+#include <utility>
+
+namespace cnetpp {
+namespace base {
+
+namespace {
+
+const uint16_t kTypeA = 1;
+const uint16_t kTypeSOA = 6;
+const uint16_t kTypeAAAA = 28;
+const uint16_t kClassIN = 1;
+
+const int kRcodeNoError = 0;
+const int kRcodeNameError = 3;
+
+const size_t kHeaderSize = 12;
+const size_t kMaxNameServers = 3;
+
+std::string NormalizeHostname(const std::string& hostname) {
+  auto result = StringUtils::ToLower(hostname);
+  if (!result.empty() && result.back() == '.') {
+    result.pop_back();
+  }
+  return result;
+}
+
+void AppendUInt16(uint16_t value, std::string* packet) {
+  packet->push_back(static_cast<char>(value >> 8));
+  packet->push_back(static_cast<char>(value & 0xff));
+}
+
+uint16_t ReadUInt16(const uint8_t* data) {
+  return static_cast<uint16_t>((data[0] << 8) | data[1]);
+}
+
+uint32_t ReadUInt32(const uint8_t* data) {
+  return (static_cast<uint32_t>(data[0]) << 24) |
+         (static_cast<uint32_t>(data[1]) << 16) |
+         (static_cast<uint32_t>(data[2]) << 8) |
+         static_cast<uint32_t>(data[3]);
+}
+
+// encode 'hostname' as a sequence of labels
+bool EncodeName(const std::string& hostname, std::string* name) {
+  name->clear();
+  size_t begin = 0;
+  while (begin < hostname.length()) {
+    auto end = hostname.find('.', begin);
+    if (end == std::string::npos) {
+      end = hostname.length();
+    }
+    auto length = end - begin;
+    if (length == 0 || length > 63) {
+      return false;
+    }
+    name->push_back(static_cast<char>(length));
+    name->append(hostname, begin, length);
+    begin = end + 1;
+  }
+  name->push_back('\0');
+  return name->length() > 1 && name->length() <= 255;
+}
+
+void BuildQuery(uint16_t id,
+                const std::string& name,
+                uint16_t type,
+                std::string* packet) {
+  packet->clear();
+  AppendUInt16(id, packet);
+  AppendUInt16(0x0100, packet);  // recursion desired
+  AppendUInt16(1, packet);  // one question
+  AppendUInt16(0, packet);
+  AppendUInt16(0, packet);
+  AppendUInt16(0, packet);
+  packet->append(name);
+  AppendUInt16(type, packet);
+  AppendUInt16(kClassIN, packet);
+}
+
+// skip a name which might be compressed
+bool SkipName(const uint8_t* data, size_t size, size_t* offset) {
+  while (*offset < size) {
+    uint8_t length = data[*offset];
+    if ((length & 0xc0) == 0xc0) {
+      *offset += 2;
+      return *offset <= size;
+    } else if (length & 0xc0) {
+      return false;
+    }
+    *offset += 1 + length;
+    if (length == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+struct Answer {
+  int rcode { 0 };
+  std::vector<IPAddress> addresses;
+  uint32_t ttl { UINT32_MAX };
+  // from the SOA record in the authority section, if any
+  uint32_t negative_ttl { UINT32_MAX };
+};
+
+// parse the response to a query of 'type' for the encoded 'name'
+bool ParseResponse(const uint8_t* data,
+                   size_t size,
+                   const std::string& name,
+                   uint16_t type,
+                   Answer* answer) {
+  if (size < kHeaderSize || !(data[2] & 0x80)) {
+    return false;
+  }
+  answer->rcode = data[3] & 0x0f;
+  auto question_count = ReadUInt16(data + 4);
+  auto answer_count = ReadUInt16(data + 6);
+  auto authority_count = ReadUInt16(data + 8);
+  // the question must be ours
+  size_t offset = kHeaderSize;
+  if (question_count != 1 ||
+      size < offset + name.length() + 4 ||
+      ::strncasecmp(reinterpret_cast<const char*>(data + offset),
+                    name.data(),
+                    name.length()) != 0 ||
+      ReadUInt16(data + offset + name.length()) != type) {
+    return false;
+  }
+  offset += name.length() + 4;
+
+  for (int i = 0; i < answer_count + authority_count; ++i) {
+    if (!SkipName(data, size, &offset) || offset + 10 > size) {
+      return false;
+    }
+    auto record_type = ReadUInt16(data + offset);
+    auto record_class = ReadUInt16(data + offset + 2);
+    auto ttl = ReadUInt32(data + offset + 4);
+    size_t length = ReadUInt16(data + offset + 8);
+    offset += 10;
+    if (offset + length > size) {
+      return false;
+    }
+    if (record_class != kClassIN) {
+      offset += length;
+      continue;
+    }
+    if (i < answer_count) {
+      // CNAME records are skipped, recursive name servers append the
+      // records of the canonical name
+      if (record_type == type &&
+          length == (type == kTypeA ? 4u : 16u)) {
+        IPAddress address;
+        address.mutable_address().assign(data + offset,
+                                          data + offset + length);
+        answer->addresses.emplace_back(std::move(address));
+        answer->ttl = std::min(answer->ttl, ttl);
+      }
+    } else if (record_type == kTypeSOA) {
+      // RFC 2308, a negative answer lives for the smaller one of the TTL and
+      // the MINIMUM field of the SOA record
+      size_t soa_offset = offset;
+      if (SkipName(data, size, &soa_offset) &&
+          SkipName(data, size, &soa_offset) &&
+          soa_offset + 20 <= offset + length) {
+        auto minimum = ReadUInt32(data + soa_offset + 16);
+        answer->negative_ttl = std::min(ttl, minimum);
+      }
+    }
+    offset += length;
+  }
+  return true;
+}
+
+}  // namespace
+
+std::shared_ptr<Resolver> Resolver::Default() {
+  static std::shared_ptr<Resolver> resolver = [] () {
+    auto resolver = std::make_shared<Resolver>();
+    if (!resolver->Launch()) {
+      CnetppError("Failed to launch the default resolver");
+    }
+    return resolver;
+  }();
+  return resolver;
+}
+
+Resolver::Resolver(const ResolverOptions& options)
+    : options_(options),
+      random_(std::random_device()()) {
+}
+
+Resolver::~Resolver() {
+  Shutdown();
+}
+
+bool Resolver::Launch() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (running_) {
+    return true;
+  }
+
+  LoadHosts();
+  name_servers_ = options_.name_servers();
+  if (name_servers_.empty()) {
+    LoadResolvConf();
+  }
+  for (auto& name_server : name_servers_) {
+    UdpSocket socket;
+    if (!socket.Create(name_server.Family() == AF_INET6) ||
+        !socket.SetCloexec(true) ||
+        !socket.SetBlocking(false) ||
+        socket.Connect(name_server) < 0) {
+      CnetppError("Failed to create socket for name server %s, Error: %s",
+                  name_server.ToString().c_str(),
+                  Socket::GetLastErrorString().c_str());
+      return false;
+    }
+    name_server_fds_.push_back(socket.Detach());
+  }
+  if (name_servers_.empty()) {
+    CnetppInfo("No name server found, resolve names with getaddrinfo");
+  }
+
+  if (::pipe(wakeup_fds_) < 0) {
+    return false;
+  }
+  for (auto fd : wakeup_fds_) {
+    ::fcntl(fd, F_SETFL, O_NONBLOCK);
+    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+  }
+
+  running_ = true;
+  thread_.reset(new std::thread([this] () { Run(); }));
+  return true;
+}
+
+void Resolver::Shutdown() {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (!running_) {
+      return;
+    }
+    running_ = false;
+  }
+  Wakeup();
+  thread_->join();
+  thread_.reset();
+
+  for (auto fd : name_server_fds_) {
+    ::close(fd);
+  }
+  name_server_fds_.clear();
+  for (auto& fd : wakeup_fds_) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+void Resolver::AsyncResolve(const std::string& hostname,
+                            CallbackType callback) {
+  assert(callback);
+  auto name = NormalizeHostname(hostname);
+  if (name.empty()) {
+    callback(false, std::vector<IPAddress>());
+    return;
+  }
+
+  std::unique_lock<std::mutex> guard(mutex_);
+  bool found = false;
+  std::vector<IPAddress> addresses;
+  if (LookupLocally(name, &found, &addresses)) {
+    guard.unlock();
+    callback(found, addresses);
+    return;
+  }
+  if (!running_) {
+    guard.unlock();
+    callback(false, addresses);
+    return;
+  }
+
+  auto itr = lookups_.find(name);
+  if (itr != lookups_.end()) {
+    // somebody is looking it up already
+    itr->second->callbacks.emplace_back(std::move(callback));
+    return;
+  }
+  auto lookup = std::make_shared<Lookup>();
+  lookup->hostname = name;
+  lookup->callbacks.emplace_back(std::move(callback));
+  lookups_[name] = lookup;
+  new_lookups_.emplace_back(std::move(lookup));
+  guard.unlock();
+  Wakeup();
+}
+
+bool Resolver::Resolve(const std::string& hostname,
+                       std::vector<IPAddress>* addresses) {
+  assert(addresses);
+  std::promise<bool> promise;
+  auto future = promise.get_future();
+  AsyncResolve(hostname,
+      [&promise, addresses] (bool found,
+                             const std::vector<IPAddress>& result) {
+    *addresses = result;
+    promise.set_value(found);
+  });
+  return future.get();
+}
+
+bool Resolver::LoadResolvConf() {
+  std::ifstream file(options_.resolv_conf_path());
+  if (!file) {
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line) && name_servers_.size() < kMaxNameServers) {
+    std::istringstream iss(line);
+    std::string keyword;
+    std::string address;
+    if (!(iss >> keyword >> address) || keyword != "nameserver") {
+      continue;
+    }
+    IPAddress ip;
+    // the scoped IPv6 addresses aren't supported
+    if (!IPAddress::LiteralToNumber(address, &ip)) {
+      continue;
+    }
+    name_servers_.emplace_back(std::move(ip), 53);
+  }
+  return true;
+}
+
+bool Resolver::LoadHosts() {
+  std::ifstream file(options_.hosts_path());
+  if (!file) {
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    auto comment = line.find('#');
+    if (comment != std::string::npos) {
+      line.resize(comment);
+    }
+    std::istringstream iss(line);
+    std::string address;
+    IPAddress ip;
+    if (!(iss >> address) || !IPAddress::LiteralToNumber(address, &ip)) {
+      continue;
+    }
+    // the connections are IPv4 only unless IPv6 is asked for
+    if (ip.Family() == AF_INET6 && !options_.enable_ipv6()) {
+      continue;
+    }
+    std::string name;
+    while (iss >> name) {
+      hosts_[NormalizeHostname(name)].push_back(ip);
+    }
+  }
+  return true;
+}
+
+bool Resolver::LookupLocally(const std::string& hostname,
+                             bool* found,
+                             std::vector<IPAddress>* addresses) {
+  IPAddress ip;
+  if (IPAddress::LiteralToNumber(hostname, &ip)) {
+    *found = true;
+    addresses->assign(1, ip);
+    return true;
+  }
+
+  auto hosts_itr = hosts_.find(hostname);
+  if (hosts_itr != hosts_.end()) {
+    *found = true;
+    *addresses = hosts_itr->second;
+    return true;
+  }
+
+  auto cache_itr = cache_.find(hostname);
+  if (cache_itr == cache_.end()) {
+    return false;
+  }
+  if (cache_itr->second.expire_time <= Clock::now()) {
+    cache_.erase(cache_itr);
+    return false;
+  }
+  *found = cache_itr->second.found;
+  *addresses = NextAddresses(&cache_itr->second);
+  return true;
+}
+
+std::vector<IPAddress> Resolver::NextAddresses(CacheEntry* entry) {
+  std::vector<IPAddress> addresses;
+  auto size = entry->addresses.size();
+  if (size == 0) {
+    return addresses;
+  }
+  addresses.reserve(size);
+  auto start = entry->next++ % size;
+  for (size_t i = 0; i < size; ++i) {
+    addresses.push_back(entry->addresses[(start + i) % size]);
+  }
+  return addresses;
+}
+
+void Resolver::AddToCache(const std::string& hostname,
+                          bool found,
+                          const std::vector<IPAddress>& addresses,
+                          uint32_t ttl) {
+  ttl = std::max(options_.min_ttl(), std::min(options_.max_ttl(), ttl));
+  auto now = Clock::now();
+  if (cache_.size() >= options_.max_cache_size()) {
+    for (auto itr = cache_.begin(); itr != cache_.end(); ) {
+      if (itr->second.expire_time <= now) {
+        itr = cache_.erase(itr);
+      } else {
+        ++itr;
+      }
+    }
+    if (cache_.size() >= options_.max_cache_size() && !cache_.empty()) {
+      cache_.erase(cache_.begin());
+    }
+  }
+  auto& entry = cache_[hostname];
+  entry.found = found;
+  entry.addresses = addresses;
+  entry.expire_time = now + std::chrono::seconds(ttl);
+  entry.next = 0;
+}
+
+void Resolver::Wakeup() {
+  char byte = 0;
+  if (::write(wakeup_fds_[1], &byte, 1) < 0 && errno != EAGAIN) {
+    CnetppError("Failed to wake up the resolver thread, Error: %s",
+                Socket::GetLastErrorString().c_str());
+  }
+}
+
+void Resolver::Run() {
+  std::vector<struct pollfd> poll_fds(name_server_fds_.size() + 1);
+  poll_fds[0].fd = wakeup_fds_[0];
+  for (size_t i = 0; i < name_server_fds_.size(); ++i) {
+    poll_fds[i + 1].fd = name_server_fds_[i];
+  }
+  for (auto& poll_fd : poll_fds) {
+    poll_fd.events = POLLIN;
+  }
+
+  while (true) {
+    std::deque<std::shared_ptr<Lookup>> new_lookups;
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      if (!running_) {
+        break;
+      }
+      new_lookups.swap(new_lookups_);
+    }
+    for (auto& lookup : new_lookups) {
+      StartLookup(std::move(lookup));
+    }
+
+    auto now = Clock::now();
+    HandleTimeouts(now);
+    int timeout = -1;
+    for (auto& query : queries_) {
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+          query.second.deadline - now).count() + 1;
+      if (timeout < 0 || left < timeout) {
+        timeout = static_cast<int>(std::max<int64_t>(left, 0));
+      }
+    }
+
+    int n = ::poll(poll_fds.data(), poll_fds.size(), timeout);
+    if (n < 0) {
+      if (errno != EINTR) {
+        CnetppError("Failed to poll in the resolver thread, Error: %s",
+                    Socket::GetLastErrorString().c_str());
+      }
+      continue;
+    }
+    if (poll_fds[0].revents & POLLIN) {
+      char data[64];
+      while (::read(wakeup_fds_[0], data, sizeof(data)) > 0) {
+      }
+    }
+    for (size_t i = 1; i < poll_fds.size(); ++i) {
+      if (poll_fds[i].revents & (POLLIN | POLLERR)) {
+        HandleResponse(poll_fds[i].fd);
+      }
+    }
+  }
+
+  // fail the pending lookups
+  queries_.clear();
+  std::unordered_map<std::string, std::shared_ptr<Lookup>> lookups;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    lookups.swap(lookups_);
+    new_lookups_.clear();
+  }
+  for (auto& lookup : lookups) {
+    for (auto& callback : lookup.second->callbacks) {
+      callback(false, std::vector<IPAddress>());
+    }
+  }
+}
+
+void Resolver::StartLookup(std::shared_ptr<Lookup> lookup) {
+  if (name_servers_.empty()) {
+    ResolveWithGetAddrInfo(std::move(lookup));
+    return;
+  }
+  std::vector<uint16_t> types { kTypeA };
+  if (options_.enable_ipv6()) {
+    types.push_back(kTypeAAAA);
+  }
+  lookup->outstanding = static_cast<int>(types.size());
+  for (auto type : types) {
+    Query query;
+    query.lookup = lookup;
+    query.type = type;
+    SendQuery(&query);
+  }
+}
+
+void Resolver::ResolveWithGetAddrInfo(std::shared_ptr<Lookup> lookup) {
+  struct addrinfo *presults = nullptr;
+  struct addrinfo hint;
+  ::memset(&hint, 0, sizeof(hint));
+  hint.ai_family = options_.enable_ipv6() ? AF_UNSPEC : AF_INET;
+  hint.ai_socktype = SOCK_STREAM;
+  auto res = ::getaddrinfo(lookup->hostname.c_str(),
+                           nullptr,
+                           &hint,
+                           &presults);
+  if (res == 0) {
+    for (auto p = presults; p; p = p->ai_next) {
+      EndPoint end_point;
+      if (!end_point.FromSockAddr(*p->ai_addr, p->ai_addrlen)) {
+        continue;
+      }
+      // there is an item for each socket type
+      auto duplicated = std::any_of(lookup->addresses.begin(),
+                                    lookup->addresses.end(),
+                                    [&end_point] (const IPAddress& address) {
+        return address.address() == end_point.address().address();
+      });
+      if (!duplicated) {
+        lookup->addresses.push_back(end_point.address());
+      }
+    }
+    ::freeaddrinfo(presults);
+    lookup->ttl = options_.fallback_ttl();
+  } else if (res == EAI_NONAME) {
+    lookup->not_found = true;
+  } else {
+    lookup->failed = true;
+  }
+  FinishLookup(std::move(lookup));
+}
+
+void Resolver::SendQuery(Query* query) {
+  std::string name;
+  if (!EncodeName(query->lookup->hostname, &name)) {
+    query->lookup->not_found = true;
+    FinishQuery(*query);
+    return;
+  }
+  uint16_t id;
+  do {
+    id = static_cast<uint16_t>(random_());
+  } while (queries_.find(id) != queries_.end());
+  query->id = id;
+
+  std::string packet;
+  BuildQuery(id, name, query->type, &packet);
+  auto fd = name_server_fds_[query->sent % name_server_fds_.size()];
+  // a failed send is retried when it times out
+  if (::send(fd, packet.data(), packet.length(), 0) < 0) {
+    CnetppDebug("Failed to send query for %s, Error: %s",
+                query->lookup->hostname.c_str(),
+                Socket::GetLastErrorString().c_str());
+  }
+  queries_sent_++;
+  query->sent++;
+  query->deadline = Clock::now() + std::chrono::milliseconds(options_.timeout());
+  queries_[id] = std::move(*query);
+}
+
+void Resolver::HandleResponse(int fd) {
+  uint8_t data[4096];
+  while (true) {
+    auto n = ::recv(fd, data, sizeof(data), 0);
+    if (n < 0) {
+      // ECONNREFUSED and alike are reported here, the query just times out
+      return;
+    }
+    if (static_cast<size_t>(n) < kHeaderSize) {
+      continue;
+    }
+    auto itr = queries_.find(ReadUInt16(data));
+    if (itr == queries_.end()) {
+      continue;
+    }
+    auto& query = itr->second;
+    // it must come from the name server the query was sent to
+    if (name_server_fds_[(query.sent - 1) % name_server_fds_.size()] != fd) {
+      continue;
+    }
+    std::string name;
+    EncodeName(query.lookup->hostname, &name);
+    Answer answer;
+    if (!ParseResponse(data, n, name, query.type, &answer)) {
+      continue;
+    }
+
+    auto lookup = query.lookup;
+    if (answer.rcode == kRcodeNoError || answer.rcode == kRcodeNameError) {
+      if (answer.addresses.empty()) {
+        lookup->not_found = true;
+        lookup->negative_ttl = std::min(lookup->negative_ttl,
+                                        answer.negative_ttl);
+      } else {
+        lookup->addresses.insert(lookup->addresses.end(),
+                                 answer.addresses.begin(),
+                                 answer.addresses.end());
+        lookup->ttl = std::min(lookup->ttl, answer.ttl);
+      }
+      Query finished = std::move(query);
+      queries_.erase(itr);
+      FinishQuery(finished);
+      continue;
+    }
+
+    // the name server failed, try the next one right away
+    Query retried = std::move(query);
+    queries_.erase(itr);
+    if (retried.sent < options_.attempts() *
+                       static_cast<int>(name_server_fds_.size())) {
+      SendQuery(&retried);
+    } else {
+      lookup->failed = true;
+      FinishQuery(retried);
+    }
+  }
+}
+
+void Resolver::HandleTimeouts(Clock::time_point now) {
+  std::vector<uint16_t> expired;
+  for (auto& query : queries_) {
+    if (query.second.deadline <= now) {
+      expired.push_back(query.first);
+    }
+  }
+  for (auto id : expired) {
+    auto itr = queries_.find(id);
+    Query query = std::move(itr->second);
+    queries_.erase(itr);
+    if (query.sent < options_.attempts() *
+                     static_cast<int>(name_server_fds_.size())) {
+      SendQuery(&query);
+    } else {
+      CnetppWarn("Timed out resolving %s", query.lookup->hostname.c_str());
+      query.lookup->failed = true;
+      FinishQuery(query);
+    }
+  }
+}
+
+void Resolver::FinishQuery(const Query& query) {
+  if (--query.lookup->outstanding == 0) {
+    FinishLookup(query.lookup);
+  }
+}
+
+void Resolver::FinishLookup(std::shared_ptr<Lookup> lookup) {
+  bool found = !lookup->addresses.empty();
+  std::vector<CallbackType> callbacks;
+  std::vector<std::vector<IPAddress>> answers;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    callbacks.swap(lookup->callbacks);
+    lookups_.erase(lookup->hostname);
+    if (found) {
+      AddToCache(lookup->hostname, true, lookup->addresses, lookup->ttl);
+    } else if (lookup->not_found && !lookup->failed) {
+      // the ttl told by a SOA record wins over the configured one
+      uint32_t ttl = lookup->negative_ttl;
+      if (ttl == UINT32_MAX) {
+        ttl = options_.negative_ttl();
+      }
+      AddToCache(lookup->hostname, false, lookup->addresses, ttl);
+    }
+    auto itr = cache_.find(lookup->hostname);
+    for (size_t i = 0; i < callbacks.size(); ++i) {
+      if (found && itr != cache_.end()) {
+        answers.emplace_back(NextAddresses(&itr->second));
+      } else {
+        answers.emplace_back(lookup->addresses);
+      }
+    }
+  }
+  for (size_t i = 0; i < callbacks.size(); ++i) {
+    callbacks[i](found, answers[i]);
+  }
+}
+
+}  // namespace base
+}  // namespace cnetpp
+
@@ -0,0 +1,287 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef CNETPP_BASE_RESOLVER_H_
+#define CNETPP_BASE_RESOLVER_H_
+
+#include <cnetpp/base/end_point.h>
+#include <cnetpp/base/ip_address.h>
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace cnetpp {
+namespace base {
+
+class ResolverOptions final {
+ public:
+  ResolverOptions() = default;
+  ~ResolverOptions() = default;
+
+  // The name servers to query, the ones listed in resolv_conf_path() are used
+  // if it is empty. If there is still none, names are resolved through
+  // getaddrinfo(3) in the resolver thread.
+  const std::vector<EndPoint>& name_servers() const {
+    return name_servers_;
+  }
+  void set_name_servers(const std::vector<EndPoint>& name_servers) {
+    name_servers_ = name_servers;
+  }
+
+  const std::string& resolv_conf_path() const {
+    return resolv_conf_path_;
+  }
+  void set_resolv_conf_path(const std::string& resolv_conf_path) {
+    resolv_conf_path_ = resolv_conf_path;
+  }
+
+  const std::string& hosts_path() const {
+    return hosts_path_;
+  }
+  void set_hosts_path(const std::string& hosts_path) {
+    hosts_path_ = hosts_path;
+  }
+
+  // in milliseconds, how long to wait for an answer before retrying with the
+  // next name server
+  int64_t timeout() const {
+    return timeout_;
+  }
+  void set_timeout(int64_t timeout) {
+    timeout_ = timeout;
+  }
+
+  // how many times each name server is tried
+  int attempts() const {
+    return attempts_;
+  }
+  void set_attempts(int attempts) {
+    attempts_ = attempts;
+  }
+
+  // query AAAA records along with A records
+  bool enable_ipv6() const {
+    return enable_ipv6_;
+  }
+  void set_enable_ipv6(bool enable_ipv6) {
+    enable_ipv6_ = enable_ipv6;
+  }
+
+  // in seconds, the TTLs of the answers are clamped into [min_ttl, max_ttl]
+  uint32_t min_ttl() const {
+    return min_ttl_;
+  }
+  void set_min_ttl(uint32_t min_ttl) {
+    min_ttl_ = min_ttl;
+  }
+
+  uint32_t max_ttl() const {
+    return max_ttl_;
+  }
+  void set_max_ttl(uint32_t max_ttl) {
+    max_ttl_ = max_ttl;
+  }
+
+  // in seconds, how long a name known not to exist is cached if the name
+  // server doesn't tell it through a SOA record
+  uint32_t negative_ttl() const {
+    return negative_ttl_;
+  }
+  void set_negative_ttl(uint32_t negative_ttl) {
+    negative_ttl_ = negative_ttl;
+  }
+
+  // in seconds, how long the answers of getaddrinfo(3) are cached
+  uint32_t fallback_ttl() const {
+    return fallback_ttl_;
+  }
+  void set_fallback_ttl(uint32_t fallback_ttl) {
+    fallback_ttl_ = fallback_ttl;
+  }
+
+  size_t max_cache_size() const {
+    return max_cache_size_;
+  }
+  void set_max_cache_size(size_t max_cache_size) {
+    max_cache_size_ = max_cache_size;
+  }
+
+ private:
+  std::vector<EndPoint> name_servers_;
+  std::string resolv_conf_path_ { "/etc/resolv.conf" };
+  std::string hosts_path_ { "/etc/hosts" };
+  int64_t timeout_ { 2000 };
+  int attempts_ { 2 };
+  bool enable_ipv6_ { false };
+  uint32_t min_ttl_ { 0 };
+  uint32_t max_ttl_ { 3600 };
+  uint32_t negative_ttl_ { 30 };
+  uint32_t fallback_ttl_ { 60 };
+  size_t max_cache_size_ { 10000 };
+};
+
+// An asynchronous DNS stub resolver. Queries are sent over UDP by a dedicated
+// thread, so a slow name server never blocks the callers. Names in the hosts
+// file and IP literals are answered right away, answers from the name servers
+// are cached for their TTL, including the negative ones. Concurrent lookups
+// of the same name share one query, and each answer lists the addresses of a
+// name starting from the next one in turn, so that callers picking the first
+// address spread over all of them.
+class Resolver final {
+ public:
+  // Called with true and the addresses of the name, or with false and an
+  // empty list if the name can't be resolved.
+  using CallbackType =
+      std::function<void(bool, const std::vector<IPAddress>&)>;
+
+  // The resolver shared by the process, created and launched on first use
+  // with the default options.
+  static std::shared_ptr<Resolver> Default();
+
+  explicit Resolver(const ResolverOptions& options = ResolverOptions());
+  ~Resolver();
+
+  // disallow copy and move operations
+  Resolver(const Resolver&) = delete;
+  Resolver& operator=(const Resolver&) = delete;
+  Resolver(Resolver&&) = delete;
+  Resolver& operator=(Resolver&&) = delete;
+
+  bool Launch();
+  void Shutdown();
+
+  // 'callback' is called in the resolver thread, or right away in the
+  // caller's thread if the answer is already known. The pending lookups are
+  // failed when the resolver is shut down.
+  void AsyncResolve(const std::string& hostname, CallbackType callback);
+
+  // Block the caller until 'hostname' is resolved.
+  bool Resolve(const std::string& hostname, std::vector<IPAddress>* addresses);
+
+  // exposed for tests
+  size_t queries_sent() const {
+    return queries_sent_;
+  }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct CacheEntry {
+    bool found { false };
+    std::vector<IPAddress> addresses;
+    Clock::time_point expire_time;
+    // where the next answer starts in 'addresses'
+    size_t next { 0 };
+  };
+
+  struct Lookup {
+    std::string hostname;
+    std::vector<CallbackType> callbacks;
+    // the queries not answered yet, one per record type
+    int outstanding { 0 };
+    std::vector<IPAddress> addresses;
+    uint32_t ttl { UINT32_MAX };
+    // a name server said the name has no address of some type
+    bool not_found { false };
+    uint32_t negative_ttl { UINT32_MAX };
+    // a query timed out or the name servers refused it
+    bool failed { false };
+  };
+
+  struct Query {
+    std::shared_ptr<Lookup> lookup;
+    uint16_t type { 0 };
+    uint16_t id { 0 };
+    // the number of sends, it also picks the name server
+    int sent { 0 };
+    Clock::time_point deadline;
+  };
+
+  ResolverOptions options_;
+
+  std::vector<EndPoint> name_servers_;
+  std::vector<int> name_server_fds_;
+  std::unordered_map<std::string, std::vector<IPAddress>> hosts_;
+
+  std::mutex mutex_;
+  std::unordered_map<std::string, CacheEntry> cache_;
+  std::unordered_map<std::string, std::shared_ptr<Lookup>> lookups_;
+  // the lookups waiting to be picked up by the resolver thread
+  std::deque<std::shared_ptr<Lookup>> new_lookups_;
+  bool running_ { false };
+
+  int wakeup_fds_[2] { -1, -1 };
+  std::unique_ptr<std::thread> thread_;
+
+  // the following are only accessed in the resolver thread
+  std::unordered_map<uint16_t, Query> queries_;
+  std::mt19937 random_;
+
+  std::atomic<size_t> queries_sent_ { 0 };
+
+  bool LoadResolvConf();
+  bool LoadHosts();
+
+  // look up the hosts file, the IP literals and the cache
+  // NOTE: mutex_ must be held
+  bool LookupLocally(const std::string& hostname,
+                     bool* found,
+                     std::vector<IPAddress>* addresses);
+  // NOTE: mutex_ must be held
+  static std::vector<IPAddress> NextAddresses(CacheEntry* entry);
+  // NOTE: mutex_ must be held
+  void AddToCache(const std::string& hostname,
+                  bool found,
+                  const std::vector<IPAddress>& addresses,
+                  uint32_t ttl);
+
+  void Run();
+  void Wakeup();
+  void StartLookup(std::shared_ptr<Lookup> lookup);
+  void ResolveWithGetAddrInfo(std::shared_ptr<Lookup> lookup);
+  void SendQuery(Query* query);
+  void HandleResponse(int fd);
+  void HandleTimeouts(Clock::time_point now);
+  void FinishQuery(const Query& query);
+  void FinishLookup(std::shared_ptr<Lookup> lookup);
+};
+
+}  // namespace base
+}  // namespace cnetpp
+
+#endif  // CNETPP_BASE_RESOLVER_H_
+
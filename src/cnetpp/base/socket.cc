@@ -27,7 +27,14 @@
 #include <cnetpp/base/socket.h>
 #include <cnetpp/base/log.h>
 
+#include <string.h>
 #include <sys/uio.h>
+#if defined(linux) || defined(__linux) || defined(__linux__)
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#endif
+
+#include <algorithm>
 
 namespace cnetpp {
 namespace base {
@@ -289,6 +296,49 @@ bool DataSocket::Send(const struct iovec* buffer,
   }
 }
 
+bool DataSocket::SendFile(int in_fd,
+                          off_t* offset,
+                          size_t count,
+                          size_t* sent_length,
+                          bool auto_restart) {
+  while (true) {
+#if defined(linux) || defined(__linux) || defined(__linux__)
+    ssize_t n = 0;
+    if (offset) {
+      n = ::sendfile(fd(), in_fd, offset, count);
+    } else {
+      n = ::splice(in_fd, nullptr, fd(), nullptr, count,
+                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    }
+#else
+    // no zero-copy interface, fall back to copying through a small buffer
+    if (!offset) {
+      errno = ENOSYS;
+      *sent_length = 0;
+      return false;
+    }
+    char buffer[64 * 1024];
+    ssize_t n = ::pread(in_fd, buffer, std::min(count, sizeof(buffer)),
+                        *offset);
+    if (n > 0) {
+      n = send(fd(), buffer, n, 0);
+      if (n > 0) {
+        *offset += n;
+      }
+    }
+#endif
+    if (n != -1) {
+      *sent_length = n;
+      return true;
+    } else {
+      if (!IsInterruptedAndRestart(auto_restart)) {
+        *sent_length = 0;
+        return false;
+      }
+    }
+  }
+}
+
 bool DataSocket::Receive(void* buffer,
                          size_t buffer_size,
                          size_t* received_size,
@@ -591,6 +641,139 @@ bool UdpSocket::ReceiveFrom(void* buffer,
   return false;
 }
 
+// Following member methods are for UnixSocket
+namespace {
+
+bool ToUnixAddress(const std::string& path, struct sockaddr_un* address) {
+  if (path.empty() || path.size() >= sizeof(address->sun_path)) {
+    return false;
+  }
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  memcpy(address->sun_path, path.data(), path.size());
+  return true;
+}
+
+#ifdef MSG_NOSIGNAL
+const int kSendFdFlags = MSG_NOSIGNAL;
+#else
+const int kSendFdFlags = 0;
+#endif
+#ifdef MSG_CMSG_CLOEXEC
+const int kReceiveFdFlags = MSG_CMSG_CLOEXEC;
+#else
+const int kReceiveFdFlags = 0;
+#endif
+
+}  // namespace
+
+bool UnixSocket::Bind(const std::string& path) {
+  struct sockaddr_un address;
+  if (!ToUnixAddress(path, &address)) {
+    return false;
+  }
+  return bind(fd(), reinterpret_cast<struct sockaddr*>(&address),
+              sizeof(address)) == 0;
+}
+
+bool UnixSocket::Connect(const std::string& path) {
+  struct sockaddr_un address;
+  if (!ToUnixAddress(path, &address)) {
+    return false;
+  }
+  while (true) {
+    if (connect(fd(), reinterpret_cast<struct sockaddr*>(&address),
+                sizeof(address)) == 0) {
+      return true;
+    }
+    if (GetLastError() != EINTR) {
+      return false;
+    }
+  }
+}
+
+bool UnixSocket::Accept(UnixSocket* socket, bool auto_restart) {
+  assert(socket);
+  while (true) {
+    int ret = accept(fd(), nullptr, nullptr);
+    if (ret != -1) {
+      socket->Attach(ret);
+      return true;
+    } else if (!auto_restart || GetLastError() != EINTR) {
+      break;
+    }
+  }
+  return false;
+}
+
+bool UnixSocket::SendFd(int passed_fd) {
+  char data = 0;
+  struct iovec buffer;
+  buffer.iov_base = &data;
+  buffer.iov_len = 1;
+  union {
+    struct cmsghdr header;
+    char space[CMSG_SPACE(sizeof(int))];
+  } control;
+  memset(&control, 0, sizeof(control));
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &buffer;
+  message.msg_iovlen = 1;
+  message.msg_control = control.space;
+  message.msg_controllen = sizeof(control.space);
+  struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+  header->cmsg_level = SOL_SOCKET;
+  header->cmsg_type = SCM_RIGHTS;
+  header->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(header), &passed_fd, sizeof(int));
+  while (true) {
+    ssize_t n = sendmsg(fd(), &message, kSendFdFlags);
+    if (n == 1) {
+      return true;
+    } else if (n == -1 && GetLastError() != EINTR) {
+      return false;
+    }
+  }
+}
+
+bool UnixSocket::ReceiveFd(int* received_fd) {
+  assert(received_fd);
+  char data = 0;
+  struct iovec buffer;
+  buffer.iov_base = &data;
+  buffer.iov_len = 1;
+  union {
+    struct cmsghdr header;
+    char space[CMSG_SPACE(sizeof(int))];
+  } control;
+  memset(&control, 0, sizeof(control));
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &buffer;
+  message.msg_iovlen = 1;
+  message.msg_control = control.space;
+  message.msg_controllen = sizeof(control.space);
+  ssize_t n = -1;
+  do {
+    n = recvmsg(fd(), &message, kReceiveFdFlags);
+  } while (n == -1 && GetLastError() == EINTR);
+  if (n != 1) {
+    return false;
+  }
+  struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+  if (!header || header->cmsg_level != SOL_SOCKET ||
+      header->cmsg_type != SCM_RIGHTS ||
+      header->cmsg_len != CMSG_LEN(sizeof(int))) {
+    return false;
+  }
+  memcpy(received_fd, CMSG_DATA(header), sizeof(int));
+#ifndef MSG_CMSG_CLOEXEC
+  fcntl(*received_fd, F_SETFD, FD_CLOEXEC);
+#endif
+  return true;
+}
+
 }  // namespace base
 }  // namespace cnetpp
 
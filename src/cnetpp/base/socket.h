@@ -329,6 +329,16 @@ class DataSocket : public Socket {
             size_t* sent_length,
             bool auto_restart = true);
 
+  // Send at most 'count' bytes of 'in_fd' without copying them through user
+  // space. For a regular file the data starts at '*offset', which is advanced
+  // by the number of bytes sent. For a pipe 'offset' must be nullptr, the
+  // data is moved out of the pipe with splice(2), Linux only.
+  bool SendFile(int in_fd,
+                off_t* offset,
+                size_t count,
+                size_t* sent_length,
+                bool auto_restart = true);
+
   // @return Whether received any data or connect close by peer.
   // @note If connection is closed by peer, return true and received_size
   //       is set to 0.
@@ -555,6 +565,31 @@ class UdpSocket : public DataSocket {
                    int flags = 0);
 };
 
+// Represent a unix domain stream socket, which is used to pass file
+// descriptors between processes
+class UnixSocket : public Socket {
+ public:
+  UnixSocket() {}
+
+  bool Create() {
+    return Socket::Create(AF_UNIX, SOCK_STREAM, 0);
+  }
+
+  // 'path' must be shorter than sizeof(sockaddr_un::sun_path)
+  bool Bind(const std::string& path);
+  bool Connect(const std::string& path);
+  bool Listen(int backlog = SOMAXCONN) {
+    return listen(fd(), backlog) == 0;
+  }
+  bool Accept(UnixSocket* socket, bool auto_restart = true);
+
+  // Send 'passed_fd' to the peer with SCM_RIGHTS, the peer gets a new
+  // descriptor referring to the same open file
+  bool SendFd(int passed_fd);
+  // Receive a descriptor sent by SendFd(), it is close-on-exec
+  bool ReceiveFd(int* received_fd);
+};
+
 }  // namespace base
 }  // namespace cnetpp
 
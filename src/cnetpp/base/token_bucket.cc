@@ -0,0 +1,77 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include <cnetpp/base/token_bucket.h>
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace cnetpp {
+namespace base {
+
+TokenBucket::TokenBucket(double rate, double burst)
+    : rate_(rate),
+      burst_(std::max(burst, 1.0)),
+      tokens_(burst_),
+      last_refill_(Clock::now()) {
+}
+
+void TokenBucket::Refill() {
+  auto now = Clock::now();
+  std::chrono::duration<double> elapsed = now - last_refill_;
+  last_refill_ = now;
+  tokens_ = std::min(burst_, tokens_ + elapsed.count() * rate_);
+}
+
+double TokenBucket::Available() {
+  Refill();
+  return tokens_;
+}
+
+bool TokenBucket::TryConsume(double count) {
+  Refill();
+  if (tokens_ < count) {
+    return false;
+  }
+  tokens_ -= count;
+  return true;
+}
+
+int64_t TokenBucket::TimeUntilAvailable(double count) {
+  Refill();
+  if (tokens_ >= count) {
+    return 0;
+  }
+  if (rate_ <= 0) {
+    return INT64_MAX;
+  }
+  return static_cast<int64_t>(ceil((count - tokens_) * 1000 / rate_));
+}
+
+}  // namespace base
+}  // namespace cnetpp
+
@@ -0,0 +1,74 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef CNETPP_BASE_TOKEN_BUCKET_H_
+#define CNETPP_BASE_TOKEN_BUCKET_H_
+
+#include <stdint.h>
+
+#include <chrono>
+
+namespace cnetpp {
+namespace base {
+
+// A bucket refilled with 'rate' tokens per second up to 'burst' tokens,
+// it starts full. It isn't thread safe.
+class TokenBucket final {
+ public:
+  TokenBucket(double rate, double burst);
+
+  double rate() const {
+    return rate_;
+  }
+  double burst() const {
+    return burst_;
+  }
+
+  // The tokens in the bucket now
+  double Available();
+
+  // Take 'count' tokens if there are enough of them
+  bool TryConsume(double count = 1);
+
+  // The milliseconds until 'count' tokens are available, 0 if they are now
+  int64_t TimeUntilAvailable(double count = 1);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  double rate_;
+  double burst_;
+  double tokens_;
+  Clock::time_point last_refill_;
+
+  void Refill();
+};
+
+}  // namespace base
+}  // namespace cnetpp
+
+#endif  // CNETPP_BASE_TOKEN_BUCKET_H_
+
@@ -0,0 +1,155 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef CNETPP_CONCURRENCY_EVENT_COUNT_H_
+#define CNETPP_CONCURRENCY_EVENT_COUNT_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+namespace cnetpp {
+namespace concurrency {
+
+// Lets the threads wait for a condition checked without any lock, such as
+// "one of the queues is not empty", and costs a single load to the
+// notifiers when nobody waits. A waiter does:
+//   auto key = event_count.PrepareWait();
+//   if (condition) {
+//     event_count.CancelWait();
+//   } else {
+//     event_count.Wait(key);
+//   }
+// and a notifier makes the condition true, then calls Notify(). The wakeup
+// can't be lost in between, since Notify() moves the epoch taken by
+// PrepareWait() whenever a waiter has registered before it.
+class EventCount final {
+ public:
+  using Key = uint32_t;
+
+  EventCount() = default;
+
+  // disallow copy and move operations
+  EventCount(const EventCount&) = delete;
+  EventCount& operator=(const EventCount&) = delete;
+
+  Key PrepareWait() {
+    uint64_t state = state_.fetch_add(kWaiter, std::memory_order_seq_cst);
+    return static_cast<Key>(state >> kEpochShift);
+  }
+
+  void CancelWait() {
+    state_.fetch_sub(kWaiter, std::memory_order_seq_cst);
+  }
+
+  void Wait(Key key) {
+    {
+      std::unique_lock<std::mutex> guard(mutex_);
+      while (Epoch() == key) {
+        cv_.wait(guard);
+      }
+    }
+    state_.fetch_sub(kWaiter, std::memory_order_seq_cst);
+  }
+
+  // The same as Wait(), giving up after 'timeout'. Return false if no
+  // Notify() has come.
+  template <typename Rep, typename Period>
+  bool WaitFor(Key key, const std::chrono::duration<Rep, Period>& timeout) {
+    bool notified = true;
+    {
+      auto deadline = std::chrono::steady_clock::now() + timeout;
+      std::unique_lock<std::mutex> guard(mutex_);
+      while (Epoch() == key) {
+        if (cv_.wait_until(guard, deadline) == std::cv_status::timeout) {
+          notified = Epoch() != key;
+          break;
+        }
+      }
+    }
+    state_.fetch_sub(kWaiter, std::memory_order_seq_cst);
+    return notified;
+  }
+
+  // wake up to 'count' waiters
+  void Notify(uint32_t count = 1) {
+    DoNotify(count);
+  }
+  void NotifyAll() {
+    DoNotify(kWaiterMask);
+  }
+
+  // how many threads are waiting or about to
+  uint32_t waiters() const {
+    return static_cast<uint32_t>(
+        state_.load(std::memory_order_relaxed) & kWaiterMask);
+  }
+
+ private:
+  static const uint64_t kWaiter = 1;
+  static const uint64_t kWaiterMask = 0xffffffff;
+  static const int kEpochShift = 32;
+  static const uint64_t kEpoch = 1ull << kEpochShift;
+
+  // the low half counts the waiters, the high half is the epoch
+  std::atomic<uint64_t> state_ { 0 };
+  std::mutex mutex_;
+  std::condition_variable cv_;
+
+  Key Epoch() const {
+    return static_cast<Key>(
+        state_.load(std::memory_order_acquire) >> kEpochShift);
+  }
+
+  void DoNotify(uint64_t count) {
+    // order the change of the condition before reading the waiters
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t waiters = state_.load(std::memory_order_relaxed) & kWaiterMask;
+    if (waiters == 0 || count == 0) {
+      return;
+    }
+    state_.fetch_add(kEpoch, std::memory_order_seq_cst);
+    // the waiters check the epoch under the lock, so taking it here makes
+    // sure none of them is between the check and the wait
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (count >= waiters) {
+      cv_.notify_all();
+    } else {
+      for (uint64_t i = 0; i < count; ++i) {
+        cv_.notify_one();
+      }
+    }
+  }
+};
+
+}  // namespace concurrency
+}  // namespace cnetpp
+
+#endif  // CNETPP_CONCURRENCY_EVENT_COUNT_H_
+
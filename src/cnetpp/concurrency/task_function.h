@@ -0,0 +1,191 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef CNETPP_CONCURRENCY_TASK_FUNCTION_H_
+#define CNETPP_CONCURRENCY_TASK_FUNCTION_H_
+
+#include <stddef.h>
+
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace cnetpp {
+namespace concurrency {
+
+// A move-only callable returning bool, like std::function<bool()> but
+// keeping the callables of up to kInlineSize bytes, such as the lambdas
+// capturing a few pointers, inside of itself instead of on the heap. It is
+// meant to be stored by value, so that adding a task takes no allocation.
+class TaskFunction final {
+ public:
+  static const size_t kInlineSize = 48;
+
+  TaskFunction() = default;
+  TaskFunction(std::nullptr_t) {
+  }
+
+  template <typename F,
+            typename = typename std::enable_if<
+                !std::is_same<typename std::decay<F>::type,
+                              TaskFunction>::value &&
+                std::is_convertible<
+                    typename std::result_of<
+                        typename std::decay<F>::type&()>::type,
+                    bool>::value>::type>
+  TaskFunction(F&& f) {
+    using Callable = typename std::decay<F>::type;
+    Init<Callable>(std::forward<F>(f),
+                   std::integral_constant<bool, IsInline<Callable>()>());
+  }
+
+  TaskFunction(TaskFunction&& that) noexcept {
+    MoveFrom(&that);
+  }
+
+  TaskFunction& operator=(TaskFunction&& that) noexcept {
+    if (this != &that) {
+      Reset();
+      MoveFrom(&that);
+    }
+    return *this;
+  }
+
+  TaskFunction& operator=(std::nullptr_t) {
+    Reset();
+    return *this;
+  }
+
+  // disallow copy operations
+  TaskFunction(const TaskFunction&) = delete;
+  TaskFunction& operator=(const TaskFunction&) = delete;
+
+  ~TaskFunction() {
+    Reset();
+  }
+
+  explicit operator bool() const {
+    return ops_ != nullptr;
+  }
+
+  bool operator()() {
+    return ops_->invoke(storage_);
+  }
+
+  // whether a callable of type F is kept inside without any allocation
+  template <typename F>
+  static constexpr bool IsInline() {
+    return sizeof(F) <= kInlineSize &&
+        alignof(F) <= alignof(max_align_t) &&
+        std::is_nothrow_move_constructible<F>::value;
+  }
+
+ private:
+  struct Ops {
+    bool (*invoke)(void* storage);
+    // move the callable to 'to' and destroy it in 'from'
+    void (*relocate)(void* from, void* to);
+    void (*destroy)(void* storage);
+  };
+
+  template <typename F>
+  struct InlineOps {
+    static bool Invoke(void* storage) {
+      return (*static_cast<F*>(storage))();
+    }
+    static void Relocate(void* from, void* to) {
+      ::new (to) F(std::move(*static_cast<F*>(from)));
+      static_cast<F*>(from)->~F();
+    }
+    static void Destroy(void* storage) {
+      static_cast<F*>(storage)->~F();
+    }
+    static const Ops kOps;
+  };
+
+  template <typename F>
+  struct HeapOps {
+    static bool Invoke(void* storage) {
+      return (**static_cast<F**>(storage))();
+    }
+    static void Relocate(void* from, void* to) {
+      *static_cast<F**>(to) = *static_cast<F**>(from);
+    }
+    static void Destroy(void* storage) {
+      delete *static_cast<F**>(storage);
+    }
+    static const Ops kOps;
+  };
+
+  alignas(max_align_t) unsigned char storage_[kInlineSize];
+  const Ops* ops_ { nullptr };
+
+  template <typename Callable, typename F>
+  void Init(F&& f, std::true_type) {
+    ::new (static_cast<void*>(storage_)) Callable(std::forward<F>(f));
+    ops_ = &InlineOps<Callable>::kOps;
+  }
+  template <typename Callable, typename F>
+  void Init(F&& f, std::false_type) {
+    *reinterpret_cast<Callable**>(storage_) = new Callable(std::forward<F>(f));
+    ops_ = &HeapOps<Callable>::kOps;
+  }
+
+  void MoveFrom(TaskFunction* that) {
+    if (that->ops_) {
+      that->ops_->relocate(that->storage_, storage_);
+      ops_ = that->ops_;
+      that->ops_ = nullptr;
+    }
+  }
+
+  void Reset() {
+    if (ops_) {
+      ops_->destroy(storage_);
+      ops_ = nullptr;
+    }
+  }
+};
+
+template <typename F>
+const TaskFunction::Ops TaskFunction::InlineOps<F>::kOps = {
+  &TaskFunction::InlineOps<F>::Invoke,
+  &TaskFunction::InlineOps<F>::Relocate,
+  &TaskFunction::InlineOps<F>::Destroy,
+};
+
+template <typename F>
+const TaskFunction::Ops TaskFunction::HeapOps<F>::kOps = {
+  &TaskFunction::HeapOps<F>::Invoke,
+  &TaskFunction::HeapOps<F>::Relocate,
+  &TaskFunction::HeapOps<F>::Destroy,
+};
+
+}  // namespace concurrency
+}  // namespace cnetpp
+
+#endif  // CNETPP_CONCURRENCY_TASK_FUNCTION_H_
+
@@ -30,6 +30,7 @@
 #include <cnetpp/concurrency/task.h>
 #include <cnetpp/concurrency/spin_lock.h>
 
+#include <functional>
 #include <memory>
 #include <atomic>
 #include <thread>
@@ -26,16 +26,85 @@
 //
 #include <cnetpp/concurrency/thread_pool.h>
 #include <cnetpp/base/log.h>
+#include <cnetpp/base/pool_allocator.h>
 
 #include <algorithm>
+#include <new>
 
 namespace cnetpp {
 namespace concurrency {
 
 namespace {
   const size_t kDefaultThreadCount = 5;
+  // the most tasks a worker moves from the shared queue to its own deque
+  const size_t kMaxQueuedBatch = 32;
+
+  using TaskSlotPool = base::BlockPool<sizeof(TaskFunction)>;
+
+  // the deques hold pointers, the slots come from per thread free lists
+  TaskFunction* NewTaskSlot(TaskFunction task) {
+    return new (TaskSlotPool::Allocate()) TaskFunction(std::move(task));
+  }
+
+  TaskFunction TakeTaskSlot(TaskFunction* slot) {
+    TaskFunction task(std::move(*slot));
+    slot->~TaskFunction();
+    TaskSlotPool::Deallocate(slot);
+    return task;
+  }
+
+  // a closure added to a pool with a queue of Task objects
+  class InternalTask final : public Task {
+   public:
+    explicit InternalTask(TaskFunction closure)
+        : closure_(std::move(closure)) {
+    }
+
+    bool operator()(void* arg = nullptr) override final {
+      (void) arg;
+      assert(closure_);
+      return closure_();
+    }
+
+   private:
+    TaskFunction closure_;
+  };
+
+  // a Task object added to a pool of closures
+  TaskFunction WrapTask(std::shared_ptr<Task> task) {
+    return [task] () -> bool {
+      return (*task)();
+    };
+  }
+
+  uint64_t NextRandom(uint64_t* seed) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 7;
+    *seed ^= *seed << 17;
+    return *seed;
+  }
+}
+
+const ThreadPool::TimerId ThreadPool::kInvalidTimerId;
+const size_t ThreadPool::kNumLanes;
+const uint64_t ThreadPool::kStrideScale;
+const size_t ThreadPoolStats::kWaitBuckets;
+
+uint64_t ThreadPoolStats::WaitPercentileUs(double p) const {
+  auto rank = static_cast<uint64_t>(num_waits * p / 100);
+  uint64_t count = 0;
+  for (size_t i = 0; i + 1 < kWaitBuckets; ++i) {
+    count += wait_histogram[i];
+    if (count > rank || (count == num_waits && count > 0)) {
+      return std::min(uint64_t(1) << i, max_wait_us);
+    }
+  }
+  return max_wait_us;
 }
 
+thread_local ThreadPool* ThreadPool::current_pool_ = nullptr;
+thread_local size_t ThreadPool::current_worker_ = 0;
+
 ThreadPool::ThreadPool(const std::string& name)
     : ThreadPool(name, CreateDefaultQueue(), false) {
 }
@@ -53,6 +122,15 @@ ThreadPool::ThreadPool(const std::string& name,
                        std::shared_ptr<QueueBase> queue,
                        bool enable_delay)
     : name_(name), queue_(queue), enable_delay_(enable_delay) {
+  // the tasks can't be reordered behind the back of any other queue
+  work_stealing_ = dynamic_cast<DefaultQueue*>(queue_.get()) != nullptr;
+  if (work_stealing_) {
+    queue_capacity_ = queue_->capacity();
+    queue_.reset();
+  }
+  set_lane_options(TaskLane::kLatencyCritical, TaskLaneOptions { 16, 0 });
+  set_lane_options(TaskLane::kNormal, TaskLaneOptions { 4, 0 });
+  set_lane_options(TaskLane::kBackground, TaskLaneOptions { 1, 0 });
   size_t num_threads = std::thread::hardware_concurrency();
   if (num_threads == 0) {
     num_threads = kDefaultThreadCount;
@@ -61,6 +139,15 @@ ThreadPool::ThreadPool(const std::string& name,
   threads_.resize(num_threads);
 }
 
+void ThreadPool::set_elastic(const ThreadPoolElasticOptions& options) {
+  assert(status_.load(std::memory_order_acquire) == Status::kInit);
+  core_threads_ = std::max<size_t>(options.core_threads, 1);
+  threads_.resize(std::max(options.max_threads, core_threads_));
+  spawn_latency_ = options.spawn_latency;
+  idle_timeout_ = options.idle_timeout;
+  elastic_ = true;
+}
+
 void ThreadPool::Start() {
   Status old = Status::kInit;
   if (!status_.compare_exchange_strong(old, Status::kRunning)) {
@@ -68,18 +155,32 @@ void ThreadPool::Start() {
         static_cast<int>(old));
   }
 
-  int32_t nr = 0;
-  for (auto& t: threads_) {
-    t = std::make_unique<Thread>([this] () -> bool { DoTask(); return true; },
-        name_ + "-" + std::to_string(nr));
-    t->SetThreadPoolIndex(nr);
-    t->Start();
-    nr++;
+  lanes_[kNumLanes].stride =
+      lanes_[static_cast<size_t>(TaskLane::kNormal)].stride;
+
+  workers_.resize(threads_.size());
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    workers_[i] = std::make_unique<Worker>();
+    workers_[i]->seed = 0x9e3779b97f4a7c15ull * (i + 1);
+  }
+
+  size_t num_workers = elastic_ ? core_threads_ : threads_.size();
+  num_workers_.store(num_workers, std::memory_order_relaxed);
+  for (size_t i = 0; i < num_workers; ++i) {
+    StartWorker(i);
+  }
+  CnetppInfo("Thread %s [%d ~ %d] started.", name_.c_str(), 0,
+             static_cast<int>(num_workers) - 1);
+
+  if (elastic_) {
+    supervisor_thread_ = std::make_unique<Thread>(
+        [this] () -> bool { Supervise(); return true; }, name_ + "-s");
+    supervisor_thread_->Start();
   }
-  CnetppInfo("Thread %s [%d ~ %d] started.", name_.c_str(), 0, nr - 1);
 
   if (enable_delay_) {
-    delay_queue_ = std::make_unique<DelayQueue>();
+    timers_ = std::make_unique<TimerWheel>();
+    next_timer_wakeup_ = TimerWheel::Clock::time_point::max();
     delay_thread_ = std::make_unique<Thread>(
         [this] () -> bool { PollDelayTask(); return true; }, name_ + "-d");
     delay_thread_->Start();
@@ -95,192 +196,595 @@ void ThreadPool::Stop(bool wait) {
 
   {
     std::unique_lock<std::mutex> guard(mutex_);
-    stopping_.store(true, std::memory_order_release);
-    force_stop_.store(!wait, std::memory_order_release);
-    queue_cv_.notify_all();
-    if (enable_delay_) {
-      delay_queue_cv_.notify_all();
+    force_stop_.store(!wait, std::memory_order_seq_cst);
+    stopping_.store(true, std::memory_order_seq_cst);
+  }
+  idle_workers_.NotifyAll();
+
+  if (elastic_) {
+    {
+      std::lock_guard<std::mutex> guard(supervisor_mutex_);
+      supervisor_cv_.notify_all();
     }
+    supervisor_thread_->Stop();
   }
 
+  std::vector<TaskFunction> periodic_tasks;
+  if (enable_delay_) {
+    // the delayed tasks left still run if 'wait', the periodic ones don't
+    std::lock_guard<std::mutex> guard(timer_mutex_);
+    timers_->CancelPeriodic(&periodic_tasks);
+    num_delay_tasks_.store(timers_->size(), std::memory_order_relaxed);
+    timer_cv_.notify_all();
+  }
+  periodic_tasks.clear();
+
   if (enable_delay_) {
     delay_thread_->Stop();
     CnetppInfo("Delay thread %s stopped.", delay_thread_->name().c_str());
   }
 
   for (auto& t : threads_) {
-    t->Stop();
+    if (t) {
+      t->Stop();
+    }
   }
   CnetppInfo("Thread %s [%d ~ %d] stopped.",
              name_.c_str(),
              0,
              threads_.size() - 1);
+  FreeLeftTasks();
+}
+
+void ThreadPool::FreeLeftTasks() {
+  // all the workers have exited, so any thread can pop now
+  for (auto& worker : workers_) {
+    while (auto slot = worker->tasks.Pop()) {
+      TakeTaskSlot(slot);
+      num_pending_tasks_--;
+    }
+  }
+  for (auto& lane : lanes_) {
+    num_pending_tasks_ -= lane.tasks.size();
+    num_lane_tasks_ -= lane.tasks.size();
+    lane.tasks.clear();
+  }
 }
 
 size_t ThreadPool::PendingCount() const {
-  return queue_->size();
+  return num_pending_tasks_.load(std::memory_order_relaxed);
 }
 
-bool ThreadPool::AddTask(std::shared_ptr<Task> task) {
+size_t ThreadPool::TaskRoom() {
   if (status_.load(std::memory_order_acquire) != Status::kRunning) {
     CnetppError("Thread pool is not running.");
-    return false;
+    return 0;
   }
 
-  std::lock_guard<std::mutex> guard(mutex_);
   if (stopping_.load(std::memory_order_acquire)) {
     CnetppError("Adding a task in a stopped thread pool.");
-    return false;
+    return 0;
   }
-  size_t pending_tasks = queue_->size();
-  if (enable_delay_) {
-    pending_tasks += delay_queue_->size();
+  if (max_num_pending_tasks_ == 0) {
+    return SIZE_MAX;
   }
-  if (max_num_pending_tasks_ > 0 && pending_tasks >= max_num_pending_tasks_) {
+  size_t pending_tasks = num_pending_tasks_.load(std::memory_order_relaxed) +
+      num_delay_tasks_.load(std::memory_order_relaxed);
+  if (pending_tasks >= max_num_pending_tasks_) {
     CnetppError("Queue is full.");
+    return 0;
+  }
+  return max_num_pending_tasks_ - pending_tasks;
+}
+
+bool ThreadPool::AddTask(std::shared_ptr<Task> task) {
+  if (!CanAddTask()) {
     return false;
   }
-  auto r = queue_->Push(task);
-  (void) r;
-  assert(r);
-  queue_cv_.notify_one();
+  return Schedule(std::move(task));
+}
+
+bool ThreadPool::Schedule(std::shared_ptr<Task> task) {
+  if (work_stealing_) {
+    return Schedule(WrapTask(std::move(task)));
+  }
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (!PushQueuedTask(std::move(task))) {
+      return false;
+    }
+  }
+  idle_workers_.Notify();
+  WatchWorkers();
   return true;
 }
 
-class InternalTask final : public Task {
- public:
-  InternalTask(std::function<bool()> closure)
-      : closure_(std::move(closure)) {
+bool ThreadPool::Schedule(TaskFunction task) {
+  if (work_stealing_ && current_pool_ == this) {
+    PushLocalTask(std::move(task));
+  } else {
+    auto now = Clock::now();
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (!PushQueuedTask(std::move(task), now)) {
+      return false;
+    }
   }
+  idle_workers_.Notify();
+  WatchWorkers();
+  return true;
+}
+
+void ThreadPool::PushLocalTask(TaskFunction task) {
+  num_pending_tasks_++;
+  workers_[current_worker_]->tasks.Push(NewTaskSlot(std::move(task)));
+}
 
-  bool operator()(void* arg = nullptr) override final {
-    (void) arg;
-    assert(closure_);
-    return closure_();
+bool ThreadPool::PushQueuedTask(TaskFunction task, Clock::time_point now) {
+  if (!work_stealing_) {
+    return PushQueuedTask(std::static_pointer_cast<Task>(
+        std::make_shared<InternalTask>(std::move(task))));
   }
+  if (queue_capacity_ > 0 && queued_tasks_.size() >= queue_capacity_) {
+    CnetppError("Queue is full.");
+    return false;
+  }
+  queued_tasks_.push_back(QueuedTask { std::move(task), now });
+  num_pending_tasks_++;
+  num_queued_tasks_++;
+  return true;
+}
+
+bool ThreadPool::PushQueuedTask(std::shared_ptr<Task> task) {
+  if (work_stealing_) {
+    return PushQueuedTask(WrapTask(std::move(task)), Clock::now());
+  }
+  if (!queue_->Push(std::move(task))) {
+    CnetppError("Queue is full.");
+    return false;
+  }
+  num_pending_tasks_++;
+  num_queued_tasks_++;
+  return true;
+}
 
-  virtual ~InternalTask() {
+bool ThreadPool::AddTask(TaskFunction closure) {
+  if (!CanAddTask()) {
+    return false;
   }
+  return Schedule(std::move(closure));
+}
 
- private:
-  std::function<bool()> closure_ { nullptr };
-};
+bool ThreadPool::AddTask(std::shared_ptr<Task> task, TaskLane lane,
+    Clock::time_point deadline) {
+  return AddTask(WrapTask(std::move(task)), lane, deadline);
+}
+
+bool ThreadPool::AddTask(TaskFunction closure, TaskLane lane,
+    Clock::time_point deadline) {
+  if (!CanAddTask()) {
+    return false;
+  }
+  auto now = Clock::now();
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto& tasks = lanes_[static_cast<size_t>(lane)].tasks;
+    tasks.push_back(
+        LaneTask { deadline, lane_seq_++, std::move(closure), now });
+    std::push_heap(tasks.begin(), tasks.end());
+    num_pending_tasks_++;
+    num_lane_tasks_++;
+  }
+  idle_workers_.Notify();
+  WatchWorkers();
+  return true;
+}
 
-bool ThreadPool::AddTask(const std::function<bool()>& closure) {
-  auto task =
-    std::static_pointer_cast<Task>(std::make_shared<InternalTask>(closure));
-  return AddTask(task);
+ThreadPool::TimerId ThreadPool::AddDelayTask(std::shared_ptr<Task> task,
+    std::chrono::microseconds delay) {
+  return AddTimer(WrapTask(std::move(task)), delay,
+                  std::chrono::microseconds::zero());
 }
 
-bool ThreadPool::AddDelayTask(std::shared_ptr<Task> task,
+ThreadPool::TimerId ThreadPool::AddDelayTask(TaskFunction closure,
     std::chrono::microseconds delay) {
+  return AddTimer(std::move(closure), delay,
+                  std::chrono::microseconds::zero());
+}
+
+ThreadPool::TimerId ThreadPool::AddPeriodicTask(TaskFunction closure,
+    std::chrono::microseconds period) {
+  if (period <= std::chrono::microseconds::zero()) {
+    CnetppError("The period of a periodic task must be positive.");
+    return kInvalidTimerId;
+  }
+  return AddTimer(std::move(closure), period, period);
+}
+
+ThreadPool::TimerId ThreadPool::AddTimer(TaskFunction closure,
+    std::chrono::microseconds delay, std::chrono::microseconds period) {
   if (status_.load(std::memory_order_acquire) != Status::kRunning) {
     CnetppError("Thread pool is not running.");
-    return false;
+    return kInvalidTimerId;
   }
 
   if (!enable_delay_) {
     CnetppError("The enable_delay option is turned off!");
-    return false;
+    return kInvalidTimerId;
   }
-  std::lock_guard<std::mutex> guard(mutex_);
+  std::lock_guard<std::mutex> guard(timer_mutex_);
   if (stopping_.load(std::memory_order_acquire)) {
     CnetppError("Adding a task in a stopped thread pool.");
-    return false;
+    return kInvalidTimerId;
   }
 
   if (max_num_pending_tasks_ > 0 &&
-      delay_queue_->size() + queue_->size() >= max_num_pending_tasks_) {
+      num_delay_tasks_.load(std::memory_order_relaxed) +
+      num_pending_tasks_.load(std::memory_order_relaxed) >=
+          max_num_pending_tasks_) {
     CnetppError("Delay queue is full.");
-    return false;
+    return kInvalidTimerId;
   }
 
-  auto r = delay_queue_->Push(
-      std::static_pointer_cast<Task>(std::make_shared<DelayTask>(task, delay)));
-  (void) r;
-  assert(r);
-  delay_queue_cv_.notify_one();
+  auto now = TimerWheel::Clock::now();
+  auto id = timers_->Add(std::move(closure), now, delay, period);
+  num_delay_tasks_++;
+  if (now + delay < next_timer_wakeup_) {
+    timer_cv_.notify_one();
+  }
+  return id;
+}
+
+bool ThreadPool::CancelDelayTask(TimerId id) {
+  if (!enable_delay_ || !timers_) {
+    return false;
+  }
+  // the closure goes away out of the lock
+  TaskFunction closure;
+  std::lock_guard<std::mutex> guard(timer_mutex_);
+  if (!timers_->Cancel(id, &closure)) {
+    return false;
+  }
+  num_delay_tasks_.store(timers_->size(), std::memory_order_relaxed);
   return true;
 }
 
-bool ThreadPool::AddDelayTask(const std::function<bool()>& closure,
-    std::chrono::microseconds delay) {
-  return AddDelayTask(
-      std::static_pointer_cast<Task>(std::make_shared<InternalTask>(closure)),
-      delay);
+void ThreadPool::FinishPeriodicTask(TimerId id, TaskFunction closure,
+                                    bool again) {
+  std::lock_guard<std::mutex> guard(timer_mutex_);
+  if (!again || stopping_.load(std::memory_order_acquire)) {
+    timers_->Release(id);
+  } else if (timers_->Rearm(id, &closure, TimerWheel::Clock::now()) &&
+             timers_->NextExpiry() < next_timer_wakeup_) {
+    timer_cv_.notify_one();
+  }
+  num_delay_tasks_.store(timers_->size(), std::memory_order_relaxed);
+  if (timers_->Empty()) {
+    // the delay thread may be waiting for the last timer at stop
+    timer_cv_.notify_one();
+  }
 }
 
-void ThreadPool::DoTask() {
-  while (true) {
-    std::shared_ptr<Task> task;
-    {
-      std::unique_lock<std::mutex> guard(mutex_);
-      queue_cv_.wait(guard, [this] {
-        return (!queue_->Empty() || stopping_.load(std::memory_order_acquire));
-      });
+TaskFunction ThreadPool::FindTask(size_t index, int* lane) {
+  *lane = -1;
+  if (num_lane_tasks_.load(std::memory_order_seq_cst) > 0) {
+    auto task = PopLaneTask(index, lane);
+    if (task) {
+      return task;
+    }
+  }
+  if (work_stealing_) {
+    auto slot = workers_[index]->tasks.Pop();
+    if (slot) {
+      return TakeTaskSlot(slot);
+    }
+  }
+  auto task = PopQueuedTask(index);
+  if (!task && work_stealing_) {
+    task = StealTask(index);
+  }
+  return task;
+}
 
-      if (force_stop_.load(std::memory_order_acquire)) {
-        return;
-      }
+TaskFunction ThreadPool::PopLaneTask(size_t index, int* lane) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  // the plain tasks this worker can take without stealing
+  bool plain_ready = num_queued_tasks_.load(std::memory_order_relaxed) > 0 ||
+      (work_stealing_ && !workers_[index]->tasks.Empty());
+  size_t next = kNumLanes + 1;
+  for (size_t i = 0; i <= kNumLanes; ++i) {
+    auto& l = lanes_[i];
+    bool ready = i == kNumLanes ? plain_ready :
+        !l.tasks.empty() && (l.max_running == 0 || l.running < l.max_running);
+    if (!ready) {
+      l.ready = false;
+      continue;
+    }
+    if (!l.ready) {
+      // a lane which has been idle doesn't get the turns it missed
+      l.pass = std::max(l.pass, lane_pass_);
+      l.ready = true;
+    }
+    // the earliest end of a turn, so that the heavier lanes go first
+    if (next > kNumLanes ||
+        l.pass + l.stride < lanes_[next].pass + lanes_[next].stride) {
+      next = i;
+    }
+  }
+  if (next > kNumLanes) {
+    return nullptr;
+  }
+  auto& l = lanes_[next];
+  lane_pass_ = l.pass;
+  l.pass += l.stride;
+  if (next == kNumLanes) {
+    // the turn of the plain tasks
+    return nullptr;
+  }
+  std::pop_heap(l.tasks.begin(), l.tasks.end());
+  RecordWait(l.tasks.back().queued, Clock::now());
+  auto task = std::move(l.tasks.back().task);
+  l.tasks.pop_back();
+  num_lane_tasks_--;
+  if (l.max_running > 0) {
+    l.running++;
+    *lane = static_cast<int>(next);
+  }
+  return task;
+}
 
-      task = queue_->TryPop();
-      if (!task.get()) {
-        if (stopping_.load(std::memory_order_acquire)) {
-          return;
+void ThreadPool::FinishLaneTask(int lane) {
+  bool more;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto& l = lanes_[lane];
+    l.running--;
+    more = !l.tasks.empty();
+  }
+  // the tasks held back by the limit
+  if (more) {
+    idle_workers_.Notify();
+  }
+}
+
+TaskFunction ThreadPool::PopQueuedTask(size_t index) {
+  if (num_queued_tasks_.load(std::memory_order_seq_cst) == 0) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (!work_stealing_) {
+    auto task = queue_->TryPop();
+    if (!task) {
+      return nullptr;
+    }
+    num_queued_tasks_--;
+    return WrapTask(std::move(task));
+  }
+  if (queued_tasks_.empty()) {
+    return nullptr;
+  }
+  auto now = Clock::now();
+  RecordWait(queued_tasks_.front().queued, now);
+  auto task = std::move(queued_tasks_.front().task);
+  queued_tasks_.pop_front();
+  num_queued_tasks_--;
+  // take a share of the rest, so that the other workers steal them from
+  // this one instead of all taking the lock
+  size_t num_workers = std::max<size_t>(
+      num_workers_.load(std::memory_order_relaxed), 1);
+  size_t batch = std::min(queued_tasks_.size() / num_workers,
+                          kMaxQueuedBatch);
+  for (size_t i = 0; i < batch; ++i) {
+    RecordWait(queued_tasks_.front().queued, now);
+    workers_[index]->tasks.Push(
+        NewTaskSlot(std::move(queued_tasks_.front().task)));
+    queued_tasks_.pop_front();
+    num_queued_tasks_--;
+  }
+  return task;
+}
+
+TaskFunction ThreadPool::StealTask(size_t index) {
+  size_t count = workers_.size();
+  size_t start = NextRandom(&workers_[index]->seed) % count;
+  for (size_t i = 0; i < count; ++i) {
+    size_t victim = (start + i) % count;
+    if (victim == index) {
+      continue;
+    }
+    auto slot = workers_[victim]->tasks.Steal();
+    if (slot) {
+      return TakeTaskSlot(slot);
+    }
+  }
+  return nullptr;
+}
+
+void ThreadPool::DoTask(size_t index) {
+  current_pool_ = this;
+  current_worker_ = index;
+  while (!force_stop_.load(std::memory_order_acquire)) {
+    int lane;
+    auto task = FindTask(index, &lane);
+    if (!task) {
+      // look once more after registering as a waiter, so that a task added
+      // in between wakes this worker up
+      auto key = idle_workers_.PrepareWait();
+      task = FindTask(index, &lane);
+      if (task) {
+        idle_workers_.CancelWait();
+      } else if (stopping_.load(std::memory_order_seq_cst)) {
+        idle_workers_.CancelWait();
+        break;
+      } else if (elastic_) {
+        if (!idle_workers_.WaitFor(key, idle_timeout_) && TryRetire()) {
+          CnetppInfo("Thread %s-%d retired.", name_.c_str(),
+                     static_cast<int>(index));
+          break;
         }
         continue;
+      } else {
+        idle_workers_.Wait(key);
+        continue;
       }
-      num_running_tasks_++;
+    }
+    num_pending_tasks_--;
+    if (force_stop_.load(std::memory_order_acquire)) {
+      break;
     }
 
     // do task
-    (*(task.get()))();
+    num_started_tasks_.fetch_add(1, std::memory_order_relaxed);
+    num_running_tasks_++;
+    task();
     num_running_tasks_--;
+    if (lane >= 0) {
+      FinishLaneTask(lane);
+    }
+  }
+  current_pool_ = nullptr;
+  workers_[index]->alive.store(false, std::memory_order_release);
+}
+
+void ThreadPool::StartWorker(size_t index) {
+  // joins the thread which had the slot before, if any
+  threads_[index].reset();
+  workers_[index]->alive.store(true, std::memory_order_release);
+  threads_[index] = std::make_unique<Thread>(
+      [this, index] () -> bool { DoTask(index); return true; },
+      name_ + "-" + std::to_string(index));
+  threads_[index]->SetThreadPoolIndex(static_cast<int>(index));
+  threads_[index]->Start();
+}
+
+bool ThreadPool::TryRetire() {
+  size_t num_workers = num_workers_.load(std::memory_order_relaxed);
+  while (num_workers > core_threads_) {
+    if (num_workers_.compare_exchange_weak(num_workers, num_workers - 1)) {
+      num_retired_++;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::Supervise() {
+  std::unique_lock<std::mutex> guard(supervisor_mutex_);
+  while (!stopping_.load(std::memory_order_acquire)) {
+    if (!Busy()) {
+      supervisor_wanted_.store(false, std::memory_order_seq_cst);
+      // a task added in between has seen the flag set and not woken it
+      if (!Busy()) {
+        supervisor_cv_.wait(guard);
+      }
+      continue;
+    }
+    // watch the pool for a while, the submitters leave it alone meanwhile
+    auto num_started = num_started_tasks_.load(std::memory_order_relaxed);
+    recent_max_wait_us_.store(0, std::memory_order_relaxed);
+    supervisor_cv_.wait_for(guard, spawn_latency_);
+    if (stopping_.load(std::memory_order_acquire) || !Busy()) {
+      continue;
+    }
+    // either no task has started for all that time, or one has waited
+    // longer in the shared queue or in a lane
+    auto spawn_latency_us = static_cast<uint64_t>(spawn_latency_.count());
+    bool stalled =
+        num_started_tasks_.load(std::memory_order_relaxed) == num_started ||
+        recent_max_wait_us_.load(std::memory_order_relaxed) >
+            spawn_latency_us;
+    if (!stalled ||
+        num_workers_.load(std::memory_order_relaxed) >= threads_.size()) {
+      continue;
+    }
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      if (!workers_[i]->alive.load(std::memory_order_acquire)) {
+        num_workers_++;
+        num_spawned_++;
+        StartWorker(i);
+        CnetppInfo("Thread %s-%d spawned.", name_.c_str(),
+                   static_cast<int>(i));
+        break;
+      }
+    }
+  }
+}
+
+void ThreadPool::RecordWait(Clock::time_point queued, Clock::time_point now) {
+  auto wait = std::chrono::duration_cast<std::chrono::microseconds>(
+      now - queued).count();
+  auto us = static_cast<uint64_t>(std::max<int64_t>(wait, 0));
+  stats_.num_waits++;
+  stats_.total_wait_us += us;
+  stats_.max_wait_us = std::max(stats_.max_wait_us, us);
+  // 2^(bucket - 1) <= us < 2^bucket
+  size_t bucket = us == 0 ? 0 : 64 - __builtin_clzll(us);
+  bucket = std::min(bucket, ThreadPoolStats::kWaitBuckets - 1);
+  stats_.wait_histogram[bucket]++;
+  if (us > recent_max_wait_us_.load(std::memory_order_relaxed)) {
+    recent_max_wait_us_.store(us, std::memory_order_relaxed);
+  }
+}
+
+ThreadPoolStats ThreadPool::GetStats() {
+  ThreadPoolStats stats;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    stats = stats_;
   }
+  stats.num_threads = num_workers_.load(std::memory_order_relaxed);
+  stats.threads_spawned = num_spawned_.load(std::memory_order_relaxed);
+  stats.threads_retired = num_retired_.load(std::memory_order_relaxed);
+  return stats;
 }
 
 void ThreadPool::PollDelayTask() {
   assert(enable_delay_);
+  std::vector<TimerWheel::Expired> expired;
   while (true) {
-    if (stopping_ && force_stop_) {
-      CnetppInfo("Forcing stop delay thread: %s-d, exit...", name_.c_str());
-      return;
-    }
-
-    std::shared_ptr<DelayTask> task;
     {
-      std::unique_lock<std::mutex> guard(mutex_);
-      task = std::static_pointer_cast<DelayTask>(delay_queue_->Peek());
-      if (task) {
-        if (task->run_time_ > std::chrono::system_clock::now()) {
-          auto run_time = task->run_time_;
-          delay_queue_cv_.wait_until(guard, task->run_time_, [this, run_time] {
-            auto peek =
-                std::static_pointer_cast<DelayTask>(delay_queue_->Peek());
-            return stopping_.load(std::memory_order_acquire) ||
-                peek->run_time_ != run_time;  // new task arrived
-          });
-        } else {
-          // some task is expired
-          auto r = queue_->Push(std::static_pointer_cast<Task>(task));
-          (void) r;
-          assert(r);
-          auto t = delay_queue_->TryPop();
-          assert(t == std::static_pointer_cast<Task>(task));
-          queue_cv_.notify_one();
-        }
-      } else {
-        if (stopping_) {
+      std::unique_lock<std::mutex> guard(timer_mutex_);
+      if (stopping_ && force_stop_) {
+        CnetppInfo("Forcing stop delay thread: %s-d, exit...", name_.c_str());
+        return;
+      }
+      timers_->Advance(TimerWheel::Clock::now(), &expired);
+      if (expired.empty()) {
+        if (stopping_ && timers_->Empty()) {
           CnetppInfo("Stopping delay thread: %s-d, exit...", name_.c_str());
           return;
         }
-        // delay queue is empty
-        delay_queue_cv_.wait(guard, [this] {
-          return stopping_.load(std::memory_order_acquire) ||
-            !delay_queue_->Empty();
-        });
+        next_timer_wakeup_ = timers_->NextExpiry();
+        if (next_timer_wakeup_ == TimerWheel::Clock::time_point::max()) {
+          timer_cv_.wait(guard);
+        } else {
+          timer_cv_.wait_until(guard, next_timer_wakeup_);
+        }
+        continue;
+      }
+      // the thread looks at the timers again before sleeping
+      next_timer_wakeup_ = TimerWheel::Clock::time_point::min();
+      num_delay_tasks_.store(timers_->size(), std::memory_order_relaxed);
+    }
+
+    for (auto& timer : expired) {
+      if (!timer.periodic) {
+        Schedule(std::move(timer.callback));
+        continue;
+      }
+      auto id = timer.id;
+      auto scheduled = Schedule(
+          [this, id, closure = std::move(timer.callback)] () mutable -> bool {
+            bool again = closure();
+            FinishPeriodicTask(id, std::move(closure), again);
+            return again;
+          });
+      if (!scheduled) {
+        std::lock_guard<std::mutex> guard(timer_mutex_);
+        timers_->Release(id);
+        num_delay_tasks_.store(timers_->size(), std::memory_order_relaxed);
       }
     }
+    expired.clear();
   }
 }
 
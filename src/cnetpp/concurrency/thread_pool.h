@@ -27,22 +27,107 @@
 #ifndef CNETPP_CONCURRENCY_THREAD_POOL_H_
 #define CNETPP_CONCURRENCY_THREAD_POOL_H_
 
+#include <cnetpp/concurrency/event_count.h>
 #include <cnetpp/concurrency/thread.h>
 #include <cnetpp/concurrency/queue_base.h>
 #include <cnetpp/concurrency/priority_queue.h>
 #include <cnetpp/concurrency/task.h>
+#include <cnetpp/concurrency/task_function.h>
+#include <cnetpp/concurrency/timer_wheel.h>
+#include <cnetpp/concurrency/work_stealing_deque.h>
 #include <cnetpp/base/log.h>
 
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <iterator>
 #include <memory>
 #include <mutex>
 #include <queue>
+#include <vector>
 #include <condition_variable>
 
 namespace cnetpp {
 namespace concurrency {
 
+// The scheduling lanes of a ThreadPool, see ThreadPool::AddTask().
+enum class TaskLane : int {
+  kLatencyCritical = 0,
+  kNormal = 1,
+  kBackground = 2,
+};
+
+struct TaskLaneOptions {
+  // the share of the workers the lane gets when the others have tasks too
+  uint32_t weight { 1 };
+  // the most tasks of the lane running at the same time, 0 for no limit
+  size_t max_running { 0 };
+};
+
+// See ThreadPool::set_elastic().
+struct ThreadPoolElasticOptions {
+  // the workers kept however idle they are, at least 1
+  size_t core_threads { 1 };
+  // the most workers
+  size_t max_threads { 1 };
+  // a worker is added when the tasks wait longer than it
+  std::chrono::microseconds spawn_latency { std::chrono::milliseconds(10) };
+  // a worker over the core ones exits when it has been idle for longer
+  std::chrono::microseconds idle_timeout { std::chrono::seconds(60) };
+};
+
+struct ThreadPoolStats {
+  static const size_t kWaitBuckets = 24;
+
+  // the workers running
+  size_t num_threads { 0 };
+  uint64_t threads_spawned { 0 };
+  uint64_t threads_retired { 0 };
+
+  // the time the tasks have waited in the default queue and in the lanes,
+  // the ones added to the deque of a worker by its tasks aside
+  uint64_t num_waits { 0 };
+  uint64_t total_wait_us { 0 };
+  uint64_t max_wait_us { 0 };
+  // wait_histogram[i] counts the waits under 2^i us, the last one the rest
+  uint64_t wait_histogram[kWaitBuckets] = {};
+
+  // an upper bound of the wait of the 'p' percentile, 0 < p <= 100
+  uint64_t WaitPercentileUs(double p) const;
+};
+
+// With the default queue, each worker has a deque of its own, where the
+// tasks added by the tasks running in it go without any lock. An idle
+// worker takes the tasks added by the other threads from the shared queue,
+// or steals from the deque of another worker picked at random, and parks
+// when there is none. The tasks are kept as TaskFunction values all along,
+// so adding a closure small enough takes no allocation. With a queue given
+// to the constructor, e.g. a priority queue, all the tasks go through it,
+// in its order, as Task objects.
+//
+// The tasks added to a lane are kept apart, ordered by their deadlines.
+// A worker looking for a task picks among the lanes having a task ready and
+// the plain tasks by stride scheduling, in proportion to their weights, so
+// that the background lane can't be starved and the latency critical one
+// gets ahead of the rest.
+//
+// An elastic pool starts with the core workers, and a supervisor thread
+// adds one when the tasks have been waiting longer than the spawn latency
+// with no idle worker around. The workers over the core ones exit when they
+// have been idle for the idle timeout.
+//
+// The delayed tasks wait in a timer wheel of their own, under a lock of
+// their own, and a thread moves them to the pool when they are due.
 class ThreadPool final {
  public:
+  using TimerId = TimerWheel::TimerId;
+  static const TimerId kInvalidTimerId = TimerWheel::kInvalidTimerId;
+  using Clock = std::chrono::steady_clock;
+  static const size_t kNumLanes = 3;
+
   explicit ThreadPool(const std::string& name);
   ThreadPool(const std::string& name, std::shared_ptr<QueueBase> queue);
   ThreadPool(const std::string& name, bool enable_delay);
@@ -60,18 +145,33 @@ class ThreadPool final {
   void set_num_threads(size_t num) {
     assert(status_.load(std::memory_order_acquire) == Status::kInit);
     threads_.resize((num == 0) ? 1 : num);
+    elastic_ = false;
   }
 
+  // Run between core_threads and max_threads workers instead of a fixed
+  // number, see ThreadPoolElasticOptions.
+  void set_elastic(const ThreadPoolElasticOptions& options);
+
   void set_max_num_pending_tasks(size_t num) {
     max_num_pending_tasks_ = num;
   }
 
+  // The lanes have the weights 16, 4 and 1 and no limit by default. The
+  // plain tasks share the weight of the normal lane.
+  void set_lane_options(TaskLane lane, const TaskLaneOptions& options) {
+    assert(status_.load(std::memory_order_acquire) == Status::kInit);
+    auto& l = lanes_[static_cast<size_t>(lane)];
+    l.stride = kStrideScale / std::max<uint32_t>(options.weight, 1);
+    l.max_running = options.max_running;
+  }
+
   // start all threads in this thread pool
   void Start();
 
   // stop all threads in this thread pool
   void Stop(bool wait = false);
 
+  // the tasks added and not running yet, the delayed ones aside
   size_t PendingCount() const;
 
   size_t NumRunningTasks() const {
@@ -80,17 +180,84 @@ class ThreadPool final {
 
   // add a task into the queue and one of the threads in the pool will run it
   bool AddTask(std::shared_ptr<Task> task);
-  bool AddTask(const std::function<bool()>& closure);
+  bool AddTask(TaskFunction closure);
+
+  // Add a task to 'lane', the tasks of a lane run in the order of their
+  // deadlines, the ones without a deadline last in the order they are
+  // added. The deadline only orders the tasks, a task past it still runs.
+  bool AddTask(std::shared_ptr<Task> task, TaskLane lane,
+      Clock::time_point deadline = Clock::time_point::max());
+  bool AddTask(TaskFunction closure, TaskLane lane,
+      Clock::time_point deadline = Clock::time_point::max());
+
+  // Add the tasks of [first, last) under a single lock and wake as many idle
+  // workers as tasks at once. The elements are converted to TaskFunction,
+  // pass move iterators for the move-only ones. Return how many tasks have
+  // been added, from the first one, the rest don't fit in the limits.
+  template <typename Iterator>
+  size_t AddTasks(Iterator first, Iterator last) {
+    size_t room = TaskRoom();
+    size_t count = 0;
+    if (work_stealing_ && current_pool_ == this) {
+      for (; first != last && count < room; ++first, ++count) {
+        PushLocalTask(TaskFunction(*first));
+      }
+    } else {
+      auto now = Clock::now();
+      std::lock_guard<std::mutex> guard(mutex_);
+      for (; first != last && count < room; ++first, ++count) {
+        if (!PushQueuedTask(TaskFunction(*first), now)) {
+          break;
+        }
+      }
+    }
+    idle_workers_.Notify(static_cast<uint32_t>(std::min<size_t>(
+        count, UINT32_MAX)));
+    WatchWorkers();
+    return count;
+  }
 
-  bool AddDelayTask(std::shared_ptr<Task> task,
+  // the same, moving the tasks out of 'tasks'
+  template <typename Range>
+  size_t AddTasks(Range&& tasks) {
+    return AddTasks(std::make_move_iterator(std::begin(tasks)),
+                    std::make_move_iterator(std::end(tasks)));
+  }
+
+  // Call fn(i) for each i in [begin, end), in the pool, by chunks of 'grain'
+  // indices, and return when all the calls are done. The calling thread
+  // takes chunks too, so that it can be a worker of the pool itself.
+  // 'fn' is called from several threads at once.
+  template <typename Index, typename Function>
+  void ParallelFor(Index begin, Index end, Index grain, Function fn);
+
+  // Add a task to run after 'delay', the pool has to be created with
+  // enable_delay. Return kInvalidTimerId if it can't be added.
+  TimerId AddDelayTask(std::shared_ptr<Task> task,
       std::chrono::microseconds delay);
-  bool AddDelayTask(const std::function<bool()>& closure,
+  TimerId AddDelayTask(TaskFunction closure,
       std::chrono::microseconds delay);
 
+  // Add a task to run every 'period', counted from the end of the previous
+  // run, until it returns false or it is cancelled. The periodic tasks are
+  // dropped when the pool stops.
+  TimerId AddPeriodicTask(TaskFunction closure,
+      std::chrono::microseconds period);
+
+  // Return false if the task has run or has been cancelled already. A
+  // periodic task being run isn't interrupted, it just doesn't run again.
+  bool CancelDelayTask(TimerId id);
+
+  // the workers running, or to start before Start()
   size_t size() const {
-    return threads_.size();
+    if (status_.load(std::memory_order_acquire) == Status::kInit) {
+      return elastic_ ? core_threads_ : threads_.size();
+    }
+    return num_workers_.load(std::memory_order_relaxed);
   }
 
+  ThreadPoolStats GetStats();
+
  private:
   enum class Status : int {
     kInit = 0x0,
@@ -107,55 +274,243 @@ class ThreadPool final {
 
   size_t max_num_pending_tasks_ { 0 };
 
+  // guards the shared queue
   std::mutex mutex_;
-  std::condition_variable queue_cv_;
+  // the shared queue, queue_ only when it isn't the default one
   std::shared_ptr<QueueBase> queue_;
+  struct QueuedTask {
+    TaskFunction task;
+    Clock::time_point queued;
+  };
+  std::deque<QueuedTask> queued_tasks_;
+  size_t queue_capacity_ { 0 };
+  // the size of the shared queue, to look for tasks in it without the lock
+  std::atomic<size_t> num_queued_tasks_ { 0 };
+
+  // the stride of a lane of weight 1
+  static const uint64_t kStrideScale = 1 << 16;
+
+  struct LaneTask {
+    Clock::time_point deadline;
+    // in the order of adding, for the tasks of the same deadline
+    uint64_t seq;
+    TaskFunction task;
+    Clock::time_point queued;
+
+    // for a heap of the earliest deadline first
+    bool operator<(const LaneTask& that) const {
+      return deadline != that.deadline ?
+          deadline > that.deadline : seq > that.seq;
+    }
+  };
+
+  // the lanes, the plain tasks in the last one, guarded by mutex_
+  struct Lane {
+    std::vector<LaneTask> tasks;
+    uint64_t stride { kStrideScale };
+    // the next time it gets a turn, in stride units
+    uint64_t pass { 0 };
+    size_t max_running { 0 };
+    size_t running { 0 };
+    // whether it had a task ready when the turns were given last
+    bool ready { false };
+  };
+  Lane lanes_[kNumLanes + 1];
+  uint64_t lane_seq_ { 0 };
+  // the pass of the last turn given
+  uint64_t lane_pass_ { 0 };
+  // the tasks in the lanes, to look for them without the lock
+  std::atomic<size_t> num_lane_tasks_ { 0 };
+  std::atomic<size_t> num_pending_tasks_ { 0 };
+  std::atomic<size_t> num_delay_tasks_ { 0 };
   std::atomic<size_t> num_running_tasks_ { 0 };
 
+  // one per worker, up to max_threads in an elastic pool
   std::vector<std::unique_ptr<Thread>> threads_;
+  std::atomic<size_t> num_workers_ { 0 };
+
+  bool elastic_ { false };
+  size_t core_threads_ { 0 };
+  std::chrono::microseconds spawn_latency_ { 0 };
+  std::chrono::microseconds idle_timeout_ { 0 };
+  std::unique_ptr<Thread> supervisor_thread_;
+  std::mutex supervisor_mutex_;
+  std::condition_variable supervisor_cv_;
+  // whether the supervisor is watching the pool, or has been asked to
+  std::atomic<bool> supervisor_wanted_ { false };
+  std::atomic<uint64_t> num_spawned_ { 0 };
+  std::atomic<uint64_t> num_retired_ { 0 };
+
+  // the waits, guarded by mutex_
+  ThreadPoolStats stats_;
+  // the longest wait since the supervisor has looked last
+  std::atomic<uint64_t> recent_max_wait_us_ { 0 };
+  // the tasks the workers have started, to tell a stalled pool
+  std::atomic<uint64_t> num_started_tasks_ { 0 };
+
+  // the workers park here when there is no task to run
+  EventCount idle_workers_;
+
+  using TaskSlot = TaskFunction;
+
+  struct Worker {
+    // used with the default queue only
+    WorkStealingDeque<TaskSlot> tasks;
+    // to pick the workers to steal from
+    uint64_t seed;
+    // whether its thread runs, the slot can be reused otherwise
+    std::atomic<bool> alive { false };
+  };
+  bool work_stealing_ { false };
+  std::vector<std::unique_ptr<Worker>> workers_;
 
-  class DelayTask : public Task {
-   public:
-    DelayTask(std::shared_ptr<Task> task, std::chrono::microseconds delay)
-        : task_(std::move(task)),
-          run_time_(std::chrono::system_clock::now() + delay) {
+  // the pool and the index of the worker running in this thread, if any
+  static thread_local ThreadPool* current_pool_;
+  static thread_local size_t current_worker_;
+
+  bool enable_delay_ { false };
+  std::unique_ptr<Thread> delay_thread_;
+  // guards timers_ and next_timer_wakeup_
+  std::mutex timer_mutex_;
+  std::condition_variable timer_cv_;
+  std::unique_ptr<TimerWheel> timers_;
+  // the time the delay thread sleeps until, the timers added before it wake
+  // the thread up
+  TimerWheel::Clock::time_point next_timer_wakeup_;
+
+  // how many tasks can be added, logging why if none
+  size_t TaskRoom();
+  bool CanAddTask() {
+    return TaskRoom() > 0;
+  }
+
+  // queue 'task' without checking the limits
+  bool Schedule(TaskFunction task);
+  bool Schedule(std::shared_ptr<Task> task);
+  // push to the deque of the worker running in this thread
+  void PushLocalTask(TaskFunction task);
+  // push to the shared queue with mutex_ held
+  bool PushQueuedTask(TaskFunction task, Clock::time_point now);
+  bool PushQueuedTask(std::shared_ptr<Task> task);
+  // with mutex_ held
+  void RecordWait(Clock::time_point queued, Clock::time_point now);
+  // 'lane' is set to the lane of the task found if the lane has a limit on
+  // the tasks running, -1 otherwise
+  TaskFunction FindTask(size_t index, int* lane);
+  TaskFunction PopLaneTask(size_t index, int* lane);
+  void FinishLaneTask(int lane);
+  TaskFunction PopQueuedTask(size_t index);
+  TaskFunction StealTask(size_t index);
+  void FreeLeftTasks();
+
+  void DoTask(size_t index);
+
+  void StartWorker(size_t index);
+  // ask the supervisor to look at the pool if the idle workers can't take
+  // all the pending tasks
+  void WatchWorkers() {
+    if (elastic_ && Busy() &&
+        !supervisor_wanted_.exchange(true, std::memory_order_seq_cst)) {
+      std::lock_guard<std::mutex> guard(supervisor_mutex_);
+      supervisor_cv_.notify_one();
     }
+  }
+  // whether more tasks wait than there are idle workers
+  bool Busy() const {
+    return num_pending_tasks_.load(std::memory_order_seq_cst) >
+        idle_workers_.waiters();
+  }
+  void Supervise();
+  bool TryRetire();
+
+  TimerId AddTimer(TaskFunction closure, std::chrono::microseconds delay,
+                   std::chrono::microseconds period);
+  // rearm or drop the periodic timer 'id' after a run returning 'again'
+  void FinishPeriodicTask(TimerId id, TaskFunction closure, bool again);
+  void PollDelayTask();
 
-    bool operator()(void* arg = nullptr) override {
-      (void) arg;
-      assert(task_);
-      return (*task_)();
+  // the chunks of a ParallelFor(), taken by the workers and the caller
+  template <typename Index, typename Function>
+  class ParallelForState {
+   public:
+    ParallelForState(Index begin, Index end, Index grain, Function fn)
+        : begin_(begin), end_(end), grain_(grain), fn_(std::move(fn)),
+          num_chunks_(static_cast<size_t>((end - begin - 1) / grain + 1)) {
     }
 
-    void Stop() override {
-      Task::Stop();
-      task_->Stop();
+    size_t num_chunks() const {
+      return num_chunks_;
     }
 
-    struct Comparator {
-      bool operator() (const std::shared_ptr<Task>& x,
-          const std::shared_ptr<Task>& y) const {
-        auto xx = std::static_pointer_cast<DelayTask>(x);
-        auto yy = std::static_pointer_cast<DelayTask>(y);
-        return xx->run_time_ > yy->run_time_;
+    // run the chunks left, until there is none
+    void Run() {
+      while (true) {
+        size_t chunk = next_chunk_.fetch_add(1, std::memory_order_relaxed);
+        if (chunk >= num_chunks_) {
+          return;
+        }
+        Index first = begin_ + static_cast<Index>(chunk) * grain_;
+        Index last = end_ - first > grain_ ? first + grain_ : end_;
+        for (Index i = first; i < last; ++i) {
+          fn_(i);
+        }
+        if (done_chunks_.fetch_add(1, std::memory_order_acq_rel) + 1 ==
+            num_chunks_) {
+          std::lock_guard<std::mutex> guard(mutex_);
+          cv_.notify_all();
+        }
       }
-    };
-    std::shared_ptr<Task> task_;
-    std::chrono::system_clock::time_point run_time_;
-  };
-
-  using DelayQueue = PriorityQueue<DelayTask::Comparator>;
-
-  bool enable_delay_ { false };
-  std::unique_ptr<Thread> delay_thread_;
-  std::condition_variable delay_queue_cv_;
-  std::unique_ptr<DelayQueue> delay_queue_;
+    }
 
-  void DoTask();
+    void Wait() {
+      std::unique_lock<std::mutex> guard(mutex_);
+      cv_.wait(guard, [this] {
+        return done_chunks_.load(std::memory_order_acquire) == num_chunks_;
+      });
+    }
 
-  void PollDelayTask();
+   private:
+    const Index begin_;
+    const Index end_;
+    const Index grain_;
+    Function fn_;
+    const size_t num_chunks_;
+    std::atomic<size_t> next_chunk_ { 0 };
+    std::atomic<size_t> done_chunks_ { 0 };
+    std::mutex mutex_;
+    std::condition_variable cv_;
+  };
 };
 
+template <typename Index, typename Function>
+void ThreadPool::ParallelFor(Index begin, Index end, Index grain,
+                             Function fn) {
+  if (!(begin < end)) {
+    return;
+  }
+  if (grain < 1) {
+    grain = 1;
+  }
+  using State = ParallelForState<Index, Function>;
+  auto state = std::make_shared<State>(begin, end, grain, std::move(fn));
+  // the caller takes one share
+  size_t num_helpers = std::min(state->num_chunks() - 1, size());
+  if (num_helpers > 0) {
+    std::vector<TaskFunction> helpers;
+    helpers.reserve(num_helpers);
+    for (size_t i = 0; i < num_helpers; ++i) {
+      helpers.emplace_back([state] () -> bool {
+        state->Run();
+        return true;
+      });
+    }
+    // what doesn't fit in the pool is left to the caller
+    AddTasks(helpers);
+  }
+  state->Run();
+  state->Wait();
+}
+
 }  // namespace concurrency
 }  // namespace cnetpp
 
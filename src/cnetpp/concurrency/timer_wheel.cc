@@ -0,0 +1,314 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include <cnetpp/concurrency/timer_wheel.h>
+
+#include <assert.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace cnetpp {
+namespace concurrency {
+
+namespace {
+  // rotate the slot bitmap right by 'n' bits
+  uint64_t RotateRight(uint64_t bits, int n) {
+    n &= 63;
+    return n == 0 ? bits : (bits >> n) | (bits << (64 - n));
+  }
+}
+
+const TimerWheel::TimerId TimerWheel::kInvalidTimerId;
+const int TimerWheel::kLevels;
+const int TimerWheel::kSlotBits;
+const size_t TimerWheel::kSlots;
+const uint32_t TimerWheel::kNil;
+
+TimerWheel::TimerWheel(Clock::duration tick, Clock::time_point now)
+    : tick_(std::max(tick, Clock::duration(1))), start_(now) {
+  std::fill(std::begin(heads_), std::end(heads_), kNil);
+  std::fill(std::begin(occupied_), std::end(occupied_), 0);
+}
+
+TimerWheel::TimerId TimerWheel::Add(TaskFunction callback,
+                                    Clock::time_point now,
+                                    Clock::duration delay,
+                                    Clock::duration period) {
+  assert(callback);
+  auto index = NewNode();
+  auto& node = nodes_[index];
+  node.callback = std::move(callback);
+  node.period = period;
+  node.expiry = ExpiryTick(now + delay);
+  node.state = State::kPending;
+  Link(index);
+  return MakeId(index, node.generation);
+}
+
+bool TimerWheel::Cancel(TimerId id, TaskFunction* callback) {
+  auto node = Find(id);
+  if (!node) {
+    return false;
+  }
+  auto index = static_cast<uint32_t>(id);
+  switch (node->state) {
+    case State::kPending:
+      Unlink(index);
+      if (callback) {
+        *callback = std::move(node->callback);
+      }
+      FreeNode(index);
+      return true;
+    case State::kRunning:
+      node->state = State::kCancelled;
+      return true;
+    default:
+      return false;
+  }
+}
+
+void TimerWheel::Advance(Clock::time_point now,
+                         std::vector<Expired>* expired) {
+  if (now < start_) {
+    return;
+  }
+  uint64_t target = (now - start_) / tick_;
+  while (now_tick_ < target) {
+    if (num_pending_ == 0) {
+      now_tick_ = target;
+      break;
+    }
+    // nothing happens before the next turn of the lowest nonempty level
+    int level = 0;
+    while (occupied_[level] == 0) {
+      level++;
+    }
+    if (level > 0) {
+      uint64_t last = now_tick_ | ((uint64_t(1) << (kSlotBits * level)) - 1);
+      if (last >= target) {
+        now_tick_ = target;
+        break;
+      }
+      now_tick_ = last;
+    }
+    Step(expired);
+  }
+}
+
+bool TimerWheel::Rearm(TimerId id, TaskFunction* callback,
+                       Clock::time_point now) {
+  auto node = Find(id);
+  assert(node);
+  assert(node->state == State::kRunning || node->state == State::kCancelled);
+  auto index = static_cast<uint32_t>(id);
+  if (node->state == State::kCancelled) {
+    FreeNode(index);
+    return false;
+  }
+  node->callback = std::move(*callback);
+  node->expiry = ExpiryTick(now + node->period);
+  node->state = State::kPending;
+  Link(index);
+  return true;
+}
+
+void TimerWheel::Release(TimerId id) {
+  auto node = Find(id);
+  assert(node);
+  assert(node->state == State::kRunning || node->state == State::kCancelled);
+  (void) node;
+  FreeNode(static_cast<uint32_t>(id));
+}
+
+void TimerWheel::CancelPeriodic(std::vector<TaskFunction>* callbacks) {
+  for (uint32_t index = 0; index < nodes_.size(); ++index) {
+    auto& node = nodes_[index];
+    if (node.period == Clock::duration::zero()) {
+      continue;
+    }
+    if (node.state == State::kPending) {
+      Unlink(index);
+      callbacks->push_back(std::move(node.callback));
+      FreeNode(index);
+    } else if (node.state == State::kRunning) {
+      node.state = State::kCancelled;
+    }
+  }
+}
+
+TimerWheel::Clock::time_point TimerWheel::NextExpiry() const {
+  if (num_pending_ == 0) {
+    return Clock::time_point::max();
+  }
+  uint64_t next = UINT64_MAX;
+  for (int level = 0; level < kLevels; ++level) {
+    if (occupied_[level] == 0) {
+      continue;
+    }
+    // the slots after the current one first, the current one last
+    int shift = kSlotBits * level;
+    uint64_t current = now_tick_ >> shift;
+    auto bits = RotateRight(occupied_[level],
+                            static_cast<int>((current + 1) & (kSlots - 1)));
+    uint64_t turn = current + 1 + __builtin_ctzll(bits);
+    next = std::min(next, turn << shift);
+  }
+  return start_ + tick_ * next;
+}
+
+TimerWheel::Node* TimerWheel::Find(TimerId id) {
+  auto index = static_cast<uint32_t>(id);
+  if (index >= nodes_.size()) {
+    return nullptr;
+  }
+  auto& node = nodes_[index];
+  if (node.generation != static_cast<uint32_t>(id >> 32) ||
+      node.state == State::kFree) {
+    return nullptr;
+  }
+  return &node;
+}
+
+uint32_t TimerWheel::NewNode() {
+  uint32_t index = free_head_;
+  if (index != kNil) {
+    free_head_ = nodes_[index].next;
+  } else {
+    index = static_cast<uint32_t>(nodes_.size());
+    nodes_.emplace_back();
+  }
+  size_++;
+  return index;
+}
+
+void TimerWheel::FreeNode(uint32_t index) {
+  auto& node = nodes_[index];
+  node.callback = nullptr;
+  node.state = State::kFree;
+  // never 0, so that no id is kInvalidTimerId
+  if (++node.generation == 0) {
+    node.generation = 1;
+  }
+  node.next = free_head_;
+  free_head_ = index;
+  size_--;
+}
+
+uint64_t TimerWheel::ExpiryTick(Clock::time_point deadline) const {
+  if (deadline <= start_) {
+    return now_tick_ + 1;
+  }
+  auto ticks = (deadline - start_ + tick_ - Clock::duration(1)) / tick_;
+  // the current tick has been run already
+  return std::max(static_cast<uint64_t>(ticks), now_tick_ + 1);
+}
+
+void TimerWheel::Link(uint32_t index) {
+  auto& node = nodes_[index];
+  assert(node.expiry >= now_tick_);
+  uint64_t delta = node.expiry - now_tick_;
+  int level = 0;
+  while (level < kLevels - 1 &&
+         delta >= (uint64_t(1) << (kSlotBits * (level + 1)))) {
+    level++;
+  }
+  uint64_t expiry = node.expiry;
+  uint64_t span = uint64_t(1) << (kSlotBits * kLevels);
+  if (delta >= span) {
+    // over the top level, comes round again
+    expiry = now_tick_ + span - 1;
+  }
+  auto slot = (expiry >> (kSlotBits * level)) & (kSlots - 1);
+  auto list = level * kSlots + slot;
+  node.list = static_cast<uint16_t>(list);
+  node.prev = kNil;
+  node.next = heads_[list];
+  if (node.next != kNil) {
+    nodes_[node.next].prev = index;
+  }
+  heads_[list] = index;
+  occupied_[level] |= uint64_t(1) << slot;
+  num_pending_++;
+}
+
+void TimerWheel::Unlink(uint32_t index) {
+  auto& node = nodes_[index];
+  if (node.prev != kNil) {
+    nodes_[node.prev].next = node.next;
+  } else {
+    heads_[node.list] = node.next;
+    if (node.next == kNil) {
+      occupied_[node.list / kSlots] &= ~(uint64_t(1) << (node.list % kSlots));
+    }
+  }
+  if (node.next != kNil) {
+    nodes_[node.next].prev = node.prev;
+  }
+  node.prev = node.next = kNil;
+  num_pending_--;
+}
+
+void TimerWheel::Step(std::vector<Expired>* expired) {
+  now_tick_++;
+  // the upper levels first, so that their timers can fall down to the slots
+  // of the lower ones run in this very tick
+  for (int level = kLevels - 1; level > 0; --level) {
+    int shift = kSlotBits * level;
+    if ((now_tick_ & ((uint64_t(1) << shift) - 1)) != 0) {
+      continue;
+    }
+    auto list = level * kSlots + ((now_tick_ >> shift) & (kSlots - 1));
+    while (heads_[list] != kNil) {
+      auto index = heads_[list];
+      Unlink(index);
+      Link(index);
+    }
+  }
+
+  auto list = now_tick_ & (kSlots - 1);
+  size_t first = expired->size();
+  while (heads_[list] != kNil) {
+    auto index = heads_[list];
+    auto& node = nodes_[index];
+    assert(node.expiry == now_tick_);
+    Unlink(index);
+    bool periodic = node.period != Clock::duration::zero();
+    expired->push_back(Expired { MakeId(index, node.generation),
+                                 std::move(node.callback), periodic });
+    if (periodic) {
+      node.state = State::kRunning;
+    } else {
+      FreeNode(index);
+    }
+  }
+  // the list is in the reverse order of linking
+  std::reverse(expired->begin() + first, expired->end());
+}
+
+}  // namespace concurrency
+}  // namespace cnetpp
+
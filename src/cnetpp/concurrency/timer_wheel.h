@@ -0,0 +1,179 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef CNETPP_CONCURRENCY_TIMER_WHEEL_H_
+#define CNETPP_CONCURRENCY_TIMER_WHEEL_H_
+
+#include <cnetpp/concurrency/task_function.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <deque>
+#include <vector>
+
+namespace cnetpp {
+namespace concurrency {
+
+// A hierarchical timing wheel: kLevels wheels of kSlots slots, each slot of
+// a level spanning a whole turn of the level below. A timer goes into the
+// lowest level whose turn covers its deadline, and moves down a level each
+// time the slot holding it comes round, so that adding and cancelling a
+// timer take O(1) whatever the number of timers. The deadlines are rounded
+// up to the tick given to the constructor, the ones over the span of the
+// wheels wait in the top level and go round again.
+//
+// The timers live in a table indexed by the low 32 bits of their ids, the
+// high 32 bits hold a generation bumped each time the entry is reused, so
+// that a stale id is told apart from a live one.
+//
+// It isn't thread safe, the owner holds a lock around it.
+class TimerWheel final {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using TimerId = uint64_t;
+  static const TimerId kInvalidTimerId = 0;
+
+  static const int kLevels = 4;
+  static const int kSlotBits = 6;
+  static const size_t kSlots = 1 << kSlotBits;
+
+  struct Expired {
+    TimerId id;
+    TaskFunction callback;
+    // a periodic timer is kept until Rearm() or Release() is called for it
+    bool periodic;
+  };
+
+  explicit TimerWheel(Clock::duration tick = std::chrono::milliseconds(1),
+                      Clock::time_point now = Clock::now());
+
+  // disallow copy and move operations
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  // Add a timer firing 'delay' after 'now', and then every 'period' after
+  // it is rearmed if 'period' isn't zero.
+  TimerId Add(TaskFunction callback, Clock::time_point now,
+              Clock::duration delay,
+              Clock::duration period = Clock::duration::zero());
+
+  // Return false if the timer has fired or has been cancelled already. The
+  // callback of a pending timer is moved to 'callback' if it isn't null. A
+  // periodic timer handed out by Advance() is only marked, it goes away at
+  // Rearm().
+  bool Cancel(TimerId id, TaskFunction* callback = nullptr);
+
+  // Move the timers due at 'now' to 'expired', in the order of their
+  // deadlines.
+  void Advance(Clock::time_point now, std::vector<Expired>* expired);
+
+  // Put back a periodic timer handed out by Advance(), to fire again one
+  // period after 'now'. Return false and drop the timer if it has been
+  // cancelled in between, '*callback' is left to the caller then.
+  bool Rearm(TimerId id, TaskFunction* callback, Clock::time_point now);
+
+  // Drop a periodic timer handed out by Advance() instead of rearming it.
+  void Release(TimerId id);
+
+  // Cancel all the periodic timers, moving the callbacks of the pending ones
+  // to 'callbacks'.
+  void CancelPeriodic(std::vector<TaskFunction>* callbacks);
+
+  // The time the wheel has to be advanced at next, Clock::time_point::max()
+  // if there is no pending timer. It may come before the nearest deadline,
+  // when some timers have to move down a level.
+  Clock::time_point NextExpiry() const;
+
+  // the timers added and not dropped yet, the periodic ones handed out by
+  // Advance() included
+  size_t size() const {
+    return size_;
+  }
+
+  bool Empty() const {
+    return size_ == 0;
+  }
+
+ private:
+  static const uint32_t kNil = UINT32_MAX;
+
+  enum class State : uint8_t {
+    kFree,
+    kPending,
+    // a periodic timer handed out by Advance()
+    kRunning,
+    // a periodic timer cancelled while it was handed out
+    kCancelled,
+  };
+
+  struct Node {
+    TaskFunction callback;
+    Clock::duration period { Clock::duration::zero() };
+    // the tick it is due at
+    uint64_t expiry { 0 };
+    uint32_t prev { kNil };
+    uint32_t next { kNil };
+    uint32_t generation { 1 };
+    // level * kSlots + slot of the list it is in
+    uint16_t list { 0 };
+    State state { State::kFree };
+  };
+
+  const Clock::duration tick_;
+  const Clock::time_point start_;
+  // the last tick the wheel has been advanced to
+  uint64_t now_tick_ { 0 };
+
+  std::deque<Node> nodes_;
+  uint32_t free_head_ { kNil };
+  size_t size_ { 0 };
+  size_t num_pending_ { 0 };
+
+  uint32_t heads_[kLevels * kSlots];
+  // a bit per nonempty slot, per level
+  uint64_t occupied_[kLevels];
+
+  static TimerId MakeId(uint32_t index, uint32_t generation) {
+    return (static_cast<TimerId>(generation) << 32) | index;
+  }
+
+  Node* Find(TimerId id);
+  uint32_t NewNode();
+  void FreeNode(uint32_t index);
+
+  uint64_t ExpiryTick(Clock::time_point deadline) const;
+  void Link(uint32_t index);
+  void Unlink(uint32_t index);
+  void Step(std::vector<Expired>* expired);
+};
+
+}  // namespace concurrency
+}  // namespace cnetpp
+
+#endif  // CNETPP_CONCURRENCY_TIMER_WHEEL_H_
+
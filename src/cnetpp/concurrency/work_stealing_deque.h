@@ -0,0 +1,175 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef CNETPP_CONCURRENCY_WORK_STEALING_DEQUE_H_
+#define CNETPP_CONCURRENCY_WORK_STEALING_DEQUE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace cnetpp {
+namespace concurrency {
+
+// The Chase-Lev deque of "Dynamic Circular Work-Stealing Deque", with the
+// memory orders of "Correct and Efficient Work-Stealing for Weak Memory
+// Models". The owner thread pushes and pops at the bottom without any lock,
+// the other threads steal from the top with a CAS. It holds pointers only,
+// so that a slot can be read by a thief racing with the owner, the items
+// left in it when it is destroyed are not freed.
+template <typename T>
+class WorkStealingDeque final {
+ public:
+  explicit WorkStealingDeque(size_t capacity = 256) {
+    size_t n = 1;
+    while (n < capacity) {
+      n <<= 1;
+    }
+    arrays_.emplace_back(new Array(n));
+    array_.store(arrays_.back().get(), std::memory_order_relaxed);
+  }
+
+  // disallow copy and move operations
+  WorkStealingDeque(const WorkStealingDeque&) = delete;
+  WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+  // the owner thread only
+  void Push(T* item) {
+    int64_t bottom = bottom_.load(std::memory_order_relaxed);
+    int64_t top = top_.load(std::memory_order_acquire);
+    Array* array = array_.load(std::memory_order_relaxed);
+    if (bottom - top > array->mask()) {
+      array = Grow(array, top, bottom);
+    }
+    array->Put(bottom, item);
+    // publish the item to the thieves
+    bottom_.store(bottom + 1, std::memory_order_release);
+  }
+
+  // the owner thread only, the last pushed item or nullptr
+  T* Pop() {
+    int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+    Array* array = array_.load(std::memory_order_relaxed);
+    bottom_.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = top_.load(std::memory_order_relaxed);
+    T* item = nullptr;
+    if (top <= bottom) {
+      item = array->Get(bottom);
+      if (top == bottom) {
+        // the last one, race with the thieves for it
+        if (!top_.compare_exchange_strong(top, top + 1,
+                                          std::memory_order_seq_cst,
+                                          std::memory_order_relaxed)) {
+          item = nullptr;
+        }
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+      }
+    } else {
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return item;
+  }
+
+  // any thread, the first pushed item or nullptr if it is empty
+  T* Steal() {
+    while (true) {
+      int64_t top = top_.load(std::memory_order_acquire);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      int64_t bottom = bottom_.load(std::memory_order_acquire);
+      if (top >= bottom) {
+        return nullptr;
+      }
+      T* item = array_.load(std::memory_order_acquire)->Get(top);
+      if (top_.compare_exchange_strong(top, top + 1,
+                                       std::memory_order_seq_cst,
+                                       std::memory_order_relaxed)) {
+        return item;
+      }
+      // lost the item to another thief or to the owner, try the next one
+    }
+  }
+
+  // only a hint when other threads use it
+  size_t size() const {
+    int64_t bottom = bottom_.load(std::memory_order_relaxed);
+    int64_t top = top_.load(std::memory_order_relaxed);
+    return bottom > top ? static_cast<size_t>(bottom - top) : 0;
+  }
+  bool Empty() const {
+    return size() == 0;
+  }
+
+ private:
+  class Array final {
+   public:
+    explicit Array(size_t capacity)
+        : mask_(static_cast<int64_t>(capacity) - 1),
+          items_(new std::atomic<T*>[capacity]) {
+    }
+
+    int64_t mask() const {
+      return mask_;
+    }
+
+    T* Get(int64_t i) const {
+      return items_[i & mask_].load(std::memory_order_relaxed);
+    }
+    void Put(int64_t i, T* item) {
+      items_[i & mask_].store(item, std::memory_order_relaxed);
+    }
+
+   private:
+    int64_t mask_;
+    std::unique_ptr<std::atomic<T*>[]> items_;
+  };
+
+  Array* Grow(Array* array, int64_t top, int64_t bottom) {
+    arrays_.emplace_back(new Array(2 * (array->mask() + 1)));
+    Array* bigger = arrays_.back().get();
+    for (int64_t i = top; i < bottom; ++i) {
+      bigger->Put(i, array->Get(i));
+    }
+    // the old arrays are kept until the deque is destroyed, a thief may
+    // still be reading one of them
+    array_.store(bigger, std::memory_order_release);
+    return bigger;
+  }
+
+  alignas(64) std::atomic<int64_t> top_ { 0 };
+  alignas(64) std::atomic<int64_t> bottom_ { 0 };
+  std::atomic<Array*> array_;
+  std::vector<std::unique_ptr<Array>> arrays_;
+};
+
+}  // namespace concurrency
+}  // namespace cnetpp
+
+#endif  // CNETPP_CONCURRENCY_WORK_STEALING_DEQUE_H_
+
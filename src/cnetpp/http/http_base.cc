@@ -26,11 +26,37 @@
 //
 #include <cnetpp/http/http_base.h>
 #include <cnetpp/http/http_connection.h>
+#include <cnetpp/base/pool_allocator.h>
 #include <cnetpp/base/string_piece.h>
 
 namespace cnetpp {
 namespace http {
 
+bool HttpBase::Shutdown() {
+  if (!DoShutdown()) {
+    return false;
+  }
+  for (auto& shard : connection_shards_) {
+    std::lock_guard<std::mutex> guard(shard->mutex);
+    for (auto& http_connection : shard->http_connections) {
+      // break the cycle between the tcp connection and the http connection
+      http_connection.second->tcp_connection()->set_context(nullptr);
+    }
+    shard->http_connections.clear();
+  }
+  return true;
+}
+
+void HttpBase::InitConnectionShards(size_t worker_count) {
+  if (!connection_shards_.empty()) {
+    return;
+  }
+  auto count = tcp::EventCenter::PollerCount(worker_count);
+  for (size_t i = 0; i < count; ++i) {
+    connection_shards_.emplace_back(new ConnectionShard);
+  }
+}
+
 void HttpBase::SetCallbacks(tcp::TcpOptions& tcp_options) {
   tcp_options.set_connected_callback(
       [this] (std::shared_ptr<tcp::TcpConnection> c) -> bool {
@@ -57,10 +83,14 @@ void HttpBase::SetCallbacks(tcp::TcpOptions& tcp_options) {
 bool HttpBase::OnConnected(std::shared_ptr<tcp::TcpConnection> tcp_connection) {
   assert(tcp_connection.get());
 
-  auto http_connection = std::make_shared<HttpConnection>(tcp_connection);
-  http_connections_mutex_.lock();
-  http_connections_[tcp_connection->id()] = http_connection;
-  http_connections_mutex_.unlock();
+  auto http_connection = std::allocate_shared<HttpConnection>(
+      base::PoolAllocator<HttpConnection>(), tcp_connection);
+  tcp_connection->set_context(http_connection);
+  {
+    auto& shard = GetConnectionShard(tcp_connection->id());
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    shard.http_connections[tcp_connection->id()] = http_connection;
+  }
   HandleConnected(http_connection);
 
   return http_connection->OnConnected();
@@ -68,33 +98,25 @@ bool HttpBase::OnConnected(std::shared_ptr<tcp::TcpConnection> tcp_connection) {
 
 bool HttpBase::OnReceived(std::shared_ptr<tcp::TcpConnection> tcp_connection) {
   assert(tcp_connection.get());
-  http_connections_mutex_.lock();
-  auto itr = http_connections_.find(tcp_connection->id());
-  assert(itr != http_connections_.end());
-  auto http_connection = itr->second;
-  http_connections_mutex_.unlock();
+  auto http_connection = tcp_connection->context<HttpConnection>();
+  assert(http_connection);
   return http_connection->OnReceived();
 }
 
 bool HttpBase::OnSent(bool success,
                       std::shared_ptr<tcp::TcpConnection> tcp_connection) {
   assert(tcp_connection.get());
-  http_connections_mutex_.lock();
-  auto itr = http_connections_.find(tcp_connection->id());
-  assert(itr != http_connections_.end());
-  auto http_connection = itr->second;
-  http_connections_mutex_.unlock();
+  auto http_connection = tcp_connection->context<HttpConnection>();
+  assert(http_connection);
   return http_connection->OnSent(success);
 }
 
 bool HttpBase::OnClosed(std::shared_ptr<tcp::TcpConnection> tcp_connection) {
   assert(tcp_connection.get());
 
-  http_connections_mutex_.lock();
-  auto itr = http_connections_.find(tcp_connection->id());
+  auto http_connection = tcp_connection->shared_context<HttpConnection>();
   // the connection might haven't established.
-  if (itr == http_connections_.end()) {
-    http_connections_mutex_.unlock();
+  if (!http_connection) {
     auto http_options =
         std::static_pointer_cast<HttpOptions>(tcp_connection->cookie());
     if (http_options->closed_callback()) {
@@ -102,9 +124,12 @@ bool HttpBase::OnClosed(std::shared_ptr<tcp::TcpConnection> tcp_connection) {
     }
     return true;
   }
-  auto http_connection = itr->second;
-  http_connections_.erase(itr);
-  http_connections_mutex_.unlock();
+  tcp_connection->set_context(nullptr);
+  {
+    auto& shard = GetConnectionShard(tcp_connection->id());
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    shard.http_connections.erase(tcp_connection->id());
+  }
   bool ret = http_connection->OnClosed();
   return ret;
 }
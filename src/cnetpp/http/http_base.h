@@ -29,12 +29,14 @@
 
 #include <cnetpp/http/http_connection.h>
 #include <cnetpp/http/http_options.h>
+#include <cnetpp/tcp/event_center.h>
 #include <cnetpp/tcp/tcp_connection.h>
 #include <cnetpp/tcp/tcp_options.h>
 
 #include <memory>
 #include <mutex>
 #include <unordered_map>
+#include <vector>
 
 namespace cnetpp {
 namespace http {
@@ -48,18 +50,29 @@ class HttpBase {
   HttpBase(const HttpBase&) = delete;
   HttpBase& operator=(const HttpBase&) = delete;
 
-  bool Shutdown() {
-    if (!DoShutdown()) {
-      return false;
-    }
-    http_connections_.clear();
-    return true;
-  }
+  bool Shutdown();
 
  protected:
-  std::unordered_map<tcp::ConnectionId,
-                     std::shared_ptr<HttpConnection> > http_connections_;
-  std::mutex http_connections_mutex_;
+  // Each HttpConnection is kept in the context slot of its TcpConnection,
+  // which is what the callbacks use. The registry only owns them until they
+  // are closed or the shutdown, it is sharded the way the connections are
+  // spread over the event pollers, so a shard lock is mostly taken by a
+  // single poller thread.
+  struct ConnectionShard {
+    std::mutex mutex;
+    std::unordered_map<tcp::ConnectionId,
+                       std::shared_ptr<HttpConnection> > http_connections;
+  };
+  std::vector<std::unique_ptr<ConnectionShard>> connection_shards_;
+
+  ConnectionShard& GetConnectionShard(tcp::ConnectionId connection_id) {
+    return *connection_shards_[connection_id % connection_shards_.size()];
+  }
+
+  // Create a shard per event poller, it must be called before the first
+  // connection is made. The shards are never rebuilt, the pollers look them
+  // up without a lock.
+  void InitConnectionShards(size_t worker_count);
 
   void SetCallbacks(tcp::TcpOptions& tcp_options);
 
@@ -27,13 +27,17 @@
 #ifndef CNETPP_HTTP_HTTP_CALLBACKS_H_
 #define CNETPP_HTTP_HTTP_CALLBACKS_H_
 
+#include <cnetpp/base/string_piece.h>
+
 #include <functional>
 #include <memory>
+#include <string>
 
 namespace cnetpp {
 namespace http {
 
 class HttpConnection;
+class HttpResponse;
 
 using ConnectedCallbackType =
     std::function<bool(std::shared_ptr<HttpConnection>)>;
@@ -43,6 +47,29 @@ using ReceivedCallbackType =
 using SentCallbackType =
     std::function<bool(bool, std::shared_ptr<HttpConnection>)>;
 
+// Used for streaming the body of a http packet. The header received callback
+// is called as soon as the headers are parsed, then the body received
+// callback is called with every piece of the body, the piece is a view into
+// the receive buffer which is valid only during the call. The second
+// argument is true for the last piece, which may be empty.
+using HeaderReceivedCallbackType =
+    std::function<bool(std::shared_ptr<HttpConnection>)>;
+using BodyReceivedCallbackType = std::function<
+    bool(base::StringPiece, bool, std::shared_ptr<HttpConnection>)>;
+
+// Produces the body of a http packet piece by piece, it stores the next piece
+// into the first argument and sets the second argument to true with the last
+// piece. Producing nothing without the last flag means no data is ready, and
+// the producer will be called again after HttpConnection::ResumeSending().
+// Return false to abort the sending and close the connection.
+using BodyProducerType = std::function<bool(std::string*, bool*)>;
+
+// Called with the response of a request sent by HttpClient::Send(), or with
+// false and nullptr if the request failed. The connection has already been
+// put back into the pool when it is called.
+using ResponseCallbackType =
+    std::function<bool(bool, std::shared_ptr<HttpResponse>)>;
+
 }  // namespace http
 }  // namespace cnetpp
 
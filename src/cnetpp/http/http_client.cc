@@ -27,8 +27,14 @@
 #include <cnetpp/http/http_client.h>
 #include <cnetpp/http/http_connection.h>
 #include <cnetpp/http/http_response.h>
+#include <cnetpp/base/log.h>
+#include <cnetpp/base/pool_allocator.h>
 
-#include <netdb.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <utility>
 
 namespace cnetpp {
 namespace http {
@@ -40,51 +46,62 @@ tcp::ConnectionId HttpClient::Connect(const base::EndPoint* remote,
   return DoConnect(remote, new_http_options);
 }
 
+tcp::TcpClientOptions HttpClient::MakeTcpOptions(
+    const HttpClientOptions& http_options) {
+  tcp::TcpClientOptions options;
+  options.set_send_buffer_size(http_options.send_buffer_size());
+  options.set_receive_buffer_size(http_options.receive_buffer_size());
+  SetCallbacks(options);
+  return options;
+}
+
 tcp::ConnectionId HttpClient::DoConnect(
     const base::EndPoint* remote,
     std::shared_ptr<HttpClientOptions> http_options) {
-  tcp::TcpClientOptions options;
-  options.set_send_buffer_size(http_options->send_buffer_size());
-  options.set_receive_buffer_size(http_options->receive_buffer_size());
-  SetCallbacks(options);
+  auto options = MakeTcpOptions(*http_options);
   auto new_http_options = std::static_pointer_cast<void>(http_options);
   return tcp_client_.Connect(remote, options, new_http_options);
 }
 
-tcp::ConnectionId HttpClient::Connect(base::StringPiece url_str,
-                                      const HttpClientOptions& http_options) {
+void HttpClient::DoAsyncConnect(
+    const std::string& hostname,
+    uint16_t port,
+    std::shared_ptr<HttpClientOptions> http_options,
+    tcp::ConnectCallbackType callback) {
+  auto options = MakeTcpOptions(*http_options);
+  http_options->set_remote_hostname(hostname);
+  auto new_http_options = std::static_pointer_cast<void>(http_options);
+  tcp_client_.AsyncConnect(hostname,
+                           port,
+                           options,
+                           new_http_options,
+                           std::move(callback));
+}
+
+bool HttpClient::ParseUrl(base::StringPiece url_str, base::Uri* url) {
   std::string url_with_scheme = "";
   if (!url_str.starts_with("http")) {
     url_with_scheme.append("http://");
   }
   url_with_scheme.append(url_str.data(), url_str.length());
-  // parse url
+  return url->Parse(url_with_scheme);
+}
+
+tcp::ConnectionId HttpClient::Connect(base::StringPiece url_str,
+                                      const HttpClientOptions& http_options) {
   base::Uri url;
-  if (!url.Parse(url_with_scheme)) {
+  if (!ParseUrl(url_str, &url)) {
     return tcp::kInvalidConnectionId;
   }
-  
+
   // resolve address of url
-  struct addrinfo *presults = nullptr;
-  struct addrinfo hint;
-  bzero(&hint, sizeof(hint));
-  hint.ai_family = AF_UNSPEC;
-  hint.ai_socktype = SOCK_STREAM;
-  std::string port_str = std::to_string(url.Port());
-  if (getaddrinfo(url.Hostname().c_str(),
-                       port_str.c_str(),
-                       &hint,
-                       &presults) != 0 ||
-      !presults) {
+  auto& resolver = tcp_client_.resolver();
+  std::vector<base::IPAddress> addresses;
+  if (!resolver || !resolver->Resolve(url.Hostname(), &addresses) ||
+      addresses.empty()) {
     return tcp::kInvalidConnectionId;
   }
-  base::EndPoint endpoint;
-  // just pick the first item in presults as the ip address
-  if (!endpoint.FromSockAddr(*presults->ai_addr, presults->ai_addrlen)) {
-    freeaddrinfo(presults);
-    return tcp::kInvalidConnectionId;
-  }
-  freeaddrinfo(presults);
+  base::EndPoint endpoint(addresses.front(), url.Port());
 
   auto new_http_options =
       std::shared_ptr<HttpClientOptions>(new HttpClientOptions(http_options));
@@ -94,10 +111,59 @@ tcp::ConnectionId HttpClient::Connect(base::StringPiece url_str,
   return DoConnect(&endpoint, new_http_options);
 }
 
+bool HttpClient::AsyncConnect(base::StringPiece url_str,
+                              const HttpClientOptions& http_options) {
+  base::Uri url;
+  if (!ParseUrl(url_str, &url)) {
+    return false;
+  }
+
+  auto new_http_options =
+      std::shared_ptr<HttpClientOptions>(new HttpClientOptions(http_options));
+  DoAsyncConnect(url.Hostname(),
+                 url.Port(),
+                 new_http_options,
+                 [new_http_options] (tcp::ConnectionId connection_id) {
+    if (connection_id == tcp::kInvalidConnectionId &&
+        new_http_options->closed_callback()) {
+      new_http_options->closed_callback()(std::shared_ptr<HttpConnection>());
+    }
+  });
+  return true;
+}
+
 bool HttpClient::AsyncClose(tcp::ConnectionId connection_id) {
   return tcp_client_.AsyncClosed(connection_id);
 }
 
+bool HttpClient::DoShutdown() {
+  bool res = tcp_client_.Shutdown();
+
+  // no closed callback comes after the shutdown, fail the requests left
+  std::vector<PendingRequest> requests;
+  {
+    std::lock_guard<std::mutex> guard(host_pools_mutex_);
+    for (auto& host_pool : host_pools_) {
+      for (auto& connection : host_pool.second.connections) {
+        if (connection->request.callback) {
+          requests.emplace_back(std::move(connection->request));
+        }
+        connection->http_connection.reset();
+        connection->counted = false;
+        connection->closed = true;
+      }
+      for (auto& request : host_pool.second.waiting_requests) {
+        requests.emplace_back(std::move(request));
+      }
+    }
+    host_pools_.clear();
+  }
+  for (auto& request : requests) {
+    request.callback(false, nullptr);
+  }
+  return res;
+}
+
 bool HttpClient::HandleConnected(
     std::shared_ptr<HttpConnection> http_connection) {
   auto http_options = std::static_pointer_cast<HttpClientOptions>(
@@ -106,14 +172,409 @@ bool HttpClient::HandleConnected(
   http_connection->set_closed_callback(http_options->closed_callback());
   http_connection->set_received_callback(http_options->received_callback());
   http_connection->set_sent_callback(http_options->sent_callback());
+  http_connection->set_header_received_callback(
+      http_options->header_received_callback());
+  http_connection->set_body_received_callback(
+      http_options->body_received_callback());
   if (!http_options->remote_hostname().empty()) {
     http_connection->set_remote_hostname(http_options->remote_hostname());
   }
-  http_connection->set_http_packet(
-      std::shared_ptr<HttpPacket>(new HttpResponse));
+  http_connection->set_http_packet(std::allocate_shared<HttpResponse>(
+      base::PoolAllocator<HttpResponse>()));
   return true;
 }
 
+bool HttpClient::Send(base::StringPiece url_str,
+                      std::shared_ptr<HttpRequest> http_request,
+                      ResponseCallbackType callback) {
+  assert(http_request.get());
+  base::Uri url;
+  if (!ParseUrl(url_str, &url)) {
+    return false;
+  }
+
+  std::string request_uri = url.Path();
+  if (request_uri.empty()) {
+    request_uri = "/";
+  }
+  if (!url.Query().empty()) {
+    request_uri.append("?");
+    request_uri.append(url.Query());
+  }
+  http_request->set_uri(request_uri);
+  if (!http_request->HasHttpHeader("Host")) {
+    http_request->SetHttpHeader("Host", url.Host());
+  }
+
+  auto hostname = url.Hostname();
+  auto port = url.Port();
+  auto host_key = hostname + ":" + std::to_string(port);
+  PendingRequest request { std::move(http_request), std::move(callback) };
+
+  PooledConnectionPtr connection;
+  std::vector<PooledConnectionPtr> to_close;
+  bool open_new_connection = false;
+  {
+    std::lock_guard<std::mutex> guard(host_pools_mutex_);
+    auto& host_pool = host_pools_[host_key];
+    if (host_pool.hostname.empty()) {
+      host_pool.hostname = hostname;
+      host_pool.port = port;
+    }
+    connection = CheckOut(&host_pool, &to_close);
+    if (!connection) {
+      if (host_pool.total < options_.max_connections_per_host()) {
+        // reserve the slot before connecting
+        host_pool.total++;
+        open_new_connection = true;
+      } else {
+        host_pool.waiting_requests.emplace_back(std::move(request));
+      }
+    }
+  }
+  ClosePooledConnections(&to_close);
+
+  if (connection) {
+    Dispatch(std::move(connection), std::move(request));
+    return true;
+  }
+  if (open_new_connection) {
+    OpenPooledConnection(host_key, hostname, port, std::move(request));
+  }
+  return true;
+}
+
+HttpClient::PooledConnectionPtr HttpClient::CheckOut(
+    HostPool* host_pool,
+    std::vector<PooledConnectionPtr>* to_close) {
+  auto& idle_connections = host_pool->idle_connections;
+  // the least recently used ones are at the front, they expire first
+  auto now = std::chrono::steady_clock::now();
+  auto idle_timeout = std::chrono::milliseconds(options_.idle_timeout());
+  while (!idle_connections.empty() &&
+         now - idle_connections.front()->idle_since >= idle_timeout) {
+    CancelIdleTimer(idle_connections.front().get());
+    to_close->emplace_back(std::move(idle_connections.front()));
+    idle_connections.pop_front();
+  }
+  while (!idle_connections.empty()) {
+    auto connection = std::move(idle_connections.back());
+    idle_connections.pop_back();
+    CancelIdleTimer(connection.get());
+    if (IsHealthy(*connection)) {
+      return connection;
+    }
+    to_close->emplace_back(std::move(connection));
+  }
+  return nullptr;
+}
+
+bool HttpClient::IsHealthy(const PooledConnection& connection) {
+  if (!connection.http_connection) {
+    return false;
+  }
+  auto tcp_connection = connection.http_connection->tcp_connection();
+  if (tcp_connection->state() != tcp::TcpConnection::State::kConnected) {
+    return false;
+  }
+  // an idle connection must have nothing to read, otherwise the peer has
+  // either closed it or sent something unexpected
+  char c;
+  auto res = ::recv(tcp_connection->socket().fd(),
+                    &c,
+                    1,
+                    MSG_PEEK | MSG_DONTWAIT);
+  return res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+void HttpClient::ArmIdleTimer(const PooledConnectionPtr& connection) {
+  auto tcp_connection = connection->http_connection->tcp_connection();
+  auto event_center = tcp_connection->event_center();
+  if (!event_center) {
+    return;
+  }
+  // a connection checked out and parked again in the meantime has a new
+  // idle_since, the timer of the previous round must not close it
+  std::weak_ptr<PooledConnection> weak_connection = connection;
+  auto idle_since = connection->idle_since;
+  connection->idle_timer = event_center->AddTimer(options_.idle_timeout(),
+      [this, weak_connection, idle_since] () {
+    auto connection = weak_connection.lock();
+    if (connection) {
+      OnIdleTimeout(std::move(connection), idle_since);
+    }
+  }, tcp_connection->id());
+}
+
+void HttpClient::CancelIdleTimer(PooledConnection* connection) {
+  if (connection->idle_timer == tcp::EventCenter::kInvalidTimerId) {
+    return;
+  }
+  if (connection->http_connection) {
+    auto event_center =
+        connection->http_connection->tcp_connection()->event_center();
+    if (event_center) {
+      event_center->CancelTimer(connection->idle_timer);
+    }
+  }
+  connection->idle_timer = tcp::EventCenter::kInvalidTimerId;
+}
+
+void HttpClient::OnIdleTimeout(
+    PooledConnectionPtr connection,
+    std::chrono::steady_clock::time_point idle_since) {
+  std::vector<PooledConnectionPtr> to_close;
+  {
+    std::lock_guard<std::mutex> guard(host_pools_mutex_);
+    if (connection->closed || connection->idle_since != idle_since) {
+      return;
+    }
+    auto host_pool_itr = host_pools_.find(connection->host_key);
+    if (host_pool_itr == host_pools_.end()) {
+      return;
+    }
+    auto& idle_connections = host_pool_itr->second.idle_connections;
+    auto itr = std::find(idle_connections.begin(),
+                         idle_connections.end(),
+                         connection);
+    if (itr == idle_connections.end()) {
+      // it has been checked out
+      return;
+    }
+    idle_connections.erase(itr);
+    connection->idle_timer = tcp::EventCenter::kInvalidTimerId;
+    to_close.emplace_back(std::move(connection));
+  }
+  ClosePooledConnections(&to_close);
+}
+
+void HttpClient::ClosePooledConnections(
+    std::vector<PooledConnectionPtr>* to_close) {
+  for (auto& connection : *to_close) {
+    std::shared_ptr<HttpConnection> http_connection;
+    {
+      std::lock_guard<std::mutex> guard(host_pools_mutex_);
+      if (connection->counted) {
+        connection->counted = false;
+        host_pools_[connection->host_key].total--;
+      }
+      http_connection = connection->http_connection;
+    }
+    if (http_connection) {
+      tcp_client_.AsyncClosed(http_connection->id());
+    }
+  }
+  to_close->clear();
+}
+
+void HttpClient::OpenPooledConnection(const std::string& host_key,
+                                      const std::string& hostname,
+                                      uint16_t port,
+                                      PendingRequest&& request) {
+  auto connection = std::make_shared<PooledConnection>();
+  connection->host_key = host_key;
+  connection->request = std::move(request);
+
+  {
+    std::lock_guard<std::mutex> guard(host_pools_mutex_);
+    host_pools_[host_key].connections.insert(connection);
+  }
+
+  // the options live as long as the tcp connection, holding the pooled
+  // connection strongly would make a cycle
+  std::weak_ptr<PooledConnection> weak_connection = connection;
+  auto http_options = std::make_shared<HttpClientOptions>(options_);
+  http_options->set_header_received_callback(nullptr);
+  http_options->set_body_received_callback(nullptr);
+  http_options->set_sent_callback(nullptr);
+  http_options->set_connected_callback(
+      [this, weak_connection] (std::shared_ptr<HttpConnection> c) -> bool {
+    auto connection = weak_connection.lock();
+    return connection && OnPooledConnected(connection, std::move(c));
+  });
+  http_options->set_received_callback(
+      [this, weak_connection] (std::shared_ptr<HttpConnection> c) -> bool {
+    auto connection = weak_connection.lock();
+    return connection && OnPooledReceived(connection, std::move(c));
+  });
+  http_options->set_closed_callback(
+      [this, weak_connection] (std::shared_ptr<HttpConnection> c) -> bool {
+    (void) c;
+    auto connection = weak_connection.lock();
+    if (connection) {
+      OnPooledClosed(connection);
+    }
+    return true;
+  });
+  DoAsyncConnect(hostname,
+                 port,
+                 http_options,
+                 [this, connection] (tcp::ConnectionId connection_id) {
+    if (connection_id == tcp::kInvalidConnectionId) {
+      CnetppWarn("[HttpClient] failed to connect to %s",
+                 connection->host_key.c_str());
+      // no closed callback will come for it
+      OnPooledClosed(connection);
+    }
+  });
+}
+
+void HttpClient::Dispatch(PooledConnectionPtr connection,
+                          PendingRequest&& request) {
+  auto http_request = request.http_request;
+  std::shared_ptr<HttpConnection> http_connection;
+  {
+    std::lock_guard<std::mutex> guard(host_pools_mutex_);
+    if (!connection->closed) {
+      http_connection = connection->http_connection;
+      connection->request = std::move(request);
+    }
+  }
+  if (!http_connection) {
+    // it has been closed on the way, as if it had been after sending
+    if (request.callback) {
+      request.callback(false, nullptr);
+    }
+    return;
+  }
+  if (!http_connection->SendPacket(http_request)) {
+    tcp_client_.AsyncClosed(http_connection->id());
+  }
+}
+
+void HttpClient::Release(PooledConnectionPtr connection) {
+  PendingRequest waiting_request;
+  bool has_waiting_request = false;
+  bool close = false;
+  std::shared_ptr<HttpConnection> http_connection;
+  {
+    std::lock_guard<std::mutex> guard(host_pools_mutex_);
+    if (!connection->counted || connection->closed) {
+      return;
+    }
+    http_connection = connection->http_connection;
+    auto& host_pool = host_pools_[connection->host_key];
+    if (!host_pool.waiting_requests.empty()) {
+      waiting_request = std::move(host_pool.waiting_requests.front());
+      host_pool.waiting_requests.pop_front();
+      has_waiting_request = true;
+    } else if (host_pool.idle_connections.size() <
+               options_.max_idle_connections_per_host()) {
+      connection->idle_since = std::chrono::steady_clock::now();
+      host_pool.idle_connections.emplace_back(connection);
+      ArmIdleTimer(connection);
+    } else {
+      connection->counted = false;
+      host_pool.total--;
+      close = true;
+    }
+  }
+  if (has_waiting_request) {
+    Dispatch(std::move(connection), std::move(waiting_request));
+  } else if (close) {
+    tcp_client_.AsyncClosed(http_connection->id());
+  }
+}
+
+bool HttpClient::OnPooledConnected(
+    PooledConnectionPtr connection,
+    std::shared_ptr<HttpConnection> http_connection) {
+  PendingRequest request;
+  {
+    std::lock_guard<std::mutex> guard(host_pools_mutex_);
+    connection->http_connection = http_connection;
+    request = std::move(connection->request);
+    connection->request = PendingRequest();
+  }
+  Dispatch(std::move(connection), std::move(request));
+  return true;
+}
+
+bool HttpClient::OnPooledReceived(
+    PooledConnectionPtr connection,
+    std::shared_ptr<HttpConnection> http_connection) {
+  // the packet of the connection is reset after this callback, take over
+  // its content
+  auto http_response = std::make_shared<HttpResponse>();
+  http_response->Swap(
+      static_cast<HttpResponse*>(http_connection->http_packet().get()));
+  PendingRequest request;
+  {
+    std::lock_guard<std::mutex> guard(host_pools_mutex_);
+    request = std::move(connection->request);
+    connection->request = PendingRequest();
+  }
+  // give the connection back before calling the callback, so that a request
+  // sent from the callback can reuse it
+  if (http_response->IsKeepAlive()) {
+    Release(std::move(connection));
+  } else {
+    tcp_client_.AsyncClosed(http_connection->id());
+  }
+  if (request.callback) {
+    request.callback(true, std::move(http_response));
+  }
+  return true;
+}
+
+void HttpClient::OnPooledClosed(PooledConnectionPtr connection) {
+  PendingRequest request;
+  PendingRequest waiting_request;
+  bool open_new_connection = false;
+  std::string hostname;
+  uint16_t port = 0;
+  {
+    std::lock_guard<std::mutex> guard(host_pools_mutex_);
+    connection->closed = true;
+    request = std::move(connection->request);
+    connection->request = PendingRequest();
+    // break the cycle between the connection and the callbacks holding it
+    connection->http_connection.reset();
+
+    // the pool is gone if the client has been shut down
+    auto host_pool_itr = host_pools_.find(connection->host_key);
+    if (host_pool_itr != host_pools_.end()) {
+      auto& host_pool = host_pool_itr->second;
+      if (connection->counted) {
+        connection->counted = false;
+        host_pool.total--;
+      }
+      host_pool.connections.erase(connection);
+      auto& idle_connections = host_pool.idle_connections;
+      for (auto itr = idle_connections.begin();
+           itr != idle_connections.end();
+           ++itr) {
+        if (*itr == connection) {
+          idle_connections.erase(itr);
+          break;
+        }
+      }
+      if (!host_pool.waiting_requests.empty() &&
+          host_pool.total < options_.max_connections_per_host()) {
+        waiting_request = std::move(host_pool.waiting_requests.front());
+        host_pool.waiting_requests.pop_front();
+        host_pool.total++;
+        open_new_connection = true;
+        hostname = host_pool.hostname;
+        port = host_pool.port;
+      } else if (host_pool.total == 0 && host_pool.connections.empty() &&
+                 host_pool.waiting_requests.empty()) {
+        host_pools_.erase(host_pool_itr);
+      }
+    }
+  }
+
+  if (request.callback) {
+    request.callback(false, nullptr);
+  }
+  if (open_new_connection) {
+    OpenPooledConnection(connection->host_key,
+                         hostname,
+                         port,
+                         std::move(waiting_request));
+  }
+}
+
 }  // namespace http
 }  // namespace cnetpp
 
@@ -29,11 +29,20 @@
 
 #include <cnetpp/http/http_base.h>
 #include <cnetpp/http/http_connection.h>
+#include <cnetpp/http/http_request.h>
 #include <cnetpp/tcp/tcp_client.h>
 #include <cnetpp/base/end_point.h>
 #include <cnetpp/base/uri.h>
 
+#include <chrono>
+#include <deque>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace cnetpp {
 namespace http {
@@ -44,27 +53,123 @@ class HttpClient final : public HttpBase {
   ~HttpClient() = default;
 
   bool Launch(const HttpClientOptions& http_options = HttpClientOptions()) {
+    options_ = http_options;
+    InitConnectionShards(http_options.worker_count());
     tcp::TcpClientOptions options;
     options.set_worker_count(http_options.worker_count());
+    options.set_resolver(http_options.resolver());
     return tcp_client_.Launch("hcli", options);
   }
 
   tcp::ConnectionId Connect(const base::EndPoint* remote,
                             const HttpClientOptions& options);
+  // It waits for the host name in 'url' to be resolved, which is done by the
+  // resolver thread, so it must not be called from the resolver callbacks.
+  // Then it returns as soon as the connect to the first address has started,
+  // the way Connect(remote, options) does, see AsyncConnect() to race over
+  // all the addresses.
   tcp::ConnectionId Connect(base::StringPiece url,
                             const HttpClientOptions& options);
 
+  // Connect to 'url' without blocking the caller. It returns false only if
+  // 'url' is invalid, if the host name can't be resolved or the connect
+  // fails, the closed callback of 'options' is called with nullptr.
+  bool AsyncConnect(base::StringPiece url, const HttpClientOptions& options);
+
   bool AsyncClose(tcp::ConnectionId connection_id);
 
+  // Send 'http_request' to 'url' over a keep-alive connection of the pool of
+  // the (host, port) in 'url'. An idle connection is reused if there is a
+  // healthy one, else a new connection is opened unless the pool is full, in
+  // which case the request waits for a connection to be released.
+  // 'callback' is called with the response in an event poller thread, the
+  // connection goes back to the pool before that if the response is
+  // keep-alive. The pool limits come from the options passed to Launch().
+  bool Send(base::StringPiece url,
+            std::shared_ptr<HttpRequest> http_request,
+            ResponseCallbackType callback);
+
  private:
+  struct PendingRequest {
+    std::shared_ptr<HttpRequest> http_request;
+    ResponseCallbackType callback;
+  };
+
+  // The fields are guarded by host_pools_mutex_, the request is handed to
+  // the connection by the caller of Send() while the poller thread may be
+  // closing it.
+  struct PooledConnection {
+    std::string host_key;
+    std::shared_ptr<HttpConnection> http_connection;
+    // the request being served on this connection
+    PendingRequest request;
+    std::chrono::steady_clock::time_point idle_since;
+    // closes it once it has been idle for the idle timeout
+    tcp::EventCenter::TimerId idle_timer { tcp::EventCenter::kInvalidTimerId };
+    // false once it is no longer counted in the pool
+    bool counted { true };
+    // true once the connection is closed, no request can be handed to it
+    bool closed { false };
+  };
+  using PooledConnectionPtr = std::shared_ptr<PooledConnection>;
+
+  // It's erased once it has no connection and no waiting request.
+  struct HostPool {
+    std::string hostname;
+    uint16_t port { 0 };
+    // the number of connections counted against the limit, including the
+    // ones being opened
+    size_t total { 0 };
+    // owns all the opened connections until they are closed
+    std::unordered_set<PooledConnectionPtr> connections;
+    // the most recently used connection is at the back
+    std::deque<PooledConnectionPtr> idle_connections;
+    std::deque<PendingRequest> waiting_requests;
+  };
+
   tcp::TcpClient tcp_client_;
+  HttpClientOptions options_;
+
+  std::unordered_map<std::string, HostPool> host_pools_;
+  std::mutex host_pools_mutex_;
 
+  static bool ParseUrl(base::StringPiece url_str, base::Uri* url);
+
+  // Take a healthy idle connection out of 'host_pool', the expired and broken
+  // ones met on the way are moved into 'to_close'.
+  // NOTE: host_pools_mutex_ must be held
+  PooledConnectionPtr CheckOut(HostPool* host_pool,
+                               std::vector<PooledConnectionPtr>* to_close);
+  static bool IsHealthy(const PooledConnection& connection);
+  // NOTE: host_pools_mutex_ must be held
+  void ArmIdleTimer(const PooledConnectionPtr& connection);
+  static void CancelIdleTimer(PooledConnection* connection);
+  void OnIdleTimeout(PooledConnectionPtr connection,
+                     std::chrono::steady_clock::time_point idle_since);
+  void ClosePooledConnections(std::vector<PooledConnectionPtr>* to_close);
+
+  void OpenPooledConnection(const std::string& host_key,
+                            const std::string& hostname,
+                            uint16_t port,
+                            PendingRequest&& request);
+  void Dispatch(PooledConnectionPtr connection, PendingRequest&& request);
+  void Release(PooledConnectionPtr connection);
+
+  bool OnPooledConnected(PooledConnectionPtr connection,
+                         std::shared_ptr<HttpConnection> http_connection);
+  bool OnPooledReceived(PooledConnectionPtr connection,
+                        std::shared_ptr<HttpConnection> http_connection);
+  void OnPooledClosed(PooledConnectionPtr connection);
+
+  tcp::TcpClientOptions MakeTcpOptions(const HttpClientOptions& http_options);
   tcp::ConnectionId DoConnect(const base::EndPoint* remote,
                               std::shared_ptr<HttpClientOptions> http_options);
+  void DoAsyncConnect(const std::string& hostname,
+                      uint16_t port,
+                      std::shared_ptr<HttpClientOptions> http_options,
+                      tcp::ConnectCallbackType callback);
 
-  bool DoShutdown() override {
-    return tcp_client_.Shutdown();
-  }
+  bool DoShutdown() override;
 
   bool HandleConnected(
       std::shared_ptr<HttpConnection> http_connection) override;
@@ -25,15 +25,80 @@
 // POSSIBILITY OF SUCH DAMAGE.
 //
 #include <cnetpp/http/http_connection.h>
+#include <cnetpp/http/http_response.h>
 #include <cnetpp/base/string_utils.h>
 
+#include <stdio.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+
 namespace cnetpp {
 namespace http {
 
+std::unique_ptr<tcp::RingBuffer> HttpConnection::HeadersToRingBuffer(
+    const HttpPacket& http_packet) {
+  if (!default_headers_) {
+    return http_packet.HttpHeadersToRingBuffer();
+  }
+  thread_local std::vector<base::StringPiece> default_header_lines;
+  default_header_lines.clear();
+  default_headers_->Collect(http_packet, &default_header_lines);
+  return http_packet.HttpHeadersToRingBuffer(&default_header_lines);
+}
+
+void HttpConnection::OnResponding(const HttpPacket& http_packet) {
+  // an interim 1xx response is followed by the final one of the same request
+  auto http_response = dynamic_cast<const HttpResponse*>(&http_packet);
+  if (http_response) {
+    auto status = static_cast<int>(http_response->status());
+    if (status >= 100 && status < 200) {
+      return;
+    }
+  }
+  int unanswered = unanswered_requests_.load(std::memory_order_relaxed);
+  while (unanswered > 0 &&
+         !unanswered_requests_.compare_exchange_weak(unanswered,
+                                                     unanswered - 1)) {
+  }
+}
+
+bool HttpConnection::Idle() {
+  if (unanswered_requests_.load() > 0 ||
+      receive_status_ != ReceiveStatus::kWaitingHeader ||
+      !tcp_connection_->recv_buffer().Empty()) {
+    return false;
+  }
+  std::lock_guard<std::mutex> guard(body_producer_mutex_);
+  return !body_producer_;
+}
+
 bool HttpConnection::SendPacket(std::shared_ptr<HttpPacket> http_packet) {
-  std::string str_packet;
-  http_packet->ToString(&str_packet);
-  return SendPacket(str_packet);
+  OnResponding(*http_packet);
+  auto headers = HeadersToRingBuffer(*http_packet);
+  if (http_packet->http_body().empty()) {
+    return tcp_connection_->SendPacket(std::move(headers));
+  }
+  base::StringPiece body(http_packet->http_body());
+  return tcp_connection_->SendPacket(std::move(headers),
+                                     body,
+                                     std::move(http_packet));
+}
+
+bool HttpConnection::SendFile(std::shared_ptr<HttpPacket> http_packet,
+                              int fd,
+                              off_t offset,
+                              size_t length,
+                              std::shared_ptr<void> file_owner) {
+  if (!http_packet->HasHttpHeader("Content-Length")) {
+    http_packet->SetHttpHeader("Content-Length", std::to_string(length));
+  }
+  OnResponding(*http_packet);
+  return tcp_connection_->SendFile(HeadersToRingBuffer(*http_packet),
+                                   fd,
+                                   offset,
+                                   length,
+                                   std::move(file_owner));
 }
 
 bool HttpConnection::SendPacket(base::StringPiece data) {
@@ -57,6 +122,11 @@ bool HttpConnection::OnClosed() {
 bool HttpConnection::OnReceived() {
   auto& recv_buffer = tcp_connection_->mutable_recv_buffer();
   while (true) {
+    if (receive_status_ != ReceiveStatus::kCompleted &&
+        tcp_connection_->read_paused()) {
+      // the rest will be processed after ResumeReceiving() is called
+      return true;
+    }
     switch (receive_status_) {
       case ReceiveStatus::kWaitingHeader: {
         base::StringPiece header;
@@ -69,16 +139,21 @@ bool HttpConnection::OnReceived() {
         }
         receive_status_ = ReceiveStatus::kWaitingBody;
         recv_buffer.CommitRead(header.length() + 4);
+        // counted here, a streaming handler may answer before the body ends
+        unanswered_requests_++;
+        if (header_received_callback_ &&
+            !header_received_callback_(shared_from_this())) {
+          return false;
+        }
         break;
       }
       case ReceiveStatus::kWaitingBody: {
-        int content_length = http_packet_->GetContentLength();
-        if (content_length >= 0) {
-          if (!recv_buffer.Read(&(http_packet_->mutable_http_body()),
-                                content_length)) {
-            return true;
-          }
-        } else {
+        int64_t content_length = http_packet_->GetContentLength();
+        if (content_length > 0) {
+          remaining_body_length_ = content_length;
+          receive_status_ = ReceiveStatus::kReceivingBody;
+          break;
+        } else if (content_length < 0) {
           // process "Transfer-Encoding: chunked" case
           std::string* chunked = nullptr;
           if (http_packet_->GetHttpHeader("Transfer-Encoding", &chunked) &&
@@ -87,37 +162,59 @@ bool HttpConnection::OnReceived() {
             break;
           }
         }
+        if (!DeliverBody(base::StringPiece(), true)) {
+          return false;
+        }
         receive_status_ = ReceiveStatus::kCompleted;
         break;
       }
+      case ReceiveStatus::kReceivingBody: {
+        if (recv_buffer.Empty()) {
+          return true;  // no enough data
+        }
+        if (!ConsumeBody(&recv_buffer, &remaining_body_length_, true)) {
+          return false;
+        }
+        if (remaining_body_length_ == 0) {
+          receive_status_ = ReceiveStatus::kCompleted;
+        }
+        break;
+      }
       case ReceiveStatus::kWaitingChunkSize: {
         base::StringPiece chunk_size_line;
         if (!recv_buffer.Find("\r\n", &chunk_size_line)) {
           return true;  // no enough data
         }
-        if (chunk_size_line.size() == 0) {
-          // should not happen
+        if (!HttpPacket::ParseChunkSize(chunk_size_line,
+                                        &current_chunk_size_)) {
           return false;
         }
-        if (chunk_size_line[0] == '0') {  // last chunk
+        recv_buffer.CommitRead(chunk_size_line.length() + 2);
+        if (current_chunk_size_ == 0) {  // last chunk
           receive_status_ = ReceiveStatus::kWaitingChunkTrailer;
-          recv_buffer.CommitRead(chunk_size_line.length() + 2);
-          break;
+        } else {
+          receive_status_ = ReceiveStatus::kWaitingChunkData;
         }
-        current_chunk_size_ =
-            base::StringUtils::HexStrToInteger(chunk_size_line, nullptr);
-        recv_buffer.CommitRead(chunk_size_line.length() + 2);
-        receive_status_ = ReceiveStatus::kWaitingChunkData;
         break;
       }
       case ReceiveStatus::kWaitingChunkData: {
-        base::StringPiece chunk_size_line;
-        if (!recv_buffer.Read(&(http_packet_->mutable_http_body()),
-                              current_chunk_size_ + 2)) {  // chunk_data + \r\n
+        if (recv_buffer.Empty()) {
           return true;  // no enough data
         }
-        http_packet_->mutable_http_body().erase(
-            http_packet_->http_body().length() - 2, 2);
+        if (!ConsumeBody(&recv_buffer, &current_chunk_size_, false)) {
+          return false;
+        }
+        if (current_chunk_size_ == 0) {
+          receive_status_ = ReceiveStatus::kWaitingChunkDataEnd;
+        }
+        break;
+      }
+      case ReceiveStatus::kWaitingChunkDataEnd: {
+        // the "\r\n" following the chunk data
+        if (recv_buffer.Size() < 2) {
+          return true;  // no enough data
+        }
+        recv_buffer.CommitRead(2);
         receive_status_ = ReceiveStatus::kWaitingChunkSize;
         break;
       }
@@ -126,9 +223,14 @@ bool HttpConnection::OnReceived() {
         if (!recv_buffer.Find("\r\n", &trailer_line)) {
           return true;
         }
-        // just ignore the trailer
+        // just ignore the trailer, an empty line ends it
         recv_buffer.CommitRead(trailer_line.length() + 2);
-        receive_status_ = ReceiveStatus::kCompleted;
+        if (trailer_line.empty()) {
+          if (!DeliverBody(base::StringPiece(), true)) {
+            return false;
+          }
+          receive_status_ = ReceiveStatus::kCompleted;
+        }
         break;
       }
       case ReceiveStatus::kCompleted:
@@ -147,7 +249,178 @@ bool HttpConnection::OnReceived() {
   return true;
 }
 
+bool HttpConnection::ConsumeBody(tcp::RingBuffer* recv_buffer,
+                                 int64_t* remaining,
+                                 bool last) {
+  struct iovec read_positions[2];
+  recv_buffer->GetReadPositions(read_positions, 2);
+  size_t length = std::min(static_cast<size_t>(*remaining),
+                           read_positions[0].iov_len);
+  *remaining -= length;
+  base::StringPiece data(static_cast<const char*>(read_positions[0].iov_base),
+                         length);
+  // the data is a view into the receive buffer, it can only be committed
+  // after being consumed
+  bool ret = DeliverBody(data, last && *remaining == 0);
+  recv_buffer->CommitRead(length);
+  return ret;
+}
+
+bool HttpConnection::DeliverBody(base::StringPiece data, bool last) {
+  if (body_received_callback_) {
+    return body_received_callback_(data, last, shared_from_this());
+  }
+  http_packet_->mutable_http_body().append(data.data(), data.size());
+  return true;
+}
+
+bool HttpConnection::SendPacket(std::shared_ptr<HttpPacket> http_packet,
+                                BodyProducerType body_producer) {
+  assert(body_producer);
+  bool chunked = !http_packet->HasHttpHeader("Content-Length");
+  if (chunked) {
+    http_packet->SetHttpHeader("Transfer-Encoding", "chunked");
+  }
+  {
+    std::lock_guard<std::mutex> guard(body_producer_mutex_);
+    assert(!body_producer_);
+    body_producer_ = std::move(body_producer);
+    body_chunked_ = chunked;
+    body_chunk_open_ = false;
+    body_produced_all_ = false;
+    // the headers are the first piece in flight, the body is pulled after
+    // they are sent
+    body_in_flight_ = true;
+    body_finished_ = false;
+    body_resume_requested_ = false;
+  }
+  return SendPacket(http_packet);
+}
+
+void HttpConnection::ResumeSending() {
+  {
+    std::lock_guard<std::mutex> guard(body_producer_mutex_);
+    if (!body_producer_) {
+      return;
+    }
+    if (body_in_flight_) {
+      body_resume_requested_ = true;
+      return;
+    }
+  }
+  PullBody();
+}
+
+void HttpConnection::PullBody() {
+  BodyProducerType body_producer;
+  {
+    std::lock_guard<std::mutex> guard(body_producer_mutex_);
+    if (!body_producer_ || body_in_flight_ || body_finished_) {
+      return;
+    }
+    body_in_flight_ = true;
+    body_producer = body_producer_;
+  }
+
+  while (true) {
+    std::string data;
+    bool last = false;
+    if (body_produced_all_) {
+      last = true;  // only the last chunk is left
+    } else if (!body_producer(&data, &last)) {
+      {
+        std::lock_guard<std::mutex> guard(body_producer_mutex_);
+        body_producer_ = nullptr;
+        body_in_flight_ = false;
+      }
+      MarkAsClosed();
+      return;
+    }
+    if (last && body_chunked_ && !data.empty()) {
+      // the "\r\n" ending this chunk goes out with the last chunk, which
+      // can only be sent after the data
+      body_produced_all_ = true;
+      last = false;
+    }
+    if (data.empty() && last && !body_chunked_) {
+      // the body has been sent completely with the previous piece
+      {
+        std::lock_guard<std::mutex> guard(body_producer_mutex_);
+        body_producer_ = nullptr;
+        body_in_flight_ = false;
+      }
+      if (sent_callback_) {
+        sent_callback_(true, shared_from_this());
+      }
+      return;
+    }
+    if (!data.empty() || last) {
+      {
+        std::lock_guard<std::mutex> guard(body_producer_mutex_);
+        body_finished_ = last;
+      }
+      if (!SendBody(std::move(data), last)) {
+        MarkAsClosed();
+      }
+      return;
+    }
+    // nothing is ready, wait for ResumeSending() unless it has been called
+    // while producing
+    std::lock_guard<std::mutex> guard(body_producer_mutex_);
+    if (!body_resume_requested_) {
+      body_in_flight_ = false;
+      return;
+    }
+    body_resume_requested_ = false;
+  }
+}
+
+bool HttpConnection::SendBody(std::string&& data, bool last) {
+  // the data is sent without being copied, the "\r\n" ending a chunk goes
+  // out in front of the next chunk size line
+  char chunk_header[64];
+  int chunk_header_length = 0;
+  if (body_chunked_) {
+    // the last chunk never carries data, see PullBody()
+    assert(!last || data.empty());
+    chunk_header_length = ::snprintf(chunk_header, sizeof(chunk_header),
+        "%s%zx\r\n%s", body_chunk_open_ ? "\r\n" : "", data.size(),
+        last ? "\r\n" : "");
+    body_chunk_open_ = !last;
+  }
+  std::unique_ptr<tcp::RingBuffer> buffer;
+  if (chunk_header_length > 0) {
+    buffer = std::make_unique<tcp::RingBuffer>(chunk_header_length);
+    buffer->Write(base::StringPiece(chunk_header, chunk_header_length));
+  }
+  if (data.empty()) {
+    return tcp_connection_->SendPacket(std::move(buffer));
+  }
+  auto body = std::make_shared<std::string>(std::move(data));
+  base::StringPiece body_data(*body);
+  return tcp_connection_->SendPacket(std::move(buffer),
+                                     body_data,
+                                     std::move(body));
+}
+
 bool HttpConnection::OnSent(bool success) {
+  bool pull_body = false;
+  {
+    std::lock_guard<std::mutex> guard(body_producer_mutex_);
+    if (body_producer_) {
+      if (!success || body_finished_) {
+        body_producer_ = nullptr;
+      } else {
+        pull_body = true;
+      }
+      body_in_flight_ = false;
+      body_resume_requested_ = false;
+    }
+  }
+  if (pull_body) {
+    PullBody();
+    return true;
+  }
   if (!sent_callback_) {
     return true;
   }
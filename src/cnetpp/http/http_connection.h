@@ -28,12 +28,16 @@
 #define CNETPP_HTTP_HTTP_CONNECTION_H_
 
 #include <cnetpp/http/http_callbacks.h>
+#include <cnetpp/http/http_default_headers.h>
 #include <cnetpp/http/http_packet.h>
 #include <cnetpp/tcp/tcp_connection.h>
 
 #include <assert.h>
 
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <string>
 
 namespace cnetpp {
 namespace http {
@@ -105,6 +109,27 @@ class HttpConnection : public std::enable_shared_from_this<HttpConnection> {
     sent_callback_ = sent_callback;
   }
 
+  const HeaderReceivedCallbackType& header_received_callback() const {
+    return header_received_callback_;
+  }
+  void set_header_received_callback(
+      const HeaderReceivedCallbackType& header_received_callback) {
+    header_received_callback_ = header_received_callback;
+  }
+
+  const BodyReceivedCallbackType& body_received_callback() const {
+    return body_received_callback_;
+  }
+  void set_body_received_callback(
+      const BodyReceivedCallbackType& body_received_callback) {
+    body_received_callback_ = body_received_callback;
+  }
+
+  void set_default_headers(
+      std::shared_ptr<const HttpDefaultHeaders> default_headers) {
+    default_headers_ = std::move(default_headers);
+  }
+
   std::shared_ptr<HttpPacket> http_packet() {
     return http_packet_;
   }
@@ -112,8 +137,39 @@ class HttpConnection : public std::enable_shared_from_this<HttpConnection> {
     http_packet_ = http_packet;
   }
 
+  // The body of 'http_packet' is sent without being copied, so the packet
+  // must not be modified after being passed in here. The default headers
+  // are only added to packets sent through this method.
   bool SendPacket(std::shared_ptr<HttpPacket> http_packet);
   bool SendPacket(base::StringPiece data);
+  // Send the start line and headers of 'http_packet', then pull the body from
+  // 'body_producer' each time the previous piece has been written to the
+  // socket. If 'http_packet' has no Content-Length header, the body is sent
+  // with chunked transfer encoding. The sent callback is called once the
+  // whole body is sent. No other packet should be sent on this connection
+  // before that.
+  bool SendPacket(std::shared_ptr<HttpPacket> http_packet,
+                  BodyProducerType body_producer);
+  // Call the body producer again after it has produced nothing
+  void ResumeSending();
+
+  // Send the start line and headers of 'http_packet' followed by 'length'
+  // bytes of the file 'fd' from 'offset', see tcp::TcpConnection::SendFile().
+  // Content-Length is set to 'length' if 'http_packet' doesn't have one.
+  bool SendFile(std::shared_ptr<HttpPacket> http_packet,
+                int fd,
+                off_t offset,
+                size_t length,
+                std::shared_ptr<void> file_owner = nullptr);
+
+  // Stop and restart receiving data from the peer, used by the consumer of a
+  // streamed body to slow the peer down. They can be called from any thread.
+  bool PauseReceiving() {
+    return tcp_connection_->PauseReceiving();
+  }
+  bool ResumeReceiving() {
+    return tcp_connection_->ResumeReceiving();
+  }
 
   bool OnConnected();
 
@@ -123,6 +179,14 @@ class HttpConnection : public std::enable_shared_from_this<HttpConnection> {
 
   bool OnClosed();
 
+  // True if no request is being received or waiting for its response and
+  // no body is being produced, so that a draining server can close it.
+  // Called in the event poller thread of the connection. A request counts
+  // from its headers on, and as answered once the headers of its final
+  // response, not an interim 1xx one, have been passed to SendPacket() or
+  // SendFile(). Raw data and the pieces of a produced body don't count.
+  bool Idle();
+
   void MarkAsClosed(bool immediately = true) {
     if (tcp_connection_.get()) {
       tcp_connection_->MarkAsClosed(immediately);
@@ -137,20 +201,56 @@ class HttpConnection : public std::enable_shared_from_this<HttpConnection> {
     kWaitingChunkData = 3,
     kWaitingChunkTrailer = 4,
     kCompleted = 5,
+    kReceivingBody = 6,
+    kWaitingChunkDataEnd = 7,
   };
 
+  // Pass the first contiguous piece of at most 'remaining' bytes in the
+  // receive buffer to the body, 'last' is true if it is the end of the body
+  // once 'remaining' drops to 0.
+  bool ConsumeBody(tcp::RingBuffer* recv_buffer, int64_t* remaining, bool last);
+  bool DeliverBody(base::StringPiece data, bool last);
+
+  // serialize the headers of 'http_packet' with the default headers
+  std::unique_ptr<tcp::RingBuffer> HeadersToRingBuffer(
+      const HttpPacket& http_packet);
+
+  void PullBody();
+  // Send one piece of the body produced, framed as a chunk if needed
+  bool SendBody(std::string&& data, bool last);
+
+  // one less request waiting for its response, unless http_packet is an
+  // interim response
+  void OnResponding(const HttpPacket& http_packet);
+
   std::string remote_hostname_;  // just used for http client
   tcp::ConnectionId connection_id_;
 
   std::shared_ptr<tcp::TcpConnection> tcp_connection_ { nullptr };
   std::shared_ptr<HttpPacket> http_packet_ { nullptr };
+  std::shared_ptr<const HttpDefaultHeaders> default_headers_ { nullptr };
   ReceiveStatus receive_status_ { ReceiveStatus::kWaitingHeader };
   int64_t current_chunk_size_ { 0 };
+  int64_t remaining_body_length_ { 0 };
+  // the requests whose headers are received and not answered yet
+  std::atomic<int> unanswered_requests_ { 0 };
+
+  // the state of the body being sent by a BodyProducerType
+  std::mutex body_producer_mutex_;
+  BodyProducerType body_producer_ { nullptr };
+  bool body_chunked_ { false };
+  bool body_chunk_open_ { false };  // the ending "\r\n" isn't sent yet
+  bool body_in_flight_ { false };  // being produced or being sent
+  bool body_produced_all_ { false };  // the producer has returned the last
+  bool body_finished_ { false };  // the last piece is being sent
+  bool body_resume_requested_ { false };
 
   ConnectedCallbackType connected_callback_ { nullptr };
   ClosedCallbackType closed_callback_ { nullptr };
   ReceivedCallbackType received_callback_ { nullptr };
   SentCallbackType sent_callback_ { nullptr };
+  HeaderReceivedCallbackType header_received_callback_ { nullptr };
+  BodyReceivedCallbackType body_received_callback_ { nullptr };
 };
 
 }  // namespace http
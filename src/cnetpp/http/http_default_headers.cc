@@ -0,0 +1,109 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include <cnetpp/http/http_default_headers.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <time.h>
+
+namespace cnetpp {
+namespace http {
+
+HttpDefaultHeaders::HttpDefaultHeaders(
+    const std::vector<std::pair<std::string, std::string>>& headers,
+    bool add_date_header) : add_date_header_(add_date_header) {
+  for (auto& header : headers) {
+    Header h;
+    h.name = header.first;
+    h.offset = serialized_headers_.size();
+    serialized_headers_.append(header.first);
+    serialized_headers_.append(": ");
+    serialized_headers_.append(header.second);
+    serialized_headers_.append("\r\n");
+    h.length = serialized_headers_.size() - h.offset;
+    headers_.emplace_back(std::move(h));
+  }
+}
+
+void HttpDefaultHeaders::Collect(const HttpPacket& http_packet,
+                                 std::vector<base::StringPiece>* lines) const {
+  assert(lines);
+  if (add_date_header_ && !http_packet.HasHttpHeader("Date")) {
+    lines->push_back(DateLine());
+  }
+
+  // in the common case the response sets none of the default headers, and
+  // the whole block goes out as one piece
+  bool overridden = false;
+  for (auto& header : headers_) {
+    if (http_packet.HasHttpHeader(header.name)) {
+      overridden = true;
+      break;
+    }
+  }
+  if (!overridden) {
+    if (!serialized_headers_.empty()) {
+      lines->emplace_back(serialized_headers_);
+    }
+    return;
+  }
+  for (auto& header : headers_) {
+    if (!http_packet.HasHttpHeader(header.name)) {
+      lines->emplace_back(serialized_headers_.data() + header.offset,
+                          header.length);
+    }
+  }
+}
+
+base::StringPiece HttpDefaultHeaders::DateLine() {
+  static const char* kWeekDays[] = {
+    "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+  };
+  static const char* kMonths[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+  };
+  thread_local time_t last_second = 0;
+  thread_local char date_line[64];
+  thread_local int date_line_length = 0;
+
+  time_t now = ::time(nullptr);
+  if (now != last_second) {
+    struct tm tm;
+    ::gmtime_r(&now, &tm);
+    date_line_length = ::snprintf(date_line, sizeof(date_line),
+        "Date: %s, %02d %s %04d %02d:%02d:%02d GMT\r\n",
+        kWeekDays[tm.tm_wday], tm.tm_mday, kMonths[tm.tm_mon],
+        tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    last_second = now;
+  }
+  return base::StringPiece(date_line, date_line_length);
+}
+
+}  // namespace http
+}  // namespace cnetpp
+
@@ -0,0 +1,82 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef CNETPP_HTTP_HTTP_DEFAULT_HEADERS_H_
+#define CNETPP_HTTP_HTTP_DEFAULT_HEADERS_H_
+
+#include <cnetpp/http/http_packet.h>
+#include <cnetpp/base/string_piece.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cnetpp {
+namespace http {
+
+// The headers a HttpServer adds to every response it sends. The constant
+// ones are serialized once when the server is launched, and the Date header
+// is formatted at most once per second on each thread, so that adding them
+// costs no formatting and no HttpHeaders::Set() per response.
+class HttpDefaultHeaders final {
+ public:
+  HttpDefaultHeaders(
+      const std::vector<std::pair<std::string, std::string>>& headers,
+      bool add_date_header);
+  ~HttpDefaultHeaders() = default;
+
+  bool Empty() const {
+    return !add_date_header_ && headers_.empty();
+  }
+
+  // Append the serialized lines of the default headers 'http_packet' does
+  // not set itself to 'lines'. The pieces are valid until the next call on
+  // the same thread.
+  void Collect(const HttpPacket& http_packet,
+               std::vector<base::StringPiece>* lines) const;
+
+  // "Date: <IMF-fixdate>\r\n" of the current second, the piece is valid
+  // until the next call on the same thread.
+  static base::StringPiece DateLine();
+
+ private:
+  struct Header {
+    std::string name;
+    size_t offset;
+    size_t length;
+  };
+
+  bool add_date_header_ { false };
+  // all the constant headers serialized back to back
+  std::string serialized_headers_;
+  std::vector<Header> headers_;
+};
+
+}  // namespace http
+}  // namespace cnetpp
+
+#endif  // CNETPP_HTTP_HTTP_DEFAULT_HEADERS_H_
+
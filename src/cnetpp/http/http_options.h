@@ -28,6 +28,12 @@
 #define CNETPP_HTTP_HTTP_OPTIONS_H_
 
 #include <cnetpp/http/http_callbacks.h>
+#include <cnetpp/base/resolver.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace cnetpp {
 namespace http {
@@ -103,6 +109,25 @@ class HttpOptions {
     sent_callback_ = sent_callback;
   }
 
+  // When the body received callback is set, the body of the received packets
+  // is streamed to it instead of being buffered in the packet, and the
+  // received callback is called with an empty body once the packet is done.
+  HeaderReceivedCallbackType header_received_callback() const {
+    return header_received_callback_;
+  }
+  void set_header_received_callback(
+      HeaderReceivedCallbackType header_received_callback) {
+    header_received_callback_ = header_received_callback;
+  }
+
+  BodyReceivedCallbackType body_received_callback() const {
+    return body_received_callback_;
+  }
+  void set_body_received_callback(
+      BodyReceivedCallbackType body_received_callback) {
+    body_received_callback_ = body_received_callback;
+  }
+
  private:
   size_t worker_count_ { 0 };
   size_t tcp_send_buffer_size_ {32 * 1024 };
@@ -113,6 +138,8 @@ class HttpOptions {
   ClosedCallbackType closed_callback_ { nullptr };
   ReceivedCallbackType received_callback_ { nullptr };
   SentCallbackType sent_callback_ { nullptr };
+  HeaderReceivedCallbackType header_received_callback_ { nullptr };
+  BodyReceivedCallbackType body_received_callback_ { nullptr };
 };
 
 class HttpClientOptions : public HttpOptions {
@@ -130,14 +157,75 @@ class HttpClientOptions : public HttpOptions {
     remote_hostname_ = std::move(remote_hostname);
   }
 
+  // The limits of the keep-alive connection pool used by HttpClient::Send(),
+  // each (host, port) has its own pool.
+  size_t max_connections_per_host() const {
+    return max_connections_per_host_;
+  }
+  void set_max_connections_per_host(size_t max_connections_per_host) {
+    max_connections_per_host_ = max_connections_per_host;
+  }
+
+  size_t max_idle_connections_per_host() const {
+    return max_idle_connections_per_host_;
+  }
+  void set_max_idle_connections_per_host(
+      size_t max_idle_connections_per_host) {
+    max_idle_connections_per_host_ = max_idle_connections_per_host;
+  }
+
+  // in milliseconds, an idle connection is closed once it has been idle for
+  // this long
+  int64_t idle_timeout() const {
+    return idle_timeout_;
+  }
+  void set_idle_timeout(int64_t idle_timeout) {
+    idle_timeout_ = idle_timeout;
+  }
+
+  // The resolver of the host names in urls, base::Resolver::Default() if it
+  // is not set. Only the one passed to HttpClient::Launch() is used.
+  const std::shared_ptr<base::Resolver>& resolver() const {
+    return resolver_;
+  }
+  void set_resolver(std::shared_ptr<base::Resolver> resolver) {
+    resolver_ = std::move(resolver);
+  }
+
  private:
   std::string remote_hostname_;
+  size_t max_connections_per_host_ { 64 };
+  size_t max_idle_connections_per_host_ { 8 };
+  int64_t idle_timeout_ { 60000 };
+  std::shared_ptr<base::Resolver> resolver_;
 };
 
 class HttpServerOptions : public HttpOptions {
  public:
   HttpServerOptions() = default;
   ~HttpServerOptions() = default;
+
+  // The default headers are added to every response sent through
+  // HttpConnection::SendPacket(std::shared_ptr<HttpPacket>), unless the
+  // response already has a header with the same name.
+  const std::vector<std::pair<std::string, std::string>>&
+      default_headers() const {
+    return default_headers_;
+  }
+  void AddDefaultHeader(const std::string& name, const std::string& value) {
+    default_headers_.emplace_back(name, value);
+  }
+
+  bool add_date_header() const {
+    return add_date_header_;
+  }
+  void set_add_date_header(bool add_date_header) {
+    add_date_header_ = add_date_header;
+  }
+
+ private:
+  std::vector<std::pair<std::string, std::string>> default_headers_;
+  bool add_date_header_ { false };
 };
 
 }  // namespace http
@@ -27,6 +27,8 @@
 #include <cnetpp/http/http_packet.h>
 #include <cnetpp/base/string_utils.h>
 
+#include <limits>
+
 namespace cnetpp {
 namespace http {
 
@@ -57,6 +59,24 @@ std::string HttpPacket::HttpHeaders::ToString() const {
   return result;
 }
 
+size_t HttpPacket::HttpHeaders::ByteSize() const {
+  size_t size = 0;
+  for (auto& http_header : http_headers_) {
+    size += http_header.first.length() + http_header.second.length() + 4;
+  }
+  return size;
+}
+
+void HttpPacket::HttpHeaders::AppendToRingBuffer(
+    tcp::RingBuffer* result) const {
+  for (auto& http_header : http_headers_) {
+    result->Write(http_header.first);
+    result->Write(": ");
+    result->Write(http_header.second);
+    result->Write("\r\n");
+  }
+}
+
 // Get a header value. return false if it does not exist.
 // the header name is not case sensitive.
 bool HttpPacket::HttpHeaders::Get(base::StringPiece name, std::string** value) {
@@ -222,6 +242,34 @@ std::string HttpPacket::HttpHeadersToString() const {
   return result;
 }
 
+std::unique_ptr<tcp::RingBuffer> HttpPacket::HttpHeadersToRingBuffer(
+    const std::vector<base::StringPiece>* extra_headers) const {
+  std::string start_line;
+  base::StringPiece cached_start_line = CachedStartLine();
+  if (cached_start_line.empty()) {
+    AppendStartLineToString(&start_line);
+    start_line.append("\r\n");
+    cached_start_line.set(start_line);
+  }
+
+  size_t length = cached_start_line.size() + http_headers_.ByteSize() + 2;
+  if (extra_headers) {
+    for (auto& extra_header : *extra_headers) {
+      length += extra_header.size();
+    }
+  }
+  auto result = std::make_unique<tcp::RingBuffer>(length);
+  result->Write(cached_start_line);
+  http_headers_.AppendToRingBuffer(result.get());
+  if (extra_headers) {
+    for (auto& extra_header : *extra_headers) {
+      result->Write(extra_header);
+    }
+  }
+  result->Write("\r\n");
+  return result;
+}
+
 void HttpPacket::AppendToString(std::string* result) const {
   AppendHttpHeadersToString(result);
   result->append(http_body_);
@@ -335,18 +383,48 @@ bool HttpPacket::ParseHttpHeaders(base::StringPiece data, ErrorType* error) {
     return false;
   }
 
+  if (pos == data.size()) {
+    // no header at all
+    return true;
+  }
   return http_headers_.Parse(data.substr(pos + 1), &error_placeholder);
 }
 
-int HttpPacket::GetContentLength() {
+int64_t HttpPacket::GetContentLength() {
   std::string content_length;
   if (!GetHttpHeader("Content-Length", &content_length)) {
     return -1;
   }
-  int length = std::strtol(content_length.c_str(), NULL, 10);
+  int64_t length = std::strtoll(content_length.c_str(), NULL, 10);
   return (length >= 0) ? length : -1;
 };
 
+bool HttpPacket::ParseChunkSize(base::StringPiece line, int64_t* size) {
+  *size = 0;
+  bool has_digit = false;
+  for (size_t i = 0; i < line.size(); ++i) {
+    int digit = 0;
+    char c = line[i];
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      digit = c - 'A' + 10;
+    } else if (c == ';' || c == ' ' || c == '\t') {
+      break;
+    } else {
+      return false;
+    }
+    if (*size > (std::numeric_limits<int64_t>::max() >> 4)) {
+      return false;
+    }
+    *size = *size * 16 + digit;
+    has_digit = true;
+  }
+  return has_digit;
+}
+
 bool HttpPacket::IsKeepAlive() const {
   const std::string* alive;
   if (!GetHttpHeader("Connection", &alive)) {
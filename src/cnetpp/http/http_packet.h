@@ -28,8 +28,10 @@
 #define CNETPP_HTTP_HTTP_PACKET_H_
 
 #include <cnetpp/base/string_piece.h>
+#include <cnetpp/tcp/ring_buffer.h>
 
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -93,6 +95,12 @@ class HttpPacket {
     void ToString(std::string* result) const;
     std::string ToString() const;
 
+    // The number of bytes AppendToString() will append
+    size_t ByteSize() const;
+    // Like AppendToString(), but write into a buffer which has at least
+    // ByteSize() bytes of free space.
+    void AppendToRingBuffer(tcp::RingBuffer* result) const;
+
     bool Parse(base::StringPiece data, ErrorType* error = NULL);
 
     void Clear();
@@ -139,9 +147,13 @@ class HttpPacket {
     http_body_.assign(body.data(), body.size());
   }
 
-  int GetContentLength();
+  int64_t GetContentLength();
   bool IsKeepAlive() const;
 
+  // Parse the size of a chunk from its size line without the ending "\r\n",
+  // the chunk extensions are ignored.
+  static bool ParseChunkSize(base::StringPiece line, int64_t* size);
+
   // Get the header value.
   const HttpHeaders& http_headers() const {
     return http_headers_;
@@ -185,12 +197,24 @@ class HttpPacket {
   void ToString(std::string* result) const;
   std::string ToString() const;
 
+  // Serialize the start line and headers into a buffer allocated with the
+  // exact size needed, the body is left out so that it can be sent without
+  // being copied. 'extra_headers' are already serialized header lines which
+  // are appended after the packet's own headers.
+  std::unique_ptr<tcp::RingBuffer> HttpHeadersToRingBuffer(
+      const std::vector<base::StringPiece>* extra_headers = nullptr) const;
+
  protected:
   static const char* GetVersionString(Version http_version);
   static Version GetVersionNumber(base::StringPiece http_version);
 
   // append without ending "\r\n"
   virtual void AppendStartLineToString(std::string* result) const = 0;
+  // return the preformatted start line with ending "\r\n", or an empty
+  // piece if there is none for this packet
+  virtual base::StringPiece CachedStartLine() const {
+    return base::StringPiece();
+  }
   virtual bool ParseStartLine(base::StringPiece data, ErrorType* error) = 0;
 
   void Swap(HttpPacket* that) {
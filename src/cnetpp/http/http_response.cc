@@ -27,6 +27,8 @@
 #include <cnetpp/http/http_response.h>
 #include <cnetpp/base/string_utils.h>
 
+#include <vector>
+
 namespace cnetpp {
 namespace http {
 
@@ -88,10 +90,58 @@ void HttpResponse::Reset() {
   status_ = StatusCode::kUnknown;
 }
 
+base::StringPiece HttpResponse::CachedStartLine() const {
+  // "HTTP/1.x <status> <reason phrase>\r\n" of every known status code,
+  // indexed by [http version - kVersion10][status code - kMinStatusCode]
+  static const int kMinStatusCode = 100;
+  static const int kMaxStatusCode = 599;
+  static const std::vector<std::vector<std::string>> kStartLines = [] {
+    std::vector<std::vector<std::string>> start_lines(2,
+        std::vector<std::string>(kMaxStatusCode - kMinStatusCode + 1));
+    for (auto& status_reason : kStatusReasonPhases) {
+      int status = static_cast<int>(status_reason.first);
+      if (!status_reason.second ||
+          status < kMinStatusCode ||
+          status > kMaxStatusCode) {
+        continue;
+      }
+      for (auto version : { Version::kVersion10, Version::kVersion11 }) {
+        std::string& start_line =
+            start_lines[static_cast<int>(version) -
+                        static_cast<int>(Version::kVersion10)]
+                       [status - kMinStatusCode];
+        start_line.append(GetVersionString(version));
+        start_line.append(" ");
+        start_line.append(std::to_string(status));
+        start_line.append(" ");
+        start_line.append(status_reason.second);
+        start_line.append("\r\n");
+      }
+    }
+    return start_lines;
+  }();
+
+  int status = static_cast<int>(status_);
+  if ((http_version() != Version::kVersion10 &&
+       http_version() != Version::kVersion11) ||
+      status < kMinStatusCode ||
+      status > kMaxStatusCode) {
+    return base::StringPiece();
+  }
+  return kStartLines[static_cast<int>(http_version()) -
+                     static_cast<int>(Version::kVersion10)]
+                    [status - kMinStatusCode];
+}
+
 // without "\r\n"
 void HttpResponse::AppendStartLineToString(std::string* result) const {
   assert(http_version() != Version::kVersionUnknown);
   assert(result);
+  base::StringPiece cached_start_line = CachedStartLine();
+  if (!cached_start_line.empty()) {
+    result->append(cached_start_line.data(), cached_start_line.size() - 2);
+    return;
+  }
   result->append(GetVersionString(HttpPacket::http_version()));
   result->append(" ");
   result->append(std::to_string(static_cast<int>(status_)));
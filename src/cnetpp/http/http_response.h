@@ -111,6 +111,7 @@ class HttpResponse final : public HttpPacket {
 
  private:
   virtual void AppendStartLineToString(std::string* result) const;
+  virtual base::StringPiece CachedStartLine() const;
   virtual bool ParseStartLine(base::StringPiece data, ErrorType* error);
 
   StatusCode status_;
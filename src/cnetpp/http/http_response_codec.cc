@@ -0,0 +1,146 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include <cnetpp/http/http_response_codec.h>
+#include <cnetpp/http/http_response.h>
+
+namespace cnetpp {
+namespace http {
+
+void HttpResponseCodec::Encode(uint64_t correlation_id,
+                               base::StringPiece request,
+                               std::string* frame) {
+  (void) correlation_id;
+  assert(frame);
+  frame->append(request.data(), request.size());
+}
+
+int HttpResponseCodec::Decode(tcp::RingBuffer* buffer,
+                              uint64_t* correlation_id,
+                              std::string* response) {
+  (void) correlation_id;
+  assert(buffer);
+  assert(response);
+  while (true) {
+    switch (state_) {
+      case State::kWaitingHeader: {
+        base::StringPiece header;
+        if (!buffer->Find("\r\n\r\n", &header)) {
+          return buffer->Size() > max_header_size_ ? -1 : 0;
+        }
+        HttpResponse http_response;
+        if (header.size() > max_header_size_ ||
+            !http_response.ParseHttpHeaders(header, nullptr)) {
+          return -1;
+        }
+        message_.clear();
+        buffer->Read(&message_, header.size() + 4);
+        auto status = static_cast<int>(http_response.status());
+        if (status >= 100 && status < 200) {
+          // an interim response, the final one follows
+          break;
+        }
+        if (status == 204 || status == 304) {
+          return Complete(response);
+        }
+        std::string transfer_encoding;
+        if (http_response.GetHttpHeader("Transfer-Encoding",
+                                        &transfer_encoding) &&
+            base::StringPiece(transfer_encoding).ignore_case_equal(
+                "chunked")) {
+          state_ = State::kWaitingChunkSize;
+          break;
+        }
+        remaining_length_ = http_response.GetContentLength();
+        if (remaining_length_ < 0) {
+          return -1;
+        }
+        state_ = State::kWaitingBody;
+        break;
+      }
+      case State::kWaitingBody: {
+        if (static_cast<int64_t>(buffer->Size()) < remaining_length_) {
+          return 0;
+        }
+        buffer->Read(&message_, remaining_length_);
+        return Complete(response);
+      }
+      case State::kWaitingChunkSize: {
+        base::StringPiece chunk_size_line;
+        if (!buffer->Find("\r\n", &chunk_size_line)) {
+          return 0;
+        }
+        int64_t chunk_size = 0;
+        if (!HttpPacket::ParseChunkSize(chunk_size_line, &chunk_size)) {
+          return -1;
+        }
+        buffer->Read(&message_, chunk_size_line.size() + 2);
+        if (chunk_size == 0) {
+          state_ = State::kWaitingChunkTrailer;
+        } else {
+          remaining_length_ = chunk_size + 2;
+          state_ = State::kWaitingChunkData;
+        }
+        break;
+      }
+      case State::kWaitingChunkData: {
+        if (static_cast<int64_t>(buffer->Size()) < remaining_length_) {
+          return 0;
+        }
+        buffer->Read(&message_, remaining_length_);
+        state_ = State::kWaitingChunkSize;
+        break;
+      }
+      case State::kWaitingChunkTrailer: {
+        base::StringPiece trailer_line;
+        if (!buffer->Find("\r\n", &trailer_line)) {
+          return 0;
+        }
+        // an empty line ends the trailer
+        bool last = trailer_line.empty();
+        buffer->Read(&message_, trailer_line.size() + 2);
+        if (last) {
+          return Complete(response);
+        }
+        break;
+      }
+      default:
+        assert(false);
+        return -1;
+    }
+  }
+}
+
+int HttpResponseCodec::Complete(std::string* response) {
+  response->swap(message_);
+  message_.clear();
+  state_ = State::kWaitingHeader;
+  return 1;
+}
+
+}  // namespace http
+}  // namespace cnetpp
+
@@ -0,0 +1,95 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef CNETPP_HTTP_HTTP_RESPONSE_CODEC_H_
+#define CNETPP_HTTP_HTTP_RESPONSE_CODEC_H_
+
+#include <cnetpp/tcp/request_codec.h>
+#include <cnetpp/tcp/ring_buffer.h>
+#include <cnetpp/base/string_piece.h>
+
+#include <stdint.h>
+
+#include <string>
+
+namespace cnetpp {
+namespace http {
+
+// Frames the HTTP/1.1 requests pipelined by a tcp::RequestChannel, the
+// responses are matched with the requests in the order they are sent:
+//   auto channel = std::make_shared<tcp::RequestChannel>(
+//       std::make_shared<HttpResponseCodec>());
+//   auto future = channel->Call(http_request->ToString(), 1000);
+// A request is sent as it is given, e.g. a serialized HttpRequest. A
+// response is the whole message, which HttpResponse::ParseHttpHeaders() can
+// read up to the body. Its body must be framed by Content-Length or by the
+// chunked encoding, a body ended by the close of the connection can't be
+// pipelined and is taken as malformed. The interim 1xx responses are
+// skipped. The responses to HEAD requests are not supported, as their
+// headers describe a body which is not sent.
+class HttpResponseCodec final : public tcp::RequestCodec {
+ public:
+  explicit HttpResponseCodec(size_t max_header_size = 64 * 1024)
+      : max_header_size_(max_header_size) {
+  }
+  ~HttpResponseCodec() = default;
+
+  bool HasCorrelationId() const override {
+    return false;
+  }
+
+  void Encode(uint64_t correlation_id,
+              base::StringPiece request,
+              std::string* frame) override;
+
+  int Decode(tcp::RingBuffer* buffer,
+             uint64_t* correlation_id,
+             std::string* response) override;
+
+ private:
+  enum class State {
+    kWaitingHeader,
+    kWaitingBody,
+    kWaitingChunkSize,
+    // the chunk data and its ending "\r\n"
+    kWaitingChunkData,
+    kWaitingChunkTrailer,
+  };
+
+  size_t max_header_size_;
+  // the state of the response being decoded, which may arrive in pieces
+  State state_ { State::kWaitingHeader };
+  int64_t remaining_length_ { 0 };
+  std::string message_;
+
+  int Complete(std::string* response);
+};
+
+}  // namespace http
+}  // namespace cnetpp
+
+#endif  // CNETPP_HTTP_HTTP_RESPONSE_CODEC_H_
+
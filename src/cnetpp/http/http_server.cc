@@ -27,13 +27,31 @@
 #include <cnetpp/http/http_server.h>
 #include <cnetpp/http/http_request.h>
 #include <cnetpp/tcp/tcp_options.h>
+#include <cnetpp/base/pool_allocator.h>
 
 namespace cnetpp {
 namespace http {
 
 bool HttpServer::Launch(const base::EndPoint& local_address,
                         const HttpServerOptions& http_options) {
+  InitConnectionShards(http_options.worker_count());
+  return tcp_server_.Launch(local_address, MakeTcpOptions(http_options));
+}
+
+bool HttpServer::Launch(int listen_fd,
+                        const HttpServerOptions& http_options) {
+  InitConnectionShards(http_options.worker_count());
+  return tcp_server_.Launch(listen_fd, MakeTcpOptions(http_options));
+}
+
+tcp::TcpServerOptions HttpServer::MakeTcpOptions(
+    const HttpServerOptions& http_options) {
   options_ = http_options;
+  auto default_headers = std::make_shared<HttpDefaultHeaders>(
+      http_options.default_headers(), http_options.add_date_header());
+  if (!default_headers->Empty()) {
+    default_headers_ = default_headers;
+  }
 
   tcp::TcpServerOptions tcp_options;
   tcp_options.set_name("hsvr");
@@ -44,7 +62,13 @@ bool HttpServer::Launch(const base::EndPoint& local_address,
   tcp_options.set_send_buffer_size(http_options.send_buffer_size());
   tcp_options.set_receive_buffer_size(http_options.receive_buffer_size());
   SetCallbacks(tcp_options);
-  return tcp_server_.Launch(local_address, tcp_options);
+  tcp_options.set_idle_callback(
+      [] (std::shared_ptr<tcp::TcpConnection> c) -> bool {
+        auto http_connection = c->context<HttpConnection>();
+        return !http_connection || http_connection->Idle();
+      }
+  );
+  return tcp_options;
 }
 
 bool HttpServer::HandleConnected(
@@ -53,7 +77,13 @@ bool HttpServer::HandleConnected(
   http_connection->set_closed_callback(options_.closed_callback());
   http_connection->set_received_callback(options_.received_callback());
   http_connection->set_sent_callback(options_.sent_callback());
-  http_connection->set_http_packet(std::shared_ptr<HttpPacket>(new HttpRequest));
+  http_connection->set_header_received_callback(
+      options_.header_received_callback());
+  http_connection->set_body_received_callback(
+      options_.body_received_callback());
+  http_connection->set_default_headers(default_headers_);
+  http_connection->set_http_packet(std::allocate_shared<HttpRequest>(
+      base::PoolAllocator<HttpRequest>()));
   return true;
 }
 
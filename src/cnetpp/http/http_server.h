@@ -28,10 +28,13 @@
 #define CNETPP_HTTP_HTTP_SERVER_H_
 
 #include <cnetpp/http/http_base.h>
+#include <cnetpp/http/http_default_headers.h>
 #include <cnetpp/http/http_options.h>
 #include <cnetpp/base/end_point.h>
 #include <cnetpp/tcp/tcp_server.h>
 
+#include <string>
+
 namespace cnetpp {
 namespace http {
 
@@ -43,10 +46,29 @@ class HttpServer final : public HttpBase {
   // you must first call this method before you do any requests
   bool Launch(const base::EndPoint& local_address,
               const HttpServerOptions& options = HttpServerOptions());
+  // Launch on a listening socket, see tcp::TcpServer::Launch()
+  bool Launch(int listen_fd,
+              const HttpServerOptions& options = HttpServerOptions());
+
+  // Stop accepting, close the keep-alive connections which are idle and the
+  // others once their last request has been answered, then shut down. The
+  // connections still open after 'timeout' milliseconds are closed at once.
+  bool GracefulShutdown(int64_t timeout) {
+    tcp_server_.Drain(timeout);
+    return Shutdown();
+  }
+
+  // see tcp::TcpServer::HandOff() and tcp::TcpServer::ReceiveListenSocket()
+  bool HandOff(const std::string& path) {
+    return tcp_server_.HandOff(path);
+  }
 
  private:
   tcp::TcpServer tcp_server_;
   HttpServerOptions options_;
+  std::shared_ptr<const HttpDefaultHeaders> default_headers_ { nullptr };
+
+  tcp::TcpServerOptions MakeTcpOptions(const HttpServerOptions& options);
 
   bool DoShutdown() override {
     return tcp_server_.Shutdown();
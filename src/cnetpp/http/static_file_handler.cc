@@ -0,0 +1,296 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include <cnetpp/http/static_file_handler.h>
+#include <cnetpp/http/http_request.h>
+#include <cnetpp/base/log.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <limits>
+
+namespace cnetpp {
+namespace http {
+
+namespace {
+
+struct ContentType {
+  const char* extension;
+  const char* content_type;
+};
+
+const ContentType kContentTypes[] = {
+  { "css", "text/css" },
+  { "gif", "image/gif" },
+  { "gz", "application/gzip" },
+  { "htm", "text/html" },
+  { "html", "text/html" },
+  { "jpeg", "image/jpeg" },
+  { "jpg", "image/jpeg" },
+  { "js", "application/javascript" },
+  { "json", "application/json" },
+  { "png", "image/png" },
+  { "svg", "image/svg+xml" },
+  { "tar", "application/x-tar" },
+  { "txt", "text/plain" },
+  { "xml", "application/xml" },
+  { "zip", "application/zip" },
+};
+
+const char* GetContentType(base::StringPiece path) {
+  auto dot = path.rfind('.');
+  auto slash = path.rfind('/');
+  if (dot != base::StringPiece::npos &&
+      (slash == base::StringPiece::npos || dot > slash)) {
+    base::StringPiece extension = path.substr(dot + 1);
+    for (auto& content_type : kContentTypes) {
+      if (extension.ignore_case_equal(content_type.extension)) {
+        return content_type.content_type;
+      }
+    }
+  }
+  return "application/octet-stream";
+}
+
+int HexValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  } else if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  } else if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// Parse a decimal integer which takes the whole 'str'
+bool ParseInteger(base::StringPiece str, int64_t* value) {
+  if (str.empty()) {
+    return false;
+  }
+  *value = 0;
+  for (size_t i = 0; i < str.size(); ++i) {
+    if (str[i] < '0' || str[i] > '9' ||
+        *value > (std::numeric_limits<int64_t>::max() - 9) / 10) {
+      return false;
+    }
+    *value = *value * 10 + (str[i] - '0');
+  }
+  return true;
+}
+
+// close the file once the connection has sent it
+class FileCloser final {
+ public:
+  explicit FileCloser(int fd) : fd_(fd) {
+  }
+  ~FileCloser() {
+    ::close(fd_);
+  }
+
+ private:
+  int fd_;
+};
+
+}  // namespace
+
+StaticFileHandler::StaticFileHandler(const std::string& root_directory)
+    : root_directory_(root_directory) {
+  while (!root_directory_.empty() && root_directory_.back() == '/') {
+    root_directory_.pop_back();
+  }
+}
+
+bool StaticFileHandler::GetFilePath(base::StringPiece uri,
+                                    std::string* path) const {
+  auto query = uri.find_first_of("?#");
+  if (query != base::StringPiece::npos) {
+    uri = uri.substr(0, query);
+  }
+  if (uri.empty() || uri[0] != '/') {
+    return false;
+  }
+
+  // percent-decode the path
+  std::string decoded;
+  for (size_t i = 0; i < uri.size(); ++i) {
+    if (uri[i] != '%') {
+      decoded.push_back(uri[i]);
+      continue;
+    }
+    if (i + 2 >= uri.size() ||
+        HexValue(uri[i + 1]) < 0 || HexValue(uri[i + 2]) < 0) {
+      return false;
+    }
+    char c = static_cast<char>(HexValue(uri[i + 1]) * 16 +
+                               HexValue(uri[i + 2]));
+    if (c == '\0') {
+      return false;
+    }
+    decoded.push_back(c);
+    i += 2;
+  }
+
+  // reject any ".." segment so the path can't escape from the root
+  size_t begin = 0;
+  while (begin < decoded.size()) {
+    size_t end = decoded.find('/', begin);
+    if (end == std::string::npos) {
+      end = decoded.size();
+    }
+    if (decoded.compare(begin, end - begin, "..") == 0) {
+      return false;
+    }
+    begin = end + 1;
+  }
+
+  *path = root_directory_ + decoded;
+  return true;
+}
+
+int StaticFileHandler::ParseRange(base::StringPiece range,
+                                  int64_t file_size,
+                                  int64_t* begin,
+                                  int64_t* end) {
+  static const base::StringPiece kBytesUnit = "bytes=";
+  if (!range.starts_with(kBytesUnit)) {
+    return 0;
+  }
+  range.remove_prefix(kBytesUnit.size());
+  if (range.find(',') != base::StringPiece::npos) {
+    // multiple ranges are not supported, serve the whole file
+    return 0;
+  }
+  auto dash = range.find('-');
+  if (dash == base::StringPiece::npos) {
+    return 0;
+  }
+  base::StringPiece first = range.substr(0, dash);
+  base::StringPiece last = range.substr(dash + 1);
+  int64_t value = 0;
+  if (first.empty()) {
+    // the suffix range "-n" means the last n bytes
+    if (!ParseInteger(last, &value)) {
+      return 0;
+    }
+    if (value == 0 || file_size == 0) {
+      return -1;
+    }
+    *begin = value >= file_size ? 0 : file_size - value;
+    *end = file_size - 1;
+    return 1;
+  }
+  if (!ParseInteger(first, begin)) {
+    return 0;
+  }
+  if (last.empty()) {
+    *end = file_size - 1;
+  } else {
+    if (!ParseInteger(last, end) || *end < *begin) {
+      return 0;
+    }
+    if (*end >= file_size) {
+      *end = file_size - 1;
+    }
+  }
+  if (*begin >= file_size) {
+    return -1;
+  }
+  return 1;
+}
+
+bool StaticFileHandler::Handle(
+    std::shared_ptr<HttpConnection> http_connection) {
+  auto http_request =
+      std::static_pointer_cast<HttpRequest>(http_connection->http_packet());
+  bool head = http_request->method() == HttpRequest::MethodType::kHead;
+  if (!head && http_request->method() != HttpRequest::MethodType::kGet) {
+    return SendError(http_connection,
+                     HttpResponse::StatusCode::kMethodNotAllowed);
+  }
+
+  std::string path;
+  if (!GetFilePath(http_request->uri(), &path)) {
+    return SendError(http_connection, HttpResponse::StatusCode::kBadRequest);
+  }
+
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return SendError(http_connection, HttpResponse::StatusCode::kNotFound);
+  }
+  auto file_closer = std::make_shared<FileCloser>(fd);
+  struct stat file_stat;
+  if (::fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+    return SendError(http_connection, HttpResponse::StatusCode::kNotFound);
+  }
+
+  int64_t file_size = file_stat.st_size;
+  int64_t begin = 0;
+  int64_t end = file_size - 1;
+  auto http_response = std::make_shared<HttpResponse>();
+  http_response->set_status(HttpResponse::StatusCode::kOk);
+  const std::string* range = nullptr;
+  if (http_request->GetHttpHeader("Range", &range)) {
+    int ret = ParseRange(*range, file_size, &begin, &end);
+    if (ret < 0) {
+      http_response->set_status(
+          HttpResponse::StatusCode::kRequestedRangeNotSatisfiable);
+      http_response->SetHttpHeader("Content-Range",
+          "bytes */" + std::to_string(file_size));
+      http_response->SetHttpHeader("Content-Length", "0");
+      return http_connection->SendPacket(http_response);
+    } else if (ret > 0) {
+      http_response->set_status(HttpResponse::StatusCode::kPartialContent);
+      http_response->SetHttpHeader("Content-Range",
+          "bytes " + std::to_string(begin) + "-" + std::to_string(end) +
+          "/" + std::to_string(file_size));
+    }
+  }
+  int64_t length = end - begin + 1;
+  http_response->SetHttpHeader("Content-Type", GetContentType(path));
+  http_response->SetHttpHeader("Accept-Ranges", "bytes");
+  http_response->SetHttpHeader("Content-Length", std::to_string(length));
+  if (head || length == 0) {
+    return http_connection->SendPacket(http_response);
+  }
+  return http_connection->SendFile(http_response, fd, begin, length,
+                                   file_closer);
+}
+
+bool StaticFileHandler::SendError(
+    std::shared_ptr<HttpConnection> http_connection,
+    HttpResponse::StatusCode status) {
+  auto http_response = std::make_shared<HttpResponse>();
+  http_response->set_status(status);
+  http_response->SetHttpHeader("Content-Length", "0");
+  return http_connection->SendPacket(http_response);
+}
+
+}  // namespace http
+}  // namespace cnetpp
+
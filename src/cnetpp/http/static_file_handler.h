@@ -0,0 +1,83 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef CNETPP_HTTP_STATIC_FILE_HANDLER_H_
+#define CNETPP_HTTP_STATIC_FILE_HANDLER_H_
+
+#include <cnetpp/http/http_connection.h>
+#include <cnetpp/http/http_response.h>
+#include <cnetpp/base/string_piece.h>
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+namespace cnetpp {
+namespace http {
+
+// Serve the files under a root directory for GET and HEAD requests. A single
+// byte range in the Range header is supported, and the file content is sent
+// with sendfile(2) without being copied through user space.
+// It can be called from the received callback of a HttpServer:
+//    StaticFileHandler handler("/var/www");
+//    options.set_received_callback([&handler] (
+//        std::shared_ptr<HttpConnection> c) -> bool {
+//      return handler.Handle(c);
+//    });
+class StaticFileHandler final {
+ public:
+  explicit StaticFileHandler(const std::string& root_directory);
+  ~StaticFileHandler() = default;
+
+  // Respond to the request received on 'http_connection', return false if
+  // the response could not be sent.
+  bool Handle(std::shared_ptr<HttpConnection> http_connection);
+
+  // Parse 'range' of a file of 'file_size' bytes into [*begin, *end].
+  // return 1 if it is a satisfiable single range, 0 if it should be ignored,
+  // -1 if it is not satisfiable.
+  static int ParseRange(base::StringPiece range,
+                        int64_t file_size,
+                        int64_t* begin,
+                        int64_t* end);
+
+  // Map the uri to a path under the root directory, return false if the uri
+  // is malformed or tries to escape from the root directory.
+  bool GetFilePath(base::StringPiece uri, std::string* path) const;
+
+ private:
+  bool SendError(std::shared_ptr<HttpConnection> http_connection,
+                 HttpResponse::StatusCode status);
+
+  std::string root_directory_;
+};
+
+}  // namespace http
+}  // namespace cnetpp
+
+#endif  // CNETPP_HTTP_STATIC_FILE_HANDLER_H_
+
@@ -49,12 +49,14 @@ class Command final {
     kReadable = 0x8,
     kWriteable = 0x10,
     kAddConnectingConn = 0x20,
+    kPauseReading = 0x40,
+    kResumeReading = 0x80,
   };
 
   Command(int type,
           std::shared_ptr<ConnectionBase> connection)
       : type_(type),
-        connection_(connection) {
+        connection_(std::move(connection)) {
   }
 
   ~Command() {
@@ -113,13 +115,21 @@ class Command final {
     if (type_ & static_cast<int>(Type::kWriteable)) {
       res += "kWriteable|";
     }
+    if (type_ & static_cast<int>(Type::kPauseReading)) {
+      res += "kPauseReading|";
+    }
+    if (type_ & static_cast<int>(Type::kResumeReading)) {
+      res += "kResumeReading|";
+    }
     if (res.size() > 0) {
       res.pop_back();
     }
     return res;
   }
 
-  std::shared_ptr<ConnectionBase> connection() const {
+  // returns a reference so that inspecting the command on the event path
+  // does not touch the reference count of the connection
+  const std::shared_ptr<ConnectionBase>& connection() const {
     return connection_;
   }
 
@@ -33,6 +33,7 @@
 #include <cnetpp/base/socket.h>
 #include <cnetpp/base/string_piece.h>
 
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <string>
@@ -72,6 +73,11 @@ class ConnectionBase : public std::enable_shared_from_this<ConnectionBase> {
     return id_;
   }
 
+  // nullptr once the event center is gone
+  std::shared_ptr<EventCenter> event_center() const {
+    return event_center_.lock();
+  }
+
   const std::thread::id& ep_thread_id() const {
     return ep_thread_id_;
   }
@@ -89,6 +95,7 @@ class ConnectionBase : public std::enable_shared_from_this<ConnectionBase> {
     connected_callback_ = std::move(connected_callback);
   }
 
+  // the Event::Type mask the socket fd is currently registered with
   int cached_event_type() const {
     return cached_event_type_;
   }
@@ -96,6 +103,13 @@ class ConnectionBase : public std::enable_shared_from_this<ConnectionBase> {
     cached_event_type_ = event_type;
   }
 
+  // true means the connection doesn't read from the socket until reading is
+  // resumed, or until it is under its receive rate limit again
+  bool read_paused() const {
+    return read_paused_.load(std::memory_order_acquire) ||
+        receive_throttled_.load(std::memory_order_relaxed);
+  }
+
   State state() const {
     return state_;
   }
@@ -110,6 +124,11 @@ class ConnectionBase : public std::enable_shared_from_this<ConnectionBase> {
   virtual void HandleWriteableEvent(EventCenter* event_center) = 0;
   virtual void HandleCloseConnection() = 0;
   virtual void MarkAsClosed(bool immediately = true) = 0;
+  // This method will be called by the event poller thread after reading has
+  // been resumed, so that the data already received can be processed
+  virtual void HandleResumeReading(EventCenter* event_center) {
+    (void) event_center;
+  }
 
  protected:
   ConnectionBase(std::shared_ptr<EventCenter> event_center, int fd)
@@ -130,6 +149,10 @@ class ConnectionBase : public std::enable_shared_from_this<ConnectionBase> {
 
   int cached_event_type_ { 0 };
 
+  std::atomic<bool> read_paused_ { false };
+  // only set by the event poller thread
+  std::atomic<bool> receive_throttled_ { false };
+
   State state_ { State::kConnecting };
 };
 
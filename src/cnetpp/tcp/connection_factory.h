@@ -30,6 +30,7 @@
 #include <cnetpp/tcp/connection_base.h>
 #include <cnetpp/tcp/listen_connection.h>
 #include <cnetpp/tcp/tcp_connection.h>
+#include <cnetpp/base/pool_allocator.h>
 
 namespace cnetpp {
 namespace tcp {
@@ -47,8 +48,9 @@ class ConnectionFactory {
       return std::shared_ptr<ConnectionBase>(
           new ListenConnection(event_center, fd));
     } else {
-      return std::shared_ptr<ConnectionBase>(
-          new TcpConnection(event_center, fd));
+      // the connection and its reference counts share one pooled block
+      return std::allocate_shared<TcpConnection>(
+          base::PoolAllocator<TcpConnection>(), event_center, fd);
     }
   }
 };
@@ -0,0 +1,169 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include <cnetpp/tcp/connection_limiter.h>
+#include <cnetpp/base/log.h>
+
+#include <assert.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace cnetpp {
+namespace tcp {
+
+namespace {
+
+std::string AddressKey(const base::IPAddress& address) {
+  return std::string(address.address().begin(), address.address().end());
+}
+
+}  // namespace
+
+ConnectionLimiter::ConnectionLimiter(const TcpServerOptions& options)
+    : max_connections_(options.max_connections()),
+      max_connections_per_ip_(options.max_connections_per_ip()),
+      max_open_files_(options.max_open_files()),
+      max_memory_usage_(options.max_memory_usage()),
+      overload_check_interval_(
+          std::max<int64_t>(options.overload_check_interval(), 1)),
+      next_overload_check_(std::chrono::steady_clock::now()) {
+  if (options.accept_rate() > 0) {
+    double burst = options.accept_burst() > 0 ?
+        options.accept_burst() : options.accept_rate();
+    accept_bucket_.reset(new base::TokenBucket(options.accept_rate(), burst));
+  }
+}
+
+int64_t ConnectionLimiter::AcceptDelay() {
+  if (Overloaded()) {
+    return overload_check_interval_;
+  }
+  if (accept_bucket_ && !accept_bucket_->TryConsume()) {
+    return std::max<int64_t>(accept_bucket_->TimeUntilAvailable(), 1);
+  }
+  return 0;
+}
+
+bool ConnectionLimiter::Overloaded() {
+  if (max_open_files_ == 0 && max_memory_usage_ == 0) {
+    return false;
+  }
+  auto now = std::chrono::steady_clock::now();
+  if (now < next_overload_check_) {
+    return overloaded_;
+  }
+  next_overload_check_ =
+      now + std::chrono::milliseconds(overload_check_interval_);
+  size_t open_files = max_open_files_ > 0 ? OpenFileCount() : 0;
+  size_t memory_usage = max_memory_usage_ > 0 ? ResidentMemoryUsage() : 0;
+  bool overloaded = (max_open_files_ > 0 && open_files > max_open_files_) ||
+      (max_memory_usage_ > 0 && memory_usage > max_memory_usage_);
+  if (overloaded != overloaded_) {
+    CnetppWarn("[ConnectionLimiter 0X%08x] %s accepting, %zu open files, "
+               "%zu bytes of resident memory", this,
+               overloaded ? "pause" : "resume", open_files, memory_usage);
+    overloaded_ = overloaded;
+  }
+  return overloaded_;
+}
+
+bool ConnectionLimiter::Admit(const base::IPAddress& address) {
+  if (!LimitsConnections()) {
+    return true;
+  }
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (max_connections_ > 0 && connection_count_ >= max_connections_) {
+    return false;
+  }
+  if (max_connections_per_ip_ > 0) {
+    auto& count = per_ip_counts_[AddressKey(address)];
+    if (count >= max_connections_per_ip_) {
+      return false;
+    }
+    count++;
+  }
+  connection_count_++;
+  return true;
+}
+
+void ConnectionLimiter::Release(const base::IPAddress& address) {
+  if (!LimitsConnections()) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(mutex_);
+  assert(connection_count_ > 0);
+  connection_count_--;
+  if (max_connections_per_ip_ > 0) {
+    auto itr = per_ip_counts_.find(AddressKey(address));
+    assert(itr != per_ip_counts_.end());
+    if (--itr->second == 0) {
+      per_ip_counts_.erase(itr);
+    }
+  }
+}
+
+size_t ConnectionLimiter::connection_count() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return connection_count_;
+}
+
+size_t ConnectionLimiter::OpenFileCount() {
+  DIR* dir = ::opendir("/proc/self/fd");
+  if (!dir) {
+    return 0;
+  }
+  size_t count = 0;
+  while (struct dirent* entry = ::readdir(dir)) {
+    if (entry->d_name[0] != '.') {
+      count++;
+    }
+  }
+  ::closedir(dir);
+  // not counting the fd of the directory itself
+  return count > 0 ? count - 1 : 0;
+}
+
+size_t ConnectionLimiter::ResidentMemoryUsage() {
+  FILE* file = ::fopen("/proc/self/statm", "r");
+  if (!file) {
+    return 0;
+  }
+  unsigned long size = 0;
+  unsigned long resident = 0;
+  int n = ::fscanf(file, "%lu %lu", &size, &resident);
+  ::fclose(file);
+  if (n != 2) {
+    return 0;
+  }
+  return resident * static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+}
+
+}  // namespace tcp
+}  // namespace cnetpp
+
@@ -0,0 +1,95 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef CNETPP_TCP_CONNECTION_LIMITER_H_
+#define CNETPP_TCP_CONNECTION_LIMITER_H_
+
+#include <cnetpp/tcp/tcp_options.h>
+#include <cnetpp/base/ip_address.h>
+#include <cnetpp/base/token_bucket.h>
+
+#include <stdint.h>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace cnetpp {
+namespace tcp {
+
+// The admission control of a ListenConnection, see the limits in
+// TcpServerOptions. AcceptDelay() is only called in the poller thread of
+// the listener, while the admitted connections are released from their
+// closed callbacks in any poller thread, so the counts have a lock.
+class ConnectionLimiter final {
+ public:
+  explicit ConnectionLimiter(const TcpServerOptions& options);
+
+  // true if the connections are counted, so they must be released
+  bool LimitsConnections() const {
+    return max_connections_ > 0 || max_connections_per_ip_ > 0;
+  }
+
+  // The milliseconds to wait before accepting the next connection, 0 if it
+  // can be accepted now. A token of the accept rate is taken if it is 0.
+  int64_t AcceptDelay();
+
+  // Count a connection from 'address', false if it is over the limits
+  bool Admit(const base::IPAddress& address);
+  void Release(const base::IPAddress& address);
+
+  size_t connection_count();
+
+  // Read from /proc on Linux, 0 if they are unknown
+  static size_t OpenFileCount();
+  static size_t ResidentMemoryUsage();
+
+ private:
+  size_t max_connections_;
+  size_t max_connections_per_ip_;
+  size_t max_open_files_;
+  size_t max_memory_usage_;
+  int64_t overload_check_interval_;
+
+  std::unique_ptr<base::TokenBucket> accept_bucket_;
+  bool overloaded_ { false };
+  std::chrono::steady_clock::time_point next_overload_check_;
+
+  std::mutex mutex_;
+  size_t connection_count_ { 0 };
+  // keyed by the bytes of the addresses
+  std::unordered_map<std::string, size_t> per_ip_counts_;
+
+  bool Overloaded();
+};
+
+}  // namespace tcp
+}  // namespace cnetpp
+
+#endif  // CNETPP_TCP_CONNECTION_LIMITER_H_
+
@@ -60,7 +60,7 @@ bool EpollEventPollerImpl::Poll() {
     count = ::epoll_wait(epoll_fd_,
                          &epoll_events_[0],
                          epoll_events_.size(),
-                         -1);
+                         NextTimeout());
   } while (count == -1 &&
       cnetpp::concurrency::ThisThread::GetLastError() == EINTR);
 
@@ -95,13 +95,16 @@ bool EpollEventPollerImpl::Poll() {
       }
     }
   }
+  ProcessTimers();
   return true;
 }
 
 bool EpollEventPollerImpl::AddPollerEvent(Event&& ev) {
   struct epoll_event epoll_ev {0u, 0};
   epoll_ev.data.fd = ev.fd();
-  epoll_ev.events = EPOLLIN;
+  if (ev.mask() & static_cast<int>(Event::Type::kRead)) {
+    epoll_ev.events |= EPOLLIN;
+  }
   if (ev.mask() & static_cast<int>(Event::Type::kWrite)) {
     epoll_ev.events |= EPOLLOUT;
   }
@@ -111,7 +114,9 @@ bool EpollEventPollerImpl::AddPollerEvent(Event&& ev) {
 bool EpollEventPollerImpl::ModifyPollerEvent(Event&& ev) {
   struct epoll_event epoll_ev {0u, 0};
   epoll_ev.data.fd = ev.fd();
-  epoll_ev.events = EPOLLIN;
+  if (ev.mask() & static_cast<int>(Event::Type::kRead)) {
+    epoll_ev.events |= EPOLLIN;
+  }
   if (ev.mask() & static_cast<int>(Event::Type::kWrite)) {
     epoll_ev.events |= EPOLLOUT;
   }
@@ -30,7 +30,11 @@
 #include <cnetpp/concurrency/task.h>
 #include <cnetpp/base/log.h>
 
+#include <stdint.h>
+
+#include <algorithm>
 #include <thread>
+#include <utility>
 
 namespace cnetpp {
 namespace tcp {
@@ -41,18 +45,25 @@ namespace {
 
 std::shared_ptr<EventCenter> EventCenter::New(const std::string& name,
     size_t thread_num) {
+  return std::shared_ptr<EventCenter>(
+      new EventCenter(name, PollerCount(thread_num)));
+}
+
+size_t EventCenter::PollerCount(size_t thread_num) {
   if (thread_num <= 0) {
     thread_num = std::thread::hardware_concurrency();
   }
   if (thread_num <= 0) {
     thread_num = kDefaultThreadNum;
   }
-
-  return std::shared_ptr<EventCenter>(new EventCenter(name, thread_num));
+  return thread_num;
 }
 
 EventCenter::EventCenter(const std::string& name, size_t thread_num)
-    : internal_event_poller_infos_(thread_num), name_(name) {
+    : internal_event_poller_infos_(thread_num),
+      name_(name),
+      memory_budget_(std::make_shared<base::MemoryBudget>(
+          0, base::MemoryBudget::Process())) {
   for (size_t i = 0; i < thread_num; ++i) {
     internal_event_poller_infos_[i] =
         std::make_shared<InternalEventPollerInfo>();
@@ -85,13 +96,32 @@ bool EventCenter::Launch() {
 void EventCenter::Shutdown() {
   CnetppInfo("[EventCenter 0X%08x, %s] is closed, all poller "
              "in this center will be closed", this, name_.c_str());
+  if (shut_down_.exchange(true)) {
+    return;
+  }
   for (auto& poller_info : internal_event_poller_infos_) {
-    poller_info->event_poller_thread_->Stop();
+    if (poller_info->event_poller_thread_) {
+      poller_info->event_poller_thread_->Stop();
+    }
+  }
+  // release the connections and the callbacks out of the locks
+  for (auto& poller_info : internal_event_poller_infos_) {
+    std::vector<Command> pending_commands;
+    std::map<InternalEventPollerInfo::TimerKey, TimerCallbackType> timers;
+    {
+      std::lock_guard<std::mutex> guard(poller_info->pending_commands_mutex_);
+      pending_commands.swap(poller_info->pending_commands_);
+    }
+    {
+      std::lock_guard<std::mutex> guard(poller_info->timers_mutex_);
+      timers.swap(poller_info->timers_);
+      poller_info->timer_deadlines_.clear();
+    }
+    poller_info->connections_.clear();
   }
-  internal_event_poller_infos_.clear();
 }
 
-void EventCenter::AddCommand(const Command& command, bool async) {
+void EventCenter::AddCommand(Command command, bool async) {
   CnetppDebug("[EventCenter 0X%08x, %s] add command [type %s] for"
               " [Socket 0X%08x] [%s 0X%08X], async %d",
               this, name_.c_str(), command.TypeString().c_str(),
@@ -104,7 +134,11 @@ void EventCenter::AddCommand(const Command& command, bool async) {
   if (async) {
     {
       std::lock_guard<std::mutex> guard(info->pending_commands_mutex_);
-      (info->pending_commands_).push_back(command);
+      if (shut_down_.load(std::memory_order_acquire)) {
+        // no poller is left to process it
+        return;
+      }
+      (info->pending_commands_).push_back(std::move(command));
     }
 
     info->event_poller_->Interrupt();
@@ -137,7 +171,8 @@ bool EventCenter::ProcessAllPendingCommands(size_t id) {
   return true;
 }
 
-void EventCenter::ProcessPendingCommand(InternalEventPollerInfoPtr info,
+void EventCenter::ProcessPendingCommand(
+    const InternalEventPollerInfoPtr& info,
     const Command& command) {
   if (info->event_poller_->ProcessCommand(command)) {
     if (command.type() & static_cast<int>(Command::Type::kAddConnectingConn)) {
@@ -160,6 +195,9 @@ void EventCenter::ProcessPendingCommand(InternalEventPollerInfoPtr info,
         static_cast<int>(Command::Type::kRemoveConn)) {
       command.connection()->set_state(ConnectionBase::State::kClosing);
       command.connection()->HandleWriteableEvent(this);
+    } else if (command.type() &
+        static_cast<int>(Command::Type::kResumeReading)) {
+      command.connection()->HandleResumeReading(this);
     }
   } else {
     CnetppInfo("[EventCenter 0X%08x, %s] process command failed "
@@ -170,6 +208,144 @@ void EventCenter::ProcessPendingCommand(InternalEventPollerInfoPtr info,
   }
 }
 
+void EventCenter::SetRateLimits(double receive_rate, double send_rate) {
+  for (auto& info : internal_event_poller_infos_) {
+    if (receive_rate > 0) {
+      info->receive_bucket_.reset(
+          new base::TokenBucket(receive_rate, receive_rate));
+    }
+    if (send_rate > 0) {
+      info->send_bucket_.reset(new base::TokenBucket(send_rate, send_rate));
+    }
+  }
+}
+
+bool EventCenter::InPollerThread() const {
+  auto current = concurrency::Thread::ThisThread();
+  if (!current) {
+    return false;
+  }
+  for (auto& info : internal_event_poller_infos_) {
+    if (info->event_poller_thread_.get() == current) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void EventCenter::GetConnections(size_t id,
+    std::vector<std::shared_ptr<ConnectionBase>>* connections) {
+  assert(connections);
+  connections->clear();
+  if (id >= internal_event_poller_infos_.size()) {
+    return;
+  }
+  auto& info = internal_event_poller_infos_[id];
+  connections->reserve(info->connections_.size());
+  for (auto& connection : info->connections_) {
+    connections->push_back(connection.second);
+  }
+}
+
+EventCenter::TimerId EventCenter::AddTimer(int64_t delay,
+                                           TimerCallbackType callback,
+                                           uint64_t shard) {
+  assert(callback);
+  auto count = internal_event_poller_infos_.size();
+  if (count == 0) {
+    return kInvalidTimerId;
+  }
+  auto index = shard % count;
+  TimerId timer_id = next_timer_sequence_.fetch_add(1) * count + index;
+  auto deadline = std::chrono::steady_clock::now() +
+      std::chrono::milliseconds(std::max<int64_t>(delay, 0));
+
+  auto& info = internal_event_poller_infos_[index];
+  bool earliest = false;
+  {
+    std::lock_guard<std::mutex> guard(info->timers_mutex_);
+    if (shut_down_.load(std::memory_order_acquire)) {
+      return kInvalidTimerId;
+    }
+    info->timers_.emplace(std::make_pair(deadline, timer_id),
+                          std::move(callback));
+    info->timer_deadlines_[timer_id] = deadline;
+    earliest = info->timers_.begin()->first.second == timer_id;
+  }
+  // the poller has to recompute how long it can wait
+  if (earliest) {
+    info->event_poller_->Interrupt();
+  }
+  return timer_id;
+}
+
+bool EventCenter::CancelTimer(TimerId timer_id) {
+  if (timer_id == kInvalidTimerId || internal_event_poller_infos_.empty()) {
+    return false;
+  }
+  auto count = internal_event_poller_infos_.size();
+  auto& info = internal_event_poller_infos_[timer_id % count];
+  TimerCallbackType callback;
+  {
+    std::lock_guard<std::mutex> guard(info->timers_mutex_);
+    auto itr = info->timer_deadlines_.find(timer_id);
+    if (itr == info->timer_deadlines_.end()) {
+      return false;
+    }
+    auto timer_itr = info->timers_.find(std::make_pair(itr->second, timer_id));
+    assert(timer_itr != info->timers_.end());
+    // destroy the callback out of the lock
+    callback.swap(timer_itr->second);
+    info->timers_.erase(timer_itr);
+    info->timer_deadlines_.erase(itr);
+  }
+  return true;
+}
+
+int EventCenter::NextTimerTimeout(size_t id) {
+  if (id >= internal_event_poller_infos_.size()) {
+    return -1;
+  }
+  auto& info = internal_event_poller_infos_[id];
+  std::lock_guard<std::mutex> guard(info->timers_mutex_);
+  if (info->timers_.empty()) {
+    return -1;
+  }
+  auto left = info->timers_.begin()->first.first -
+      std::chrono::steady_clock::now();
+  if (left <= std::chrono::steady_clock::duration::zero()) {
+    return 0;
+  }
+  // round up, or the poller would wake up a bit early and spin
+  auto left_ms = std::chrono::duration_cast<std::chrono::milliseconds>(left);
+  if (left_ms < left) {
+    left_ms += std::chrono::milliseconds(1);
+  }
+  return static_cast<int>(std::min<int64_t>(left_ms.count(), INT32_MAX));
+}
+
+void EventCenter::ProcessTimers(size_t id) {
+  if (id >= internal_event_poller_infos_.size()) {
+    return;
+  }
+  auto& info = internal_event_poller_infos_[id];
+  std::vector<TimerCallbackType> callbacks;
+  {
+    std::lock_guard<std::mutex> guard(info->timers_mutex_);
+    auto now = std::chrono::steady_clock::now();
+    while (!info->timers_.empty() &&
+           info->timers_.begin()->first.first <= now) {
+      auto itr = info->timers_.begin();
+      callbacks.emplace_back(std::move(itr->second));
+      info->timer_deadlines_.erase(itr->first.second);
+      info->timers_.erase(itr);
+    }
+  }
+  for (auto& callback : callbacks) {
+    callback();
+  }
+}
+
 bool EventCenter::ProcessEvent(const Event& event, size_t id) {
   if (id >= internal_event_poller_infos_.size()) {
     return false;
@@ -180,18 +356,22 @@ bool EventCenter::ProcessEvent(const Event& event, size_t id) {
     return false;
   }
 
+  // the handlers take their own reference when they need one, the one in
+  // the map is used without a copy
   auto& connections = internal_event_poller_infos_[id]->connections_;
-  auto itr = connections.find(event.fd());
+  auto itr = connections.find(fd);
   if (itr != connections.end()) {
-    auto connection = itr->second;
     if (event.mask() & static_cast<int>(Event::Type::kClose)) {
-      connection->MarkAsClosed(true);
+      itr->second->MarkAsClosed(true);
     } else {
       if (event.mask() & static_cast<int>(Event::Type::kRead)) {
-        connection->HandleReadableEvent(this);
+        itr->second->HandleReadableEvent(this);
+        // the connection is gone from the map if it has been closed
+        itr = connections.find(fd);
       }
-      if (event.mask() & static_cast<int>(Event::Type::kWrite)) {
-        connection->HandleWriteableEvent(this);
+      if (itr != connections.end() &&
+          (event.mask() & static_cast<int>(Event::Type::kWrite))) {
+        itr->second->HandleWriteableEvent(this);
       }
     }
   }
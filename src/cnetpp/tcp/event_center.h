@@ -31,11 +31,18 @@
 #include <cnetpp/tcp/connection_base.h>
 #include <cnetpp/tcp/event.h>
 #include <cnetpp/concurrency/thread.h>
+#include <cnetpp/base/memory_budget.h>
+#include <cnetpp/base/token_bucket.h>
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
 #include <memory>
 #include <vector>
 #include <unordered_map>
 #include <mutex>
+#include <utility>
 
 namespace cnetpp {
 namespace tcp {
@@ -44,6 +51,10 @@ class EventPoller;
 
 class EventCenter final : public std::enable_shared_from_this<EventCenter> {
  public:
+  using TimerId = uint64_t;
+  using TimerCallbackType = std::function<void()>;
+  static const TimerId kInvalidTimerId = 0;
+
   // Create an EventCenter instance
   // NOTE: This class is not singleton, so we can create more than one
   // EventCenter instances in one process. e.g. We can create two servers to
@@ -53,22 +64,79 @@ class EventCenter final : public std::enable_shared_from_this<EventCenter> {
   static std::shared_ptr<EventCenter> New(const std::string& name,
       size_t thread_num = 0);
 
+  // The number of event poller threads New() creates for 'thread_num'
+  static size_t PollerCount(size_t thread_num);
+
   ~EventCenter() = default;
 
   bool Launch();
 
   void Shutdown();
 
-  void AddCommand(const Command& command, bool async = true);
+  void AddCommand(Command command, bool async = true);
 
   bool ProcessAllPendingCommands(size_t id);
 
   bool ProcessEvent(const Event& event, size_t id);
 
+  // Run 'callback' once in an event poller thread after 'delay' milliseconds.
+  // 'shard' picks the poller the way connection ids do, so that a timer
+  // added with the id of a connection runs in the thread of the connection.
+  // It can be called from any thread, even while the EventCenter is being
+  // shut down. The timers which haven't fired are dropped by the shutdown,
+  // and kInvalidTimerId is returned after it.
+  TimerId AddTimer(int64_t delay, TimerCallbackType callback,
+                   uint64_t shard = 0);
+
+  // Return false if the timer has fired or has been cancelled already.
+  bool CancelTimer(TimerId timer_id);
+
+  // The milliseconds until the nearest timer of poller 'id' fires, -1 if it
+  // has no timer.
+  int NextTimerTimeout(size_t id);
+
+  // Run the timers of poller 'id' which are due.
+  void ProcessTimers(size_t id);
+
   const std::string& name() const {
     return name_;
   }
 
+  // Limit the bytes per second received and sent by all the connections of
+  // each event poller thread, 0 means no limit. Call it right after Launch()
+  // before any connection is added.
+  void SetRateLimits(double receive_rate, double send_rate);
+
+  // The buckets of the poller serving 'connection_id', nullptr if there is
+  // no limit. They must only be used in the thread of that poller.
+  base::TokenBucket* receive_bucket(ConnectionId connection_id) {
+    auto& info = internal_event_poller_infos_[
+        connection_id % internal_event_poller_infos_.size()];
+    return info->receive_bucket_.get();
+  }
+  base::TokenBucket* send_bucket(ConnectionId connection_id) {
+    auto& info = internal_event_poller_infos_[
+        connection_id % internal_event_poller_infos_.size()];
+    return info->send_bucket_.get();
+  }
+
+  // The budget the buffers of all the connections are charged to
+  const std::shared_ptr<base::MemoryBudget>& memory_budget() const {
+    return memory_budget_;
+  }
+
+  size_t poller_count() const {
+    return internal_event_poller_infos_.size();
+  }
+
+  // Whether the caller runs in one of the event poller threads
+  bool InPollerThread() const;
+
+  // Copy the connections registered in poller 'id', it must be called in
+  // the thread of that poller, e.g. from a timer added with shard 'id'.
+  void GetConnections(size_t id,
+      std::vector<std::shared_ptr<ConnectionBase>>* connections);
+
  private:
   EventCenter(const std::string& name, size_t thread_num = 0);
 
@@ -103,6 +171,16 @@ class EventCenter final : public std::enable_shared_from_this<EventCenter> {
     // No need to be protected by lock, because only the corresponding
     // EventPoller thread can access this structure
     std::unordered_map<int, ConnectionPtr> connections_;
+
+    // the timers ordered by their deadlines, ties are broken by ids
+    using TimerKey = std::pair<std::chrono::steady_clock::time_point, TimerId>;
+    std::map<TimerKey, TimerCallbackType> timers_;
+    std::unordered_map<TimerId, std::chrono::steady_clock::time_point>
+        timer_deadlines_;
+    std::mutex timers_mutex_;
+
+    std::unique_ptr<base::TokenBucket> receive_bucket_;
+    std::unique_ptr<base::TokenBucket> send_bucket_;
   };
 
   using InternalEventPollerInfoPtr = std::shared_ptr<InternalEventPollerInfo>;
@@ -111,7 +189,18 @@ class EventCenter final : public std::enable_shared_from_this<EventCenter> {
 
   std::string name_;
 
-  void ProcessPendingCommand(InternalEventPollerInfoPtr info,
+  std::shared_ptr<base::MemoryBudget> memory_budget_;
+
+  // the ids of timers are multiples of the number of pollers plus the
+  // poller index, so that a timer can be found by its id
+  std::atomic<TimerId> next_timer_sequence_ { 1 };
+
+  // The poller infos are kept until the destruction, so that the commands
+  // and timers can be added from other threads while shutting down. They are
+  // refused under the lock of their queue once it is set.
+  std::atomic<bool> shut_down_ { false };
+
+  void ProcessPendingCommand(const InternalEventPollerInfoPtr& info,
       const Command& command);
 
 };
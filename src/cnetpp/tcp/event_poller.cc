@@ -27,6 +27,7 @@
 #include <cnetpp/tcp/event_poller.h>
 #include <cnetpp/tcp/event_center.h>
 #include <cnetpp/tcp/interrupter.h>
+#include <cnetpp/base/memory_cache.h>
 #include <cnetpp/base/log.h>
 
 #if defined(linux) || defined(__linux) || defined(__linux__)
@@ -86,13 +87,17 @@ bool EventPoller::ProcessCommand(const Command& command) {
     // do nothing
     return false;
   }
-  int type = static_cast<int>(Event::Type::kRead);
+  int type = 0;
+  if (!command.connection()->read_paused()) {
+    type |= static_cast<int>(Event::Type::kRead);
+  }
   if (static_cast<int>(command.type()) &
       static_cast<int>(Command::Type::kWriteable)) {
     type |= static_cast<int>(Event::Type::kWrite);
   }
   if ((command.type() & static_cast<int>(Command::Type::kAddConnectingConn)) ||
       (command.type() & static_cast<int>(Command::Type::kAddConnectedConn))) {
+    command.connection()->set_cached_event_type(type);
     int res = AddPollerEvent(Event(command.connection()->socket().fd(), type));
     CnetppDebug("[EventPoller 0X%08x, %d, %s] AddPollerEvent for command "
                 "[type %s] for [Socket 0X%08x] [%s 0X%08X] res(1 for OK) %d",
@@ -116,11 +121,19 @@ bool EventPoller::ProcessCommand(const Command& command) {
                 command.connection()->id(), res);
     return res;
   } else if (command.type() & static_cast<int>(Command::Type::kReadable) ||
-      command.type() & static_cast<int>(Command::Type::kWriteable)) {
-    if (command.type() == command.connection()->cached_event_type()) {
+      command.type() & static_cast<int>(Command::Type::kWriteable) ||
+      command.type() & static_cast<int>(Command::Type::kPauseReading) ||
+      command.type() & static_cast<int>(Command::Type::kResumeReading)) {
+    if (!(command.type() & static_cast<int>(Command::Type::kReadable)) &&
+        !(command.type() & static_cast<int>(Command::Type::kWriteable))) {
+      // pausing or resuming reading keeps the interest in writing
+      type |= command.connection()->cached_event_type() &
+          static_cast<int>(Event::Type::kWrite);
+    }
+    if (type == command.connection()->cached_event_type()) {
       return true;
     }
-    command.connection()->set_cached_event_type(command.type());
+    command.connection()->set_cached_event_type(type);
     int res = ModifyPollerEvent(Event(command.connection()->socket().fd(),
                                 type));
     CnetppDebug("[EventPoller 0X%08x, %d, %s] ModifyPollerEvent for command "
@@ -146,6 +159,28 @@ bool EventPoller::ProcessInterrupt() {
   return false;
 }
 
+int EventPoller::NextTimeout() {
+  int timeout = -1;
+  auto event_center = event_center_.lock();
+  if (event_center) {
+    timeout = event_center->NextTimerTimeout(id_);
+  }
+  // the buffers of the connections are freed here, wake up to give them
+  // back to the other threads if the poller stays idle
+  int scavenge_timeout = base::MemoryCache::Instance()->ScavengeIfDue();
+  if (scavenge_timeout >= 0 && (timeout < 0 || scavenge_timeout < timeout)) {
+    timeout = scavenge_timeout;
+  }
+  return timeout;
+}
+
+void EventPoller::ProcessTimers() {
+  auto event_center = event_center_.lock();
+  if (event_center) {
+    event_center->ProcessTimers(id_);
+  }
+}
+
 }  // namespace tcp
 }  // namespace cnetpp
 
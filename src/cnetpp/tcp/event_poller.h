@@ -136,6 +136,11 @@ class EventPoller {
 
   virtual bool ProcessInterrupt();
 
+  // how long Poll() may wait in milliseconds, -1 to wait until an event
+  // comes
+  int NextTimeout();
+  void ProcessTimers();
+
   virtual bool AddPollerEvent(Event&& event) = 0;
   virtual bool ModifyPollerEvent(Event&& event) = 0;
   virtual bool RemovePollerEvent(Event&& event) = 0;
@@ -47,6 +47,14 @@ void ListenConnection::HandleReadableEvent(EventCenter* event_center) {
 
   assert(event_center);
 
+  if (limiter_) {
+    auto delay = limiter_->AcceptDelay();
+    if (delay > 0) {
+      PauseAccepting(event_center, delay);
+      return;
+    }
+  }
+
   base::ListenSocket listen_socket;
   listen_socket.Attach(socket_.fd());
 
@@ -54,10 +62,24 @@ void ListenConnection::HandleReadableEvent(EventCenter* event_center) {
   base::EndPoint remote_end_point;
   if (!listen_socket.Accept(&new_socket, &remote_end_point)) {
     listen_socket.Detach();
+    int error = base::Socket::GetLastError();
+    if (error == EMFILE || error == ENFILE) {
+      // the listen socket would stay readable, so don't spin on it
+      CnetppWarn("[ListenSocket 0X%08x] [ListenConnection 0X%08x] "
+                 "run out of fds", socket_.fd(), this->id());
+      PauseAccepting(event_center, options_.overload_check_interval());
+    }
     return;
   }
   listen_socket.Detach();
 
+  if (limiter_ && !limiter_->Admit(remote_end_point.address())) {
+    CnetppInfo("[ListenSocket 0X%08x] [ListenConnection 0X%08x] "
+               "reject client from %s over the connection limits",
+               socket_.fd(), this->id(), remote_end_point.ToString().c_str());
+    return;
+  }
+
   new_socket.SetCloexec(true);
   new_socket.SetBlocking(false);
   new_socket.SetTcpNoDelay(true);
@@ -84,12 +106,33 @@ void ListenConnection::HandleReadableEvent(EventCenter* event_center) {
               remote_end_point.ToString().c_str(), localEp.ToString().c_str());
   auto new_tcp_connection =
       std::static_pointer_cast<TcpConnection>(new_connection);
-  new_tcp_connection->set_closed_callback(options_.closed_callback());
+  if (limiter_ && limiter_->LimitsConnections()) {
+    auto limiter = limiter_;
+    auto address = remote_end_point.address();
+    auto closed_callback = options_.closed_callback();
+    new_tcp_connection->set_closed_callback(
+        [limiter, address, closed_callback] (
+            std::shared_ptr<TcpConnection> c) -> bool {
+          limiter->Release(address);
+          return closed_callback ? closed_callback(c) : true;
+        });
+  } else {
+    new_tcp_connection->set_closed_callback(options_.closed_callback());
+  }
   new_tcp_connection->set_sent_callback(options_.sent_callback());
   new_tcp_connection->set_received_callback(options_.received_callback());
   new_tcp_connection->set_state(TcpConnection::State::kConnected);
   new_tcp_connection->SetSendBufferSize(options_.send_buffer_size());
   new_tcp_connection->SetRecvBufferSize(options_.receive_buffer_size());
+  new_tcp_connection->SetRateLimits(options_.receive_rate(),
+                                    options_.receive_burst(),
+                                    options_.send_rate(),
+                                    options_.send_burst());
+  new_tcp_connection->SetReadBudget(options_.max_reads_per_event(),
+                                    options_.max_bytes_per_event());
+  new_tcp_connection->SetMemoryBudget(
+      options_.connection_buffer_memory_limit(),
+      event_center->memory_budget());
   new_tcp_connection->set_remote_end_point(std::move(remote_end_point));
 
   new_socket.Detach();
@@ -102,6 +145,9 @@ void ListenConnection::HandleReadableEvent(EventCenter* event_center) {
   }
 
   if (!ok) {
+    if (limiter_) {
+      limiter_->Release(new_tcp_connection->remote_end_point().address());
+    }
     return;
   }
 
@@ -111,6 +157,41 @@ void ListenConnection::HandleReadableEvent(EventCenter* event_center) {
       true);
 }
 
+void ListenConnection::PauseAccepting(EventCenter* event_center,
+                                      int64_t delay) {
+  if (read_paused_.exchange(true)) {
+    return;
+  }
+  CnetppDebug("[ListenSocket 0X%08x] [ListenConnection 0X%08x] "
+              "pause accepting for %lld milliseconds", socket_.fd(),
+              this->id(), static_cast<long long>(delay));
+  event_center->AddCommand(
+      Command(static_cast<int>(Command::Type::kPauseReading),
+              shared_from_this()),
+      false);
+  std::weak_ptr<ListenConnection> weak_listener =
+      std::static_pointer_cast<ListenConnection>(shared_from_this());
+  event_center->AddTimer(delay, [weak_listener] () {
+    auto listener = weak_listener.lock();
+    if (listener) {
+      listener->ResumeAccepting();
+    }
+  }, id());
+}
+
+void ListenConnection::ResumeAccepting() {
+  auto event_center = event_center_.lock();
+  // not if the listen socket has been removed in the mean time
+  if (!event_center || state_ == State::kClosed ||
+      !read_paused_.exchange(false)) {
+    return;
+  }
+  event_center->AddCommand(
+      Command(static_cast<int>(Command::Type::kResumeReading),
+              shared_from_this()),
+      false);
+}
+
 void ListenConnection::HandleWriteableEvent(EventCenter* event_center) {
   assert(event_center);
   event_center->AddCommand(
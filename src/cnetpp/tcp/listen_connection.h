@@ -28,8 +28,11 @@
 #define CNETPP_LISTEN_CONNECTION_H_
 
 #include <cnetpp/tcp/connection_base.h>
+#include <cnetpp/tcp/connection_limiter.h>
 #include <cnetpp/tcp/tcp_options.h>
 
+#include <stdint.h>
+
 #include <memory>
 
 namespace cnetpp {
@@ -54,11 +57,18 @@ class ListenConnection : public ConnectionBase {
   }
   void set_tcp_server_options(const TcpServerOptions& options) {
     options_ = options;
+    limiter_ = std::make_shared<ConnectionLimiter>(options);
+  }
+
+  const std::shared_ptr<ConnectionLimiter>& limiter() const {
+    return limiter_;
   }
 
   virtual void HandleReadableEvent(EventCenter* event_center) override;
   virtual void HandleWriteableEvent(EventCenter* event_center) override;
+  // called once the listen socket is removed from the poller
   virtual void HandleCloseConnection() override {
+    state_ = State::kClosed;
   }
   virtual void MarkAsClosed(bool immediately = true) override {
   }
@@ -69,6 +79,12 @@ class ListenConnection : public ConnectionBase {
   }
 
   TcpServerOptions options_;
+  // shared with the closed callbacks of the admitted connections
+  std::shared_ptr<ConnectionLimiter> limiter_;
+
+  // Stop polling the listen socket for 'delay' milliseconds
+  void PauseAccepting(EventCenter* event_center, int64_t delay);
+  void ResumeAccepting();
 };
 
 }  // namespace tcp
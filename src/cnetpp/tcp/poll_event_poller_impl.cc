@@ -56,7 +56,7 @@ bool PollEventPollerImpl::Poll() {
 
   int count = 0;
   do {
-    count = ::poll(&(poll_fds_[0]), poll_fds_end_, -1);
+    count = ::poll(&(poll_fds_[0]), poll_fds_end_, NextTimeout());
   } while (count == -1 &&
            cnetpp::concurrency::ThisThread::GetLastError() == EINTR);
 
@@ -106,6 +106,7 @@ bool PollEventPollerImpl::Poll() {
   }
 
   InternalRemovePollerEvent();
+  ProcessTimers();
 
   return true;
 }
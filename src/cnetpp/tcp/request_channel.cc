@@ -0,0 +1,262 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include <cnetpp/tcp/request_channel.h>
+#include <cnetpp/base/log.h>
+
+#include <utility>
+#include <vector>
+
+namespace cnetpp {
+namespace tcp {
+
+RequestChannel::~RequestChannel() {
+  // no closed callback comes once the TcpClient is shut down
+  for (auto& outstanding_request : outstanding_) {
+    outstanding_request.second.callback(false, std::string());
+  }
+}
+
+void RequestChannel::Bind(TcpClientOptions* options) {
+  assert(options);
+  // the connection holds its options, and the channel holds the connection
+  std::weak_ptr<RequestChannel> weak_channel = shared_from_this();
+  auto connected_callback = options->connected_callback();
+  options->set_connected_callback(
+      [weak_channel, connected_callback] (std::shared_ptr<TcpConnection> c) {
+    auto channel = weak_channel.lock();
+    if (channel) {
+      channel->OnConnected(c);
+    }
+    return connected_callback ? connected_callback(c) : true;
+  });
+  options->set_received_callback(
+      [weak_channel] (std::shared_ptr<TcpConnection> c) {
+    // nobody is left to take the responses without the channel
+    auto channel = weak_channel.lock();
+    return channel && channel->OnReceived(c);
+  });
+  auto closed_callback = options->closed_callback();
+  options->set_closed_callback(
+      [weak_channel, closed_callback] (std::shared_ptr<TcpConnection> c) {
+    auto channel = weak_channel.lock();
+    if (channel) {
+      channel->OnClosed();
+    }
+    return closed_callback ? closed_callback(c) : true;
+  });
+}
+
+bool RequestChannel::Call(base::StringPiece request,
+                          ResponseCallbackType callback,
+                          int64_t timeout) {
+  assert(callback);
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (closed_) {
+    return false;
+  }
+  auto correlation_id = next_correlation_id_++;
+  OutstandingRequest outstanding_request;
+  outstanding_request.callback = std::move(callback);
+  outstanding_request.deadline = timeout > 0 ?
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout) :
+      std::chrono::steady_clock::time_point::max();
+  if (!codec_->HasCorrelationId()) {
+    order_.push_back(correlation_id);
+  }
+  if (tcp_connection_) {
+    std::string frame;
+    codec_->Encode(correlation_id, request, &frame);
+    // sending under the mutex keeps the frames in the order of order_
+    if (!tcp_connection_->SendPacket(frame)) {
+      if (!codec_->HasCorrelationId()) {
+        order_.pop_back();
+      }
+      return false;
+    }
+    ArmDeadline(correlation_id, &outstanding_request);
+  } else {
+    codec_->Encode(correlation_id, request, &unsent_);
+  }
+  outstanding_.emplace(correlation_id, std::move(outstanding_request));
+  return true;
+}
+
+std::future<RequestChannel::Result> RequestChannel::Call(
+    base::StringPiece request,
+    int64_t timeout) {
+  auto promise = std::make_shared<std::promise<Result>>();
+  auto future = promise->get_future();
+  bool res = Call(request,
+      [promise] (bool success, const std::string& response) {
+    Result result;
+    result.success = success;
+    result.response = response;
+    promise->set_value(std::move(result));
+  }, timeout);
+  if (!res) {
+    promise->set_value(Result());
+  }
+  return future;
+}
+
+size_t RequestChannel::outstanding() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return outstanding_.size();
+}
+
+void RequestChannel::ArmDeadline(uint64_t correlation_id,
+                                 OutstandingRequest* request) {
+  if (request->deadline == std::chrono::steady_clock::time_point::max() ||
+      !event_center_) {
+    return;
+  }
+  auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(
+      request->deadline - std::chrono::steady_clock::now()).count();
+  std::weak_ptr<RequestChannel> weak_channel = shared_from_this();
+  // the timer runs in the thread of the connection
+  request->deadline_timer = event_center_->AddTimer(
+      delay > 0 ? delay : 0,
+      [weak_channel, correlation_id] () {
+    auto channel = weak_channel.lock();
+    if (channel) {
+      channel->OnDeadline(correlation_id);
+    }
+  }, tcp_connection_->id());
+}
+
+void RequestChannel::OnConnected(
+    std::shared_ptr<TcpConnection> tcp_connection) {
+  std::unordered_map<uint64_t, OutstandingRequest> failed;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    assert(!tcp_connection_);
+    tcp_connection_ = tcp_connection;
+    event_center_ = tcp_connection->event_center();
+    if (!unsent_.empty() && !tcp_connection_->SendPacket(unsent_)) {
+      // all the requests so far are in unsent_
+      CnetppError("[RequestChannel] failed to send %zu requests on "
+                  "[TcpConnection 0X%08x]", outstanding_.size(),
+                  tcp_connection->id());
+      failed.swap(outstanding_);
+      order_.clear();
+    }
+    std::string().swap(unsent_);
+    for (auto& outstanding_request : outstanding_) {
+      ArmDeadline(outstanding_request.first, &outstanding_request.second);
+    }
+  }
+  for (auto& outstanding_request : failed) {
+    outstanding_request.second.callback(false, std::string());
+  }
+}
+
+bool RequestChannel::OnReceived(
+    std::shared_ptr<TcpConnection> tcp_connection) {
+  std::vector<std::pair<ResponseCallbackType, std::string>> completed;
+  bool malformed = false;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto& buffer = tcp_connection->mutable_recv_buffer();
+    while (true) {
+      uint64_t correlation_id = 0;
+      std::string response;
+      auto res = codec_->Decode(&buffer, &correlation_id, &response);
+      if (res == 0) {
+        break;
+      }
+      if (res < 0) {
+        CnetppError("[RequestChannel] malformed response on "
+                    "[TcpConnection 0X%08x]", tcp_connection->id());
+        malformed = true;
+        break;
+      }
+      if (!codec_->HasCorrelationId()) {
+        if (order_.empty()) {
+          CnetppError("[RequestChannel] unexpected response on "
+                      "[TcpConnection 0X%08x]", tcp_connection->id());
+          malformed = true;
+          break;
+        }
+        correlation_id = order_.front();
+        order_.pop_front();
+      }
+      auto itr = outstanding_.find(correlation_id);
+      if (itr == outstanding_.end()) {
+        // it has timed out
+        continue;
+      }
+      if (event_center_) {
+        event_center_->CancelTimer(itr->second.deadline_timer);
+      }
+      completed.emplace_back(std::move(itr->second.callback),
+                             std::move(response));
+      outstanding_.erase(itr);
+    }
+  }
+  for (auto& response : completed) {
+    response.first(true, response.second);
+  }
+  return !malformed;
+}
+
+void RequestChannel::OnClosed() {
+  std::unordered_map<uint64_t, OutstandingRequest> outstanding;
+  std::shared_ptr<EventCenter> event_center;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    closed_ = true;
+    outstanding.swap(outstanding_);
+    order_.clear();
+    std::string().swap(unsent_);
+    tcp_connection_.reset();
+    event_center.swap(event_center_);
+  }
+  for (auto& outstanding_request : outstanding) {
+    if (event_center) {
+      event_center->CancelTimer(outstanding_request.second.deadline_timer);
+    }
+    outstanding_request.second.callback(false, std::string());
+  }
+}
+
+void RequestChannel::OnDeadline(uint64_t correlation_id) {
+  ResponseCallbackType callback;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto itr = outstanding_.find(correlation_id);
+    if (itr == outstanding_.end()) {
+      return;
+    }
+    callback = std::move(itr->second.callback);
+    outstanding_.erase(itr);
+  }
+  callback(false, std::string());
+}
+
+}  // namespace tcp
+}  // namespace cnetpp
+
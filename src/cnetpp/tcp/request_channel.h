@@ -0,0 +1,146 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef CNETPP_TCP_REQUEST_CHANNEL_H_
+#define CNETPP_TCP_REQUEST_CHANNEL_H_
+
+#include <cnetpp/tcp/event_center.h>
+#include <cnetpp/tcp/request_codec.h>
+#include <cnetpp/tcp/tcp_connection.h>
+#include <cnetpp/tcp/tcp_options.h>
+#include <cnetpp/base/string_piece.h>
+
+#include <stdint.h>
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace cnetpp {
+namespace tcp {
+
+// Keeps many requests in flight on one client connection and hands every
+// response to the request it answers, either by the correlation id in the
+// frames or by the order of the requests, as 'codec' decides.
+//
+// It must be owned by a std::shared_ptr, and is bound to the connection made
+// with the options passed to Bind():
+//   auto channel = std::make_shared<RequestChannel>(codec);
+//   channel->Bind(&options);
+//   tcp_client.Connect(&remote, options);
+//   auto future = channel->Call("request", 1000);
+// The requests still in flight fail when the connection is closed, or when
+// the channel is destroyed, e.g. after the TcpClient is shut down, which
+// calls no closed callback.
+class RequestChannel final :
+    public std::enable_shared_from_this<RequestChannel> {
+ public:
+  struct Result {
+    // false if it has timed out or the connection has been closed
+    bool success { false };
+    std::string response;
+  };
+  using ResponseCallbackType =
+      std::function<void(bool success, const std::string& response)>;
+
+  explicit RequestChannel(std::shared_ptr<RequestCodec> codec)
+      : codec_(std::move(codec)) {
+    assert(codec_.get());
+  }
+  ~RequestChannel();
+
+  // disallow copy and move operations
+  RequestChannel(const RequestChannel&) = delete;
+  RequestChannel& operator=(const RequestChannel&) = delete;
+  RequestChannel(RequestChannel&&) = delete;
+  RequestChannel& operator=(RequestChannel&&) = delete;
+
+  // Route the callbacks of the connection made with 'options' to this
+  // channel, the connected and closed callbacks already set in 'options' are
+  // still called after the channel's. 'options' doesn't keep the channel
+  // alive, the caller does.
+  void Bind(TcpClientOptions* options);
+
+  // Send 'request' and call 'callback' with its response in an event poller
+  // thread. It is called with false once 'timeout' milliseconds (0 for no
+  // limit) have passed without the response, or when the connection is
+  // closed. The requests made before the connection is established are sent
+  // once it is, and their timeouts count from the call but only fire after
+  // that, TcpClientOptions::connect_timeout() bounds the wait. Return false,
+  // without calling 'callback', if the connection has been closed already or
+  // the request can't be sent, e.g. over the memory budget of the connection.
+  // The requests made before the connection is established fail in the same
+  // way once it is.
+  bool Call(base::StringPiece request,
+            ResponseCallbackType callback,
+            int64_t timeout = 0);
+  std::future<Result> Call(base::StringPiece request, int64_t timeout = 0);
+
+  // the number of requests waiting for their responses
+  size_t outstanding() const;
+
+ private:
+  struct OutstandingRequest {
+    ResponseCallbackType callback;
+    // the time point max() means no deadline
+    std::chrono::steady_clock::time_point deadline;
+    EventCenter::TimerId deadline_timer { EventCenter::kInvalidTimerId };
+  };
+
+  std::shared_ptr<RequestCodec> codec_;
+
+  mutable std::mutex mutex_;
+  std::shared_ptr<TcpConnection> tcp_connection_;
+  std::shared_ptr<EventCenter> event_center_;
+  bool closed_ { false };
+  uint64_t next_correlation_id_ { 1 };
+  // the frames waiting for the connection to be established
+  std::string unsent_;
+  std::unordered_map<uint64_t, OutstandingRequest> outstanding_;
+  // the correlation ids in the order the requests are sent, only used by a
+  // codec without ids. The ids of the timed out requests are kept, so that
+  // their late responses are dropped.
+  std::deque<uint64_t> order_;
+
+  // NOTE: mutex_ must be held, and the connection must be established
+  void ArmDeadline(uint64_t correlation_id, OutstandingRequest* request);
+
+  void OnConnected(std::shared_ptr<TcpConnection> tcp_connection);
+  bool OnReceived(std::shared_ptr<TcpConnection> tcp_connection);
+  void OnClosed();
+  void OnDeadline(uint64_t correlation_id);
+};
+
+}  // namespace tcp
+}  // namespace cnetpp
+
+#endif  // CNETPP_TCP_REQUEST_CHANNEL_H_
+
@@ -0,0 +1,100 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include <cnetpp/tcp/request_codec.h>
+
+#include <string.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+
+namespace cnetpp {
+namespace tcp {
+
+void LengthPrefixedCodec::Encode(uint64_t correlation_id,
+                                 base::StringPiece request,
+                                 std::string* frame) {
+  assert(frame);
+  assert(request.size() <= max_payload_size_);
+  auto length = static_cast<uint32_t>(request.size());
+  char header[kHeaderSize];
+  for (int i = 0; i < 4; ++i) {
+    header[i] = static_cast<char>(length >> (24 - 8 * i));
+  }
+  for (int i = 0; i < 8; ++i) {
+    header[4 + i] = static_cast<char>(correlation_id >> (56 - 8 * i));
+  }
+  frame->reserve(frame->size() + kHeaderSize + request.size());
+  frame->append(header, kHeaderSize);
+  frame->append(request.data(), request.size());
+}
+
+int LengthPrefixedCodec::Decode(RingBuffer* buffer,
+                                uint64_t* correlation_id,
+                                std::string* response) {
+  assert(buffer);
+  assert(correlation_id);
+  assert(response);
+  if (buffer->Size() < kHeaderSize) {
+    return 0;
+  }
+  // peek at the header, it may wrap around the end of the buffer
+  unsigned char header[kHeaderSize];
+  struct iovec positions[2];
+  buffer->GetReadPositions(positions, 2);
+  size_t copied = 0;
+  for (auto& position : positions) {
+    auto n = std::min(position.iov_len, kHeaderSize - copied);
+    if (n > 0) {
+      ::memcpy(header + copied, position.iov_base, n);
+      copied += n;
+    }
+  }
+  assert(copied == kHeaderSize);
+
+  uint32_t length = 0;
+  for (int i = 0; i < 4; ++i) {
+    length = (length << 8) | header[i];
+  }
+  if (length > max_payload_size_) {
+    return -1;
+  }
+  if (buffer->Size() < kHeaderSize + length) {
+    return 0;
+  }
+  uint64_t id = 0;
+  for (int i = 0; i < 8; ++i) {
+    id = (id << 8) | header[4 + i];
+  }
+  *correlation_id = id;
+  buffer->CommitRead(kHeaderSize);
+  response->clear();
+  return buffer->Read(response, length) ? 1 : -1;
+}
+
+}  // namespace tcp
+}  // namespace cnetpp
+
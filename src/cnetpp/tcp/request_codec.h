@@ -0,0 +1,97 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef CNETPP_TCP_REQUEST_CODEC_H_
+#define CNETPP_TCP_REQUEST_CODEC_H_
+
+#include <cnetpp/tcp/ring_buffer.h>
+#include <cnetpp/base/string_piece.h>
+
+#include <stdint.h>
+
+#include <string>
+
+namespace cnetpp {
+namespace tcp {
+
+// Frames the requests and the responses of a RequestChannel.
+class RequestCodec {
+ public:
+  RequestCodec() = default;
+  virtual ~RequestCodec() = default;
+
+  // Whether a response carries the correlation id of its request. The
+  // responses of a protocol without ids, e.g. HTTP/1.1 pipelining with
+  // http::HttpResponseCodec, are matched with the requests in the order they
+  // are sent.
+  virtual bool HasCorrelationId() const = 0;
+
+  // Append the frame of 'request' to 'frame'. 'correlation_id' is unique on
+  // the connection, a codec without ids ignores it.
+  virtual void Encode(uint64_t correlation_id,
+                      base::StringPiece request,
+                      std::string* frame) = 0;
+
+  // Take one response out of 'buffer'. Return 1 if a response is decoded, 0
+  // if more data is needed and -1 if the data is malformed, which closes
+  // the connection. A codec without ids doesn't set 'correlation_id'.
+  virtual int Decode(RingBuffer* buffer,
+                     uint64_t* correlation_id,
+                     std::string* response) = 0;
+};
+
+// A frame is a 4 bytes payload length and an 8 bytes correlation id, both in
+// network byte order, followed by the payload.
+class LengthPrefixedCodec final : public RequestCodec {
+ public:
+  explicit LengthPrefixedCodec(uint32_t max_payload_size = 64 * 1024 * 1024)
+      : max_payload_size_(max_payload_size) {
+  }
+  ~LengthPrefixedCodec() = default;
+
+  bool HasCorrelationId() const override {
+    return true;
+  }
+
+  void Encode(uint64_t correlation_id,
+              base::StringPiece request,
+              std::string* frame) override;
+
+  int Decode(RingBuffer* buffer,
+             uint64_t* correlation_id,
+             std::string* response) override;
+
+ private:
+  static const size_t kHeaderSize = 12;
+
+  uint32_t max_payload_size_;
+};
+
+}  // namespace tcp
+}  // namespace cnetpp
+
+#endif  // CNETPP_TCP_REQUEST_CODEC_H_
+
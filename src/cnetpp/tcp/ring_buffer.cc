@@ -39,8 +39,8 @@ namespace cnetpp {
 namespace tcp {
 
 std::atomic<int64_t> RingBuffer::total_memory_{0};
-int64_t RingBuffer::min_memory_ = INT64_MAX;
-int64_t RingBuffer::max_memory_ = 0;
+std::atomic<int64_t> RingBuffer::min_memory_{INT64_MAX};
+std::atomic<int64_t> RingBuffer::max_memory_{0};
 
 void RingBuffer::Recycle() {
   if (Empty()) {
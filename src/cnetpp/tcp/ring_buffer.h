@@ -61,11 +61,11 @@ class RingBuffer {
     }
   }
 
-  size_t Capacity() {
+  size_t Capacity() const {
     return capacity_;
   }
 
-  size_t Size() {
+  size_t Size() const {
     return size_;
   }
 
@@ -75,15 +75,15 @@ class RingBuffer {
   // if new_size is less than size_, resize will fail
   bool Resize(size_t new_size);
 
-  size_t Length() {
+  size_t Length() const {
     return size_;
   }
 
-  bool Full() {
+  bool Full() const {
     return size_ == capacity_;
   }
 
-  bool Empty() {
+  bool Empty() const {
     return size_ == 0;
   }
 
@@ -142,24 +142,30 @@ class RingBuffer {
   }
 
   static int64_t MinRingBuffer() {
-    return min_memory_;
+    return min_memory_.load(std::memory_order_relaxed);
   }
 
   static int64_t MaxRingBuffer() {
-    return max_memory_;
+    return max_memory_.load(std::memory_order_relaxed);
   }
  private:
 
   static void UpdateMemoryUsed(int64_t old, int64_t n) {
-    // no atomic, is acceptable
-    if (n > max_memory_) max_memory_ = n;
-    if (n > 0 && n < min_memory_) min_memory_ = n;
+    // the buffers are resized in all the event poller threads at once
+    int64_t max = max_memory_.load(std::memory_order_relaxed);
+    while (n > max && !max_memory_.compare_exchange_weak(
+        max, n, std::memory_order_relaxed)) {
+    }
+    int64_t min = min_memory_.load(std::memory_order_relaxed);
+    while (n > 0 && n < min && !min_memory_.compare_exchange_weak(
+        min, n, std::memory_order_relaxed)) {
+    }
     total_memory_.fetch_add(n - old, std::memory_order_relaxed);
   }
 
   static std::atomic<int64_t> total_memory_;
-  static int64_t min_memory_;
-  static int64_t max_memory_;
+  static std::atomic<int64_t> min_memory_;
+  static std::atomic<int64_t> max_memory_;
  private:
   // preallocate space for each connection
   char* buffer_;
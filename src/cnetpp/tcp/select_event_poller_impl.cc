@@ -50,7 +50,10 @@ bool SelectEventPollerImpl::Poll() {
   }
 
   do {
-    count = ::select(max_fd + 1, &rd_fds, &wr_fds, &ex_fds, nullptr);
+    int timeout = NextTimeout();
+    struct timeval tv { timeout / 1000, (timeout % 1000) * 1000 };
+    count = ::select(max_fd + 1, &rd_fds, &wr_fds, &ex_fds,
+                     timeout < 0 ? nullptr : &tv);
   } while (count == -1 &&
            cnetpp::concurrency::ThisThread::GetLastError() == EINTR);
 
@@ -92,6 +95,7 @@ bool SelectEventPollerImpl::Poll() {
       }
     }
   }
+  ProcessTimers();
   return true;
 }
 
@@ -27,6 +27,8 @@
 #ifndef CNETPP_TCP_TCP_CALLBACKS_H_
 #define CNETPP_TCP_TCP_CALLBACKS_H_
 
+#include <cnetpp/tcp/connection_id.h>
+
 #include <functional>
 #include <memory>
 
@@ -35,14 +37,24 @@ namespace tcp {
 
 class TcpConnection;
 
+// The connection is passed by reference so that calling a callback doesn't
+// copy it, a callback taking a std::shared_ptr<TcpConnection> by value still
+// converts to these types.
 using ConnectedCallbackType =
-    std::function<bool(std::shared_ptr<TcpConnection>)>;
+    std::function<bool(const std::shared_ptr<TcpConnection>&)>;
 using ClosedCallbackType =
-    std::function<bool(std::shared_ptr<TcpConnection>)>;
+    std::function<bool(const std::shared_ptr<TcpConnection>&)>;
 using ReceivedCallbackType =
-    std::function<bool(std::shared_ptr<TcpConnection>)>;
+    std::function<bool(const std::shared_ptr<TcpConnection>&)>;
 using SentCallbackType =
-    std::function<bool(bool, std::shared_ptr<TcpConnection>)>;
+    std::function<bool(bool, const std::shared_ptr<TcpConnection>&)>;
+// Tells whether a connection of a draining server can be closed now, see
+// TcpServer::Drain().
+using IdleCallbackType =
+    std::function<bool(const std::shared_ptr<TcpConnection>&)>;
+// Called with the id of the new connection, or kInvalidConnectionId if it
+// fails to connect.
+using ConnectCallbackType = std::function<void(ConnectionId)>;
 
 }  // namespace tcp
 }  // namespace cnetpp
@@ -45,22 +45,100 @@ bool TcpClient::Launch(const std::string& name,
     const TcpClientOptions& options) {
   event_center_ = EventCenter::New(name, options.worker_count());
   assert(event_center_.get());
-  return event_center_->Launch();
+  context_shards_.clear();
+  for (size_t i = 0; i < event_center_->poller_count(); ++i) {
+    context_shards_.emplace_back(new ContextShard);
+  }
+  resolver_ = options.resolver() ? options.resolver() :
+                                   base::Resolver::Default();
+  resolve_guard_ = std::make_shared<ResolveGuard>();
+  resolve_guard_->client = this;
+  if (!event_center_->Launch()) {
+    return false;
+  }
+  event_center_->SetRateLimits(options.poller_receive_rate(),
+                               options.poller_send_rate());
+  event_center_->memory_budget()->set_limit(options.buffer_memory_limit());
+  return true;
 }
 
 bool TcpClient::Shutdown() {
+  if (resolve_guard_) {
+    std::lock_guard<std::recursive_mutex> guard(resolve_guard_->mutex);
+    resolve_guard_->client = nullptr;
+  }
   event_center_->Shutdown();
-  contexts_.clear();
+  for (auto& shard : context_shards_) {
+    std::lock_guard<std::mutex> guard(shard->mutex);
+    for (auto& context : shard->contexts) {
+      // the callbacks of the connection hold the context
+      context.second->tcp_connection.reset();
+    }
+    shard->contexts.clear();
+  }
   return true;
 }
 
+TcpClient::InternalConnectionContextPtr TcpClient::FindContext(
+    ConnectionId connection_id) {
+  auto& shard = GetContextShard(connection_id);
+  std::lock_guard<std::mutex> guard(shard.mutex);
+  auto itr = shard.contexts.find(connection_id);
+  return itr == shard.contexts.end() ? nullptr : itr->second;
+}
+
+std::shared_ptr<TcpConnection> TcpClient::FindConnection(
+    ConnectionId connection_id) {
+  auto& shard = GetContextShard(connection_id);
+  std::lock_guard<std::mutex> guard(shard.mutex);
+  auto itr = shard.contexts.find(connection_id);
+  return itr == shard.contexts.end() ? nullptr :
+                                       itr->second->tcp_connection;
+}
+
+void TcpClient::EraseContext(ConnectionId connection_id) {
+  auto& shard = GetContextShard(connection_id);
+  std::lock_guard<std::mutex> guard(shard.mutex);
+  auto itr = shard.contexts.find(connection_id);
+  if (itr != shard.contexts.end()) {
+    // break the cycle between the connection and its callbacks
+    itr->second->tcp_connection.reset();
+    shard.contexts.erase(itr);
+  }
+}
+
 ConnectionId TcpClient::Connect(const base::EndPoint* remote,
                                 const TcpClientOptions& options,
                                 std::shared_ptr<void> cookie) {
+  return DoConnect(remote, options, cookie, nullptr);
+}
+
+void TcpClient::Connect(const std::vector<base::EndPoint>& remotes,
+                        const TcpClientOptions& options,
+                        std::shared_ptr<void> cookie,
+                        ConnectCallbackType callback) {
+  assert(callback);
+  auto race = std::make_shared<ConnectRace>();
+  race->remotes = InterleaveByFamily(remotes);
+  race->options = options;
+  race->cookie = cookie;
+  race->callback = callback;
+  if (options.connect_timeout() > 0) {
+    std::lock_guard<std::mutex> guard(race->mutex);
+    race->timeout_timer = event_center_->AddTimer(options.connect_timeout(),
+        [this, race] () { this->FinishRace(race, kInvalidConnectionId); });
+  }
+  StartNextAttempt(race);
+}
+
+ConnectionId TcpClient::DoConnect(const base::EndPoint* remote,
+                                  const TcpClientOptions& options,
+                                  std::shared_ptr<void> cookie,
+                                  ConnectRacePtr race) {
   assert(remote);
 
   base::TcpSocket socket;
-  if (!socket.Create()) {
+  if (!socket.Create(remote->Family() == AF_INET6)) {
     CnetppError("Failed to create socket, Error: %s",
                 cnetpp::concurrency::ThisThread::GetLastErrorString().c_str());
     return kInvalidConnectionId;
@@ -114,43 +192,60 @@ ConnectionId TcpClient::Connect(const base::EndPoint* remote,
     return kInvalidConnectionId;
   }
 
-  InternalConnectionContext cc;
-  cc.status = Status::kConnecting;
-  cc.options = options;
-  cc.tcp_connection.reset();
+  auto cc = std::make_shared<InternalConnectionContext>();
+  cc->status = Status::kConnecting;
+  cc->options = options;
+  cc->race = race;
 
   ConnectionFactory cf;
   auto connection = cf.CreateConnection(event_center_, socket.fd(), false);
   auto tcp_connection = std::static_pointer_cast<TcpConnection>(connection);
   tcp_connection->SetSendBufferSize(options.send_buffer_size());
   tcp_connection->SetRecvBufferSize(options.receive_buffer_size());
+  tcp_connection->SetRateLimits(options.receive_rate(),
+                                options.receive_burst(),
+                                options.send_rate(),
+                                options.send_burst());
+  tcp_connection->SetReadBudget(options.max_reads_per_event(),
+                                options.max_bytes_per_event());
+  tcp_connection->SetMemoryBudget(options.connection_buffer_memory_limit(),
+                                  event_center_->memory_budget());
   tcp_connection->set_cookie(cookie);
   tcp_connection->set_remote_end_point(*remote);
-  cc.tcp_connection = tcp_connection;
-  std::unique_lock<std::mutex> guard(contexts_mutex_);
-  contexts_[connection->id()] = cc;
-  guard.unlock();
+  cc->tcp_connection = tcp_connection;
+  if (!race && options.connect_timeout() > 0) {
+    // the timer runs in the thread of the connection
+    auto connection_id = connection->id();
+    cc->connect_timer = event_center_->AddTimer(options.connect_timeout(),
+        [this, connection_id] () { this->OnConnectTimeout(connection_id); },
+        connection_id);
+  }
+  {
+    auto& shard = GetContextShard(connection->id());
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    shard.contexts[connection->id()] = cc;
+  }
 
   CnetppDebug("[Socket 0X%08x] <-> [TcpConnection 0X%08x]",
               socket.fd(), tcp_connection->id());
   tcp_connection->set_connected_callback(
-      [this] (std::shared_ptr<TcpConnection> c) -> bool {
-        return this->OnConnected(c);
+      [this, cc] (std::shared_ptr<TcpConnection> c) -> bool {
+        return this->OnConnected(cc.get(), c);
       }
   );
   tcp_connection->set_closed_callback(
-      [this] (std::shared_ptr<TcpConnection> c) -> bool {
-        return this->OnClosed(c);
+      [this, cc] (std::shared_ptr<TcpConnection> c) -> bool {
+        return this->OnClosed(cc.get(), c);
       }
   );
   tcp_connection->set_sent_callback(
-      [this] (bool status, std::shared_ptr<TcpConnection> c) -> bool {
-        return this->OnSent(status, c);
+      [this, cc] (bool status, std::shared_ptr<TcpConnection> c) -> bool {
+        return this->OnSent(cc.get(), status, c);
       }
   );
   tcp_connection->set_received_callback(
-      [this] (std::shared_ptr<TcpConnection> c) -> bool {
-        return this->OnReceived(c);
+      [this, cc] (std::shared_ptr<TcpConnection> c) -> bool {
+        return this->OnReceived(cc.get(), c);
       }
   );
 
@@ -170,78 +265,225 @@ ConnectionId TcpClient::Connect(const base::EndPoint* remote,
   return connection->id();
 }
 
+void TcpClient::AsyncConnect(const std::string& hostname,
+                             int port,
+                             const TcpClientOptions& options,
+                             std::shared_ptr<void> cookie,
+                             ConnectCallbackType callback) {
+  assert(resolver_.get());
+  assert(callback);
+  auto resolve_guard = resolve_guard_;
+  resolver_->AsyncResolve(hostname,
+      [resolve_guard, hostname, port, options, cookie, callback] (
+          bool found,
+          const std::vector<base::IPAddress>& addresses) {
+    std::lock_guard<std::recursive_mutex> guard(resolve_guard->mutex);
+    if (!resolve_guard->client) {
+      return;
+    }
+    if (!found || addresses.empty()) {
+      CnetppError("Failed to resolve %s", hostname.c_str());
+      callback(kInvalidConnectionId);
+      return;
+    }
+    std::vector<base::EndPoint> remotes;
+    for (auto& address : addresses) {
+      remotes.emplace_back(address, port);
+    }
+    resolve_guard->client->Connect(remotes, options, cookie, callback);
+  });
+}
+
+std::vector<base::EndPoint> TcpClient::InterleaveByFamily(
+    const std::vector<base::EndPoint>& remotes) {
+  std::vector<base::EndPoint> first;
+  std::vector<base::EndPoint> second;
+  for (auto& remote : remotes) {
+    if (remote.Family() == remotes.front().Family()) {
+      first.push_back(remote);
+    } else {
+      second.push_back(remote);
+    }
+  }
+  std::vector<base::EndPoint> result;
+  for (size_t i = 0; i < first.size() || i < second.size(); ++i) {
+    if (i < first.size()) {
+      result.push_back(first[i]);
+    }
+    if (i < second.size()) {
+      result.push_back(second[i]);
+    }
+  }
+  return result;
+}
+
+void TcpClient::StartNextAttempt(ConnectRacePtr race) {
+  std::unique_lock<std::mutex> guard(race->mutex);
+  if (race->done) {
+    return;
+  }
+  event_center_->CancelTimer(race->attempt_timer);
+  race->attempt_timer = EventCenter::kInvalidTimerId;
+  while (race->next < race->remotes.size()) {
+    auto& remote = race->remotes[race->next++];
+    // the commands of the new connection are processed asynchronously, so
+    // its callbacks can't run before the mutex of the race is released
+    auto connection_id = DoConnect(&remote, race->options, race->cookie,
+                                   race);
+    if (connection_id == kInvalidConnectionId) {
+      continue;
+    }
+    race->attempts.push_back(connection_id);
+    if (race->next < race->remotes.size()) {
+      race->attempt_timer = event_center_->AddTimer(
+          race->options.connect_attempt_delay(),
+          [this, race] () { this->StartNextAttempt(race); });
+    }
+    return;
+  }
+  if (!race->attempts.empty()) {
+    return;
+  }
+  guard.unlock();
+  FinishRace(race, kInvalidConnectionId);
+}
+
+bool TcpClient::FinishRace(ConnectRacePtr race, ConnectionId connection_id) {
+  std::vector<ConnectionId> losers;
+  {
+    std::lock_guard<std::mutex> guard(race->mutex);
+    if (race->done) {
+      return false;
+    }
+    race->done = true;
+    event_center_->CancelTimer(race->attempt_timer);
+    event_center_->CancelTimer(race->timeout_timer);
+    for (auto attempt : race->attempts) {
+      if (attempt != connection_id) {
+        losers.push_back(attempt);
+      }
+    }
+    race->attempts.clear();
+  }
+  for (auto loser : losers) {
+    RemoveConnection(loser);
+  }
+  if (connection_id == kInvalidConnectionId) {
+    CnetppError("Failed to connect to any of %zu remote servers",
+                race->remotes.size());
+    race->callback(kInvalidConnectionId);
+  }
+  return true;
+}
+
+void TcpClient::RemoveConnection(ConnectionId connection_id) {
+  auto tcp_connection = FindConnection(connection_id);
+  if (!tcp_connection) {
+    return;
+  }
+  // always queue the command, the connection may not have been added to its
+  // poller yet
+  event_center_->AddCommand(
+      Command(static_cast<int>(Command::Type::kRemoveConnImmediately),
+              tcp_connection),
+      true);
+}
+
+void TcpClient::OnConnectTimeout(ConnectionId connection_id) {
+  // in the thread of the connection
+  auto context = FindContext(connection_id);
+  if (!context || context->status != Status::kConnecting) {
+    return;
+  }
+  context->connect_timer = EventCenter::kInvalidTimerId;
+  CnetppError("Timed out connecting to remote server");
+  RemoveConnection(connection_id);
+}
+
 bool TcpClient::AsyncClosed(ConnectionId connection_id) {
-  std::unique_lock<std::mutex> guard(contexts_mutex_);
-  auto itr = contexts_.find(connection_id);
-  if (itr == contexts_.end()) {
+  auto tcp_connection = FindConnection(connection_id);
+  if (!tcp_connection) {
     return false;
   }
-  auto connection = itr->second.tcp_connection;
-  guard.unlock();
-  connection->MarkAsClosed();
+  tcp_connection->MarkAsClosed();
   return true;
 }
 
 bool TcpClient::OnConnected(
+    InternalConnectionContext* context,
     std::shared_ptr<TcpConnection> tcp_connection) {
   assert(tcp_connection.get());
-  std::unique_lock<std::mutex> guard(contexts_mutex_);
-  auto itr = contexts_.find(tcp_connection->id());
-  assert(itr != contexts_.end());
-  itr->second.status = Status::kConnected;
-  if (itr->second.options.connected_callback()) {
-    auto& cb = itr->second.options.mutable_connected_callback();
-    guard.unlock();
-    return cb(tcp_connection);
+  context->status = Status::kConnected;
+  event_center_->CancelTimer(context->connect_timer);
+  context->connect_timer = EventCenter::kInvalidTimerId;
+  if (context->race) {
+    auto race = std::move(context->race);
+    context->race.reset();
+    if (!FinishRace(race, tcp_connection->id())) {
+      // another attempt has won already, or the race has timed out
+      RemoveConnection(tcp_connection->id());
+      return true;
+    }
+    race->callback(tcp_connection->id());
+    if (context->status != Status::kConnected) {
+      // the callback has closed the connection
+      return true;
+    }
+  }
+  if (context->options.connected_callback()) {
+    return context->options.mutable_connected_callback()(tcp_connection);
   }
   return true;
 }
 
 bool TcpClient::OnClosed(
+    InternalConnectionContext* context,
     std::shared_ptr<TcpConnection> tcp_connection) {
   assert(tcp_connection.get());
-  std::unique_lock<std::mutex> guard(contexts_mutex_);
-  auto itr = contexts_.find(tcp_connection->id());
-  assert(itr != contexts_.end());
-  itr->second.status = Status::kClosed;
+  context->status = Status::kClosed;
+  event_center_->CancelTimer(context->connect_timer);
+  if (context->race) {
+    // a failed or a losing attempt, the user never learns about it
+    auto race = std::move(context->race);
+    context->race.reset();
+    EraseContext(tcp_connection->id());
+    std::unique_lock<std::mutex> race_guard(race->mutex);
+    race->attempts.erase(std::remove(race->attempts.begin(),
+                                     race->attempts.end(),
+                                     tcp_connection->id()),
+                         race->attempts.end());
+    if (race->done) {
+      return true;
+    }
+    race_guard.unlock();
+    StartNextAttempt(race);
+    return true;
+  }
   bool res = true;
-  if (itr->second.options.closed_callback()) {
-    auto& cb = itr->second.options.mutable_closed_callback();
-    guard.unlock();
-    res = cb(tcp_connection);
-    guard.lock();
-    contexts_.erase(itr);
-    return res;
-  }
-  contexts_.erase(itr);
+  if (context->options.closed_callback()) {
+    res = context->options.mutable_closed_callback()(tcp_connection);
+  }
+  EraseContext(tcp_connection->id());
   return res;
 }
 
-bool TcpClient::OnSent(bool success,
+bool TcpClient::OnSent(InternalConnectionContext* context,
+                       bool success,
                        std::shared_ptr<TcpConnection> tcp_connection) {
   assert(tcp_connection.get());
-  std::unique_lock<std::mutex> guard(contexts_mutex_);
-  auto itr = contexts_.find(tcp_connection->id());
-  assert(itr != contexts_.end());
-  assert(itr->second.status == Status::kConnected);
-  if (itr->second.options.sent_callback()) {
-    auto& cb = itr->second.options.mutable_sent_callback();
-    guard.unlock();
-    return cb(success, tcp_connection);
+  assert(context->status == Status::kConnected);
+  if (context->options.sent_callback()) {
+    return context->options.mutable_sent_callback()(success, tcp_connection);
   }
   return true;
 }
 
-bool TcpClient::OnReceived(std::shared_ptr<TcpConnection> tcp_connection) {
+bool TcpClient::OnReceived(InternalConnectionContext* context,
+                           std::shared_ptr<TcpConnection> tcp_connection) {
   assert(tcp_connection.get());
-  std::unique_lock<std::mutex> guard(contexts_mutex_);
-  auto itr = contexts_.find(tcp_connection->id());
-  assert(itr != contexts_.end());
-  assert(itr->second.status == Status::kConnected);
-  if (itr->second.options.received_callback()) {
-    auto& cb = itr->second.options.mutable_received_callback();
-    guard.unlock();
-    return cb(tcp_connection);
+  assert(context->status == Status::kConnected);
+  if (context->options.received_callback()) {
+    return context->options.mutable_received_callback()(tcp_connection);
   }
   return true;
 }
@@ -32,10 +32,13 @@
 #include <cnetpp/tcp/tcp_callbacks.h>
 #include <cnetpp/tcp/tcp_options.h>
 #include <cnetpp/base/end_point.h>
+#include <cnetpp/base/resolver.h>
 #include <cnetpp/base/uri.h>
 
 #include <mutex>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace cnetpp {
 namespace tcp {
@@ -61,10 +64,58 @@ class TcpClient final {
                        const TcpClientOptions& options = TcpClientOptions(),
                        std::shared_ptr<void> cookie = nullptr);
 
+  // Race connects to 'remotes' the way Happy Eyeballs (RFC 8305) does. The
+  // addresses are tried in turn with their families interleaved, starting
+  // with the family of the first one. The next attempt starts as soon as the
+  // previous one fails, or after options.connect_attempt_delay() if it is
+  // still pending. The first connection established wins, the other attempts
+  // are closed and none of the callbacks in 'options' is called for them.
+  // 'callback' is called in an event poller thread with the id of the winner
+  // right before its connected callback, or with kInvalidConnectionId once
+  // all the attempts have failed or options.connect_timeout() has passed,
+  // maybe right away if no socket can be created. It is never called once
+  // Shutdown() has returned.
+  void Connect(const std::vector<base::EndPoint>& remotes,
+               const TcpClientOptions& options,
+               std::shared_ptr<void> cookie,
+               ConnectCallbackType callback);
+
+  // Resolve 'hostname' without blocking the caller, then race connects over
+  // its addresses as the above does. The resolver rotates the addresses of a
+  // name between lookups, so the connections spread over them. 'callback' is
+  // also called with kInvalidConnectionId if the name can't be resolved,
+  // maybe right away if the failure is cached.
+  void AsyncConnect(const std::string& hostname,
+                    int port,
+                    const TcpClientOptions& options,
+                    std::shared_ptr<void> cookie,
+                    ConnectCallbackType callback);
+
   bool AsyncClosed(ConnectionId connection_id);
 
+  // The resolver of AsyncConnect(), nullptr before Launch()
+  const std::shared_ptr<base::Resolver>& resolver() const {
+    return resolver_;
+  }
+
+  // The memory taken by the buffers of all the connections, see
+  // TcpOptions::buffer_memory_limit(), nullptr before Launch()
+  std::shared_ptr<base::MemoryBudget> memory_budget() const {
+    return event_center_ ? event_center_->memory_budget() : nullptr;
+  }
+
  private:
   std::shared_ptr<EventCenter> event_center_;
+  std::shared_ptr<base::Resolver> resolver_;
+
+  // Outlives the client in the pending resolver callbacks, 'client' is reset
+  // when the client shuts down. It is recursive since a callback can start
+  // another connect which is answered right away from the resolver cache.
+  struct ResolveGuard {
+    std::recursive_mutex mutex;
+    TcpClient* client { nullptr };
+  };
+  std::shared_ptr<ResolveGuard> resolve_guard_;
 
   enum class Status {
     kInitialized, 
@@ -73,22 +124,79 @@ class TcpClient final {
     kClosed
   };
 
+  // a connect racing over several addresses
+  struct ConnectRace {
+    std::mutex mutex;
+    std::vector<base::EndPoint> remotes;
+    // the next address to try
+    size_t next { 0 };
+    // the attempts in flight
+    std::vector<ConnectionId> attempts;
+    bool done { false };
+    TcpClientOptions options;
+    std::shared_ptr<void> cookie;
+    ConnectCallbackType callback;
+    EventCenter::TimerId attempt_timer { EventCenter::kInvalidTimerId };
+    EventCenter::TimerId timeout_timer { EventCenter::kInvalidTimerId };
+  };
+  using ConnectRacePtr = std::shared_ptr<ConnectRace>;
+
+  // Held by the callbacks of its connection, so that they reach it without
+  // a lookup. Once the connection is registered, the fields are only
+  // touched in the event poller thread of the connection.
   struct InternalConnectionContext {
     Status status;
     TcpClientOptions options;
     std::shared_ptr<TcpConnection> tcp_connection;
+    // set while the connection is an attempt of a race
+    ConnectRacePtr race;
+    EventCenter::TimerId connect_timer { EventCenter::kInvalidTimerId };
   };
-
-  std::unordered_map<ConnectionId, InternalConnectionContext> contexts_;
-  std::mutex contexts_mutex_;
-
-  bool OnConnected(std::shared_ptr<TcpConnection> tcp_connection);
-
-  bool OnClosed(std::shared_ptr<TcpConnection> tcp_connection);
-
-  bool OnSent(bool success, std::shared_ptr<TcpConnection> tcp_connection);
-
-  bool OnReceived(std::shared_ptr<TcpConnection> tcp_connection);
+  using InternalConnectionContextPtr =
+      std::shared_ptr<InternalConnectionContext>;
+
+  // The registry of the connections is sharded the way the connections are
+  // spread over the event pollers, so the lock of a shard is mostly taken by
+  // a single poller thread.
+  struct ContextShard {
+    std::mutex mutex;
+    std::unordered_map<ConnectionId, InternalConnectionContextPtr> contexts;
+  };
+  std::vector<std::unique_ptr<ContextShard>> context_shards_;
+
+  ContextShard& GetContextShard(ConnectionId connection_id) {
+    return *context_shards_[connection_id % context_shards_.size()];
+  }
+  InternalConnectionContextPtr FindContext(ConnectionId connection_id);
+  std::shared_ptr<TcpConnection> FindConnection(ConnectionId connection_id);
+  void EraseContext(ConnectionId connection_id);
+
+  // NOTE: the mutex of 'race' must be held if it is not nullptr
+  ConnectionId DoConnect(const base::EndPoint* remote,
+                         const TcpClientOptions& options,
+                         std::shared_ptr<void> cookie,
+                         ConnectRacePtr race);
+
+  static std::vector<base::EndPoint> InterleaveByFamily(
+      const std::vector<base::EndPoint>& remotes);
+  void StartNextAttempt(ConnectRacePtr race);
+  // Return true if 'connection_id' wins the race.
+  bool FinishRace(ConnectRacePtr race, ConnectionId connection_id);
+  void RemoveConnection(ConnectionId connection_id);
+  void OnConnectTimeout(ConnectionId connection_id);
+
+  bool OnConnected(InternalConnectionContext* context,
+                   std::shared_ptr<TcpConnection> tcp_connection);
+
+  bool OnClosed(InternalConnectionContext* context,
+                std::shared_ptr<TcpConnection> tcp_connection);
+
+  bool OnSent(InternalConnectionContext* context,
+              bool success,
+              std::shared_ptr<TcpConnection> tcp_connection);
+
+  bool OnReceived(InternalConnectionContext* context,
+                  std::shared_ptr<TcpConnection> tcp_connection);
 };
 
 }  // namespace tcp
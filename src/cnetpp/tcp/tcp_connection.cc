@@ -31,28 +31,229 @@
 #include <cnetpp/base/socket.h>
 #include <cnetpp/base/log.h>
 #include <assert.h>
+#include <poll.h>
+#include <sys/stat.h>
 
+#include <algorithm>
+#include <limits>
 #include <memory>
+#include <utility>
 
 namespace cnetpp {
 namespace tcp {
 
+namespace {
+
+// the wait for this many bytes when a connection is throttled
+const double kThrottleResumeBytes = 4096;
+
+// the wait in milliseconds before reading again when the receive buffer is
+// full and the memory budget allows no larger one
+const int64_t kMemoryRetryDelay = 10;
+
+// the wait in milliseconds before splicing again from an empty pipe
+const int64_t kPipeRetryDelay = 5;
+
+// the bytes both buckets allow now, the maximum of size_t without buckets
+size_t Budget(base::TokenBucket* own, base::TokenBucket* shared) {
+  double budget = std::numeric_limits<size_t>::max();
+  if (own) {
+    budget = std::min(budget, own->Available());
+  }
+  if (shared) {
+    budget = std::min(budget, shared->Available());
+  }
+  if (budget >= std::numeric_limits<size_t>::max()) {
+    return std::numeric_limits<size_t>::max();
+  }
+  return static_cast<size_t>(budget);
+}
+
+void Charge(base::TokenBucket* own, base::TokenBucket* shared, size_t n) {
+  if (own) {
+    own->TryConsume(n);
+  }
+  if (shared) {
+    shared->TryConsume(n);
+  }
+}
+
+int64_t ThrottleDelay(base::TokenBucket* own, base::TokenBucket* shared) {
+  int64_t delay = 1;
+  for (auto bucket : { own, shared }) {
+    if (bucket) {
+      delay = std::max(delay, bucket->TimeUntilAvailable(
+          std::min(bucket->burst(), kThrottleResumeBytes)));
+    }
+  }
+  return delay;
+}
+
+// whether splice(2) from the pipe 'fd' would find data, or the end of it
+bool PipeReadable(int fd) {
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  return ::poll(&pfd, 1, 0) != 0;
+}
+
+// cut the total length of 'buffers' down to 'max_length'
+void LimitLength(struct iovec* buffers, size_t count, size_t max_length) {
+  for (size_t i = 0; i < count; ++i) {
+    buffers[i].iov_len = std::min(buffers[i].iov_len, max_length);
+    max_length -= buffers[i].iov_len;
+  }
+}
+
+}  // namespace
+
+TcpConnection::~TcpConnection() {
+  if (memory_budget_) {
+    int64_t charged = recv_charged_;
+    for (auto& entry : send_buffers_) {
+      charged += entry.charged;
+    }
+    memory_budget_->Release(charged);
+  }
+}
+
 bool TcpConnection::SendPacket() {
-  Command command(static_cast<int>(Command::Type::kReadable) |
-                  static_cast<int>(Command::Type::kWriteable),
-                  shared_from_this());
+  return AddCommand(static_cast<int>(Command::Type::kReadable) |
+                    static_cast<int>(Command::Type::kWriteable));
+}
+
+bool TcpConnection::AddCommand(int type, bool async) {
   std::shared_ptr<EventCenter> event_center = event_center_.lock();
   if (!event_center.get()) {
     return false;
   }
+  Command command(type, shared_from_this());
   CnetppDebug("[Socket 0X%08x] [TcpConnection 0X%08x] "
-              "send packet command [type %s]",
+              "add command [type %s]",
               socket_.fd(), this->id(), command.TypeString().c_str());
-  event_center->AddCommand(command,
-      ep_thread_id_ != std::this_thread::get_id());
+  event_center->AddCommand(std::move(command),
+      async || ep_thread_id_ != std::this_thread::get_id());
   return true;
 }
 
+void TcpConnection::SetRateLimits(double receive_rate,
+                                  double receive_burst,
+                                  double send_rate,
+                                  double send_burst) {
+  receive_bucket_.reset();
+  if (receive_rate > 0) {
+    receive_bucket_.reset(new base::TokenBucket(
+        receive_rate, receive_burst > 0 ? receive_burst : receive_rate));
+  }
+  send_bucket_.reset();
+  if (send_rate > 0) {
+    send_bucket_.reset(new base::TokenBucket(
+        send_rate, send_burst > 0 ? send_burst : send_rate));
+  }
+}
+
+void TcpConnection::SetMemoryBudget(
+    int64_t limit,
+    std::shared_ptr<base::MemoryBudget> parent) {
+  if (memory_budget_) {
+    memory_budget_->Release(recv_charged_);
+  }
+  // without a limit of its own the connection is charged to its parent
+  // directly
+  if (limit > 0 || !parent) {
+    memory_budget_ =
+        std::make_shared<base::MemoryBudget>(limit, std::move(parent));
+  } else {
+    memory_budget_ = std::move(parent);
+  }
+  recv_charged_ = recv_buffer_.Capacity();
+  memory_budget_->Charge(recv_charged_);
+}
+
+bool TcpConnection::ChargeSendEntry(SendEntry* entry) {
+  if (!memory_budget_) {
+    return true;
+  }
+  int64_t n = (entry->buffer ? entry->buffer->Capacity() : 0) +
+      entry->body.size();
+  if (!memory_budget_->TryCharge(n)) {
+    CnetppWarn("[Socket 0X%08x] [TcpConnection 0X%08x] "
+               "reject a packet of %lld bytes over the memory budget",
+               socket_.fd(), this->id(), static_cast<long long>(n));
+    return false;
+  }
+  entry->charged = n;
+  return true;
+}
+
+void TcpConnection::ThrottleReceiving(EventCenter* event_center,
+                                      int64_t delay) {
+  CnetppDebug("[Socket 0X%08x] [TcpConnection 0X%08x] "
+              "throttle receiving", socket_.fd(), this->id());
+  receive_throttled_.store(true, std::memory_order_relaxed);
+  auto self = std::static_pointer_cast<TcpConnection>(shared_from_this());
+  event_center->AddCommand(
+      Command(static_cast<int>(Command::Type::kPauseReading), self), false);
+  std::weak_ptr<TcpConnection> weak_self = self;
+  event_center->AddTimer(delay, [weak_self, event_center] () {
+    auto connection = weak_self.lock();
+    if (!connection) {
+      return;
+    }
+    connection->receive_throttled_.store(false, std::memory_order_relaxed);
+    if (connection->state() == State::kConnected) {
+      event_center->AddCommand(
+          Command(static_cast<int>(Command::Type::kResumeReading),
+                  connection),
+          false);
+    }
+  }, id());
+}
+
+void TcpConnection::ThrottleSending(EventCenter* event_center,
+                                    int64_t delay) {
+  CnetppDebug("[Socket 0X%08x] [TcpConnection 0X%08x] "
+              "throttle sending", socket_.fd(), this->id());
+  auto self = std::static_pointer_cast<TcpConnection>(shared_from_this());
+  event_center->AddCommand(
+      Command(static_cast<int>(Command::Type::kReadable), self), false);
+  if (send_throttled_) {
+    // the timer is already there
+    return;
+  }
+  send_throttled_ = true;
+  std::weak_ptr<TcpConnection> weak_self = self;
+  event_center->AddTimer(delay, [weak_self, event_center] () {
+    auto connection = weak_self.lock();
+    if (!connection) {
+      return;
+    }
+    connection->send_throttled_ = false;
+    if (connection->state() == State::kConnected ||
+        connection->state() == State::kClosing) {
+      int type = static_cast<int>(Command::Type::kReadable) |
+          static_cast<int>(Command::Type::kWriteable);
+      event_center->AddCommand(Command(type, connection), false);
+    }
+  }, id());
+}
+
+bool TcpConnection::PauseReceiving() {
+  if (read_paused_.exchange(true, std::memory_order_acq_rel)) {
+    return true;
+  }
+  return AddCommand(static_cast<int>(Command::Type::kPauseReading));
+}
+
+bool TcpConnection::ResumeReceiving() {
+  if (!read_paused_.exchange(false, std::memory_order_acq_rel)) {
+    return true;
+  }
+  // never re-enter the received callback from inside of it
+  return AddCommand(static_cast<int>(Command::Type::kResumeReading), true);
+}
+
 bool TcpConnection::SendPacket(base::StringPiece data) {
   auto send_buffer = std::make_unique<RingBuffer>(data.size());
   bool r = send_buffer->Write(data);
@@ -62,17 +263,137 @@ bool TcpConnection::SendPacket(base::StringPiece data) {
 }
 
 bool TcpConnection::SendPacket(std::unique_ptr<RingBuffer>&& data) {
+  SendEntry entry;
+  entry.buffer = std::move(data);
+  if (!ChargeSendEntry(&entry)) {
+    return false;
+  }
+  {
+    concurrency::SpinLock::ScopeGuard guard(send_lock_);
+    send_buffers_.push_back(std::move(entry));
+  }
+  return SendPacket();
+}
+
+bool TcpConnection::SendPacket(std::unique_ptr<RingBuffer>&& data,
+                               base::StringPiece body,
+                               std::shared_ptr<void> body_owner) {
+  SendEntry entry;
+  entry.buffer = std::move(data);
+  entry.body = body;
+  entry.body_owner = std::move(body_owner);
+  if (!ChargeSendEntry(&entry)) {
+    return false;
+  }
+  {
+    concurrency::SpinLock::ScopeGuard guard(send_lock_);
+    send_buffers_.push_back(std::move(entry));
+  }
+  return SendPacket();
+}
+
+bool TcpConnection::SendFile(int fd,
+                             off_t offset,
+                             size_t length,
+                             std::shared_ptr<void> file_owner) {
+  return SendFile(nullptr, fd, offset, length, std::move(file_owner));
+}
+
+bool TcpConnection::SendFile(std::unique_ptr<RingBuffer>&& data,
+                             int fd,
+                             off_t offset,
+                             size_t length,
+                             std::shared_ptr<void> file_owner) {
+  struct stat file_stat;
+  if (::fstat(fd, &file_stat) != 0) {
+    CnetppError("[Socket 0X%08x] [TcpConnection 0X%08x] "
+                "fstat() failed on [File 0X%08x]", socket_.fd(), id(), fd);
+    return false;
+  }
+  SendEntry entry;
+  entry.buffer = std::move(data);
+  entry.file_fd = fd;
+  entry.file_is_pipe = S_ISFIFO(file_stat.st_mode);
+  entry.file_offset = offset;
+  entry.file_length = length;
+  entry.file_owner = std::move(file_owner);
+  if (!ChargeSendEntry(&entry)) {
+    return false;
+  }
   {
     concurrency::SpinLock::ScopeGuard guard(send_lock_);
-    send_buffers_.emplace_back(std::move(data));
+    send_buffers_.push_back(std::move(entry));
   }
   return SendPacket();
 }
 
+size_t TcpConnection::SendEntry::GetReadPositions(
+    struct iovec* read_positions) {
+  size_t count = 0;
+  if (buffer && !buffer->Empty()) {
+    buffer->GetReadPositions(read_positions, 2);
+    count = read_positions[1].iov_len > 0 ? 2 : 1;
+  }
+  if (!body.empty()) {
+    read_positions[count].iov_base = const_cast<char*>(body.data());
+    read_positions[count].iov_len = body.size();
+    count++;
+  }
+  return count;
+}
+
+void TcpConnection::SendEntry::CommitRead(size_t n) {
+  if (buffer) {
+    size_t buffered = std::min(n, buffer->Size());
+    buffer->CommitRead(buffered);
+    n -= buffered;
+  }
+  assert(n <= body.size());
+  body.remove_prefix(n);
+}
+
+bool TcpConnection::SendEntry::Write(base::TcpSocket* socket,
+                                     size_t max_length,
+                                     size_t* requested_length,
+                                     size_t* sent_length) {
+  if (MemorySize() > 0 || file_length == 0) {
+    struct iovec buffers[3];
+    size_t count = GetReadPositions(buffers);
+    LimitLength(buffers, count, max_length);
+    *requested_length = std::min(MemorySize(), max_length);
+    bool ret = socket->Send(buffers, count, sent_length, true);
+    if (ret) {
+      CommitRead(*sent_length);
+    }
+    return ret;
+  }
+
+  *requested_length = std::min(file_length, max_length);
+  bool ret = socket->SendFile(file_fd,
+                              file_is_pipe ? nullptr : &file_offset,
+                              *requested_length,
+                              sent_length,
+                              true);
+  if (ret) {
+    file_length -= *sent_length;
+  }
+  return ret;
+}
+
 // This method will be called when a socket fd becomes readable
 void TcpConnection::HandleReadableEvent(EventCenter* event_center) {
   CnetppDebug("[Socket 0X%08x] [TcpConnection 0X%08x] "
               "receive readable event", socket_.fd(), this->id());
+  // the map of the event center holds the connection until it is removed,
+  // which needs a reference. Take it on the first callback or command only
+  // and reuse it, a wakeup which reads nothing doesn't touch the count.
+  std::shared_ptr<TcpConnection> self;
+  auto get_self = [this, &self] () -> const std::shared_ptr<TcpConnection>& {
+    if (!self) {
+      self = std::static_pointer_cast<TcpConnection>(shared_from_this());
+    }
+    return self;
+  };
   bool closed = false;
 
   if (state_ == State::kConnecting) {
@@ -90,20 +411,46 @@ void TcpConnection::HandleReadableEvent(EventCenter* event_center) {
       state_ = State::kConnected;
       if (connected_callback_) {
         // call callback user defined
-        connected_callback_(
-            std::static_pointer_cast<TcpConnection>(shared_from_this()));
+        connected_callback_(get_self());
       }
     }
   }
 
   if (state_ == State::kConnected) {
     // handle new arrival data
-    while (true) {
+    auto shared_bucket = event_center->receive_bucket(id());
+    size_t reads = 0;
+    size_t bytes = 0;
+    while (!read_paused()) {
+      if ((max_reads_per_event_ > 0 && reads >= max_reads_per_event_) ||
+          (max_bytes_per_event_ > 0 && bytes >= max_bytes_per_event_)) {
+        // leave the rest to the next poll, the fd is still readable
+        break;
+      }
+      size_t budget = Budget(receive_bucket_.get(), shared_bucket);
+      if (budget == 0) {
+        ThrottleReceiving(event_center,
+                          ThrottleDelay(receive_bucket_.get(), shared_bucket));
+        break;
+      }
+      if (max_bytes_per_event_ > 0) {
+        budget = std::min(budget, max_bytes_per_event_ - bytes);
+      }
       if (recv_buffer_.Capacity() - recv_buffer_.Size() < 512) {
-        recv_buffer_.Resize(2 * recv_buffer_.Capacity());
+        int64_t capacity = 2 * recv_buffer_.Capacity();
+        if (!memory_budget_ ||
+            memory_budget_->TryCharge(capacity - recv_charged_)) {
+          recv_buffer_.Resize(capacity);
+          recv_charged_ = capacity;
+        } else if (recv_buffer_.Size() == recv_buffer_.Capacity()) {
+          // nothing more can be read until the consumer frees some room
+          ThrottleReceiving(event_center, kMemoryRetryDelay);
+          break;
+        }
       }
       struct iovec buffers[2];
       recv_buffer_.GetWritePositions(buffers, 2);
+      LimitLength(buffers, 2, budget);
       size_t received_length = 0;
       bool ret = socket_.Receive(buffers, 2, &received_length, true);
       status_ = cnetpp::concurrency::ThisThread::GetLastError();
@@ -116,9 +463,11 @@ void TcpConnection::HandleReadableEvent(EventCenter* event_center) {
       } else {
         // really received data
         recv_buffer_.CommitWrite(received_length);
+        Charge(receive_bucket_.get(), shared_bucket, received_length);
+        reads++;
+        bytes += received_length;
         if (received_callback_) {
-          if (!received_callback_(
-              std::static_pointer_cast<TcpConnection>(shared_from_this()))) {
+          if (!received_callback_(get_self())) {
             closed = true;
             break;
           }
@@ -129,15 +478,17 @@ void TcpConnection::HandleReadableEvent(EventCenter* event_center) {
 
   if (closed && state_ != State::kClosed) {
     // remove this connection from event center
-    Command command(static_cast<int>(Command::Type::kRemoveConnImmediately),
-                    shared_from_this());
-    event_center->AddCommand(command, false/* only ep thread could be here */);
+    event_center->AddCommand(
+        Command(static_cast<int>(Command::Type::kRemoveConnImmediately),
+                get_self()),
+        false/* only ep thread could be here */);
   }
 }
 
 void TcpConnection::HandleWriteableEvent(EventCenter* event_center) {
   CnetppDebug("[Socket 0X%08x] [TcpConnection 0X%08x] "
               "receive writeable event...", socket_.fd(), this->id());
+  auto self = std::static_pointer_cast<TcpConnection>(shared_from_this());
 
   bool closed = false;
 
@@ -162,8 +513,7 @@ void TcpConnection::HandleWriteableEvent(EventCenter* event_center) {
       state_ = State::kConnected;
       if (connected_callback_) {
         // call callback user defined
-        connected_callback_(
-            std::static_pointer_cast<TcpConnection>(shared_from_this()));
+        connected_callback_(self);
       }
     }
   }
@@ -173,13 +523,11 @@ void TcpConnection::HandleWriteableEvent(EventCenter* event_center) {
     if (send_buffers_.empty()) {
       send_lock_.Unlock();
       if (state_ == State::kConnected) {
-        Command command(static_cast<int>(Command::Type::kReadable),
-            shared_from_this());
-        event_center->AddCommand(command, false);
+        int type = static_cast<int>(Command::Type::kReadable);
+        event_center->AddCommand(Command(type, self), false);
       } else if (state_ == State::kClosing) {
-        Command command(static_cast<int>(Command::Type::kRemoveConnImmediately),
-            shared_from_this());
-        event_center->AddCommand(command, false);
+        int type = static_cast<int>(Command::Type::kRemoveConnImmediately);
+        event_center->AddCommand(Command(type, self), false);
       }
       // do nothing
       return;
@@ -188,62 +536,101 @@ void TcpConnection::HandleWriteableEvent(EventCenter* event_center) {
   }
 
   if (state_ == State::kConnected || state_ == State::kClosing) {
+    auto shared_bucket = event_center->send_bucket(id());
     while (true) {
+      size_t budget = Budget(send_bucket_.get(), shared_bucket);
+      if (budget == 0) {
+        ThrottleSending(event_center,
+                        ThrottleDelay(send_bucket_.get(), shared_bucket));
+        return;
+      }
       send_lock_.Lock();
       auto& send_buffer = send_buffers_.front();
       send_lock_.Unlock();
+      size_t requested_length = 0;
       size_t sent_length = 0;
-      struct iovec buffers[2];
-      send_buffer->GetReadPositions(buffers, 2);
-      bool ret = socket_.Send(buffers, 2, &sent_length, true);
+      bool ret = send_buffer.Write(&socket_, budget, &requested_length,
+                                   &sent_length);
       status_ = cnetpp::concurrency::ThisThread::GetLastError();
+      if (ret) {
+        Charge(send_bucket_.get(), shared_bucket, sent_length);
+      }
       //error_message_ = cnetpp::concurrency::ThisThread::GetLastErrorString();
       if (!ret && status_ == EAGAIN) {
+        if (send_buffer.MemorySize() == 0 && send_buffer.file_is_pipe &&
+            !PipeReadable(send_buffer.file_fd)) {
+          // it's the pipe which is empty, the socket stays writable and
+          // would wake the poller up again right away
+          ThrottleSending(event_center, kPipeRetryDelay);
+        }
         return;
       } else if (!ret) {
         closed = true;
         break;
+      } else if (sent_length == 0 && requested_length > 0) {
+        // the file is shorter than expected, or the pipe is closed
+        CnetppError("[Socket 0X%08x] [TcpConnection 0X%08x] "
+                    "no more data in [File 0X%08x]",
+                    socket_.fd(), this->id(), send_buffer.file_fd);
+        closed = true;
+        break;
+      } else if (send_buffer.Size() > 0) {
+        if (sent_length == requested_length) {
+          // go on with the file segment of the entry
+          continue;
+        }
+        int type = static_cast<int>(Command::Type::kReadable) |
+          static_cast<int>(Command::Type::kWriteable);
+        event_center->AddCommand(Command(type, self), false);
+        return;
       } else {
-        if (sent_length > 0) {
-          if (sent_length != send_buffer->Size()) {
-            send_buffer->CommitRead(sent_length);
-            int type = static_cast<int>(Command::Type::kReadable) |
-              static_cast<int>(Command::Type::kWriteable);
-            event_center->AddCommand(Command(type, shared_from_this()), false);
-            return;
-          } else {
-            bool all_sent = false;
-            send_lock_.Lock();
-            send_buffers_.pop_front();
-            if (send_buffers_.empty()) {
-              all_sent = true;
-            }
-            send_lock_.Unlock();
-            if (all_sent && state_ != State::kClosing) {
-              int type = static_cast<int>(Command::Type::kReadable);
-              event_center->AddCommand(Command(type, shared_from_this()),
-                  false);
-            }
-            if (sent_callback_) {
-              sent_callback_(true,
-                  std::static_pointer_cast<TcpConnection>(shared_from_this()));
-            }
-            if (all_sent) {
-              if (state_ == State::kClosing) {
-                closed = true;
-              }
-              break;
-            }
+        bool all_sent = false;
+        int64_t charged = send_buffer.charged;
+        send_lock_.Lock();
+        send_buffers_.pop_front();
+        if (send_buffers_.empty()) {
+          all_sent = true;
+        }
+        send_lock_.Unlock();
+        if (memory_budget_) {
+          memory_budget_->Release(charged);
+        }
+        if (all_sent && state_ != State::kClosing) {
+          int type = static_cast<int>(Command::Type::kReadable);
+          event_center->AddCommand(Command(type, self), false);
+        }
+        if (sent_callback_) {
+          sent_callback_(true, self);
+        }
+        if (all_sent) {
+          if (state_ == State::kClosing) {
+            closed = true;
           }
+          break;
         }
       }
     }
   }
 
   if (closed && state_ != State::kClosed) {
-    Command command(static_cast<int>(Command::Type::kRemoveConnImmediately),
-                    shared_from_this());
-    event_center->AddCommand(command, false);
+    event_center->AddCommand(
+        Command(static_cast<int>(Command::Type::kRemoveConnImmediately), self),
+        false);
+  }
+}
+
+void TcpConnection::HandleResumeReading(EventCenter* event_center) {
+  CnetppDebug("[Socket 0X%08x] [TcpConnection 0X%08x] "
+              "receive resume reading event", socket_.fd(), this->id());
+  if (state_ != State::kConnected || read_paused() ||
+      recv_buffer_.Empty() || !received_callback_) {
+    return;
+  }
+  auto self = std::static_pointer_cast<TcpConnection>(shared_from_this());
+  if (!received_callback_(self)) {
+    event_center->AddCommand(
+        Command(static_cast<int>(Command::Type::kRemoveConnImmediately), self),
+        false);
   }
 }
 
@@ -272,10 +659,9 @@ void TcpConnection::MarkAsClosed(bool immediately) {
   } else {
     type = static_cast<int>(Command::Type::kRemoveConn);
   }
-  Command command(type, shared_from_this());
   auto event_center = event_center_.lock();
   if (event_center.get()) {
-    event_center->AddCommand(command,
+    event_center->AddCommand(Command(type, shared_from_this()),
         ep_thread_id_ != std::this_thread::get_id());
   }
 }
@@ -30,7 +30,10 @@
 #include <cnetpp/tcp/connection_base.h>
 #include <cnetpp/tcp/ring_buffer.h>
 #include <cnetpp/tcp/tcp_callbacks.h>
+#include <cnetpp/base/memory_budget.h>
+#include <cnetpp/base/pool_allocator.h>
 #include <cnetpp/base/string_piece.h>
+#include <cnetpp/base/token_bucket.h>
 #include <cnetpp/concurrency/spin_lock.h>
 
 #include <atomic>
@@ -49,8 +52,9 @@ class EventCenter;
 class TcpConnection : public ConnectionBase {
  public:
   friend class ConnectionFactory;
+  friend class base::PoolAllocator<TcpConnection>;
 
-  virtual ~TcpConnection() = default;
+  virtual ~TcpConnection();
   virtual std::string ToName() const override {
     return "TcpConnection";
   }
@@ -123,6 +127,22 @@ class TcpConnection : public ConnectionBase {
     cookie_ = cookie;
   }
 
+  // The object the layer above keeps for this connection, e.g. the
+  // HttpConnection, so that its callbacks reach it without a lookup. It is
+  // set and read in the event poller thread of the connection, and the owner
+  // resets it once the connection is closed.
+  template <typename T>
+  T* context() const {
+    return static_cast<T*>(context_.get());
+  }
+  template <typename T>
+  std::shared_ptr<T> shared_context() const {
+    return std::static_pointer_cast<T>(context_);
+  }
+  void set_context(std::shared_ptr<void> context) {
+    context_ = std::move(context);
+  }
+
   const base::EndPoint& remote_end_point() const {
     return remote_end_point_;
   }
@@ -138,6 +158,65 @@ class TcpConnection : public ConnectionBase {
 
   bool SendPacket(base::StringPiece data);
   bool SendPacket(std::unique_ptr<RingBuffer>&& data);
+  // Send 'data' followed by 'body' as a single packet. 'body' is not copied,
+  // it is written to the socket straight from the caller's memory, which
+  // must be kept alive and unmodified by 'body_owner' until it is sent.
+  bool SendPacket(std::unique_ptr<RingBuffer>&& data,
+                  base::StringPiece body,
+                  std::shared_ptr<void> body_owner);
+
+  // Send 'length' bytes of the file 'fd' starting at 'offset' with
+  // sendfile(2), or of the pipe 'fd' with splice(2), in which case 'offset'
+  // is ignored. 'fd' must stay open until it is sent, 'file_owner' is
+  // released then, so it can be used to close 'fd'. While a pipe is empty
+  // the connection stops polling for writing and checks it again every few
+  // milliseconds.
+  bool SendFile(int fd,
+                off_t offset,
+                size_t length,
+                std::shared_ptr<void> file_owner = nullptr);
+  // Same as above, but 'data' is sent in front of the file content
+  bool SendFile(std::unique_ptr<RingBuffer>&& data,
+                int fd,
+                off_t offset,
+                size_t length,
+                std::shared_ptr<void> file_owner = nullptr);
+
+  // Stop reading from the socket, e.g. when the consumer of the received data
+  // is slower than the peer. The received callback isn't called again until
+  // ResumeReceiving() is called, the data already received is kept in the
+  // receive buffer. Both of them can be called from any thread.
+  bool PauseReceiving();
+  // Start reading from the socket again. The received callback will be
+  // called at once if there is data left in the receive buffer.
+  bool ResumeReceiving();
+
+  // Limit the bytes per second this connection receives and sends, see
+  // TcpOptions::receive_rate(). It must be called before the connection is
+  // added to the event center.
+  void SetRateLimits(double receive_rate,
+                     double receive_burst,
+                     double send_rate,
+                     double send_burst);
+
+  // Limit how much is read in one readable event, see
+  // TcpOptions::max_reads_per_event()
+  void SetReadBudget(size_t max_reads, size_t max_bytes) {
+    max_reads_per_event_ = max_reads;
+    max_bytes_per_event_ = max_bytes;
+  }
+
+  // Charge the receive and the send buffers to a budget of 'limit' bytes, 0
+  // means no limit, under 'parent', usually the one of the event center. The
+  // connection stops reading while the budget or one of its parents is used
+  // up, and SendPacket() and SendFile() fail. It must be called before the
+  // connection is added to the event center.
+  void SetMemoryBudget(int64_t limit,
+                       std::shared_ptr<base::MemoryBudget> parent);
+  // nullptr if the buffers aren't charged
+  const std::shared_ptr<base::MemoryBudget>& memory_budget() const {
+    return memory_budget_;
+  }
 
   // These three methods will be called by the event poller thread when a
   // socket fd becomes readable or writable
@@ -145,6 +224,7 @@ class TcpConnection : public ConnectionBase {
   void HandleReadableEvent(EventCenter* event_center) override;
   void HandleWriteableEvent(EventCenter* event_center) override;
   void HandleCloseConnection() override;
+  void HandleResumeReading(EventCenter* event_center) override;
 
   void MarkAsClosed(bool immediately = true) override;
 
@@ -156,23 +236,85 @@ class TcpConnection : public ConnectionBase {
 
   bool SendPacket();
 
+  // 'async' forces the command to be processed in the next poll loop even if
+  // it is added in the event poller thread
+  bool AddCommand(int type, bool async = false);
+
+  // Stop polling for reading or writing until the rate limits allow some
+  // more bytes, or for 'delay' milliseconds, called in the event poller
+  // thread
+  void ThrottleReceiving(EventCenter* event_center, int64_t delay);
+  void ThrottleSending(EventCenter* event_center, int64_t delay);
+
+  // An entry of the send queue, 'buffer' is owned by the connection, 'body'
+  // is borrowed memory sent right after 'buffer' without any copy, and the
+  // file segment, if any, is sent after both of them.
+  struct SendEntry {
+    std::unique_ptr<RingBuffer> buffer;
+    base::StringPiece body;
+    std::shared_ptr<void> body_owner;
+
+    int file_fd { -1 };
+    bool file_is_pipe { false };
+    off_t file_offset { 0 };
+    size_t file_length { 0 };
+    std::shared_ptr<void> file_owner;
+
+    // the bytes charged to the memory budget of the connection
+    int64_t charged { 0 };
+
+    size_t MemorySize() const {
+      return (buffer ? buffer->Size() : 0) + body.size();
+    }
+    size_t Size() const {
+      return MemorySize() + file_length;
+    }
+    // return the number of iovecs filled, at most 3
+    size_t GetReadPositions(struct iovec* read_positions);
+    void CommitRead(size_t n);
+
+    // Write at most 'max_length' bytes of the memory part of the entry, or
+    // of the file segment once the memory part is sent. 'requested_length'
+    // is set to the number of bytes tried to write.
+    bool Write(base::TcpSocket* socket,
+               size_t max_length,
+               size_t* requested_length,
+               size_t* sent_length);
+  };
+
+  // Charge an entry to the memory budget, false if it must be rejected
+  bool ChargeSendEntry(SendEntry* entry);
+
   base::EndPoint remote_end_point_;
 
   int status_ { 0 }; // equal to errno
   std::string error_message_;
 
   concurrency::SpinLock send_lock_;
-  std::list<std::unique_ptr<RingBuffer>> send_buffers_;
+  std::list<SendEntry> send_buffers_;
 
   RingBuffer recv_buffer_;
 
   size_t receive_buffer_size_;
   size_t send_buffer_size_;
 
+  // the rate limits of this connection, nullptr if there is no limit
+  std::unique_ptr<base::TokenBucket> receive_bucket_;
+  std::unique_ptr<base::TokenBucket> send_bucket_;
+  bool send_throttled_ { false };
+
+  size_t max_reads_per_event_ { 0 };
+  size_t max_bytes_per_event_ { 0 };
+
+  std::shared_ptr<base::MemoryBudget> memory_budget_;
+  // the capacity of the receive buffer charged to the budget
+  int64_t recv_charged_ { 0 };
+
   ClosedCallbackType closed_callback_ { nullptr };
   SentCallbackType sent_callback_ { nullptr };
   ReceivedCallbackType received_callback_ { nullptr };
   std::shared_ptr<void> cookie_ { nullptr };
+  std::shared_ptr<void> context_ { nullptr };
 };
 
 }  // namespace tcp
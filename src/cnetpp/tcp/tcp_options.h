@@ -35,6 +35,7 @@
 #include "event_center.h"
 #include "tcp_callbacks.h"
 #include "../base/end_point.h"
+#include "../base/resolver.h"
 
 namespace cnetpp {
 namespace tcp {
@@ -126,6 +127,87 @@ class TcpOptions {
     sent_callback_ = sent_callback;
   }
 
+  // The bytes per second each connection receives and sends on average and
+  // in a burst, a rate of 0 means no limit and a burst of 0 means one second
+  // worth of the rate. A connection over its rate stops being polled for
+  // reading or writing until it has tokens again.
+  double receive_rate() const {
+    return receive_rate_;
+  }
+  void set_receive_rate(double receive_rate) {
+    receive_rate_ = receive_rate;
+  }
+  double receive_burst() const {
+    return receive_burst_;
+  }
+  void set_receive_burst(double receive_burst) {
+    receive_burst_ = receive_burst;
+  }
+  double send_rate() const {
+    return send_rate_;
+  }
+  void set_send_rate(double send_rate) {
+    send_rate_ = send_rate;
+  }
+  double send_burst() const {
+    return send_burst_;
+  }
+  void set_send_burst(double send_burst) {
+    send_burst_ = send_burst;
+  }
+
+  // How much a connection reads in one readable event, 0 means no limit.
+  // The fds are polled level-triggered, so a connection stopping at its
+  // budget is reported again by the next poll after the other ready fds have
+  // been served.
+  size_t max_reads_per_event() const {
+    return max_reads_per_event_;
+  }
+  void set_max_reads_per_event(size_t max_reads_per_event) {
+    max_reads_per_event_ = max_reads_per_event;
+  }
+  size_t max_bytes_per_event() const {
+    return max_bytes_per_event_;
+  }
+  void set_max_bytes_per_event(size_t max_bytes_per_event) {
+    max_bytes_per_event_ = max_bytes_per_event;
+  }
+
+  // The same limits shared by all the connections of each event poller
+  // thread, with one second worth of burst, so that bulk transfers leave
+  // some room for the others
+  double poller_receive_rate() const {
+    return poller_receive_rate_;
+  }
+  void set_poller_receive_rate(double poller_receive_rate) {
+    poller_receive_rate_ = poller_receive_rate;
+  }
+  double poller_send_rate() const {
+    return poller_send_rate_;
+  }
+  void set_poller_send_rate(double poller_send_rate) {
+    poller_send_rate_ = poller_send_rate;
+  }
+
+  // The most bytes the receive and send buffers of all the connections, and
+  // of each one, may take, 0 means no limit. The buffers are charged to the
+  // budget of the connection, then to the one of the event center, see
+  // TcpServer::memory_budget(), and at last to base::MemoryBudget::Process().
+  // Once one of them is used up the connections stop reading until some
+  // memory is freed, and SendPacket() fails.
+  int64_t buffer_memory_limit() const {
+    return buffer_memory_limit_;
+  }
+  void set_buffer_memory_limit(int64_t buffer_memory_limit) {
+    buffer_memory_limit_ = buffer_memory_limit;
+  }
+  int64_t connection_buffer_memory_limit() const {
+    return connection_buffer_memory_limit_;
+  }
+  void set_connection_buffer_memory_limit(int64_t limit) {
+    connection_buffer_memory_limit_ = limit;
+  }
+
  private:
   size_t worker_count_ { 0 };
   size_t max_command_queue_len_ { 1024 };
@@ -137,6 +219,16 @@ class TcpOptions {
   ClosedCallbackType closed_callback_ { nullptr };
   ReceivedCallbackType received_callback_ { nullptr };
   SentCallbackType sent_callback_ { nullptr };
+  double receive_rate_ { 0 };
+  double receive_burst_ { 0 };
+  double send_rate_ { 0 };
+  double send_burst_ { 0 };
+  double poller_receive_rate_ { 0 };
+  double poller_send_rate_ { 0 };
+  size_t max_reads_per_event_ { 16 };
+  size_t max_bytes_per_event_ { 0 };
+  int64_t buffer_memory_limit_ { 0 };
+  int64_t connection_buffer_memory_limit_ { 0 };
 };
 
 class TcpServerOptions final : public TcpOptions {
@@ -158,15 +250,120 @@ class TcpServerOptions final : public TcpOptions {
     backlog_ = backlog;
   }
 
+  // Called in the event poller thread of a connection while the server is
+  // draining, a connection is closed once it returns true and the queued
+  // data has been sent. Without it every connection is closed that way.
+  const IdleCallbackType& idle_callback() const {
+    return idle_callback_;
+  }
+  void set_idle_callback(IdleCallbackType idle_callback) {
+    idle_callback_ = std::move(idle_callback);
+  }
+
+  // The connections over the limits are closed right after being accepted,
+  // 0 means no limit
+  size_t max_connections() const {
+    return max_connections_;
+  }
+  void set_max_connections(size_t max_connections) {
+    max_connections_ = max_connections;
+  }
+  size_t max_connections_per_ip() const {
+    return max_connections_per_ip_;
+  }
+  void set_max_connections_per_ip(size_t max_connections_per_ip) {
+    max_connections_per_ip_ = max_connections_per_ip;
+  }
+
+  // The connections accepted per second on average and in a burst, a rate
+  // of 0 means no limit and a burst of 0 means one second worth of the rate.
+  // The listen socket isn't polled while the rate is exceeded, so the
+  // connections wait in the backlog.
+  double accept_rate() const {
+    return accept_rate_;
+  }
+  void set_accept_rate(double accept_rate) {
+    accept_rate_ = accept_rate;
+  }
+  double accept_burst() const {
+    return accept_burst_;
+  }
+  void set_accept_burst(double accept_burst) {
+    accept_burst_ = accept_burst;
+  }
+
+  // Accepting is paused while the process has more open files or more
+  // resident memory in bytes than these, 0 means no limit. They are checked
+  // at most once every 'overload_check_interval' milliseconds, which is also
+  // how long accepting is paused for when the process runs out of fds.
+  size_t max_open_files() const {
+    return max_open_files_;
+  }
+  void set_max_open_files(size_t max_open_files) {
+    max_open_files_ = max_open_files;
+  }
+  size_t max_memory_usage() const {
+    return max_memory_usage_;
+  }
+  void set_max_memory_usage(size_t max_memory_usage) {
+    max_memory_usage_ = max_memory_usage;
+  }
+  int64_t overload_check_interval() const {
+    return overload_check_interval_;
+  }
+  void set_overload_check_interval(int64_t overload_check_interval) {
+    overload_check_interval_ = overload_check_interval;
+  }
+
  private:
   std::string name_ { "dft" };
   int backlog_ { SOMAXCONN };
+  IdleCallbackType idle_callback_ { nullptr };
+  size_t max_connections_ { 0 };
+  size_t max_connections_per_ip_ { 0 };
+  double accept_rate_ { 0 };
+  double accept_burst_ { 0 };
+  size_t max_open_files_ { 0 };
+  size_t max_memory_usage_ { 0 };
+  int64_t overload_check_interval_ { 100 };
 };
 
 class TcpClientOptions final : public TcpOptions {
  public:
   TcpClientOptions() = default;
   virtual ~TcpClientOptions() = default;
+
+  // The resolver used by TcpClient::AsyncConnect(), base::Resolver::Default()
+  // if it is not set. Only the one passed to TcpClient::Launch() is used.
+  const std::shared_ptr<base::Resolver>& resolver() const {
+    return resolver_;
+  }
+  void set_resolver(std::shared_ptr<base::Resolver> resolver) {
+    resolver_ = std::move(resolver);
+  }
+
+  // in milliseconds, a connection not established in time is closed, 0 means
+  // it is up to the kernel, which takes minutes for an unreachable host
+  int64_t connect_timeout() const {
+    return connect_timeout_;
+  }
+  void set_connect_timeout(int64_t connect_timeout) {
+    connect_timeout_ = connect_timeout;
+  }
+
+  // in milliseconds, how long a connect racing over several addresses waits
+  // for an attempt before starting the next one
+  int64_t connect_attempt_delay() const {
+    return connect_attempt_delay_;
+  }
+  void set_connect_attempt_delay(int64_t connect_attempt_delay) {
+    connect_attempt_delay_ = connect_attempt_delay;
+  }
+
+ private:
+  std::shared_ptr<base::Resolver> resolver_;
+  int64_t connect_timeout_ { 10000 };
+  int64_t connect_attempt_delay_ { 250 };
 };
 
 }  // namespace tcp
@@ -27,6 +27,7 @@
 #include <cnetpp/tcp/tcp_server.h>
 #include <cnetpp/tcp/connection_factory.h>
 #include <cnetpp/tcp/listen_connection.h>
+#include <cnetpp/tcp/tcp_connection.h>
 #include <cnetpp/base/socket.h>
 
 #include <fcntl.h>
@@ -34,19 +35,29 @@
 #include <sys/socket.h>
 #include <netinet/tcp.h>
 #include <netinet/in.h>
+#include <unistd.h>
 #include <cnetpp/base/log.h>
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 namespace cnetpp {
 namespace tcp {
 
+namespace {
+
+// how long the pollers are waited for to close the connections left once
+// the drain has timed out
+const int64_t kForceCloseTimeout = 1000;
+
+}  // namespace
+
 bool TcpServer::Launch(const base::EndPoint& local_address,
                        const TcpServerOptions& options) {
-  event_center_ = EventCenter::New(options.name(), options.worker_count());
-  assert(event_center_.get());
-  if (!event_center_->Launch()) {
-    return false;
-  }
-
   // create listen socket
   base::ListenSocket listen_socket(local_address);
   if (!listen_socket.IsValid()) {
@@ -59,8 +70,7 @@ bool TcpServer::Launch(const base::EndPoint& local_address,
               this, listen_socket.fd(), local_address.ToString().c_str());
 
   int one = 0; (void) one;
-  if (!listen_socket.SetCloexec(true) ||
-      !listen_socket.SetBlocking(false) ||
+  if (
 #if 0
       !listen_socket.SetReceiveBufferSize(options.tcp_receive_buffer_size()) ||
       !listen_socket.SetSendBufferSize(options.tcp_send_buffer_size()) ||
@@ -72,22 +82,42 @@ bool TcpServer::Launch(const base::EndPoint& local_address,
       !listen_socket.Listen(options.backlog())) {
     return false;
   }
+  return Launch(listen_socket.Detach(), options);
+}
+
+bool TcpServer::Launch(int listen_fd, const TcpServerOptions& options) {
+  base::ListenSocket listen_socket;
+  listen_socket.Attach(listen_fd);
+  if (!listen_socket.SetCloexec(true) || !listen_socket.SetBlocking(false)) {
+    return false;
+  }
+
+  event_center_ = EventCenter::New(options.name(), options.worker_count());
+  assert(event_center_.get());
+  if (!event_center_->Launch()) {
+    return false;
+  }
+  event_center_->SetRateLimits(options.poller_receive_rate(),
+                               options.poller_send_rate());
+  event_center_->memory_budget()->set_limit(options.buffer_memory_limit());
+  idle_callback_ = options.idle_callback();
 
   ConnectionFactory cf;
   auto connection =
       cf.CreateConnection(event_center_, listen_socket.fd(), true);
   assert(connection.get());
   connection->set_connected_callback(options.connected_callback());
-  auto listener = std::static_pointer_cast<ListenConnection>(connection);
-  listener->set_tcp_server_options(options);
+  listener_ = std::static_pointer_cast<ListenConnection>(connection);
+  listener_->set_tcp_server_options(options);
+  accepting_ = true;
 
   CnetppDebug("[TcpServer 0X%08x] bind listen socket [0X%08x] "
               "with [ListenConnection 0X%08x]",
               this, listen_socket.fd(), connection->id());
   // add the listen fd onto multiplexer
-  Command cmd(static_cast<int>(Command::Type::kAddConnectedConn),
-              std::static_pointer_cast<ConnectionBase>(listener));
-  event_center_->AddCommand(cmd, true);
+  event_center_->AddCommand(
+      Command(static_cast<int>(Command::Type::kAddConnectedConn), connection),
+      true);
 
   listen_socket.Detach();
   return true;
@@ -95,9 +125,164 @@ bool TcpServer::Launch(const base::EndPoint& local_address,
 
 bool TcpServer::Shutdown() {
   event_center_->Shutdown();
+  listener_.reset();
+  return true;
+}
+
+void TcpServer::StopAccepting() {
+  if (!accepting_) {
+    return;
+  }
+  accepting_ = false;
+  // the listen socket stays open until the shutdown, the connections
+  // waiting in its backlog are left to the process it has been handed off
+  // to, if any
+  event_center_->AddCommand(
+      Command(static_cast<int>(Command::Type::kRemoveConnImmediately),
+              listener_),
+      true);
+}
+
+bool TcpServer::CloseIdleConnections(
+    bool force,
+    std::chrono::steady_clock::time_point deadline,
+    size_t* open) {
+  assert(open);
+  struct Progress {
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t done { 0 };
+    size_t open { 0 };
+  };
+  auto progress = std::make_shared<Progress>();
+  size_t count = event_center_->poller_count();
+  size_t added = 0;
+  for (size_t i = 0; i < count; ++i) {
+    auto timer_id = event_center_->AddTimer(0, [this, progress, i, force] () {
+      std::vector<std::shared_ptr<ConnectionBase>> connections;
+      event_center_->GetConnections(i, &connections);
+      size_t open = 0;
+      for (auto& connection : connections) {
+        if (connection == listener_) {
+          continue;
+        }
+        auto tcp_connection =
+            std::static_pointer_cast<TcpConnection>(connection);
+        if (tcp_connection->state() == ConnectionBase::State::kClosed) {
+          continue;
+        }
+        if (force) {
+          tcp_connection->MarkAsClosed(true);
+          open++;
+          continue;
+        }
+        if (tcp_connection->state() == ConnectionBase::State::kConnected &&
+            (!idle_callback_ || idle_callback_(tcp_connection))) {
+          // closed once the data queued has been sent
+          tcp_connection->MarkAsClosed(false);
+        }
+        if (tcp_connection->state() != ConnectionBase::State::kClosed) {
+          open++;
+        }
+      }
+      std::lock_guard<std::mutex> guard(progress->mutex);
+      progress->done++;
+      progress->open += open;
+      progress->cond.notify_one();
+    }, i);
+    if (timer_id != EventCenter::kInvalidTimerId) {
+      added++;
+    }
+  }
+  std::unique_lock<std::mutex> guard(progress->mutex);
+  progress->cond.wait_until(guard, deadline, [&progress, added] () {
+    return progress->done == added;
+  });
+  *open = progress->open;
+  return added == count && progress->done == count;
+}
+
+bool TcpServer::Drain(int64_t timeout) {
+  if (!event_center_) {
+    return true;
+  }
+  if (event_center_->InPollerThread()) {
+    // the pollers would wait for themselves
+    CnetppError("[TcpServer 0X%08x] can't drain from an event poller thread",
+                this);
+    return false;
+  }
+  StopAccepting();
+  auto deadline = std::chrono::steady_clock::now() +
+      std::chrono::milliseconds(timeout);
+  size_t open = 0;
+  while (true) {
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
+      break;
+    }
+    if (CloseIdleConnections(false, deadline, &open) && open == 0) {
+      return true;
+    }
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - now);
+    std::this_thread::sleep_for(
+        std::min(left, std::chrono::milliseconds(10)));
+  }
+  if (!CloseIdleConnections(true,
+                            std::chrono::steady_clock::now() +
+                                std::chrono::milliseconds(kForceCloseTimeout),
+                            &open)) {
+    CnetppInfo("[TcpServer 0X%08x] the event pollers haven't closed the "
+               "connections in time", this);
+    return false;
+  }
+  if (open == 0) {
+    return true;
+  }
+  CnetppInfo("[TcpServer 0X%08x] %zu connections are still open after "
+             "draining for %lld milliseconds",
+             this, open, static_cast<long long>(timeout));
+  return false;
+}
+
+bool TcpServer::HandOff(const std::string& path) {
+  if (!accepting_) {
+    return false;
+  }
+  base::UnixSocket socket;
+  if (!socket.Create() || !socket.Connect(path) ||
+      !socket.SendFd(listener_->socket().fd())) {
+    CnetppWarn("[TcpServer 0X%08x] failed to hand off the listen socket "
+               "to %s, %s", this, path.c_str(),
+               base::Socket::GetLastErrorString().c_str());
+    return false;
+  }
+  StopAccepting();
   return true;
 }
 
+int TcpServer::ReceiveListenSocket(const std::string& path,
+                                   int64_t timeout) {
+  base::UnixSocket listen_socket;
+  ::unlink(path.c_str());
+  if (!listen_socket.Create() ||
+      !listen_socket.SetCloexec(true) ||
+      !listen_socket.Bind(path) ||
+      !listen_socket.Listen(1)) {
+    CnetppWarn("failed to listen on %s, %s", path.c_str(),
+               base::Socket::GetLastErrorString().c_str());
+    return -1;
+  }
+  base::UnixSocket socket;
+  int fd = -1;
+  bool received = listen_socket.WaitReadable(timeout) &&
+      listen_socket.Accept(&socket) &&
+      socket.WaitReadable(timeout) &&
+      socket.ReceiveFd(&fd);
+  ::unlink(path.c_str());
+  return received ? fd : -1;
+}
+
 }  // namespace tcp
 }  // namespace cnetpp
-
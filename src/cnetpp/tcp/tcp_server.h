@@ -32,8 +32,10 @@
 #include <cnetpp/tcp/tcp_options.h>
 #include <cnetpp/base/end_point.h>
 
+#include <chrono>
 #include <memory>
 #include <functional>
+#include <string>
 
 namespace cnetpp {
 namespace tcp {
@@ -42,21 +44,68 @@ namespace {
 const size_t kDefaultMaxCommandQueueLen = 1024;
 }
 
+class ListenConnection;
+
 class TcpServer final {
  public:
   // you must first call this method before you do any requests
   bool Launch(const base::EndPoint& local_address,
               const TcpServerOptions& options = TcpServerOptions());
+  // Launch on a listening socket, e.g. one received with
+  // ReceiveListenSocket(), the server takes the ownership of 'listen_fd'.
+  bool Launch(int listen_fd,
+              const TcpServerOptions& options = TcpServerOptions());
+  // Close all the connections at once, the data not sent yet is dropped.
   bool Shutdown();
 
+  // Stop accepting, then close every connection once it is idle, see
+  // TcpServerOptions::idle_callback(), and its queued data has been sent.
+  // The connections still open after 'timeout' milliseconds are closed at
+  // once. Return false if there were some. Call Shutdown() after it. It
+  // waits for the event poller threads, so it fails at once when called from
+  // one of them, e.g. from a callback.
+  bool Drain(int64_t timeout);
+  bool GracefulShutdown(int64_t timeout) {
+    Drain(timeout);
+    return Shutdown();
+  }
+
+  // For a binary upgrade: pass the listening socket to the new process
+  // waiting in ReceiveListenSocket() on the unix socket 'path' and stop
+  // accepting, so the port keeps accepting connections all along. The
+  // connections accepted by this process are left to Drain().
+  bool HandOff(const std::string& path);
+  // Wait up to 'timeout' milliseconds on the unix socket 'path' for the
+  // listening socket of a server calling HandOff(), -1 if none arrives.
+  static int ReceiveListenSocket(const std::string& path, int64_t timeout);
+
+  // The memory taken by the buffers of all the connections, see
+  // TcpOptions::buffer_memory_limit(), nullptr before Launch()
+  std::shared_ptr<base::MemoryBudget> memory_budget() const {
+    return event_center_ ? event_center_->memory_budget() : nullptr;
+  }
+
  private:
   std::shared_ptr<EventCenter> event_center_;
+  std::shared_ptr<ListenConnection> listener_;
+  bool accepting_ { false };
+  IdleCallbackType idle_callback_;
 
   // all callbacks
   ConnectedCallbackType connected_callback_;
   ClosedCallbackType closed_callback_;
   ReceivedCallbackType received_callback_;
   SentCallbackType sent_callback_;
+
+  void StopAccepting();
+
+  // Close the idle connections in their poller threads and set 'open' to how
+  // many are still open, or close all of them if 'force' is true and set it
+  // to how many there were. Return false if some pollers haven't done it by
+  // 'deadline'.
+  bool CloseIdleConnections(bool force,
+                            std::chrono::steady_clock::time_point deadline,
+                            size_t* open);
 };
 
 }  // namespace tcp
@@ -0,0 +1,44 @@
+#include <cnetpp/base/memory_budget.h>
+
+#include <memory>
+
+#include <gtest/gtest.h>
+
+using cnetpp::base::MemoryBudget;
+
+TEST(MemoryBudget, ChargeParents) {
+  auto root = std::make_shared<MemoryBudget>(1000);
+  auto child = std::make_shared<MemoryBudget>(600, root);
+  auto sibling = std::make_shared<MemoryBudget>(0, root);
+
+  ASSERT_TRUE(child->TryCharge(500));
+  ASSERT_EQ(500, child->usage());
+  ASSERT_EQ(500, root->usage());
+  // over the limit of the child only
+  ASSERT_FALSE(child->TryCharge(200));
+  ASSERT_EQ(1u, child->rejected());
+  ASSERT_EQ(500, root->usage());
+
+  // over the limit of the parent, nothing is left charged to the sibling
+  ASSERT_TRUE(sibling->TryCharge(400));
+  ASSERT_FALSE(sibling->TryCharge(200));
+  ASSERT_EQ(400, sibling->usage());
+  ASSERT_EQ(1u, root->rejected());
+  ASSERT_EQ(0u, sibling->rejected());
+  ASSERT_FALSE(child->Exhausted());
+  sibling->Charge(100);
+  ASSERT_TRUE(child->Exhausted());
+  ASSERT_EQ(1000, root->peak());
+
+  sibling->Release(500);
+  child->Release(500);
+  ASSERT_EQ(0, root->usage());
+  ASSERT_EQ(1000, root->peak());
+  ASSERT_EQ(500, child->peak());
+
+  // no limit
+  root->set_limit(0);
+  ASSERT_TRUE(sibling->TryCharge(1 << 30));
+  sibling->Release(1 << 30);
+  ASSERT_EQ(nullptr, MemoryBudget::Process()->parent());
+}
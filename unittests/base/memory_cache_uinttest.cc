@@ -1,4 +1,12 @@
 #include <cnetpp/base/memory_cache.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 using namespace cnetpp::base;
@@ -163,3 +171,185 @@ TEST(MemoryCache, Test) {
     }
   }
 }
+
+TEST(MemoryCache, SmallClasses) {
+  // every size up to 64k gets a usable block, reused once freed
+  for (uint32_t n = 1; n <= 64 * 1024; n += (n < 4096 ? 1 : 61)) {
+    char* ptr = static_cast<char*>(MemoryCache::Instance()->Allocate(n));
+    ASSERT_TRUE(ptr != nullptr);
+    ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(ptr) % 16);
+    ptr[0] = 'a';
+    ptr[n - 1] = 'z';
+    MemoryCache::Instance()->Deallocate(ptr);
+    ASSERT_EQ(ptr, MemoryCache::Instance()->Allocate(n));
+    MemoryCache::Instance()->Deallocate(ptr);
+  }
+
+  // the sizes of a class share the blocks
+  void* ptr = MemoryCache::Instance()->Allocate(2000);
+  MemoryCache::Instance()->Deallocate(ptr);
+  ASSERT_EQ(ptr, MemoryCache::Instance()->Allocate(2048));
+  uint32_t len = 0;
+  ASSERT_EQ(ptr, MemoryCache::Instance()->Recycle(ptr, &len));
+  ASSERT_EQ(2048u, len);
+  MemoryCache::Instance()->Deallocate(ptr);
+
+  // the blocks freed by an exiting thread are taken by the others
+  std::vector<void*> blocks;
+  std::thread([&blocks] () {
+    for (int i = 0; i < 8; ++i) {
+      blocks.push_back(MemoryCache::Instance()->Allocate(100));
+    }
+    for (auto block : blocks) {
+      MemoryCache::Instance()->Deallocate(block);
+    }
+  }).join();
+  std::thread([&blocks] () {
+    for (int i = 0; i < 8; ++i) {
+      void* block = MemoryCache::Instance()->Allocate(100);
+      ASSERT_NE(blocks.end(), std::find(blocks.begin(), blocks.end(), block));
+    }
+  }).join();
+}
+
+TEST(MemoryCache, SpanTail) {
+  // a span holds 31 blocks of 64k, the rest of it becomes a block of 60k
+  // once the thread moves on to the next span
+  std::thread([] () {
+    const size_t kBlockSize = 64 * 1024 + 16;
+    const uintptr_t kSpanSize = 2 * 1024 * 1024;
+    std::vector<char*> blocks;
+    char* span = nullptr;
+    bool tail_checked = false;
+    for (int i = 0; i < 100 && !tail_checked; ++i) {
+      auto block =
+          static_cast<char*>(MemoryCache::Instance()->Allocate(64 * 1024));
+      if (!blocks.empty() && block != blocks.back() + kBlockSize &&
+          span != nullptr) {
+        // moved on from a whole span
+        auto tail = MemoryCache::Instance()->Allocate(60 * 1024);
+        ASSERT_EQ(span + 31 * kBlockSize + 16, tail);
+        MemoryCache::Instance()->Deallocate(tail);
+        tail_checked = true;
+      }
+      if (reinterpret_cast<uintptr_t>(block - 16) % kSpanSize == 0) {
+        span = block - 16;
+      } else if (!blocks.empty() && block != blocks.back() + kBlockSize) {
+        span = nullptr;  // the tail of a span of another thread
+      }
+      blocks.push_back(block);
+    }
+    ASSERT_TRUE(tail_checked);
+    for (auto block : blocks) {
+      MemoryCache::Instance()->Deallocate(block);
+    }
+  }).join();
+}
+
+TEST(MemoryCache, TransferAndScavenge) {
+  // one thread allocates what another one frees, the blocks go back to the
+  // allocating thread through the transfer cache instead of new spans
+  const int kRounds = 1000;
+  const int kBlocks = 64;
+  auto usage = MemoryCache::Instance()->SmallMemoryUsage();
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<std::vector<void*>> queue;
+  std::thread consumer([&] () {
+    for (int i = 0; i < kRounds; ++i) {
+      std::unique_lock<std::mutex> guard(mutex);
+      cond.wait(guard, [&queue] () { return !queue.empty(); });
+      auto blocks = std::move(queue.front());
+      queue.pop_front();
+      guard.unlock();
+      for (auto block : blocks) {
+        MemoryCache::Instance()->Deallocate(block);
+      }
+    }
+  });
+  for (int i = 0; i < kRounds; ++i) {
+    std::vector<void*> blocks;
+    for (int j = 0; j < kBlocks; ++j) {
+      blocks.push_back(MemoryCache::Instance()->Allocate(2048));
+    }
+    std::lock_guard<std::mutex> guard(mutex);
+    queue.push_back(std::move(blocks));
+    cond.notify_one();
+  }
+  consumer.join();
+  // 64 * 2064 * 1000 bytes without the transfer cache
+  ASSERT_LT(MemoryCache::Instance()->SmallMemoryUsage() - usage,
+            16u * 1024 * 1024);
+
+  std::thread([] () {
+    auto interval = MemoryCache::Instance()->scavenge_interval();
+    MemoryCache::Instance()->scavenge_interval(0);
+    ASSERT_EQ(-1, MemoryCache::Instance()->ScavengeIfDue());
+    void* blocks[10];
+    for (auto& block : blocks) {
+      block = MemoryCache::Instance()->Allocate(300);
+    }
+    for (auto block : blocks) {
+      MemoryCache::Instance()->Deallocate(block);
+    }
+    // the first scavenge finds the blocks in use since the last one, the
+    // second one gives them away
+    ASSERT_EQ(0, MemoryCache::Instance()->ScavengeIfDue());
+    ASSERT_EQ(-1, MemoryCache::Instance()->ScavengeIfDue());
+    MemoryCache::Instance()->scavenge_interval(interval);
+  }).join();
+}
+
+TEST(MemoryCache, HugePages) {
+  auto mapped = [] () -> uint64_t {
+    uint64_t bytes = 0;
+    for (auto& node : MemoryCache::Instance()->GetHugePageStats()) {
+      bytes += std::get<1>(node) + std::get<2>(node);
+    }
+    return bytes;
+  };
+  auto before = mapped();
+  MemoryCache::Instance()->huge_pages(true);
+  std::thread([&mapped, before] () {
+    auto ptr = static_cast<char*>(
+        MemoryCache::Instance()->Allocate(3 * 1024 * 1024));
+    ASSERT_TRUE(ptr != nullptr);
+    ptr[0] = 'a';
+    ptr[3 * 1024 * 1024 - 1] = 'z';
+    ASSERT_GE(mapped(), before + 3 * 1024 * 1024);
+    // recycled blocks stay mapped until the thread exits
+    uint32_t len = 0;
+    MemoryCache::Instance()->Deallocate(
+        MemoryCache::Instance()->Recycle(ptr, &len));
+    ASSERT_EQ(2048u, len);
+    ASSERT_EQ(ptr, MemoryCache::Instance()->Allocate(3 * 1024 * 1024));
+    MemoryCache::Instance()->Deallocate(ptr);
+  }).join();
+  MemoryCache::Instance()->huge_pages(false);
+  ASSERT_EQ(before, mapped());
+}
+
+TEST(MemoryCache, HugePageLength) {
+  auto mapped = [] () -> uint64_t {
+    uint64_t bytes = 0;
+    for (auto& node : MemoryCache::Instance()->GetHugePageStats()) {
+      bytes += std::get<1>(node) + std::get<2>(node);
+    }
+    return bytes;
+  };
+  auto before = mapped();
+  MemoryCache::Instance()->huge_pages(true);
+  std::thread([&mapped, before] () {
+    // the header of the block doesn't take another huge page
+    auto ptr = static_cast<char*>(
+        MemoryCache::Instance()->Allocate(2 * 1024 * 1024));
+    ASSERT_TRUE(ptr != nullptr);
+    ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(ptr) % (2 * 1024 * 1024));
+    ptr[0] = 'a';
+    ptr[2 * 1024 * 1024 - 1] = 'z';
+    ASSERT_EQ(before + 2 * 1024 * 1024, mapped());
+    MemoryCache::Instance()->Deallocate(ptr);
+  }).join();
+  MemoryCache::Instance()->huge_pages(false);
+  ASSERT_EQ(before, mapped());
+}
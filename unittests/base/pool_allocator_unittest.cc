@@ -0,0 +1,64 @@
+#include <cnetpp/base/pool_allocator.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using cnetpp::base::BlockPoolCounters;
+using cnetpp::base::PoolAllocator;
+
+namespace {
+
+struct Object {
+  explicit Object(int v) : value(v) {
+  }
+  int value;
+  char padding[200];
+};
+
+}  // namespace
+
+TEST(PoolAllocator, ReuseBlocks) {
+  auto before = BlockPoolCounters::GetStats();
+  auto object = std::allocate_shared<Object>(PoolAllocator<Object>(), 1);
+  ASSERT_EQ(1, object->value);
+  auto address = object.get();
+  object.reset();
+
+  auto stats = BlockPoolCounters::GetStats();
+  ASSERT_EQ(before.allocated + 1, stats.allocated);
+  ASSERT_EQ(before.cached + 1, stats.cached);
+
+  // the same block comes back, constructed again
+  object = std::allocate_shared<Object>(PoolAllocator<Object>(), 2);
+  ASSERT_EQ(address, object.get());
+  ASSERT_EQ(2, object->value);
+  stats = BlockPoolCounters::GetStats();
+  ASSERT_EQ(before.allocated + 1, stats.allocated);
+  ASSERT_EQ(before.reused + 1, stats.reused);
+  ASSERT_EQ(before.cached, stats.cached);
+}
+
+TEST(PoolAllocator, LimitsAndThreadExit) {
+  auto max_cached_blocks = BlockPoolCounters::max_cached_blocks();
+  BlockPoolCounters::set_max_cached_blocks(4);
+  auto before = BlockPoolCounters::GetStats();
+  std::thread thread([] () {
+    std::vector<std::shared_ptr<Object>> objects;
+    for (int i = 0; i < 10; ++i) {
+      objects.emplace_back(
+          std::allocate_shared<Object>(PoolAllocator<Object>(), i));
+    }
+    objects.clear();
+  });
+  thread.join();
+  BlockPoolCounters::set_max_cached_blocks(max_cached_blocks);
+
+  // 4 blocks were kept until the thread exited
+  auto stats = BlockPoolCounters::GetStats();
+  ASSERT_EQ(before.allocated + 10, stats.allocated);
+  ASSERT_EQ(before.freed + 10, stats.freed);
+  ASSERT_EQ(before.cached, stats.cached);
+}
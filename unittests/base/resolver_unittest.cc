@@ -0,0 +1,300 @@
+#include <cnetpp/base/resolver.h>
+#include <cnetpp/base/end_point.h>
+#include <cnetpp/base/ip_address.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using cnetpp::base::IPAddress;
+using cnetpp::base::Resolver;
+using cnetpp::base::ResolverOptions;
+
+namespace {
+
+void AppendUInt16(uint16_t value, std::string* packet) {
+  packet->push_back(static_cast<char>(value >> 8));
+  packet->push_back(static_cast<char>(value & 0xff));
+}
+
+void AppendUInt32(uint32_t value, std::string* packet) {
+  AppendUInt16(static_cast<uint16_t>(value >> 16), packet);
+  AppendUInt16(static_cast<uint16_t>(value & 0xffff), packet);
+}
+
+// A name server answering from a fixed zone:
+//   stub*.test     A 10.0.0.1, 10.0.0.2, TTL 300, answered after 50ms
+//   short.test     A 10.0.0.3, TTL 1
+//   missing.test   NXDOMAIN, SOA TTL 300 MINIMUM 60
+//   broken.test    SERVFAIL
+//   silent.test    no answer
+class StubNameServer {
+ public:
+  StubNameServer() {
+    fd_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    ::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ::bind(fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+    socklen_t length = sizeof(addr);
+    ::getsockname(fd_, reinterpret_cast<struct sockaddr*>(&addr), &length);
+    port_ = ntohs(addr.sin_port);
+    thread_ = std::thread([this] () { Run(); });
+  }
+
+  ~StubNameServer() {
+    running_ = false;
+    thread_.join();
+    ::close(fd_);
+  }
+
+  int port() const {
+    return port_;
+  }
+
+ private:
+  int fd_ { -1 };
+  int port_ { 0 };
+  std::atomic<bool> running_ { true };
+  std::thread thread_;
+
+  void Run() {
+    while (running_) {
+      struct pollfd poll_fd;
+      poll_fd.fd = fd_;
+      poll_fd.events = POLLIN;
+      if (::poll(&poll_fd, 1, 10) <= 0) {
+        continue;
+      }
+      char data[512];
+      struct sockaddr_storage from;
+      socklen_t from_length = sizeof(from);
+      auto n = ::recvfrom(fd_, data, sizeof(data), 0,
+                          reinterpret_cast<struct sockaddr*>(&from),
+                          &from_length);
+      if (n < 17) {
+        continue;
+      }
+      std::string query(data, n);
+      std::string response;
+      if (Answer(query, &response)) {
+        ::sendto(fd_, response.data(), response.size(), 0,
+                 reinterpret_cast<struct sockaddr*>(&from), from_length);
+      }
+    }
+  }
+
+  bool Answer(const std::string& query, std::string* response) {
+    // decode the question name
+    std::string name;
+    size_t offset = 12;
+    while (offset < query.size() && query[offset] != 0) {
+      size_t length = static_cast<uint8_t>(query[offset]);
+      if (!name.empty()) {
+        name.push_back('.');
+      }
+      name.append(query, offset + 1, length);
+      offset += 1 + length;
+    }
+    std::string question = query.substr(12, offset + 5 - 12);
+
+    int rcode = 0;
+    std::vector<std::string> addresses;
+    uint32_t ttl = 300;
+    bool soa = false;
+    if (name.compare(0, 4, "stub") == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      addresses = { std::string("\x0a\x00\x00\x01", 4),
+                    std::string("\x0a\x00\x00\x02", 4) };
+    } else if (name == "short.test") {
+      addresses = { std::string("\x0a\x00\x00\x03", 4) };
+      ttl = 1;
+    } else if (name == "missing.test") {
+      rcode = 3;
+      soa = true;
+    } else if (name == "broken.test") {
+      rcode = 2;
+    } else {
+      return false;
+    }
+
+    response->assign(query, 0, 2);  // id
+    AppendUInt16(static_cast<uint16_t>(0x8180 | rcode), response);
+    AppendUInt16(1, response);
+    AppendUInt16(static_cast<uint16_t>(addresses.size()), response);
+    AppendUInt16(soa ? 1 : 0, response);
+    AppendUInt16(0, response);
+    response->append(question);
+    for (auto& address : addresses) {
+      AppendUInt16(0xc00c, response);  // points to the question name
+      AppendUInt16(1, response);
+      AppendUInt16(1, response);
+      AppendUInt32(ttl, response);
+      AppendUInt16(4, response);
+      response->append(address);
+    }
+    if (soa) {
+      AppendUInt16(0xc00c, response);
+      AppendUInt16(6, response);
+      AppendUInt16(1, response);
+      AppendUInt32(300, response);
+      std::string rdata;
+      rdata.append("\x02ns\x00", 4);
+      rdata.append("\x04root\x00", 6);
+      for (uint32_t value : { 1u, 3600u, 600u, 86400u, 60u }) {
+        AppendUInt32(value, &rdata);
+      }
+      AppendUInt16(static_cast<uint16_t>(rdata.size()), response);
+      response->append(rdata);
+    }
+    return true;
+  }
+};
+
+ResolverOptions StubOptions(const StubNameServer& name_server) {
+  ResolverOptions options;
+  options.set_name_servers({ cnetpp::base::EndPoint(
+      IPAddress("127.0.0.1"), name_server.port()) });
+  options.set_hosts_path("/nonexistent");
+  options.set_timeout(100);
+  options.set_attempts(1);
+  return options;
+}
+
+std::string ToString(const IPAddress& address) {
+  std::string result;
+  IPAddress::NumberToLiteral(address, &result);
+  return result;
+}
+
+}  // namespace
+
+TEST(Resolver, ResolveAndRoundRobin) {
+  StubNameServer name_server;
+  Resolver resolver(StubOptions(name_server));
+  ASSERT_TRUE(resolver.Launch());
+
+  std::vector<IPAddress> addresses;
+  ASSERT_TRUE(resolver.Resolve("stub.test", &addresses));
+  ASSERT_EQ(2u, addresses.size());
+  auto first = ToString(addresses[0]);
+  ASSERT_TRUE(first == "10.0.0.1" || first == "10.0.0.2");
+
+  // answered from the cache, starting from the next address
+  ASSERT_TRUE(resolver.Resolve("STUB.test.", &addresses));
+  ASSERT_EQ(2u, addresses.size());
+  ASSERT_NE(first, ToString(addresses[0]));
+  ASSERT_EQ(1u, resolver.queries_sent());
+}
+
+TEST(Resolver, ConcurrentLookupsShareOneQuery) {
+  StubNameServer name_server;
+  Resolver resolver(StubOptions(name_server));
+  ASSERT_TRUE(resolver.Launch());
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  int found_count = 0;
+  int done_count = 0;
+  for (int i = 0; i < 5; ++i) {
+    resolver.AsyncResolve("stub2.test",
+        [&] (bool found, const std::vector<IPAddress>& addresses) {
+      std::lock_guard<std::mutex> guard(mutex);
+      if (found && addresses.size() == 2) {
+        found_count++;
+      }
+      done_count++;
+      cond.notify_one();
+    });
+  }
+  std::unique_lock<std::mutex> guard(mutex);
+  ASSERT_TRUE(cond.wait_for(guard, std::chrono::seconds(5),
+                            [&done_count] () { return done_count == 5; }));
+  ASSERT_EQ(5, found_count);
+  ASSERT_EQ(1u, resolver.queries_sent());
+}
+
+TEST(Resolver, NegativeAnswerIsCached) {
+  StubNameServer name_server;
+  auto options = StubOptions(name_server);
+  // it is the 60s of the SOA record which counts
+  options.set_negative_ttl(0);
+  Resolver resolver(options);
+  ASSERT_TRUE(resolver.Launch());
+
+  std::vector<IPAddress> addresses;
+  ASSERT_FALSE(resolver.Resolve("missing.test", &addresses));
+  ASSERT_FALSE(resolver.Resolve("missing.test", &addresses));
+  ASSERT_TRUE(addresses.empty());
+  ASSERT_EQ(1u, resolver.queries_sent());
+}
+
+TEST(Resolver, FailuresAreNotCached) {
+  StubNameServer name_server;
+  Resolver resolver(StubOptions(name_server));
+  ASSERT_TRUE(resolver.Launch());
+
+  std::vector<IPAddress> addresses;
+  ASSERT_FALSE(resolver.Resolve("broken.test", &addresses));
+  ASSERT_FALSE(resolver.Resolve("silent.test", &addresses));
+  ASSERT_FALSE(resolver.Resolve("silent.test", &addresses));
+  ASSERT_EQ(3u, resolver.queries_sent());
+}
+
+TEST(Resolver, TtlExpires) {
+  StubNameServer name_server;
+  Resolver resolver(StubOptions(name_server));
+  ASSERT_TRUE(resolver.Launch());
+
+  std::vector<IPAddress> addresses;
+  ASSERT_TRUE(resolver.Resolve("short.test", &addresses));
+  ASSERT_TRUE(resolver.Resolve("short.test", &addresses));
+  ASSERT_EQ(1u, resolver.queries_sent());
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+  ASSERT_TRUE(resolver.Resolve("short.test", &addresses));
+  ASSERT_EQ(1u, addresses.size());
+  ASSERT_EQ("10.0.0.3", ToString(addresses[0]));
+  ASSERT_EQ(2u, resolver.queries_sent());
+}
+
+TEST(Resolver, HostsFileAndLiterals) {
+  char path[] = "/tmp/cnetpp_hosts_XXXXXX";
+  int fd = ::mkstemp(path);
+  ASSERT_GE(fd, 0);
+  ::close(fd);
+  std::ofstream(path) << "# comment\n"
+                      << "10.1.1.1 myhost.test alias.test # trailing\n"
+                      << "::1 myhost6.test\n";
+
+  StubNameServer name_server;
+  auto options = StubOptions(name_server);
+  options.set_hosts_path(path);
+  Resolver resolver(options);
+  ASSERT_TRUE(resolver.Launch());
+
+  std::vector<IPAddress> addresses;
+  ASSERT_TRUE(resolver.Resolve("alias.test", &addresses));
+  ASSERT_EQ(1u, addresses.size());
+  ASSERT_EQ("10.1.1.1", ToString(addresses[0]));
+  ASSERT_TRUE(resolver.Resolve("192.168.1.1", &addresses));
+  ASSERT_EQ("192.168.1.1", ToString(addresses[0]));
+  // IPv6 entries are skipped unless enabled
+  ASSERT_FALSE(resolver.Resolve("myhost6.test", &addresses));
+  ASSERT_EQ(1u, resolver.queries_sent());
+  ::unlink(path);
+}
@@ -0,0 +1,73 @@
+#include <cnetpp/concurrency/task_function.h>
+
+#include <memory>
+#include <utility>
+
+#include <gtest/gtest.h>
+
+using cnetpp::concurrency::TaskFunction;
+
+namespace {
+
+// counts the live copies of itself
+struct Counted {
+  explicit Counted(int* live) : live_(live) {
+    (*live_)++;
+  }
+  Counted(const Counted& that) noexcept : live_(that.live_) {
+    (*live_)++;
+  }
+  ~Counted() {
+    (*live_)--;
+  }
+  int* live_;
+};
+
+}  // namespace
+
+TEST(TaskFunction, Inline) {
+  int live = 0;
+  int runs = 0;
+  {
+    Counted counted(&live);
+    auto f = [counted, &runs] () -> bool { runs++; return true; };
+    static_assert(TaskFunction::IsInline<decltype(f)>(), "should be inline");
+    TaskFunction task(f);
+    ASSERT_TRUE(static_cast<bool>(task));
+    ASSERT_EQ(3, live);
+    // moving relocates the callable, it doesn't leave a copy behind
+    TaskFunction other(std::move(task));
+    ASSERT_FALSE(static_cast<bool>(task));
+    ASSERT_EQ(3, live);
+    ASSERT_TRUE(other());
+    ASSERT_EQ(1, runs);
+    other = nullptr;
+    ASSERT_EQ(2, live);
+  }
+  ASSERT_EQ(0, live);
+}
+
+TEST(TaskFunction, Heap) {
+  int live = 0;
+  char big[TaskFunction::kInlineSize] = { 1 };
+  {
+    Counted counted(&live);
+    auto f = [counted, big] () -> bool { return big[0] == 1; };
+    static_assert(!TaskFunction::IsInline<decltype(f)>(), "should be heap");
+    TaskFunction task(std::move(f));
+    TaskFunction other;
+    other = std::move(task);
+    ASSERT_FALSE(static_cast<bool>(task));
+    ASSERT_TRUE(other());
+  }
+  ASSERT_EQ(0, live);
+}
+
+TEST(TaskFunction, MoveOnly) {
+  std::unique_ptr<int> value(new int(3));
+  TaskFunction task([value = std::move(value)] () -> bool {
+    return *value == 3;
+  });
+  TaskFunction other(std::move(task));
+  ASSERT_TRUE(other());
+}
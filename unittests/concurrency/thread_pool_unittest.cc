@@ -5,8 +5,10 @@
 #include <string.h>
 #include <pthread.h>
 
+#include <algorithm>
 #include <atomic>
 #include <memory>
+#include <vector>
 
 TEST(ThreadPool, Test01) {
   auto tp = std::make_shared<cnetpp::concurrency::ThreadPool>("Test01", true);
@@ -150,3 +152,295 @@ TEST(ThreadPool, TestOnlyDelayTask) {
   EXPECT_EQ(j, 1);
   //tp->Stop();
 }
+
+namespace {
+
+// each task adds two subtasks until 'depth' is 0, from the worker running
+// it, and marks the worker in 'workers'
+void Spawn(cnetpp::concurrency::ThreadPool* tp, int depth,
+           std::atomic<int>* count, std::atomic<int>* workers) {
+  (*count)++;
+  *workers |= 1 << cnetpp::concurrency::Thread::ThisThread()->ThreadPoolIndex();
+  if (depth > 0) {
+    for (int i = 0; i < 2; ++i) {
+      ASSERT_TRUE(tp->AddTask([tp, depth, count, workers] () -> bool {
+        Spawn(tp, depth - 1, count, workers);
+        return true;
+      }));
+    }
+  }
+}
+
+}  // namespace
+
+TEST(ThreadPool, TestWorkStealing) {
+  auto tp = std::make_shared<cnetpp::concurrency::ThreadPool>("Test01");
+  tp->set_num_threads(4);
+  tp->Start();
+  std::atomic<int> count { 0 };
+  std::atomic<int> workers { 0 };
+  // the subtasks go to the deque of the worker adding them, the idle
+  // workers steal them
+  ASSERT_TRUE(tp->AddTask([&tp, &count, &workers] () -> bool {
+    Spawn(tp.get(), 14, &count, &workers);
+    return true;
+  }));
+  for (int i = 0; i < 500 && count.load() < (1 << 15) - 1; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ((1 << 15) - 1, count.load());
+  // more than one worker ran them
+  ASSERT_NE(0, workers.load() & (workers.load() - 1));
+
+  // a pool stopped with wait runs everything added before
+  std::atomic<int> i { 0 };
+  for (int j = 0; j < 1000; ++j) {
+    ASSERT_TRUE(tp->AddTask([&i] () -> bool { i++; return true; }));
+  }
+  tp->Stop(true);
+  ASSERT_EQ(1000, i.load());
+  ASSERT_EQ(0u, tp->PendingCount());
+}
+
+TEST(ThreadPool, TestMoveOnlyClosure) {
+  auto tp = std::make_shared<cnetpp::concurrency::ThreadPool>("Test01");
+  tp->set_num_threads(2);
+  tp->Start();
+  std::atomic<int> i { 0 };
+  std::unique_ptr<int> value(new int(7));
+  // std::function can't hold this one
+  ASSERT_TRUE(tp->AddTask([&i, value = std::move(value)] () -> bool {
+    i += *value;
+    return true;
+  }));
+  tp->Stop(true);
+  ASSERT_EQ(7, i.load());
+}
+
+TEST(ThreadPool, TestCancelDelayTask) {
+  auto tp = std::make_shared<cnetpp::concurrency::ThreadPool>("Test01", true);
+  tp->set_num_threads(2);
+  tp->Start();
+  std::atomic<int> i { 0 };
+  auto closure = [&i] () -> bool { i++; return true; };
+  std::vector<cnetpp::concurrency::ThreadPool::TimerId> ids;
+  for (int j = 0; j < 1000; ++j) {
+    auto id = tp->AddDelayTask(closure, std::chrono::milliseconds(20));
+    ASSERT_NE(cnetpp::concurrency::ThreadPool::kInvalidTimerId, id);
+    ids.push_back(id);
+  }
+  // all but the last one
+  for (int j = 0; j < 999; ++j) {
+    ASSERT_TRUE(tp->CancelDelayTask(ids[j]));
+  }
+  ASSERT_FALSE(tp->CancelDelayTask(ids[0]));
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  ASSERT_EQ(1, i.load());
+  ASSERT_FALSE(tp->CancelDelayTask(ids[999]));
+  tp->Stop(true);
+}
+
+TEST(ThreadPool, TestPeriodicTask) {
+  auto tp = std::make_shared<cnetpp::concurrency::ThreadPool>("Test01", true);
+  tp->set_num_threads(2);
+  tp->Start();
+  std::atomic<int> i { 0 };
+  std::atomic<int> j { 0 };
+  // stops by itself after 3 runs
+  ASSERT_NE(cnetpp::concurrency::ThreadPool::kInvalidTimerId,
+            tp->AddPeriodicTask([&i] () -> bool { return ++i < 3; },
+                                std::chrono::milliseconds(5)));
+  auto id = tp->AddPeriodicTask([&j] () -> bool { j++; return true; },
+                                std::chrono::milliseconds(5));
+  for (int k = 0; k < 200 && (i.load() < 3 || j.load() < 3); ++k) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  ASSERT_TRUE(tp->CancelDelayTask(id));
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  int runs = j.load();
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  ASSERT_EQ(3, i.load());
+  ASSERT_EQ(runs, j.load());
+  // the periodic tasks don't hold the stop
+  ASSERT_NE(cnetpp::concurrency::ThreadPool::kInvalidTimerId,
+            tp->AddPeriodicTask([] () -> bool { return true; },
+                                std::chrono::hours(1)));
+  tp->Stop(true);
+}
+
+TEST(ThreadPool, TestLanes) {
+  using cnetpp::concurrency::TaskLane;
+  auto tp = std::make_shared<cnetpp::concurrency::ThreadPool>("Test01");
+  tp->set_num_threads(1);
+  tp->Start();
+  // hold the only worker until all the tasks are added
+  std::atomic<bool> hold { true };
+  ASSERT_TRUE(tp->AddTask([&hold] () -> bool {
+    while (hold.load()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+  }));
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  std::vector<int> order;
+  auto now = cnetpp::concurrency::ThreadPool::Clock::now();
+  for (int i = 0; i < 5; ++i) {
+    ASSERT_TRUE(tp->AddTask([&order, i] () -> bool {
+      order.push_back(-1 - i);
+      return true;
+    }, TaskLane::kBackground));
+  }
+  // added in the reverse order of their deadlines
+  for (int i = 39; i >= 0; --i) {
+    ASSERT_TRUE(tp->AddTask([&order, i] () -> bool {
+      order.push_back(i);
+      return true;
+    }, TaskLane::kLatencyCritical, now + std::chrono::seconds(i)));
+  }
+  hold = false;
+  tp->Stop(true);
+  ASSERT_EQ(45u, order.size());
+  int critical = 0;
+  int background = 0;
+  for (size_t i = 0; i < order.size(); ++i) {
+    if (order[i] >= 0) {
+      ASSERT_EQ(critical++, order[i]);
+    } else {
+      ASSERT_EQ(-1 - background++, order[i]);
+      // one turn of the background lane for 16 of the critical one
+      ASSERT_LE(i, 17u * background);
+    }
+  }
+  ASSERT_EQ(0, order[0]);
+}
+
+TEST(ThreadPool, TestLaneLimit) {
+  using cnetpp::concurrency::TaskLane;
+  auto tp = std::make_shared<cnetpp::concurrency::ThreadPool>("Test01");
+  tp->set_num_threads(4);
+  cnetpp::concurrency::TaskLaneOptions options;
+  options.weight = 1;
+  options.max_running = 1;
+  tp->set_lane_options(TaskLane::kBackground, options);
+  tp->Start();
+  std::atomic<int> running { 0 };
+  std::atomic<int> max_running { 0 };
+  std::atomic<int> done { 0 };
+  for (int i = 0; i < 8; ++i) {
+    ASSERT_TRUE(tp->AddTask([&] () -> bool {
+      int n = ++running;
+      int max = max_running.load();
+      while (n > max && !max_running.compare_exchange_weak(max, n)) {
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      running--;
+      done++;
+      return true;
+    }, TaskLane::kBackground));
+  }
+  // the other workers still run the plain tasks
+  std::atomic<int> plain { 0 };
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(tp->AddTask([&plain] () -> bool { plain++; return true; }));
+  }
+  for (int i = 0; i < 200 && done.load() < 8; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  tp->Stop(true);
+  ASSERT_EQ(8, done.load());
+  ASSERT_EQ(100, plain.load());
+  ASSERT_EQ(1, max_running.load());
+  ASSERT_EQ(0u, tp->PendingCount());
+}
+
+TEST(ThreadPool, TestAddTasks) {
+  auto tp = std::make_shared<cnetpp::concurrency::ThreadPool>("Test01");
+  tp->set_num_threads(4);
+  tp->set_max_num_pending_tasks(150);
+  tp->Start();
+  std::atomic<bool> hold { true };
+  std::atomic<int> i { 0 };
+  std::vector<cnetpp::concurrency::TaskFunction> tasks;
+  for (int j = 0; j < 200; ++j) {
+    tasks.emplace_back([&hold, &i] () -> bool {
+      while (hold.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      i++;
+      return true;
+    });
+  }
+  // the ones over the limit aren't added
+  ASSERT_EQ(150u, tp->AddTasks(tasks));
+  hold = false;
+  tp->Stop(true);
+  ASSERT_EQ(150, i.load());
+}
+
+TEST(ThreadPool, TestParallelFor) {
+  auto tp = std::make_shared<cnetpp::concurrency::ThreadPool>("Test01");
+  tp->set_num_threads(4);
+  tp->Start();
+  std::vector<std::atomic<int>> hits(10000);
+  tp->ParallelFor(0, 10000, 7, [&hits] (int i) { hits[i]++; });
+  for (auto& hit : hits) {
+    ASSERT_EQ(1, hit.load());
+  }
+
+  // nested in the tasks of the pool, all the workers busy
+  std::atomic<int64_t> sum { 0 };
+  std::atomic<int> done { 0 };
+  for (int j = 0; j < 8; ++j) {
+    ASSERT_TRUE(tp->AddTask([&tp, &sum, &done] () -> bool {
+      tp->ParallelFor<size_t>(0, 1000, 10, [&sum] (size_t i) { sum += i; });
+      done++;
+      return true;
+    }));
+  }
+  for (int j = 0; j < 500 && done.load() < 8; ++j) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(8, done.load());
+  ASSERT_EQ(8 * 999 * 1000 / 2, sum.load());
+  tp->Stop(true);
+}
+
+TEST(ThreadPool, TestElastic) {
+  auto tp = std::make_shared<cnetpp::concurrency::ThreadPool>("Test01");
+  cnetpp::concurrency::ThreadPoolElasticOptions options;
+  options.core_threads = 1;
+  options.max_threads = 4;
+  options.spawn_latency = std::chrono::milliseconds(5);
+  options.idle_timeout = std::chrono::milliseconds(50);
+  tp->set_elastic(options);
+  ASSERT_EQ(1u, tp->size());
+  tp->Start();
+  ASSERT_EQ(1u, tp->size());
+  std::atomic<int> done { 0 };
+  for (int i = 0; i < 8; ++i) {
+    ASSERT_TRUE(tp->AddTask([&done] () -> bool {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      done++;
+      return true;
+    }));
+  }
+  size_t max_size = 0;
+  for (int i = 0; i < 400 && done.load() < 8; ++i) {
+    max_size = std::max(max_size, tp->size());
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  ASSERT_EQ(8, done.load());
+  ASSERT_EQ(4u, max_size);
+  // the extra workers go away once they have been idle long enough
+  for (int i = 0; i < 200 && tp->size() > 1; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  ASSERT_EQ(1u, tp->size());
+  auto stats = tp->GetStats();
+  ASSERT_EQ(8u, stats.num_waits);
+  ASSERT_EQ(3u, stats.threads_spawned);
+  ASSERT_EQ(3u, stats.threads_retired);
+  ASSERT_GE(stats.WaitPercentileUs(99), stats.WaitPercentileUs(50));
+  ASSERT_LE(stats.WaitPercentileUs(99), stats.max_wait_us);
+  tp->Stop(true);
+}
@@ -0,0 +1,110 @@
+#include <cnetpp/concurrency/timer_wheel.h>
+
+#include <chrono>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using cnetpp::concurrency::TaskFunction;
+using cnetpp::concurrency::TimerWheel;
+
+namespace {
+
+const auto kStart = TimerWheel::Clock::time_point(std::chrono::hours(1));
+
+TimerWheel::Clock::time_point At(int64_t ms) {
+  return kStart + std::chrono::milliseconds(ms);
+}
+
+TaskFunction Record(std::vector<int>* fired, int value) {
+  return [fired, value] () -> bool {
+    fired->push_back(value);
+    return true;
+  };
+}
+
+void RunUntil(TimerWheel* wheel, int64_t ms) {
+  std::vector<TimerWheel::Expired> expired;
+  wheel->Advance(At(ms), &expired);
+  for (auto& timer : expired) {
+    timer.callback();
+    if (timer.periodic) {
+      wheel->Release(timer.id);
+    }
+  }
+}
+
+}  // namespace
+
+TEST(TimerWheel, FireInOrder) {
+  TimerWheel wheel(std::chrono::milliseconds(1), kStart);
+  std::vector<int> fired;
+  // over each level of the wheel
+  const int64_t delays[] = { 1, 63, 64, 65, 4095, 4096, 300000, 20000000 };
+  for (auto delay : delays) {
+    wheel.Add(Record(&fired, static_cast<int>(delay / 1000)), kStart,
+              std::chrono::milliseconds(delay));
+  }
+  ASSERT_EQ(8u, wheel.size());
+  for (auto delay : delays) {
+    ASSERT_LE(wheel.NextExpiry(), At(delay));
+    size_t count = fired.size();
+    RunUntil(&wheel, delay - 1);
+    ASSERT_EQ(count, fired.size());
+    RunUntil(&wheel, delay);
+    ASSERT_EQ(count + 1, fired.size());
+    ASSERT_EQ(delay / 1000, fired.back());
+  }
+  ASSERT_TRUE(wheel.Empty());
+  ASSERT_EQ(TimerWheel::Clock::time_point::max(), wheel.NextExpiry());
+}
+
+TEST(TimerWheel, Cancel) {
+  TimerWheel wheel(std::chrono::milliseconds(1), kStart);
+  std::vector<int> fired;
+  auto id1 = wheel.Add(Record(&fired, 1), kStart,
+                       std::chrono::milliseconds(10));
+  auto id2 = wheel.Add(Record(&fired, 2), kStart,
+                       std::chrono::milliseconds(10000));
+  ASSERT_NE(TimerWheel::kInvalidTimerId, id1);
+  TaskFunction callback;
+  ASSERT_TRUE(wheel.Cancel(id2, &callback));
+  ASSERT_TRUE(static_cast<bool>(callback));
+  ASSERT_FALSE(wheel.Cancel(id2));
+  RunUntil(&wheel, 20000);
+  ASSERT_EQ(std::vector<int>({ 1 }), fired);
+  // fired already, and the entry reused doesn't take the stale id
+  ASSERT_FALSE(wheel.Cancel(id1));
+  auto id3 = wheel.Add(Record(&fired, 3), At(20000),
+                       std::chrono::milliseconds(1));
+  ASSERT_NE(id1, id3);
+  ASSERT_FALSE(wheel.Cancel(id1));
+  ASSERT_TRUE(wheel.Cancel(id3));
+  ASSERT_TRUE(wheel.Empty());
+}
+
+TEST(TimerWheel, Periodic) {
+  TimerWheel wheel(std::chrono::milliseconds(1), kStart);
+  int count = 0;
+  auto id = wheel.Add([&count] () -> bool { count++; return true; }, kStart,
+                      std::chrono::milliseconds(5),
+                      std::chrono::milliseconds(5));
+  std::vector<TimerWheel::Expired> expired;
+  for (int64_t ms = 1; ms <= 20; ++ms) {
+    wheel.Advance(At(ms), &expired);
+    for (auto& timer : expired) {
+      ASSERT_EQ(id, timer.id);
+      ASSERT_TRUE(timer.periodic);
+      timer.callback();
+      ASSERT_TRUE(wheel.Rearm(timer.id, &timer.callback, At(ms)));
+    }
+    expired.clear();
+  }
+  ASSERT_EQ(4, count);
+  wheel.Advance(At(25), &expired);
+  ASSERT_EQ(1u, expired.size());
+  // cancelled while handed out, it goes away at Rearm()
+  ASSERT_TRUE(wheel.Cancel(id));
+  ASSERT_FALSE(wheel.Rearm(id, &expired[0].callback, At(25)));
+  ASSERT_TRUE(wheel.Empty());
+}
@@ -0,0 +1,66 @@
+#include <cnetpp/concurrency/work_stealing_deque.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using cnetpp::concurrency::WorkStealingDeque;
+
+TEST(WorkStealingDeque, PushPopSteal) {
+  WorkStealingDeque<int> deque(2);
+  int items[8];
+  ASSERT_EQ(nullptr, deque.Pop());
+  ASSERT_EQ(nullptr, deque.Steal());
+  // grows over the initial capacity
+  for (auto& item : items) {
+    deque.Push(&item);
+  }
+  ASSERT_EQ(8u, deque.size());
+  // the owner takes the last pushed, the thieves the first pushed
+  ASSERT_EQ(&items[7], deque.Pop());
+  ASSERT_EQ(&items[0], deque.Steal());
+  ASSERT_EQ(&items[1], deque.Steal());
+  ASSERT_EQ(&items[6], deque.Pop());
+  ASSERT_EQ(4u, deque.size());
+}
+
+TEST(WorkStealingDeque, ConcurrentSteal) {
+  const int kCount = 100000;
+  WorkStealingDeque<int> deque;
+  std::vector<int> items(kCount);
+  std::vector<std::atomic<int>> taken(kCount);
+  for (auto& t : taken) {
+    t = 0;
+  }
+  std::atomic<bool> done { false };
+  std::vector<std::thread> thieves;
+  for (int i = 0; i < 4; ++i) {
+    thieves.emplace_back([&] () {
+      while (!done.load() || !deque.Empty()) {
+        auto item = deque.Steal();
+        if (item) {
+          taken[item - items.data()]++;
+        }
+      }
+    });
+  }
+  for (int i = 0; i < kCount; ++i) {
+    deque.Push(&items[i]);
+    if (i % 3 == 0) {
+      auto item = deque.Pop();
+      if (item) {
+        taken[item - items.data()]++;
+      }
+    }
+  }
+  done = true;
+  for (auto& thief : thieves) {
+    thief.join();
+  }
+  // every item is taken exactly once
+  for (auto& t : taken) {
+    ASSERT_EQ(1, t.load());
+  }
+}
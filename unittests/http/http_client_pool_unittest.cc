@@ -0,0 +1,201 @@
+#include <cnetpp/http/http_client.h>
+#include <cnetpp/http/http_connection.h>
+#include <cnetpp/http/http_options.h>
+#include <cnetpp/http/http_request.h>
+#include <cnetpp/http/http_response.h>
+#include <cnetpp/http/http_server.h>
+#include <cnetpp/base/end_point.h>
+#include <cnetpp/base/ip_address.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+class PoolTest {
+ public:
+  explicit PoolTest(int port) : port_(port) {
+    cnetpp::http::HttpServerOptions options;
+    options.set_worker_count(1);
+    options.set_connected_callback(
+        [this] (std::shared_ptr<cnetpp::http::HttpConnection> c) -> bool {
+      (void) c;
+      connected_count_++;
+      return true;
+    });
+    options.set_closed_callback(
+        [this] (std::shared_ptr<cnetpp::http::HttpConnection> c) -> bool {
+      (void) c;
+      closed_count_++;
+      return true;
+    });
+    options.set_received_callback(
+        [] (std::shared_ptr<cnetpp::http::HttpConnection> c) -> bool {
+      auto http_request =
+          std::static_pointer_cast<cnetpp::http::HttpRequest>(c->http_packet());
+      auto http_response = std::make_shared<cnetpp::http::HttpResponse>();
+      http_response->set_status(cnetpp::http::HttpResponse::StatusCode::kOk);
+      http_response->SetHttpHeader("Content-Length",
+                                   std::to_string(http_request->uri().size()));
+      http_response->set_http_body(http_request->uri());
+      return c->SendPacket(http_response);
+    });
+    started_ = http_server_.Launch(
+        cnetpp::base::EndPoint(cnetpp::base::IPAddress("127.0.0.1"), port),
+        options);
+  }
+
+  ~PoolTest() {
+    http_server_.Shutdown();
+  }
+
+  bool started() const {
+    return started_;
+  }
+  int connected_count() const {
+    return connected_count_;
+  }
+  int closed_count() const {
+    return closed_count_;
+  }
+
+  std::string Url(const std::string& path) const {
+    return "127.0.0.1:" + std::to_string(port_) + path;
+  }
+
+ private:
+  int port_;
+  bool started_ { false };
+  std::atomic<int> connected_count_ { 0 };
+  std::atomic<int> closed_count_ { 0 };
+  cnetpp::http::HttpServer http_server_;
+};
+
+std::shared_ptr<cnetpp::http::HttpRequest> NewGet() {
+  auto http_request = std::make_shared<cnetpp::http::HttpRequest>();
+  http_request->set_method(cnetpp::http::HttpRequest::MethodType::kGet);
+  return http_request;
+}
+
+}  // namespace
+
+TEST(HttpClientPool, ReuseKeepAliveConnection) {
+  PoolTest pool_test(12549);
+  ASSERT_TRUE(pool_test.started());
+
+  cnetpp::http::HttpClientOptions options;
+  options.set_worker_count(1);
+  cnetpp::http::HttpClient http_client;
+  ASSERT_TRUE(http_client.Launch(options));
+
+  for (int i = 0; i < 5; ++i) {
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool done = false;
+    bool success = false;
+    std::string body;
+    std::string path = "/seq/" + std::to_string(i);
+    ASSERT_TRUE(http_client.Send(pool_test.Url(path), NewGet(),
+        [&] (bool ok,
+             std::shared_ptr<cnetpp::http::HttpResponse> response) -> bool {
+      std::lock_guard<std::mutex> guard(mutex);
+      success = ok;
+      if (ok) {
+        body = response->http_body();
+      }
+      done = true;
+      cond.notify_one();
+      return true;
+    }));
+    std::unique_lock<std::mutex> guard(mutex);
+    ASSERT_TRUE(cond.wait_for(guard, std::chrono::seconds(5),
+                              [&done] () { return done; }));
+    ASSERT_TRUE(success);
+    ASSERT_EQ(path, body);
+  }
+  ASSERT_EQ(1, pool_test.connected_count());
+  http_client.Shutdown();
+}
+
+TEST(HttpClientPool, QueueOverMaxConnections) {
+  PoolTest pool_test(12550);
+  ASSERT_TRUE(pool_test.started());
+
+  cnetpp::http::HttpClientOptions options;
+  options.set_worker_count(1);
+  options.set_max_connections_per_host(2);
+  cnetpp::http::HttpClient http_client;
+  ASSERT_TRUE(http_client.Launch(options));
+
+  const int kRequests = 20;
+  std::mutex mutex;
+  std::condition_variable cond;
+  int done = 0;
+  int succeeded = 0;
+  for (int i = 0; i < kRequests; ++i) {
+    ASSERT_TRUE(http_client.Send(pool_test.Url("/queued"), NewGet(),
+        [&] (bool ok,
+             std::shared_ptr<cnetpp::http::HttpResponse> response) -> bool {
+      std::lock_guard<std::mutex> guard(mutex);
+      if (ok && response->http_body() == "/queued") {
+        succeeded++;
+      }
+      done++;
+      cond.notify_one();
+      return true;
+    }));
+  }
+  {
+    std::unique_lock<std::mutex> guard(mutex);
+    ASSERT_TRUE(cond.wait_for(guard, std::chrono::seconds(5),
+                              [&done] () { return done == kRequests; }));
+  }
+  ASSERT_EQ(kRequests, succeeded);
+  ASSERT_LE(pool_test.connected_count(), 2);
+  http_client.Shutdown();
+}
+
+TEST(HttpClientPool, CloseIdleConnection) {
+  PoolTest pool_test(12572);
+  ASSERT_TRUE(pool_test.started());
+
+  cnetpp::http::HttpClientOptions options;
+  options.set_worker_count(1);
+  options.set_idle_timeout(100);
+  cnetpp::http::HttpClient http_client;
+  ASSERT_TRUE(http_client.Launch(options));
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool done = false;
+  ASSERT_TRUE(http_client.Send(pool_test.Url("/once"), NewGet(),
+      [&] (bool ok,
+           std::shared_ptr<cnetpp::http::HttpResponse> response) -> bool {
+    (void) ok;
+    (void) response;
+    std::lock_guard<std::mutex> guard(mutex);
+    done = true;
+    cond.notify_one();
+    return true;
+  }));
+  {
+    std::unique_lock<std::mutex> guard(mutex);
+    ASSERT_TRUE(cond.wait_for(guard, std::chrono::seconds(5),
+                              [&done] () { return done; }));
+  }
+
+  // no other request comes to check the pool, the timer closes it
+  for (int i = 0; i < 200 && pool_test.closed_count() == 0; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(1, pool_test.connected_count());
+  ASSERT_EQ(1, pool_test.closed_count());
+  http_client.Shutdown();
+}
@@ -0,0 +1,120 @@
+#include <cnetpp/http/http_client.h>
+#include <cnetpp/http/http_connection.h>
+#include <cnetpp/http/http_options.h>
+#include <cnetpp/tcp/connection_id.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// a socket the kernel completes the connects to without accepting them
+int Listen(int port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr;
+  ::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::bind(fd, reinterpret_cast<struct sockaddr*>(&addr),
+             sizeof(addr)) != 0 ||
+      ::listen(fd, 16) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+}  // namespace
+
+TEST(HttpClient, ConnectFromCallback) {
+  int listen_fd = Listen(12568);
+  ASSERT_GE(listen_fd, 0);
+  cnetpp::http::HttpClientOptions options;
+  options.set_worker_count(1);
+  cnetpp::http::HttpClient http_client;
+  ASSERT_TRUE(http_client.Launch(options));
+
+  // the only event poller thread runs the callback, the connect started
+  // there can't be waited for
+  std::atomic<bool> called { false };
+  std::atomic<cnetpp::tcp::ConnectionId> nested_id {
+    cnetpp::tcp::kInvalidConnectionId };
+  options.set_connected_callback(
+      [&] (std::shared_ptr<cnetpp::http::HttpConnection> c) -> bool {
+    (void) c;
+    if (!called.exchange(true)) {
+      nested_id = http_client.Connect("127.0.0.1:12568/",
+                                      cnetpp::http::HttpClientOptions());
+    }
+    return true;
+  });
+  ASSERT_NE(cnetpp::tcp::kInvalidConnectionId,
+            http_client.Connect("127.0.0.1:12568/", options));
+  for (int i = 0; i < 100 &&
+       nested_id.load() == cnetpp::tcp::kInvalidConnectionId; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_NE(cnetpp::tcp::kInvalidConnectionId, nested_id.load());
+  ASSERT_EQ(cnetpp::tcp::kInvalidConnectionId,
+            http_client.Connect("127.0.0.1:bad/", options));
+  http_client.Shutdown();
+  ::close(listen_fd);
+}
+
+TEST(HttpClient, ShutdownReleasesConnections) {
+  int listen_fd = Listen(12570);
+  ASSERT_GE(listen_fd, 0);
+  cnetpp::http::HttpClientOptions options;
+  options.set_worker_count(2);
+  cnetpp::http::HttpClient http_client;
+  ASSERT_TRUE(http_client.Launch(options));
+
+  std::mutex mutex;
+  std::vector<std::weak_ptr<cnetpp::http::HttpConnection>> connections;
+  options.set_connected_callback(
+      [&] (std::shared_ptr<cnetpp::http::HttpConnection> c) -> bool {
+    std::lock_guard<std::mutex> guard(mutex);
+    connections.push_back(c);
+    return true;
+  });
+  auto wait_connected = [&] (size_t count) {
+    for (int i = 0; i < 100; ++i) {
+      {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (connections.size() >= count) {
+          return true;
+        }
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+  };
+  // the second connect starts after the first connection is registered
+  ASSERT_NE(cnetpp::tcp::kInvalidConnectionId,
+            http_client.Connect("127.0.0.1:12570/", options));
+  ASSERT_TRUE(wait_connected(1));
+  ASSERT_NE(cnetpp::tcp::kInvalidConnectionId,
+            http_client.Connect("127.0.0.1:12570/", options));
+  ASSERT_TRUE(wait_connected(2));
+
+  http_client.Shutdown();
+  std::lock_guard<std::mutex> guard(mutex);
+  for (auto& connection : connections) {
+    ASSERT_TRUE(connection.expired());
+  }
+  ::close(listen_fd);
+}
@@ -0,0 +1,54 @@
+#include <cnetpp/http/http_default_headers.h>
+#include <cnetpp/http/http_response.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+TEST(HttpDefaultHeaders, DateLine) {
+  auto date_line = cnetpp::http::HttpDefaultHeaders::DateLine();
+  // "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+  ASSERT_EQ((size_t)37, date_line.size());
+  ASSERT_TRUE(date_line.starts_with("Date: "));
+  ASSERT_TRUE(date_line.ends_with(" GMT\r\n"));
+}
+
+TEST(HttpDefaultHeaders, Collect) {
+  std::vector<std::pair<std::string, std::string>> headers = {
+    { "Server", "cnetpp" },
+    { "Content-Type", "text/plain" },
+  };
+  cnetpp::http::HttpDefaultHeaders default_headers(headers, true);
+  ASSERT_FALSE(default_headers.Empty());
+
+  cnetpp::http::HttpResponse http_response;
+  http_response.set_status(cnetpp::http::HttpResponse::StatusCode::kOk);
+  http_response.SetHttpHeader("Content-Length", "0");
+  std::vector<cnetpp::base::StringPiece> lines;
+  default_headers.Collect(http_response, &lines);
+  ASSERT_EQ((size_t)2, lines.size());
+  ASSERT_TRUE(lines[0].starts_with("Date: "));
+  ASSERT_EQ("Server: cnetpp\r\nContent-Type: text/plain\r\n",
+            lines[1].as_string());
+
+  auto buffer = http_response.HttpHeadersToRingBuffer(&lines);
+  ASSERT_TRUE(buffer->Full());
+  std::string result;
+  buffer->ReadAll(&result);
+  ASSERT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n" +
+                lines[0].as_string() +
+                "Server: cnetpp\r\nContent-Type: text/plain\r\n\r\n",
+            result);
+
+  http_response.SetHttpHeader("Content-Type", "text/html");
+  http_response.SetHttpHeader("Date", "Sun, 06 Nov 1994 08:49:37 GMT");
+  lines.clear();
+  default_headers.Collect(http_response, &lines);
+  ASSERT_EQ((size_t)1, lines.size());
+  ASSERT_EQ("Server: cnetpp\r\n", lines[0].as_string());
+
+  cnetpp::http::HttpDefaultHeaders empty_headers({}, false);
+  ASSERT_TRUE(empty_headers.Empty());
+}
@@ -0,0 +1,145 @@
+#include <cnetpp/http/http_connection.h>
+#include <cnetpp/http/http_options.h>
+#include <cnetpp/http/http_request.h>
+#include <cnetpp/http/http_response.h>
+#include <cnetpp/http/http_response_codec.h>
+#include <cnetpp/http/http_server.h>
+#include <cnetpp/tcp/request_channel.h>
+#include <cnetpp/tcp/ring_buffer.h>
+#include <cnetpp/tcp/tcp_client.h>
+#include <cnetpp/tcp/tcp_options.h>
+#include <cnetpp/base/end_point.h>
+#include <cnetpp/base/ip_address.h>
+
+#include <stdio.h>
+
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using cnetpp::http::HttpResponseCodec;
+
+namespace {
+
+// the body of a whole response message
+std::string Body(const std::string& message) {
+  auto pos = message.find("\r\n\r\n");
+  return pos == std::string::npos ? std::string() : message.substr(pos + 4);
+}
+
+}  // namespace
+
+TEST(HttpResponseCodec, Framing) {
+  std::string data =
+      "HTTP/1.1 100 Continue\r\n\r\n"
+      "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello"
+      "HTTP/1.1 204 No Content\r\n\r\n"
+      "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+      "5\r\nhello\r\n6;ext=1\r\n world\r\n0\r\nX-Trailer: 1\r\n\r\n"
+      "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+
+  // the responses come a byte at a time
+  HttpResponseCodec codec;
+  cnetpp::tcp::RingBuffer buffer(data.size());
+  std::vector<std::string> responses;
+  uint64_t correlation_id = 0;
+  for (char c : data) {
+    ASSERT_TRUE(buffer.Write(cnetpp::base::StringPiece(&c, 1)));
+    std::string response;
+    int res = 0;
+    while ((res = codec.Decode(&buffer, &correlation_id, &response)) == 1) {
+      responses.push_back(response);
+    }
+    ASSERT_EQ(0, res);
+  }
+  ASSERT_EQ(4u, responses.size());
+  ASSERT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello", responses[0]);
+  ASSERT_EQ("HTTP/1.1 204 No Content\r\n\r\n", responses[1]);
+  ASSERT_EQ("5\r\nhello\r\n6;ext=1\r\n world\r\n0\r\nX-Trailer: 1\r\n\r\n",
+            Body(responses[2]));
+  ASSERT_EQ("", Body(responses[3]));
+  ASSERT_TRUE(buffer.Empty());
+
+  // a body ended by the close of the connection can't be pipelined
+  std::string unframed = "HTTP/1.1 200 OK\r\n\r\nhello";
+  cnetpp::tcp::RingBuffer unframed_buffer(unframed.size());
+  ASSERT_TRUE(unframed_buffer.Write(unframed));
+  std::string response;
+  ASSERT_EQ(-1, HttpResponseCodec().Decode(&unframed_buffer,
+                                           &correlation_id,
+                                           &response));
+}
+
+TEST(HttpResponseCodec, PipelinedRequests) {
+  // the even paths are answered with a Content-Length body, the odd ones
+  // with a chunked body
+  cnetpp::http::HttpServerOptions server_options;
+  server_options.set_worker_count(1);
+  server_options.set_received_callback(
+      [] (std::shared_ptr<cnetpp::http::HttpConnection> c) -> bool {
+    auto http_request =
+        std::static_pointer_cast<cnetpp::http::HttpRequest>(c->http_packet());
+    const auto& uri = http_request->uri();
+    if ((uri.back() - '0') % 2 == 1) {
+      char size[16];
+      snprintf(size, sizeof(size), "%zx", uri.size());
+      return c->SendPacket("HTTP/1.1 200 OK\r\n"
+                           "Transfer-Encoding: chunked\r\n\r\n" +
+                           std::string(size) + "\r\n" + uri + "\r\n0\r\n\r\n");
+    }
+    auto http_response = std::make_shared<cnetpp::http::HttpResponse>();
+    http_response->set_status(cnetpp::http::HttpResponse::StatusCode::kOk);
+    http_response->SetHttpHeader("Content-Length",
+                                 std::to_string(uri.size()));
+    http_response->set_http_body(uri);
+    return c->SendPacket(http_response);
+  });
+  cnetpp::http::HttpServer http_server;
+  cnetpp::base::EndPoint end_point(cnetpp::base::IPAddress("127.0.0.1"),
+                                   12573);
+  ASSERT_TRUE(http_server.Launch(end_point, server_options));
+
+  cnetpp::tcp::TcpClientOptions options;
+  options.set_worker_count(1);
+  cnetpp::tcp::TcpClient client;
+  ASSERT_TRUE(client.Launch("pipe", options));
+  auto channel = std::make_shared<cnetpp::tcp::RequestChannel>(
+      std::make_shared<HttpResponseCodec>());
+  channel->Bind(&options);
+
+  // the first requests are queued before the connection is established,
+  // all of them are in flight on the one connection at once
+  const int kRequests = 6;
+  std::vector<std::future<cnetpp::tcp::RequestChannel::Result>> futures;
+  auto call = [&channel, &futures] (int i) {
+    cnetpp::http::HttpRequest http_request;
+    http_request.set_method(cnetpp::http::HttpRequest::MethodType::kGet);
+    http_request.set_uri("/pipelined/" + std::to_string(i));
+    http_request.SetHttpHeader("Host", "127.0.0.1");
+    http_request.SetHttpHeader("Content-Length", "0");
+    futures.emplace_back(channel->Call(http_request.ToString(), 5000));
+  };
+  for (int i = 0; i < kRequests / 2; ++i) {
+    call(i);
+  }
+  ASSERT_NE(cnetpp::tcp::kInvalidConnectionId,
+            client.Connect(&end_point, options));
+  for (int i = kRequests / 2; i < kRequests; ++i) {
+    call(i);
+  }
+  for (int i = 0; i < kRequests; ++i) {
+    auto result = futures[i].get();
+    ASSERT_TRUE(result.success);
+    auto uri = "/pipelined/" + std::to_string(i);
+    if (i % 2 == 1) {
+      ASSERT_NE(std::string::npos, Body(result.response).find(uri));
+    } else {
+      ASSERT_EQ(uri, Body(result.response));
+    }
+  }
+  client.Shutdown();
+  http_server.Shutdown();
+}
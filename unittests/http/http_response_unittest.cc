@@ -0,0 +1,43 @@
+#include <cnetpp/http/http_response.h>
+#include <cnetpp/http/http_request.h>
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+TEST(HttpResponse, HttpHeadersToRingBuffer) {
+  cnetpp::http::HttpResponse http_response;
+  http_response.set_status(cnetpp::http::HttpResponse::StatusCode::kOk);
+  http_response.SetHttpHeader("Content-Length", "10");
+  http_response.SetHttpHeader("Content-Type", "text/plain");
+  http_response.set_http_body("1234567890");
+
+  auto buffer = http_response.HttpHeadersToRingBuffer();
+  ASSERT_TRUE(buffer->Full());
+  std::string headers;
+  buffer->ReadAll(&headers);
+  ASSERT_EQ(http_response.HttpHeadersToString(), headers);
+  ASSERT_EQ(0, headers.find("HTTP/1.1 200 OK\r\n"));
+  ASSERT_EQ(http_response.ToString(), headers + "1234567890");
+
+  http_response.set_http_version(cnetpp::http::HttpPacket::Version::kVersion10);
+  http_response.set_status(cnetpp::http::HttpResponse::StatusCode::kNotFound);
+  buffer = http_response.HttpHeadersToRingBuffer();
+  headers.clear();
+  buffer->ReadAll(&headers);
+  ASSERT_EQ(http_response.HttpHeadersToString(), headers);
+  ASSERT_EQ(0, headers.find("HTTP/1.0 404 Not Found\r\n"));
+}
+
+TEST(HttpResponse, HttpHeadersToRingBufferWithoutCachedStartLine) {
+  cnetpp::http::HttpRequest http_request;
+  http_request.set_method(cnetpp::http::HttpRequest::MethodType::kGet);
+  http_request.set_uri("/index.html");
+  http_request.SetHttpHeader("Host", "localhost");
+
+  auto buffer = http_request.HttpHeadersToRingBuffer();
+  ASSERT_TRUE(buffer->Full());
+  std::string headers;
+  buffer->ReadAll(&headers);
+  ASSERT_EQ(http_request.HttpHeadersToString(), headers);
+}
@@ -0,0 +1,258 @@
+#include <cnetpp/http/http_connection.h>
+#include <cnetpp/http/http_options.h>
+#include <cnetpp/http/http_response.h>
+#include <cnetpp/http/http_server.h>
+#include <cnetpp/base/end_point.h>
+#include <cnetpp/base/ip_address.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+int ConnectTo(int port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  ::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for (int i = 0; i < 100; ++i) {
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                  sizeof(addr)) == 0) {
+      return fd;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ::close(fd);
+  return -1;
+}
+
+bool WriteAll(int fd, const std::string& data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t n = ::write(fd, data.data() + sent, data.size() - sent);
+    if (n <= 0) {
+      return false;
+    }
+    sent += n;
+  }
+  return true;
+}
+
+// read until 'terminator' shows up
+std::string ReadUntil(int fd, const std::string& terminator) {
+  std::string result;
+  char buffer[4096];
+  while (result.find(terminator) == std::string::npos) {
+    ssize_t n = ::read(fd, buffer, sizeof(buffer));
+    if (n <= 0) {
+      break;
+    }
+    result.append(buffer, n);
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST(HttpStreaming, ChunkedBodyWithBackpressureAndProducer) {
+  std::mutex mutex;
+  std::string received_body;
+  int header_count = 0;
+  bool last_seen = false;
+  std::atomic<int> paused_count { 0 };
+  std::thread resumer;
+
+  cnetpp::http::HttpServerOptions options;
+  options.set_worker_count(1);
+  options.set_header_received_callback(
+      [&] (std::shared_ptr<cnetpp::http::HttpConnection> c) -> bool {
+    std::lock_guard<std::mutex> guard(mutex);
+    (void) c;
+    header_count++;
+    return true;
+  });
+  options.set_body_received_callback(
+      [&] (cnetpp::base::StringPiece data,
+           bool last,
+           std::shared_ptr<cnetpp::http::HttpConnection> c) -> bool {
+    std::lock_guard<std::mutex> guard(mutex);
+    received_body.append(data.data(), data.size());
+    last_seen = last;
+    if (paused_count++ == 0) {
+      // pretend to be a slow consumer
+      c->PauseReceiving();
+      resumer = std::thread([c] () {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        c->ResumeReceiving();
+      });
+    }
+    return true;
+  });
+  options.set_received_callback(
+      [&] (std::shared_ptr<cnetpp::http::HttpConnection> c) -> bool {
+    EXPECT_TRUE(c->http_packet()->http_body().empty());
+    auto http_response = std::make_shared<cnetpp::http::HttpResponse>();
+    http_response->set_status(cnetpp::http::HttpResponse::StatusCode::kOk);
+    auto pieces = std::make_shared<int>(0);
+    return c->SendPacket(http_response,
+        [pieces] (std::string* data, bool* last) -> bool {
+      (*pieces)++;
+      data->assign(std::to_string(*pieces) + "abc");
+      *last = *pieces == 3;
+      return true;
+    });
+  });
+
+  cnetpp::base::EndPoint end_point(cnetpp::base::IPAddress("127.0.0.1"),
+                                   12547);
+  cnetpp::http::HttpServer http_server;
+  ASSERT_TRUE(http_server.Launch(end_point, options));
+
+  int fd = ConnectTo(12547);
+  ASSERT_GE(fd, 0);
+  ASSERT_TRUE(WriteAll(fd, "POST /upload HTTP/1.1\r\n"
+                           "Transfer-Encoding: chunked\r\n\r\n"
+                           "5\r\nhello\r\n"));
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ASSERT_TRUE(WriteAll(fd, "6;ext=1\r\n world\r\n"
+                           "0\r\n\r\n"));
+
+  std::string response = ReadUntil(fd, "0\r\n\r\n");
+  ::close(fd);
+  http_server.Shutdown();
+  if (resumer.joinable()) {
+    resumer.join();
+  }
+
+  ASSERT_EQ(1, header_count);
+  ASSERT_EQ("hello world", received_body);
+  ASSERT_TRUE(last_seen);
+  ASSERT_EQ(0u, response.find("HTTP/1.1 200 OK\r\n"));
+  ASSERT_NE(std::string::npos, response.find("Transfer-Encoding: chunked"));
+  auto body = response.substr(response.find("\r\n\r\n") + 4);
+  ASSERT_EQ("4\r\n1abc\r\n4\r\n2abc\r\n4\r\n3abc\r\n0\r\n\r\n", body);
+}
+
+TEST(HttpStreaming, DrainAfterEarlyResponse) {
+  std::atomic<bool> body_done { false };
+  cnetpp::http::HttpServerOptions options;
+  options.set_worker_count(1);
+  options.set_header_received_callback(
+      [] (std::shared_ptr<cnetpp::http::HttpConnection> c) -> bool {
+    // answer before the body has been received
+    auto http_response = std::make_shared<cnetpp::http::HttpResponse>();
+    http_response->set_status(cnetpp::http::HttpResponse::StatusCode::kOk);
+    http_response->set_http_body("ok");
+    return c->SendPacket(http_response);
+  });
+  options.set_body_received_callback(
+      [&] (cnetpp::base::StringPiece data,
+           bool last,
+           std::shared_ptr<cnetpp::http::HttpConnection> c) -> bool {
+    (void) data;
+    (void) c;
+    if (last) {
+      body_done = true;
+    }
+    return true;
+  });
+  options.set_received_callback(
+      [] (std::shared_ptr<cnetpp::http::HttpConnection> c) -> bool {
+    (void) c;
+    return true;
+  });
+
+  cnetpp::base::EndPoint end_point(cnetpp::base::IPAddress("127.0.0.1"),
+                                   12574);
+  cnetpp::http::HttpServer http_server;
+  ASSERT_TRUE(http_server.Launch(end_point, options));
+
+  int fd = ConnectTo(12574);
+  ASSERT_GE(fd, 0);
+  ASSERT_TRUE(WriteAll(fd, "POST /upload HTTP/1.1\r\n"
+                           "Content-Length: 5\r\n\r\n"));
+  std::string response = ReadUntil(fd, "ok");
+  ASSERT_EQ(0u, response.find("HTTP/1.1 200 OK\r\n"));
+  ASSERT_TRUE(WriteAll(fd, "hello"));
+  for (int i = 0; i < 100 && !body_done; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_TRUE(body_done);
+
+  // the request has been answered, so it is closed as an idle one at once
+  auto start = std::chrono::steady_clock::now();
+  http_server.GracefulShutdown(2000);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  ASSERT_LT(elapsed, std::chrono::milliseconds(1000));
+  char c;
+  ASSERT_GE(0, ::read(fd, &c, 1));  // closed
+  ::close(fd);
+}
+
+TEST(HttpStreaming, DrainWaitsForFinalResponse) {
+  std::mutex mutex;
+  std::shared_ptr<cnetpp::http::HttpConnection> pending;
+  cnetpp::http::HttpServerOptions options;
+  options.set_worker_count(1);
+  options.set_received_callback(
+      [&] (std::shared_ptr<cnetpp::http::HttpConnection> c) -> bool {
+    // an interim response now, the final one later
+    auto http_response = std::make_shared<cnetpp::http::HttpResponse>();
+    http_response->set_status(
+        cnetpp::http::HttpResponse::StatusCode::kContinue);
+    std::lock_guard<std::mutex> guard(mutex);
+    pending = c;
+    return c->SendPacket(http_response);
+  });
+
+  cnetpp::base::EndPoint end_point(cnetpp::base::IPAddress("127.0.0.1"),
+                                   12575);
+  cnetpp::http::HttpServer http_server;
+  ASSERT_TRUE(http_server.Launch(end_point, options));
+
+  int fd = ConnectTo(12575);
+  ASSERT_GE(fd, 0);
+  ASSERT_TRUE(WriteAll(fd, "GET /slow HTTP/1.1\r\n\r\n"));
+  std::string response = ReadUntil(fd, "\r\n\r\n");
+  ASSERT_EQ(0u, response.find("HTTP/1.1 100 Continue\r\n"));
+
+  std::thread drainer([&http_server] () {
+    http_server.GracefulShutdown(2000);
+  });
+  // the request isn't answered yet, so the connection must stay open
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  char c;
+  bool open = ::recv(fd, &c, 1, MSG_DONTWAIT) < 0 && errno == EAGAIN;
+
+  auto http_response = std::make_shared<cnetpp::http::HttpResponse>();
+  http_response->set_status(cnetpp::http::HttpResponse::StatusCode::kOk);
+  http_response->set_http_body("done");
+  bool sent = false;
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    sent = pending->SendPacket(http_response);
+    pending.reset();
+  }
+  response = ReadUntil(fd, "done");
+  drainer.join();
+  ASSERT_TRUE(open);
+  ASSERT_TRUE(sent);
+  ASSERT_EQ(0u, response.find("HTTP/1.1 200 OK\r\n"));
+  ASSERT_GE(0, ::read(fd, &c, 1));  // closed
+  ::close(fd);
+}
+
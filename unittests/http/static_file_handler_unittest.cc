@@ -0,0 +1,155 @@
+#include <cnetpp/http/static_file_handler.h>
+#include <cnetpp/http/http_server.h>
+#include <cnetpp/base/end_point.h>
+#include <cnetpp/base/ip_address.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+using cnetpp::http::StaticFileHandler;
+
+TEST(StaticFileHandler, ParseRange) {
+  int64_t begin = 0;
+  int64_t end = 0;
+  ASSERT_EQ(1, StaticFileHandler::ParseRange("bytes=0-9", 100, &begin, &end));
+  ASSERT_EQ(0, begin);
+  ASSERT_EQ(9, end);
+  ASSERT_EQ(1, StaticFileHandler::ParseRange("bytes=90-", 100, &begin, &end));
+  ASSERT_EQ(90, begin);
+  ASSERT_EQ(99, end);
+  ASSERT_EQ(1, StaticFileHandler::ParseRange("bytes=-10", 100, &begin, &end));
+  ASSERT_EQ(90, begin);
+  ASSERT_EQ(99, end);
+  ASSERT_EQ(1, StaticFileHandler::ParseRange("bytes=-200", 100, &begin, &end));
+  ASSERT_EQ(0, begin);
+  ASSERT_EQ(99, end);
+  ASSERT_EQ(1, StaticFileHandler::ParseRange("bytes=50-200", 100, &begin, &end));
+  ASSERT_EQ(50, begin);
+  ASSERT_EQ(99, end);
+  ASSERT_EQ(-1, StaticFileHandler::ParseRange("bytes=100-", 100, &begin, &end));
+  ASSERT_EQ(-1, StaticFileHandler::ParseRange("bytes=-0", 100, &begin, &end));
+  ASSERT_EQ(0, StaticFileHandler::ParseRange("bytes=0-1,5-6", 100, &begin, &end));
+  ASSERT_EQ(0, StaticFileHandler::ParseRange("items=0-1", 100, &begin, &end));
+  ASSERT_EQ(0, StaticFileHandler::ParseRange("bytes=9-1", 100, &begin, &end));
+  ASSERT_EQ(0, StaticFileHandler::ParseRange("bytes=a-1", 100, &begin, &end));
+}
+
+TEST(StaticFileHandler, GetFilePath) {
+  StaticFileHandler handler("/srv/www/");
+  std::string path;
+  ASSERT_TRUE(handler.GetFilePath("/a/b.txt?x=1", &path));
+  ASSERT_EQ("/srv/www/a/b.txt", path);
+  ASSERT_TRUE(handler.GetFilePath("/a%20b", &path));
+  ASSERT_EQ("/srv/www/a b", path);
+  ASSERT_TRUE(handler.GetFilePath("/a..b", &path));
+  ASSERT_FALSE(handler.GetFilePath("/../etc/passwd", &path));
+  ASSERT_FALSE(handler.GetFilePath("/a/%2e%2e/%2e%2e/etc/passwd", &path));
+  ASSERT_FALSE(handler.GetFilePath("/a/..", &path));
+  ASSERT_FALSE(handler.GetFilePath("a/b", &path));
+  ASSERT_FALSE(handler.GetFilePath("/a%2", &path));
+  ASSERT_FALSE(handler.GetFilePath("/a%00", &path));
+}
+
+TEST(StaticFileHandler, ServeFile) {
+  char root[] = "/tmp/cnetpp_static_XXXXXX";
+  ASSERT_TRUE(::mkdtemp(root));
+  std::string content;
+  for (int i = 0; i < 100000; ++i) {
+    content.push_back(static_cast<char>('a' + i % 26));
+  }
+  std::string file = std::string(root) + "/data.txt";
+  std::ofstream(file) << content;
+
+  StaticFileHandler handler(root);
+  cnetpp::http::HttpServerOptions options;
+  options.set_worker_count(1);
+  options.set_received_callback(
+      [&handler] (std::shared_ptr<cnetpp::http::HttpConnection> c) -> bool {
+    return handler.Handle(c);
+  });
+  cnetpp::http::HttpServer http_server;
+  ASSERT_TRUE(http_server.Launch(
+      cnetpp::base::EndPoint(cnetpp::base::IPAddress("127.0.0.1"), 12548),
+      options));
+
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  ::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(12548);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bool connected = false;
+  for (int i = 0; i < 100 && !connected; ++i) {
+    connected = ::connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                          sizeof(addr)) == 0;
+    if (!connected) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+  ASSERT_TRUE(connected);
+
+  // read a response with a body of 'length' bytes
+  auto read_response = [fd] (size_t length) -> std::string {
+    std::string response;
+    char buffer[8192];
+    while (true) {
+      auto header_end = response.find("\r\n\r\n");
+      if (header_end != std::string::npos &&
+          response.size() >= header_end + 4 + length) {
+        break;
+      }
+      ssize_t n = ::read(fd, buffer, sizeof(buffer));
+      if (n <= 0) {
+        break;
+      }
+      response.append(buffer, n);
+    }
+    return response;
+  };
+
+  std::string request = "GET /data.txt HTTP/1.1\r\n\r\n";
+  ASSERT_EQ(static_cast<ssize_t>(request.size()),
+            ::write(fd, request.data(), request.size()));
+  std::string response = read_response(content.size());
+  ASSERT_EQ(0u, response.find("HTTP/1.1 200 OK\r\n"));
+  ASSERT_NE(std::string::npos, response.find("Content-Type: text/plain\r\n"));
+  ASSERT_EQ(content, response.substr(response.find("\r\n\r\n") + 4));
+
+  request = "GET /data.txt HTTP/1.1\r\nRange: bytes=26-51\r\n\r\n";
+  ASSERT_EQ(static_cast<ssize_t>(request.size()),
+            ::write(fd, request.data(), request.size()));
+  response = read_response(26);
+  ASSERT_EQ(0u, response.find("HTTP/1.1 206 Partial Content\r\n"));
+  ASSERT_NE(std::string::npos,
+            response.find("Content-Range: bytes 26-51/100000\r\n"));
+  ASSERT_EQ(content.substr(26, 26),
+            response.substr(response.find("\r\n\r\n") + 4));
+
+  request = "GET /data.txt HTTP/1.1\r\nRange: bytes=100000-\r\n\r\n";
+  ASSERT_EQ(static_cast<ssize_t>(request.size()),
+            ::write(fd, request.data(), request.size()));
+  response = read_response(0);
+  ASSERT_EQ(0u, response.find("HTTP/1.1 416 Requested Range Not Satisfiable"));
+
+  request = "GET /missing.txt HTTP/1.1\r\n\r\n";
+  ASSERT_EQ(static_cast<ssize_t>(request.size()),
+            ::write(fd, request.data(), request.size()));
+  response = read_response(0);
+  ASSERT_EQ(0u, response.find("HTTP/1.1 404 Not Found"));
+
+  ::close(fd);
+  http_server.Shutdown();
+  ::unlink(file.c_str());
+  ::rmdir(root);
+}
@@ -411,13 +411,20 @@ TEST(RingBuffer, FindCharAndReform4) {
 }
 
 TEST(RingBuffer, Stats) {
+  // the stats are process wide and the buffers of the other tests move
+  // them, so only the changes made by the buffers created here are checked
+  int64_t total = cnetpp::tcp::RingBuffer::TotalMemory();
+  int64_t max = cnetpp::tcp::RingBuffer::MaxRingBuffer();
   {
     cnetpp::tcp::RingBuffer rb(50);
-    ASSERT_EQ(50, cnetpp::tcp::RingBuffer::TotalMemory());
-    ASSERT_EQ(500, cnetpp::tcp::RingBuffer::MaxRingBuffer());
-    ASSERT_EQ(10, cnetpp::tcp::RingBuffer::MinRingBuffer());
+    cnetpp::tcp::RingBuffer large(max + 1);
+    cnetpp::tcp::RingBuffer small(1);
+    ASSERT_EQ(50 + max + 1 + 1,
+              cnetpp::tcp::RingBuffer::TotalMemory() - total);
+    ASSERT_LE(max + 1, cnetpp::tcp::RingBuffer::MaxRingBuffer());
+    ASSERT_EQ(1, cnetpp::tcp::RingBuffer::MinRingBuffer());
   }
-  ASSERT_EQ(0, cnetpp::tcp::RingBuffer::TotalMemory());
-  ASSERT_EQ(500, cnetpp::tcp::RingBuffer::MaxRingBuffer());
-  ASSERT_EQ(10, cnetpp::tcp::RingBuffer::MinRingBuffer());
+  ASSERT_EQ(0, cnetpp::tcp::RingBuffer::TotalMemory() - total);
+  ASSERT_LE(max + 1, cnetpp::tcp::RingBuffer::MaxRingBuffer());
+  ASSERT_EQ(1, cnetpp::tcp::RingBuffer::MinRingBuffer());
 }
@@ -6,7 +6,13 @@
 
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace cnetpp {
 
@@ -140,6 +146,219 @@ TEST_F(TcpClientTest, SimpleConnectionTest) {
   }
 }
 
+namespace {
+
+// Wait for the callback of a racing connect.
+class ConnectWaiter {
+ public:
+  tcp::ConnectCallbackType Callback() {
+    return [this] (tcp::ConnectionId connection_id) {
+      std::lock_guard<std::mutex> guard(mutex_);
+      connection_id_ = connection_id;
+      done_ = true;
+      cond_.notify_one();
+    };
+  }
+
+  bool Wait(tcp::ConnectionId* connection_id) {
+    std::unique_lock<std::mutex> guard(mutex_);
+    if (!cond_.wait_for(guard, std::chrono::seconds(5),
+                        [this] () { return done_; })) {
+      return false;
+    }
+    *connection_id = connection_id_;
+    return true;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool done_ { false };
+  tcp::ConnectionId connection_id_ { tcp::kInvalidConnectionId };
+};
+
+}  // namespace
+
+TEST(TcpClientRace, SkipFailedAddresses) {
+  base::EndPoint listening("127.0.0.1", 12551);
+  tcp::TcpServerOptions server_options;
+  server_options.set_connected_callback(
+      [] (std::shared_ptr<tcp::TcpConnection> c) -> bool {
+    (void) c;
+    return true;
+  });
+  tcp::TcpServer server;
+  ASSERT_TRUE(server.Launch(listening, server_options));
+
+  std::atomic<int> connected { 0 };
+  std::atomic<int> closed { 0 };
+  tcp::TcpClientOptions options;
+  options.set_worker_count(1);
+  // a failed attempt starts the next one right away
+  options.set_connect_attempt_delay(2000);
+  options.set_connected_callback(
+      [&connected] (std::shared_ptr<tcp::TcpConnection> c) -> bool {
+    (void) c;
+    connected++;
+    return true;
+  });
+  options.set_closed_callback(
+      [&closed] (std::shared_ptr<tcp::TcpConnection> c) -> bool {
+    (void) c;
+    closed++;
+    return true;
+  });
+  tcp::TcpClient client;
+  ASSERT_TRUE(client.Launch("race", options));
+
+  auto start = std::chrono::steady_clock::now();
+  ConnectWaiter waiter;
+  client.Connect({ base::EndPoint("::1", 12552),
+                   base::EndPoint("127.0.0.1", 12552),
+                   listening },
+                 options, nullptr, waiter.Callback());
+  tcp::ConnectionId connection_id = tcp::kInvalidConnectionId;
+  ASSERT_TRUE(waiter.Wait(&connection_id));
+  ASSERT_NE(tcp::kInvalidConnectionId, connection_id);
+  ASSERT_LT(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(1000));
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  ASSERT_EQ(1, connected);
+  ASSERT_EQ(0, closed);
+
+  // all of them fail
+  ConnectWaiter failure_waiter;
+  client.Connect({ base::EndPoint("127.0.0.1", 12552) },
+                 options, nullptr, failure_waiter.Callback());
+  ASSERT_TRUE(failure_waiter.Wait(&connection_id));
+  ASSERT_EQ(tcp::kInvalidConnectionId, connection_id);
+  ASSERT_EQ(0, closed);
+
+  client.Shutdown();
+  server.Shutdown();
+}
+
+TEST(TcpClientRace, CloseLosers) {
+  base::EndPoint listening("127.0.0.1", 12553);
+  std::atomic<int> server_connected { 0 };
+  std::atomic<int> server_closed { 0 };
+  tcp::TcpServerOptions server_options;
+  server_options.set_connected_callback(
+      [&server_connected] (std::shared_ptr<tcp::TcpConnection> c) -> bool {
+    (void) c;
+    server_connected++;
+    return true;
+  });
+  server_options.set_closed_callback(
+      [&server_closed] (std::shared_ptr<tcp::TcpConnection> c) -> bool {
+    (void) c;
+    server_closed++;
+    return true;
+  });
+  tcp::TcpServer server;
+  ASSERT_TRUE(server.Launch(listening, server_options));
+
+  std::atomic<int> connected { 0 };
+  tcp::TcpClientOptions options;
+  options.set_worker_count(2);
+  options.set_connect_attempt_delay(0);
+  options.set_connected_callback(
+      [&connected] (std::shared_ptr<tcp::TcpConnection> c) -> bool {
+    (void) c;
+    connected++;
+    return true;
+  });
+  tcp::TcpClient client;
+  ASSERT_TRUE(client.Launch("race", options));
+
+  ConnectWaiter waiter;
+  client.Connect({ listening, listening, listening },
+                 options, nullptr, waiter.Callback());
+  tcp::ConnectionId connection_id = tcp::kInvalidConnectionId;
+  ASSERT_TRUE(waiter.Wait(&connection_id));
+  ASSERT_NE(tcp::kInvalidConnectionId, connection_id);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  ASSERT_EQ(1, connected);
+  // the server sees the losers which got connected go away
+  ASSERT_EQ(server_connected - 1, server_closed);
+
+  client.Shutdown();
+  server.Shutdown();
+}
+
+TEST(TcpClientRace, ConnectTimeout) {
+  std::atomic<int> closed { 0 };
+  tcp::TcpClientOptions options;
+  options.set_worker_count(1);
+  options.set_connect_timeout(100);
+  options.set_closed_callback(
+      [&closed] (std::shared_ptr<tcp::TcpConnection> c) -> bool {
+    (void) c;
+    closed++;
+    return true;
+  });
+  tcp::TcpClient client;
+  ASSERT_TRUE(client.Launch("race", options));
+
+  // not routable, the connect hangs or fails right away
+  base::EndPoint blackhole("10.255.255.1", 12554);
+  auto start = std::chrono::steady_clock::now();
+  ConnectWaiter waiter;
+  client.Connect({ blackhole }, options, nullptr, waiter.Callback());
+  tcp::ConnectionId connection_id = tcp::kInvalidConnectionId;
+  ASSERT_TRUE(waiter.Wait(&connection_id));
+  ASSERT_EQ(tcp::kInvalidConnectionId, connection_id);
+  ASSERT_LT(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(1000));
+
+  if (client.Connect(&blackhole, options, nullptr) !=
+      tcp::kInvalidConnectionId) {
+    for (int i = 0; i < 100 && closed == 0; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(1, closed);
+  }
+  client.Shutdown();
+}
+
+TEST(TcpClientRace, TimersAcrossShutdown) {
+  auto event_center = tcp::EventCenter::New("tmr", 2);
+  ASSERT_TRUE(event_center->Launch());
+  ASSERT_LT(0, tcp::TcpClientOptions().connect_timeout());
+
+  // timers are added and cancelled from another thread all along the
+  // shutdown, they are refused once it is done
+  std::atomic<bool> stop { false };
+  std::atomic<bool> refused { false };
+  std::atomic<int> fired { 0 };
+  std::thread adder([&] () {
+    uint64_t shard = 0;
+    while (!stop) {
+      auto timer_id = event_center->AddTimer(0, [&fired] () {
+        fired++;
+      }, shard++);
+      auto cancelled_id = event_center->AddTimer(1000, [] () {}, shard++);
+      event_center->CancelTimer(cancelled_id);
+      if (timer_id == tcp::EventCenter::kInvalidTimerId) {
+        refused = true;
+      }
+    }
+  });
+  for (int i = 0; i < 100 && fired == 0; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  event_center->Shutdown();
+  for (int i = 0; i < 100 && !refused; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  stop = true;
+  adder.join();
+  ASSERT_LT(0, fired.load());
+  ASSERT_TRUE(refused.load());
+  ASSERT_TRUE(event_center->AddTimer(0, [] () {}) ==
+              tcp::EventCenter::kInvalidTimerId);
+}
+
 #if 0
 TEST_F(StatelessRpcChannelTest, AsyncServerFailed) {
   ASSERT_TRUE(server1_->Shutdown());
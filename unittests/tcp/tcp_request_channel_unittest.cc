@@ -0,0 +1,262 @@
+#include <cnetpp/tcp/request_channel.h>
+#include <cnetpp/tcp/request_codec.h>
+#include <cnetpp/tcp/ring_buffer.h>
+#include <cnetpp/tcp/tcp_client.h>
+#include <cnetpp/tcp/tcp_connection.h>
+#include <cnetpp/tcp/tcp_options.h>
+#include <cnetpp/tcp/tcp_server.h>
+#include <cnetpp/base/end_point.h>
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using cnetpp::tcp::LengthPrefixedCodec;
+using cnetpp::tcp::RequestChannel;
+using cnetpp::tcp::RequestCodec;
+using cnetpp::tcp::RingBuffer;
+
+namespace {
+
+// one line per request and per response, answered in order
+class LineCodec final : public RequestCodec {
+ public:
+  bool HasCorrelationId() const override {
+    return false;
+  }
+
+  void Encode(uint64_t correlation_id,
+              cnetpp::base::StringPiece request,
+              std::string* frame) override {
+    (void) correlation_id;
+    frame->append(request.data(), request.size());
+    frame->push_back('\n');
+  }
+
+  int Decode(RingBuffer* buffer,
+             uint64_t* correlation_id,
+             std::string* response) override {
+    (void) correlation_id;
+    cnetpp::base::StringPiece line;
+    if (!buffer->Find('\n', &line)) {
+      return 0;
+    }
+    response->clear();
+    buffer->Read(response, line.size() + 1);
+    response->pop_back();
+    return 1;
+  }
+};
+
+// Echo the requests back. A framed server answers every pair of requests in
+// reverse order and never answers "drop", a line server answers in order.
+class EchoServer {
+ public:
+  EchoServer(int port, bool framed) : end_point_("127.0.0.1", port) {
+    cnetpp::tcp::TcpServerOptions options;
+    options.set_worker_count(1);
+    options.set_connected_callback(
+        [] (std::shared_ptr<cnetpp::tcp::TcpConnection> c) -> bool {
+      (void) c;
+      return true;
+    });
+    options.set_received_callback(
+        [this, framed] (std::shared_ptr<cnetpp::tcp::TcpConnection> c) {
+      return framed ? OnFramed(c) : OnLines(c);
+    });
+    started_ = server_.Launch(end_point_, options);
+  }
+
+  ~EchoServer() {
+    server_.Shutdown();
+  }
+
+  bool started() const {
+    return started_;
+  }
+  const cnetpp::base::EndPoint& end_point() const {
+    return end_point_;
+  }
+
+ private:
+  cnetpp::base::EndPoint end_point_;
+  cnetpp::tcp::TcpServer server_;
+  bool started_ { false };
+  LengthPrefixedCodec codec_;
+  // only touched in the single worker thread
+  std::vector<std::pair<uint64_t, std::string>> held_;
+
+  bool OnFramed(std::shared_ptr<cnetpp::tcp::TcpConnection> c) {
+    uint64_t id = 0;
+    std::string request;
+    while (codec_.Decode(&c->mutable_recv_buffer(), &id, &request) == 1) {
+      if (request == "drop") {
+        continue;
+      }
+      held_.emplace_back(id, request);
+      if (held_.size() == 2) {
+        std::string frames;
+        codec_.Encode(held_[1].first, held_[1].second, &frames);
+        codec_.Encode(held_[0].first, held_[0].second, &frames);
+        held_.clear();
+        c->SendPacket(frames);
+      }
+    }
+    return true;
+  }
+
+  bool OnLines(std::shared_ptr<cnetpp::tcp::TcpConnection> c) {
+    cnetpp::base::StringPiece line;
+    auto& buffer = c->mutable_recv_buffer();
+    while (buffer.Find('\n', &line)) {
+      std::string request;
+      buffer.Read(&request, line.size() + 1);
+      c->SendPacket(request);
+    }
+    return true;
+  }
+};
+
+}  // namespace
+
+TEST(RequestCodec, LengthPrefixed) {
+  LengthPrefixedCodec codec(16);
+  std::string frames;
+  codec.Encode(1, "hello", &frames);
+  codec.Encode(0x0102030405060708ULL, "", &frames);
+  ASSERT_EQ(12u + 5 + 12, frames.size());
+
+  RingBuffer buffer(64);
+  uint64_t id = 0;
+  std::string response;
+  buffer.Write(cnetpp::base::StringPiece(frames.data(), 10));
+  ASSERT_EQ(0, codec.Decode(&buffer, &id, &response));
+  buffer.Write(cnetpp::base::StringPiece(frames.data() + 10,
+                                         frames.size() - 10));
+  ASSERT_EQ(1, codec.Decode(&buffer, &id, &response));
+  ASSERT_EQ(1u, id);
+  ASSERT_EQ("hello", response);
+  ASSERT_EQ(1, codec.Decode(&buffer, &id, &response));
+  ASSERT_EQ(0x0102030405060708ULL, id);
+  ASSERT_EQ("", response);
+  ASSERT_EQ(0, codec.Decode(&buffer, &id, &response));
+
+  std::string too_large;
+  LengthPrefixedCodec().Encode(2, std::string(17, 'x'), &too_large);
+  buffer.Write(too_large);
+  ASSERT_EQ(-1, codec.Decode(&buffer, &id, &response));
+}
+
+TEST(RequestChannel, CorrelatedResponsesAndDeadlines) {
+  EchoServer server(12555, true);
+  ASSERT_TRUE(server.started());
+
+  cnetpp::tcp::TcpClientOptions options;
+  options.set_worker_count(1);
+  cnetpp::tcp::TcpClient client;
+  ASSERT_TRUE(client.Launch("reqc", options));
+  auto channel = std::make_shared<RequestChannel>(
+      std::make_shared<LengthPrefixedCodec>());
+  channel->Bind(&options);
+
+  // sent before the connection is established
+  auto first = channel->Call("first");
+  auto connection_id = client.Connect(&server.end_point(), options);
+  ASSERT_NE(cnetpp::tcp::kInvalidConnectionId, connection_id);
+  auto dropped = channel->Call("drop", 100);
+  auto second = channel->Call("second", 5000);
+
+  // answered in reverse order
+  auto result = first.get();
+  ASSERT_TRUE(result.success);
+  ASSERT_EQ("first", result.response);
+  result = second.get();
+  ASSERT_TRUE(result.success);
+  ASSERT_EQ("second", result.response);
+
+  auto start = std::chrono::steady_clock::now();
+  result = dropped.get();
+  ASSERT_FALSE(result.success);
+  ASSERT_LT(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(1000));
+
+  // the connection closes with a request in flight
+  auto pending = channel->Call("pending");
+  ASSERT_TRUE(client.AsyncClosed(connection_id));
+  ASSERT_FALSE(pending.get().success);
+  ASSERT_EQ(0u, channel->outstanding());
+  ASSERT_FALSE(channel->Call("late").get().success);
+  client.Shutdown();
+}
+
+TEST(RequestChannel, OrderedResponses) {
+  EchoServer server(12556, false);
+  ASSERT_TRUE(server.started());
+
+  cnetpp::tcp::TcpClientOptions options;
+  options.set_worker_count(1);
+  cnetpp::tcp::TcpClient client;
+  ASSERT_TRUE(client.Launch("reqc", options));
+  auto channel = std::make_shared<RequestChannel>(
+      std::make_shared<LineCodec>());
+  channel->Bind(&options);
+  ASSERT_NE(cnetpp::tcp::kInvalidConnectionId,
+            client.Connect(&server.end_point(), options));
+
+  std::vector<std::future<RequestChannel::Result>> futures;
+  for (int i = 0; i < 100; ++i) {
+    futures.emplace_back(channel->Call(std::to_string(i), 5000));
+  }
+  for (int i = 0; i < 100; ++i) {
+    auto result = futures[i].get();
+    ASSERT_TRUE(result.success);
+    ASSERT_EQ(std::to_string(i), result.response);
+  }
+  ASSERT_EQ(0u, channel->outstanding());
+  client.Shutdown();
+}
+
+TEST(RequestChannel, FailedSendsAndShutdown) {
+  EchoServer server(12569, true);
+  ASSERT_TRUE(server.started());
+
+  cnetpp::tcp::TcpClientOptions options;
+  options.set_worker_count(1);
+  options.set_connection_buffer_memory_limit(64 * 1024);
+  cnetpp::tcp::TcpClient client;
+  ASSERT_TRUE(client.Launch("reqc", options));
+  auto channel = std::make_shared<RequestChannel>(
+      std::make_shared<LengthPrefixedCodec>());
+  channel->Bind(&options);
+
+  // the requests over the memory budget fail instead of waiting forever,
+  // whether they are sent on connecting or right away
+  std::string too_large(128 * 1024, 'x');
+  auto unsent = channel->Call(too_large);
+  ASSERT_NE(cnetpp::tcp::kInvalidConnectionId,
+            client.Connect(&server.end_point(), options));
+  ASSERT_FALSE(unsent.get().success);
+  auto first = channel->Call("first", 5000);
+  auto rejected = channel->Call(too_large);
+  ASSERT_EQ(std::future_status::ready,
+            rejected.wait_for(std::chrono::seconds(0)));
+  ASSERT_FALSE(rejected.get().success);
+  auto second = channel->Call("second", 5000);
+  ASSERT_EQ("first", first.get().response);
+  ASSERT_EQ("second", second.get().response);
+
+  // no closed callback comes after the shutdown, the requests in flight
+  // fail as the channel goes away, and nothing else holds it
+  auto pending = channel->Call("drop");
+  client.Shutdown();
+  std::weak_ptr<RequestChannel> weak_channel = channel;
+  channel.reset();
+  ASSERT_TRUE(weak_channel.expired());
+  ASSERT_EQ(std::future_status::ready,
+            pending.wait_for(std::chrono::seconds(0)));
+  ASSERT_FALSE(pending.get().success);
+}
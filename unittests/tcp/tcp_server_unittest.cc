@@ -0,0 +1,482 @@
+#include <cnetpp/tcp/connection_limiter.h>
+#include <cnetpp/tcp/ring_buffer.h>
+#include <cnetpp/tcp/tcp_connection.h>
+#include <cnetpp/tcp/tcp_options.h>
+#include <cnetpp/tcp/tcp_server.h>
+#include <cnetpp/base/end_point.h>
+#include <cnetpp/base/memory_budget.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+int ConnectTo(int port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  ::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for (int i = 0; i < 100; ++i) {
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                  sizeof(addr)) == 0) {
+      return fd;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ::close(fd);
+  return -1;
+}
+
+// send 'request' and read until 'length' bytes or the end of the stream
+std::string Exchange(int fd, const std::string& request, size_t length) {
+  if (!request.empty() &&
+      ::write(fd, request.data(), request.size()) !=
+          static_cast<ssize_t>(request.size())) {
+    return "";
+  }
+  std::string response;
+  char buffer[256];
+  while (response.size() < length) {
+    ssize_t n = ::read(fd, buffer, sizeof(buffer));
+    if (n <= 0) {
+      break;
+    }
+    response.append(buffer, n);
+  }
+  return response;
+}
+
+// the cpu time used by the process so far
+std::chrono::microseconds CpuTime() {
+  struct rusage usage;
+  ::getrusage(RUSAGE_SELF, &usage);
+  return std::chrono::seconds(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+      std::chrono::microseconds(usage.ru_utime.tv_usec +
+                                usage.ru_stime.tv_usec);
+}
+
+// Answer every piece of data with 'tag' followed by the data
+cnetpp::tcp::TcpServerOptions TaggingOptions(const std::string& tag) {
+  cnetpp::tcp::TcpServerOptions options;
+  options.set_worker_count(2);
+  options.set_connected_callback(
+      [] (std::shared_ptr<cnetpp::tcp::TcpConnection> c) -> bool {
+    (void) c;
+    return true;
+  });
+  options.set_received_callback(
+      [tag] (std::shared_ptr<cnetpp::tcp::TcpConnection> c) -> bool {
+    std::string data;
+    c->mutable_recv_buffer().ReadAll(&data);
+    return c->SendPacket(tag + data);
+  });
+  return options;
+}
+
+}  // namespace
+
+TEST(TcpServer, DrainClosesIdleConnections) {
+  std::atomic<bool> idle { false };
+  auto options = TaggingOptions("");
+  options.set_idle_callback(
+      [&idle] (std::shared_ptr<cnetpp::tcp::TcpConnection> c) -> bool {
+    (void) c;
+    return idle.load();
+  });
+  cnetpp::tcp::TcpServer server;
+  ASSERT_TRUE(server.Launch(cnetpp::base::EndPoint("127.0.0.1", 12557),
+                            options));
+
+  int fds[2] = { ConnectTo(12557), ConnectTo(12557) };
+  ASSERT_GE(fds[0], 0);
+  ASSERT_GE(fds[1], 0);
+  ASSERT_EQ("ping", Exchange(fds[0], "ping", 4));
+  ASSERT_EQ("pong", Exchange(fds[1], "pong", 4));
+
+  // nothing is idle, so the connections are only closed at the deadline
+  auto start = std::chrono::steady_clock::now();
+  std::thread idler([&idle] () {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    idle = true;
+  });
+  ASSERT_TRUE(server.Drain(5000));
+  idler.join();
+  ASSERT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(100));
+  for (int fd : fds) {
+    ASSERT_EQ("", Exchange(fd, "", 1));
+    ::close(fd);
+  }
+
+  // and the connections which never get idle are closed at the deadline
+  cnetpp::tcp::TcpServer busy_server;
+  idle = false;
+  ASSERT_TRUE(busy_server.Launch(cnetpp::base::EndPoint("127.0.0.1", 12558),
+                                 options));
+  int fd = ConnectTo(12558);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ("ping", Exchange(fd, "ping", 4));
+  ASSERT_FALSE(busy_server.Drain(50));
+  ASSERT_EQ("", Exchange(fd, "", 1));
+  ::close(fd);
+
+  server.Shutdown();
+  busy_server.Shutdown();
+}
+
+TEST(TcpServer, DrainFromPoller) {
+  // the pollers can't wait for themselves, so it fails instead of hanging
+  cnetpp::tcp::TcpServer server;
+  std::atomic<int> drained { -1 };
+  auto options = TaggingOptions("");
+  options.set_received_callback(
+      [&server, &drained] (std::shared_ptr<cnetpp::tcp::TcpConnection> c)
+      -> bool {
+    std::string data;
+    c->mutable_recv_buffer().ReadAll(&data);
+    drained = server.Drain(1000) ? 1 : 0;
+    return c->SendPacket(data);
+  });
+  ASSERT_TRUE(server.Launch(cnetpp::base::EndPoint("127.0.0.1", 12571),
+                            options));
+  int fd = ConnectTo(12571);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ("ping", Exchange(fd, "ping", 4));
+  ASSERT_EQ(0, drained.load());
+
+  // it still drains from another thread
+  ASSERT_TRUE(server.Drain(1000));
+  ASSERT_EQ("", Exchange(fd, "", 1));
+  ::close(fd);
+  server.Shutdown();
+}
+
+TEST(TcpServer, HandOffListenSocket) {
+  std::string path = "/tmp/cnetpp_handoff_" + std::to_string(::getpid());
+  cnetpp::tcp::TcpServer old_server;
+  ASSERT_TRUE(old_server.Launch(cnetpp::base::EndPoint("127.0.0.1", 12559),
+                                TaggingOptions("old:")));
+  int fd = ConnectTo(12559);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ("old:a", Exchange(fd, "a", 5));
+
+  int listen_fd = -1;
+  std::thread receiver([&listen_fd, &path] () {
+    listen_fd = cnetpp::tcp::TcpServer::ReceiveListenSocket(path, 2000);
+  });
+  bool handed_off = false;
+  for (int i = 0; i < 100 && !handed_off; ++i) {
+    handed_off = old_server.HandOff(path);
+    if (!handed_off) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+  receiver.join();
+  ASSERT_TRUE(handed_off);
+  ASSERT_GE(listen_fd, 0);
+
+  cnetpp::tcp::TcpServer new_server;
+  ASSERT_TRUE(new_server.Launch(listen_fd, TaggingOptions("new:")));
+  // the connection accepted before keeps being served until the drain
+  ASSERT_EQ("old:b", Exchange(fd, "b", 5));
+  ASSERT_TRUE(old_server.GracefulShutdown(1000));
+  ASSERT_EQ("", Exchange(fd, "", 1));
+  ::close(fd);
+
+  fd = ConnectTo(12559);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ("new:c", Exchange(fd, "c", 5));
+  ::close(fd);
+  new_server.Shutdown();
+}
+
+TEST(TcpServer, ConnectionLimits) {
+  auto options = TaggingOptions("");
+  options.set_max_connections(3);
+  options.set_max_connections_per_ip(2);
+  cnetpp::tcp::TcpServer server;
+  ASSERT_TRUE(server.Launch(cnetpp::base::EndPoint("127.0.0.1", 12560),
+                            options));
+
+  int fds[3] = { ConnectTo(12560), ConnectTo(12560), ConnectTo(12560) };
+  ASSERT_EQ("a", Exchange(fds[0], "a", 1));
+  ASSERT_EQ("b", Exchange(fds[1], "b", 1));
+  // the third one from the same address is closed once accepted
+  ASSERT_EQ("", Exchange(fds[2], "c", 1));
+  ::close(fds[2]);
+
+  // a slot is available again once a connection is closed
+  ::close(fds[0]);
+  bool served = false;
+  for (int i = 0; i < 100 && !served; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    fds[0] = ConnectTo(12560);
+    served = Exchange(fds[0], "d", 1) == "d";
+    if (!served) {
+      ::close(fds[0]);
+    }
+  }
+  ASSERT_TRUE(served);
+  ::close(fds[0]);
+  ::close(fds[1]);
+  server.Shutdown();
+}
+
+TEST(TcpServer, GlobalConnectionLimit) {
+  auto options = TaggingOptions("");
+  options.set_max_connections(2);
+  options.set_max_connections_per_ip(3);
+  cnetpp::tcp::TcpServer server;
+  ASSERT_TRUE(server.Launch(cnetpp::base::EndPoint("127.0.0.1", 12576),
+                            options));
+
+  int fds[3] = { ConnectTo(12576), ConnectTo(12576), ConnectTo(12576) };
+  ASSERT_EQ("a", Exchange(fds[0], "a", 1));
+  ASSERT_EQ("b", Exchange(fds[1], "b", 1));
+  // the address is still under its own limit, but the server is full
+  ASSERT_EQ("", Exchange(fds[2], "c", 1));
+  ::close(fds[2]);
+
+  ::close(fds[0]);
+  bool served = false;
+  for (int i = 0; i < 100 && !served; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    fds[0] = ConnectTo(12576);
+    served = Exchange(fds[0], "d", 1) == "d";
+    if (!served) {
+      ::close(fds[0]);
+    }
+  }
+  ASSERT_TRUE(served);
+  ::close(fds[0]);
+  ::close(fds[1]);
+  server.Shutdown();
+}
+
+TEST(TcpServer, PauseAcceptingWhenOverloaded) {
+  // hold some fds, so that closing them brings the process under the limit
+  int spare_fds[64];
+  for (auto& fd : spare_fds) {
+    fd = ::dup(0);
+    ASSERT_GE(fd, 0);
+  }
+  auto options = TaggingOptions("");
+  options.set_max_open_files(
+      cnetpp::tcp::ConnectionLimiter::OpenFileCount() - 1);
+  options.set_overload_check_interval(20);
+  cnetpp::tcp::TcpServer server;
+  ASSERT_TRUE(server.Launch(cnetpp::base::EndPoint("127.0.0.1", 12577),
+                            options));
+
+  // the connection waits in the backlog while the process has too many fds
+  int fd = ConnectTo(12577);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(1, ::write(fd, "x", 1));
+  struct pollfd poll_fd = { fd, POLLIN, 0 };
+  ASSERT_EQ(0, ::poll(&poll_fd, 1, 200));
+
+  for (auto spare_fd : spare_fds) {
+    ::close(spare_fd);
+  }
+  ASSERT_EQ("x", Exchange(fd, "", 1));
+  ::close(fd);
+  server.Shutdown();
+}
+
+TEST(TcpServer, AcceptRate) {
+  auto options = TaggingOptions("");
+  options.set_accept_rate(20);
+  options.set_accept_burst(2);
+  cnetpp::tcp::TcpServer server;
+  ASSERT_TRUE(server.Launch(cnetpp::base::EndPoint("127.0.0.1", 12561),
+                            options));
+
+  auto start = std::chrono::steady_clock::now();
+  int fds[4];
+  for (auto& fd : fds) {
+    fd = ConnectTo(12561);
+    ASSERT_GE(fd, 0);
+  }
+  // the connections beyond the burst wait in the backlog for a token
+  for (auto fd : fds) {
+    ASSERT_EQ("x", Exchange(fd, "x", 1));
+    ::close(fd);
+  }
+  ASSERT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(90));
+  server.Shutdown();
+
+  ASSERT_GT(cnetpp::tcp::ConnectionLimiter::OpenFileCount(), 0u);
+  ASSERT_GT(cnetpp::tcp::ConnectionLimiter::ResidentMemoryUsage(), 0u);
+}
+
+TEST(TcpServer, RateLimits) {
+  auto options = TaggingOptions("");
+  options.set_receive_rate(100000);
+  options.set_receive_burst(10000);
+  cnetpp::tcp::TcpServer server;
+  ASSERT_TRUE(server.Launch(cnetpp::base::EndPoint("127.0.0.1", 12562),
+                            options));
+  // the echo can only be as fast as the server receives
+  std::string data(50000, 'r');
+  int fd = ConnectTo(12562);
+  ASSERT_GE(fd, 0);
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_EQ(data, Exchange(fd, data, data.size()));
+  ASSERT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(350));
+  ::close(fd);
+  server.Shutdown();
+
+  // the limit shared by a poller
+  options = TaggingOptions(std::string(75000, 's'));
+  options.set_worker_count(1);
+  options.set_poller_send_rate(100000);
+  cnetpp::tcp::TcpServer shaped_server;
+  ASSERT_TRUE(shaped_server.Launch(
+      cnetpp::base::EndPoint("127.0.0.1", 12563), options));
+  int fds[2] = { ConnectTo(12563), ConnectTo(12563) };
+  ASSERT_GE(fds[0], 0);
+  ASSERT_GE(fds[1], 0);
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 2; ++i) {
+    ASSERT_EQ(75000u + 1, Exchange(fds[i], "s", 75000 + 1).size());
+    ::close(fds[i]);
+  }
+  // one second worth of burst, then 100000 bytes per second
+  ASSERT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(400));
+  shaped_server.Shutdown();
+}
+
+TEST(TcpServer, ReadBudget) {
+  std::atomic<int> received_count { 0 };
+  auto options = TaggingOptions("");
+  options.set_worker_count(1);
+  options.set_max_bytes_per_event(1000);
+  options.set_received_callback(
+      [&received_count] (std::shared_ptr<cnetpp::tcp::TcpConnection> c)
+      -> bool {
+    received_count++;
+    std::string data;
+    c->mutable_recv_buffer().ReadAll(&data);
+    return c->SendPacket(data);
+  });
+  cnetpp::tcp::TcpServer server;
+  ASSERT_TRUE(server.Launch(cnetpp::base::EndPoint("127.0.0.1", 12564),
+                            options));
+  int fds[2] = { ConnectTo(12564), ConnectTo(12564) };
+  ASSERT_GE(fds[0], 0);
+  ASSERT_GE(fds[1], 0);
+  // the bulk sender is read at most 1000 bytes per wakeup and the other
+  // connection sharing the poller is still served in between
+  std::string data(20000, 'b');
+  ASSERT_EQ(static_cast<ssize_t>(data.size()),
+            ::write(fds[0], data.data(), data.size()));
+  ASSERT_EQ("small", Exchange(fds[1], "small", 5));
+  ASSERT_EQ(data, Exchange(fds[0], "", data.size()));
+  ASSERT_GE(received_count.load(), 20);
+  ::close(fds[0]);
+  ::close(fds[1]);
+  server.Shutdown();
+}
+
+TEST(TcpServer, MemoryBudget) {
+  // the received data is kept, so the receive buffer grows up to the limit
+  // of the connection and the reading stops there
+  auto options = TaggingOptions("");
+  options.set_connection_buffer_memory_limit(64 * 1024);
+  options.set_received_callback(
+      [] (std::shared_ptr<cnetpp::tcp::TcpConnection> c) -> bool {
+    (void) c;
+    return true;
+  });
+  cnetpp::tcp::TcpServer server;
+  ASSERT_TRUE(server.Launch(cnetpp::base::EndPoint("127.0.0.1", 12565),
+                            options));
+  auto budget = server.memory_budget();
+  ASSERT_EQ(cnetpp::base::MemoryBudget::Process(), budget->parent());
+  int fd = ConnectTo(12565);
+  ASSERT_GE(fd, 0);
+  std::thread writer([fd] () {
+    std::string data(64 * 1024, 'm');
+    while (::send(fd, data.data(), data.size(), MSG_NOSIGNAL) > 0) {
+    }
+  });
+  for (int i = 0; i < 100 && budget->peak() < 64 * 1024; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  ASSERT_EQ(64 * 1024, budget->peak());
+  ASSERT_EQ(64 * 1024, budget->usage());
+  ::shutdown(fd, SHUT_RDWR);
+  writer.join();
+  ::close(fd);
+  server.Shutdown();
+
+  // the peer never reads the echo, so the sends fail at the limit of the
+  // server and the connection is closed
+  options = TaggingOptions("");
+  options.set_buffer_memory_limit(256 * 1024);
+  cnetpp::tcp::TcpServer echo_server;
+  ASSERT_TRUE(echo_server.Launch(cnetpp::base::EndPoint("127.0.0.1", 12566),
+                                 options));
+  budget = echo_server.memory_budget();
+  fd = ConnectTo(12566);
+  ASSERT_GE(fd, 0);
+  std::string data(64 * 1024, 'e');
+  while (::send(fd, data.data(), data.size(), MSG_NOSIGNAL) > 0) {
+  }
+  ASSERT_GT(budget->rejected(), 0u);
+  ASSERT_LE(budget->peak(), 256 * 1024);
+  ::close(fd);
+  echo_server.Shutdown();
+}
+
+TEST(TcpServer, SendFromPipe) {
+  int pipe_fds[2];
+  ASSERT_EQ(0, ::pipe(pipe_fds));
+  auto options = TaggingOptions("");
+  options.set_received_callback(
+      [&pipe_fds] (std::shared_ptr<cnetpp::tcp::TcpConnection> c) -> bool {
+    std::string data;
+    c->mutable_recv_buffer().ReadAll(&data);
+    return c->SendFile(pipe_fds[0], 0, 8);
+  });
+  cnetpp::tcp::TcpServer server;
+  ASSERT_TRUE(server.Launch(cnetpp::base::EndPoint("127.0.0.1", 12567),
+                            options));
+  int fd = ConnectTo(12567);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(2, ::write(fd, "go", 2));
+
+  // the socket is writable all along, but the empty pipe mustn't keep the
+  // poller busy
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  auto cpu_time = CpuTime();
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  ASSERT_LT((CpuTime() - cpu_time).count(), 50000);
+
+  ASSERT_EQ(4, ::write(pipe_fds[1], "abcd", 4));
+  ASSERT_EQ("abcd", Exchange(fd, "", 4));
+  ASSERT_EQ(4, ::write(pipe_fds[1], "efgh", 4));
+  ASSERT_EQ("efgh", Exchange(fd, "", 4));
+  ::close(fd);
+  server.Shutdown();
+  ::close(pipe_fds[0]);
+  ::close(pipe_fds[1]);
+}